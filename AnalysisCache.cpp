@@ -0,0 +1,404 @@
+﻿#include "AnalysisCache.h"
+#include "IndexFile.h"
+#include "DecodedAudioCache.h"
+#include "RealtimeGuard.h"
+
+// ===== Measurement =====
+float AnalysisCache::Measurement::getNormalisationGain(double targetLufs) const
+{
+    if (!valid)
+        return 1.0f;
+
+    auto gainDb = targetLufs - integratedLufs;
+
+    // Quiet tracks with sharp peaks are raised only as far as the peak allows
+    if (std::isfinite(truePeakDb))
+        gainDb = juce::jmin(gainDb, maxTruePeakDb - truePeakDb);
+
+    return juce::Decibels::decibelsToGain((float)juce::jlimit(-24.0, 12.0, gainDb));
+}
+
+AnalysisCache::Measurement AnalysisCache::measure(const juce::File& file, juce::AudioFormatManager& formats, double& audioSeconds,
+    const std::function<bool()>& shouldStop)
+{
+    Measurement result;
+    audioSeconds = 0.0;
+
+    std::unique_ptr<juce::AudioFormatReader> reader{ formats.createReaderFor(file) };
+
+    if (reader == nullptr || reader->sampleRate <= 0.0 || reader->numChannels == 0)
+        return result;
+
+    const int numChannels = (int)reader->numChannels;
+    LoudnessMeter meter(reader->sampleRate, numChannels, blockSize);
+    TempoAnalyser tempo(reader->sampleRate, numChannels);
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+
+    juce::int64 pos = 0;
+
+    while (pos < reader->lengthInSamples)
+    {
+        if (shouldStop && shouldStop())
+            return result;
+
+        const int n = (int)juce::jmin((juce::int64)blockSize, reader->lengthInSamples - pos);
+
+        if (!reader->read(&buffer, 0, n, pos, true, true))
+            break;
+
+        meter.process(buffer, n);
+        tempo.process(buffer, n);
+        pos += n;
+    }
+
+    audioSeconds = (double)pos / reader->sampleRate;
+
+    const auto loudness = meter.getResult();
+
+    if (loudness.hasSignal())
+    {
+        result.integratedLufs = loudness.integratedLufs;
+        result.loudnessRange = loudness.loudnessRange;
+        result.truePeakDb = loudness.truePeakDb;
+        result.beatGrid = tempo.getResult();
+        result.valid = true;
+    }
+
+    return result;
+}
+
+// ===== Worker =====
+// Measures queued files one after another until the queue is empty
+class AnalysisCache::Worker : public juce::ThreadPoolJob
+{
+public:
+    explicit Worker(AnalysisCache& o) : juce::ThreadPoolJob("Analysis"), owner(o) {}
+
+    JobStatus runJob() override
+    {
+        // Each worker has its own format manager, so pool threads never share reader state
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        juce::File file;
+
+        while (!shouldExit() && owner.popNext(file))
+        {
+            // Files are queued by path alone; ones measured in an earlier session end here
+            Measurement result;
+            const auto key = DecodedAudioCache::getKeyFor(file);
+
+            if (!owner.find(key, result))
+            {
+                const auto started = juce::Time::getMillisecondCounterHiRes();
+                double seconds = 0.0;
+                result = measure(file, formats, seconds, [this] { return shouldExit(); });
+
+                // Cut short by the cache closing: nothing worth keeping
+                if (shouldExit())
+                    break;
+
+                owner.store(key, result, seconds, (juce::Time::getMillisecondCounterHiRes() - started) / 1000.0);
+            }
+
+            owner.release(file, result);
+        }
+
+        owner.workerFinished();
+        return jobHasFinished;
+    }
+
+private:
+    AnalysisCache& owner;
+};
+
+// ===== AnalysisCache =====
+AnalysisCache::AnalysisCache()
+    : indexFile(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("Analysis.index")),
+    pool(juce::jmax(1, juce::SystemStats::getNumCpus() - 1), 0, juce::Thread::Priority::low),
+    maxWorkers(juce::jmax(1, juce::SystemStats::getNumCpus() - 1))
+{
+    load();
+}
+
+AnalysisCache::~AnalysisCache()
+{
+    cancelPending();
+
+    // Workers check between blocks, so this is quick; they must be gone before the cache is
+    pool.removeAllJobs(true, -1);
+
+    if (dirty)
+        save();
+}
+
+bool AnalysisCache::find(const juce::File& file, Measurement& result) const
+{
+    return find(DecodedAudioCache::getKeyFor(file), result);
+}
+
+bool AnalysisCache::find(const juce::String& key, Measurement& result) const
+{
+    const juce::ScopedLock sl(lock);
+
+    const auto found = measurements.find(key);
+    if (found == measurements.end())
+        return false;
+
+    result = found->second;
+    return true;
+}
+
+void AnalysisCache::analyse(const juce::File& file, Callback onDone)
+{
+    RealtimeGuard::assertNotRealtime("AnalysisCache::analyse");
+
+    Measurement known;
+    if (find(file, known))
+    {
+        if (onDone)
+            juce::MessageManager::callAsync([onDone, known] { onDone(known); });
+
+        return;
+    }
+
+    const auto path = file.getFullPathName();
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (onDone)
+            callbacks[path].push_back(std::move(onDone));
+
+        // Already waiting further back: move it to the front
+        if (!queuedPaths.insert(path).second)
+        {
+            const auto queued = std::find(pending.begin(), pending.end(), file);
+
+            if (queued != pending.end())
+                pending.erase(queued);
+            else
+                return;     // being measured right now
+        }
+
+        pending.push_front(file);
+    }
+
+    startWorkers();
+}
+
+void AnalysisCache::analyseInBackground(const juce::Array<juce::File>& files)
+{
+    {
+        const juce::ScopedLock sl(lock);
+
+        for (const auto& file : files)
+            if (queuedPaths.insert(file.getFullPathName()).second)
+                pending.push_back(file);
+    }
+
+    startWorkers();
+}
+
+AnalysisCache::Measurement AnalysisCache::analyseNow(const juce::File& file)
+{
+    Measurement result;
+    if (find(file, result))
+        return result;
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    const auto started = juce::Time::getMillisecondCounterHiRes();
+    double seconds = 0.0;
+    result = measure(file, formats, seconds);
+
+    store(DecodedAudioCache::getKeyFor(file), result, seconds, (juce::Time::getMillisecondCounterHiRes() - started) / 1000.0);
+    return result;
+}
+
+void AnalysisCache::cancelPending()
+{
+    const juce::ScopedLock sl(lock);
+
+    for (const auto& file : pending)
+    {
+        queuedPaths.erase(file.getFullPathName());
+        callbacks.erase(file.getFullPathName());
+    }
+
+    pending.clear();
+}
+
+void AnalysisCache::startWorkers()
+{
+    const juce::ScopedLock sl(lock);
+
+    if (activeWorkers == 0 && !pending.empty())
+        busySince = juce::Time::getMillisecondCounterHiRes();
+
+    while (activeWorkers < maxWorkers && activeWorkers < (int)pending.size())
+    {
+        ++activeWorkers;
+        pool.addJob(new Worker(*this), true);
+    }
+}
+
+bool AnalysisCache::popNext(juce::File& file)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (pending.empty())
+        return false;
+
+    file = pending.front();
+    pending.pop_front();
+    return true;
+}
+
+void AnalysisCache::store(const juce::String& key, const Measurement& result, double seconds, double measuringSeconds)
+{
+    if (!result.valid)
+        DBG("AnalysisCache: could not measure " << key);
+
+    const juce::ScopedLock sl(lock);
+
+    measurements[key] = result;
+    dirty = true;
+
+    ++filesDone;
+    audioSeconds += seconds;
+    threadSeconds += measuringSeconds;
+}
+
+// Takes a finished file off the queue and hands its result to whoever asked for it
+void AnalysisCache::release(const juce::File& file, const Measurement& result)
+{
+    std::vector<Callback> waiting;
+
+    {
+        const juce::ScopedLock sl(lock);
+        queuedPaths.erase(file.getFullPathName());
+
+        const auto found = callbacks.find(file.getFullPathName());
+        if (found != callbacks.end())
+        {
+            waiting.swap(found->second);
+            callbacks.erase(found);
+        }
+    }
+
+    if (!waiting.empty())
+        juce::MessageManager::callAsync([waiting, result]
+            {
+                for (const auto& cb : waiting)
+                    cb(result);
+            });
+}
+
+// The last worker to run out of files saves the cache
+void AnalysisCache::workerFinished()
+{
+    bool shouldSave = false;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (--activeWorkers > 0)
+            return;
+
+        busySeconds += (juce::Time::getMillisecondCounterHiRes() - busySince) / 1000.0;
+        shouldSave = dirty;
+        dirty = false;
+    }
+
+    if (shouldSave && !save())
+        DBG("AnalysisCache: could not save " << indexFile.getFullPathName());
+}
+
+AnalysisCache::Progress AnalysisCache::getProgress() const
+{
+    const juce::ScopedLock sl(lock);
+
+    Progress p;
+    p.filesQueued = (int)queuedPaths.size();
+    p.filesDone = filesDone;
+    p.audioSeconds = audioSeconds;
+    p.threadSeconds = threadSeconds;
+    p.busySeconds = busySeconds;
+    p.analysing = activeWorkers > 0;
+
+    if (p.analysing)
+        p.busySeconds += (juce::Time::getMillisecondCounterHiRes() - busySince) / 1000.0;
+
+    return p;
+}
+
+int AnalysisCache::getNumMeasured() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int)measurements.size();
+}
+
+// ===== Persistence =====
+// IndexFile header, count, then per file: key (path|size|mtime), integrated loudness,
+// loudness range, true peak, a valid flag, then the grid's tempo, first beat and confidence
+bool AnalysisCache::load()
+{
+    std::unordered_map<juce::String, Measurement> loaded;
+
+    const bool read = IndexFile::read(indexFile, indexMagic, indexVersion, indexVersion, [&](juce::InputStream& in, int)
+        {
+            const int count = in.readCompressedInt();
+            if (count < 0)
+                return false;
+
+            loaded.reserve((size_t)count);
+
+            for (int i = 0; i < count && !in.isExhausted(); ++i)
+            {
+                const auto key = in.readString();
+
+                Measurement m;
+                m.integratedLufs = in.readFloat();
+                m.loudnessRange = in.readFloat();
+                m.truePeakDb = in.readFloat();
+                m.valid = in.readBool();
+                m.beatGrid.bpm = in.readDouble();
+                m.beatGrid.firstBeatSeconds = in.readDouble();
+                m.beatGrid.confidence = in.readFloat();
+                loaded[key] = m;
+            }
+
+            return (int)loaded.size() == count;
+        });
+
+    if (!read)
+        return false;
+
+    const juce::ScopedLock sl(lock);
+    measurements = std::move(loaded);
+    return true;
+}
+
+bool AnalysisCache::save() const
+{
+    return IndexFile::write(indexFile, indexMagic, indexVersion, [this](juce::OutputStream& out)
+        {
+            const juce::ScopedLock sl(lock);
+            out.writeCompressedInt((int)measurements.size());
+
+            for (const auto& entry : measurements)
+            {
+                out.writeString(entry.first);
+                out.writeFloat((float)entry.second.integratedLufs);
+                out.writeFloat((float)entry.second.loudnessRange);
+                out.writeFloat((float)entry.second.truePeakDb);
+                out.writeBool(entry.second.valid);
+                out.writeDouble(entry.second.beatGrid.bpm);
+                out.writeDouble(entry.second.beatGrid.firstBeatSeconds);
+                out.writeFloat(entry.second.beatGrid.confidence);
+            }
+        });
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "LoudnessMeter.h"
+#include "TempoAnalyser.h"
+
+// Loudness and beat grid of every track the player has seen, shared by every deck.
+//
+// Files are decoded once and fed to both LoudnessMeter and TempoAnalyser on a pool of
+// low-priority threads, one file per thread, and the results are kept in memory and saved next
+// to the library index, keyed by the file's path, size and modification time. A file a deck is
+// waiting for jumps the queue. The normalisation gain follows ReplayGain 2.0: the track is
+// brought to -18 LUFS, but never so far that its true peak would go over -1 dBTP.
+class AnalysisCache
+{
+public:
+    struct Measurement
+    {
+        double integratedLufs = 0.0;
+        double loudnessRange = 0.0;
+        double truePeakDb = 0.0;
+
+        // Invalid for tracks without a steady beat
+        BeatGrid beatGrid;
+
+        // False for files that could not be decoded or are silent; they get unity gain
+        bool valid = false;
+
+        // Linear gain that brings the track to targetLufs
+        float getNormalisationGain(double targetLufs = referenceLufs) const;
+    };
+
+    struct Progress
+    {
+        int filesQueued = 0;
+        int filesDone = 0;
+        double audioSeconds = 0.0;      // of audio measured this session
+        double threadSeconds = 0.0;     // spent measuring, summed over the pool's threads
+        double busySeconds = 0.0;       // wall-clock time with at least one file in progress
+        bool analysing = false;
+
+        // How many times faster than playback the pool gets through audio, overall and per thread
+        double getRealtimeMultiple() const { return busySeconds > 0.0 ? audioSeconds / busySeconds : 0.0; }
+        double getRealtimeMultiplePerThread() const { return threadSeconds > 0.0 ? audioSeconds / threadSeconds : 0.0; }
+    };
+
+    using Callback = std::function<void(const Measurement&)>;
+
+    static constexpr double referenceLufs = -18.0;
+    static constexpr double maxTruePeakDb = -1.0;
+
+    AnalysisCache();
+    ~AnalysisCache();
+
+    // The stored measurement, if the file has been analysed since it last changed
+    bool find(const juce::File& file, Measurement& result) const;
+
+    // Queues the file ahead of everything else; onDone runs on the message thread, straight
+    // away (asynchronously) if the file is already measured
+    void analyse(const juce::File& file, Callback onDone);
+
+    // Queues files behind anything already queued; ones measured before are skipped by the workers
+    void analyseInBackground(const juce::Array<juce::File>& files);
+
+    // Measures the file on the calling thread, unless it is already stored
+    Measurement analyseNow(const juce::File& file);
+
+    // Drops queued files; the ones being measured finish and are kept
+    void cancelPending();
+
+    Progress getProgress() const;
+    int getNumMeasured() const;
+
+    // Decodes the whole file through the meter and the tempo analysis; audioSeconds gets the
+    // length that was read. shouldStop is polled between blocks and gives an invalid result
+    static Measurement measure(const juce::File& file, juce::AudioFormatManager& formats, double& audioSeconds,
+        const std::function<bool()>& shouldStop = nullptr);
+
+    juce::File getIndexFile() const { return indexFile; }
+
+private:
+    class Worker;
+
+    bool find(const juce::String& key, Measurement& result) const;
+    bool popNext(juce::File& file);
+    void store(const juce::String& key, const Measurement& result, double audioSeconds, double threadSeconds);
+    void release(const juce::File& file, const Measurement& result);
+    void workerFinished();
+    void startWorkers();
+
+    bool load();
+    bool save() const;
+
+    static constexpr int indexMagic = 0x414e4c59;  // "ANLY"
+    static constexpr int indexVersion = 1;
+    static constexpr int blockSize = 65536;
+
+    juce::File indexFile;
+    juce::ThreadPool pool;
+    const int maxWorkers;
+
+    mutable juce::CriticalSection lock;
+    std::unordered_map<juce::String, Measurement> measurements;
+    std::deque<juce::File> pending;
+    std::unordered_set<juce::String> queuedPaths;
+    std::unordered_map<juce::String, std::vector<Callback>> callbacks;     // by path
+    int activeWorkers = 0;
+    bool dirty = false;
+
+    // Progress counters (under lock)
+    int filesDone = 0;
+    double audioSeconds = 0.0, threadSeconds = 0.0, busySeconds = 0.0;
+    double busySince = 0.0;     // ms, while any worker is running
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AnalysisCache)
+};
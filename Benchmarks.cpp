@@ -0,0 +1,1434 @@
+﻿#include "Benchmarks.h"
+#include "TimeStretchAudioSource.h"
+#include "PolyphaseResamplingAudioSource.h"
+#include "MappedAudioSource.h"
+#include "DecodedAudioCache.h"
+#include "PlayerAudio.h"
+#include "DeckEngine.h"
+#include "Mp3SeekIndex.h"
+#include "PlaylistStore.h"
+#include "TrackSearchIndex.h"
+#include "AnalysisCache.h"
+#include "SpectrumView.h"
+#include "SessionStore.h"
+#include "RealtimeGuard.h"
+
+namespace
+{
+    constexpr double benchSampleRate = 44100.0;
+    constexpr int benchBlockSize = 512;
+    constexpr double benchSeconds = 20.0;
+
+    // Renders benchSeconds of audio from source and returns the realtime factor
+    double measureRealtimeFactor(juce::AudioSource& source)
+    {
+        juce::AudioBuffer<float> buffer(2, benchBlockSize);
+        const int numBlocks = (int)(benchSeconds * benchSampleRate / benchBlockSize);
+
+        source.prepareToPlay(benchBlockSize, benchSampleRate);
+
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numBlocks; ++i)
+            source.getNextAudioBlock(juce::AudioSourceChannelInfo(&buffer, 0, benchBlockSize));
+
+        const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+        source.releaseResources();
+
+        const double rendered = numBlocks * benchBlockSize / benchSampleRate;
+        return elapsed > 0.0 ? rendered / elapsed : 0.0;
+    }
+
+    // Renders numSamples of the left channel, skipping the start-up transient
+    std::vector<float> renderSteadyState(juce::AudioSource& source, int numSamples)
+    {
+        const int warmUp = 4096;
+        juce::AudioBuffer<float> buffer(2, benchBlockSize);
+        std::vector<float> output;
+        output.reserve((size_t)numSamples);
+
+        source.prepareToPlay(benchBlockSize, benchSampleRate);
+
+        for (int done = -warmUp; done < numSamples; done += benchBlockSize)
+        {
+            source.getNextAudioBlock(juce::AudioSourceChannelInfo(&buffer, 0, benchBlockSize));
+
+            for (int i = 0; i < benchBlockSize; ++i)
+                if (done + i >= 0 && done + i < numSamples)
+                    output.push_back(buffer.getSample(0, i));
+        }
+
+        source.releaseResources();
+        return output;
+    }
+
+    // Residual after a least-squares fit of a sine at the expected frequency, in dB
+    double measureThdPlusNoise(const std::vector<float>& signal, double frequency)
+    {
+        const double w = juce::MathConstants<double>::twoPi * frequency / benchSampleRate;
+        double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0;
+
+        for (size_t n = 0; n < signal.size(); ++n)
+        {
+            const double s = std::sin(w * (double)n), c = std::cos(w * (double)n);
+            ss += s * s; cc += c * c; sc += s * c;
+            ys += signal[n] * s; yc += signal[n] * c;
+        }
+
+        const double det = ss * cc - sc * sc;
+        const double a = (ys * cc - yc * sc) / det;
+        const double b = (yc * ss - ys * sc) / det;
+        double error = 0.0, power = 0.0;
+
+        for (size_t n = 0; n < signal.size(); ++n)
+        {
+            const double fit = a * std::sin(w * (double)n) + b * std::cos(w * (double)n);
+            error += (signal[n] - fit) * (signal[n] - fit);
+            power += fit * fit;
+        }
+
+        return 10.0 * std::log10(juce::jmax(1.0e-30, error) / juce::jmax(1.0e-30, power));
+    }
+
+    // Mean and 99th percentile of a set of timings, in microseconds
+    juce::String describeTimings(std::vector<double> micros)
+    {
+        if (micros.empty())
+            return "-";
+
+        std::sort(micros.begin(), micros.end());
+        double total = 0.0;
+        for (auto t : micros)
+            total += t;
+
+        const auto p99 = micros[juce::jmin(micros.size() - 1, (size_t)((double)micros.size() * 0.99))];
+        return juce::String(total / (double)micros.size(), 2) + " / " + juce::String(p99, 2);
+    }
+
+    struct TimingSummary
+    {
+        double mean = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+    };
+
+    TimingSummary summarise(std::vector<double> micros)
+    {
+        TimingSummary summary;
+        if (micros.empty())
+            return summary;
+
+        std::sort(micros.begin(), micros.end());
+        for (auto t : micros)
+            summary.mean += t;
+
+        auto percentile = [&](double p) { return micros[juce::jmin(micros.size() - 1, (size_t)((double)micros.size() * p))]; };
+
+        summary.mean /= (double)micros.size();
+        summary.p50 = percentile(0.5);
+        summary.p99 = percentile(0.99);
+        summary.max = micros.back();
+        return summary;
+    }
+
+    double ticksToMicros(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6;
+    }
+
+    // Writes seconds of 16-bit stereo noise, as FLAC or WAV depending on the file's extension
+    bool writeTestFile(const juce::File& file, int seconds)
+    {
+        std::unique_ptr<juce::AudioFormat> format(file.hasFileExtension("flac") ? (juce::AudioFormat*)new juce::FlacAudioFormat()
+                                                                               : (juce::AudioFormat*)new juce::WavAudioFormat());
+        auto stream = file.createOutputStream();
+        if (stream == nullptr)
+            return false;
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), benchSampleRate, 2, 16, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+
+        juce::Random random(1);
+        juce::AudioBuffer<float> noise(2, (int)benchSampleRate);
+
+        for (int s = 0; s < seconds; ++s)
+        {
+            for (int ch = 0; ch < noise.getNumChannels(); ++ch)
+                for (int i = 0; i < noise.getNumSamples(); ++i)
+                    noise.setSample(ch, i, random.nextFloat() - 0.5f);
+
+            writer->writeFromAudioSampleBuffer(noise, 0, noise.getNumSamples());
+        }
+
+        return true;
+    }
+
+    // Decks in a DeckEngine driven the way MainComponent drives them, one callback at a time.
+    // Serial by default, so every deck runs on the calling thread and its allocations are counted.
+    struct DeckRig
+    {
+        // Declared first so it outlives the decks it renders
+        DeckEngine engine;
+        juce::OwnedArray<PlayerAudio> decks;
+        juce::AudioBuffer<float> output;
+        int blockSize = 0;
+
+        ~DeckRig()
+        {
+            engine.releaseResources();
+        }
+
+        bool prepare(const juce::File& fixture, bool mapped, int numDecks, int blockSizeToUse, double speed, bool keepPitch,
+            bool parallel = false)
+        {
+            blockSize = blockSizeToUse;
+            output.setSize(2, blockSize);
+            engine.setParallel(parallel);
+
+            for (int i = 0; i < numDecks; ++i)
+            {
+                auto* deck = decks.add(new PlayerAudio());
+
+                // Callbacks run back to back, far faster than realtime, so the streams must
+                // never substitute silence for audio the disk has not delivered yet
+                deck->setBlockingReads(true);
+                deck->setReadAheadSeconds(8.0);
+                deck->setMemoryMappedPlayback(mapped);
+                deck->prepareToPlay(blockSize, benchSampleRate);
+                deck->setSpeed((float)speed);
+                deck->setSpeedMode(keepPitch ? PlayerAudio::SpeedMode::preservePitch : PlayerAudio::SpeedMode::resample);
+
+                if (!deck->loadFileNow(fixture))
+                    return false;
+
+                deck->setPosition(i * 1.5);
+                deck->start();
+                engine.addDeck(*deck);
+            }
+
+            engine.prepareToPlay(blockSize, benchSampleRate);
+            return true;
+        }
+
+        void renderBlock()
+        {
+            engine.render(juce::AudioSourceChannelInfo(&output, 0, blockSize));
+        }
+
+        // Pauses the decks until their read-ahead has caught up, so the timed callbacks
+        // measure the audio thread's work rather than waits on the disk thread
+        void waitForStreams()
+        {
+            for (auto* deck : decks)
+                deck->stop();
+
+            const auto deadline = juce::Time::getMillisecondCounter() + 5000;
+
+            while (juce::Time::getMillisecondCounter() < deadline)
+            {
+                renderBlock();
+
+                if (std::all_of(decks.begin(), decks.end(), [](PlayerAudio* d) { return d->getBufferFill() >= 0.9f; }))
+                    break;
+
+                juce::Thread::sleep(2);
+            }
+
+            for (auto* deck : decks)
+                deck->start();
+        }
+
+        // Made while rendering, on this thread and on the engine's workers
+        juce::int64 getAllocationCount() const
+        {
+            return RealtimeGuard::getAllocationCountForThisThread() + engine.getWorkerAllocationCount();
+        }
+
+        int getUnderruns() const
+        {
+            int total = 0;
+            for (auto* deck : decks)
+                total += deck->getUnderrunCount();
+
+            return total;
+        }
+    };
+
+    juce::var summaryToVar(const TimingSummary& summary)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("meanUs", summary.mean);
+        object->setProperty("p50Us", summary.p50);
+        object->setProperty("p99Us", summary.p99);
+        object->setProperty("maxUs", summary.max);
+        return juce::var(object);
+    }
+
+    double measureLevel(const std::vector<float>& signal, float amplitude)
+    {
+        double sum = 0.0;
+        for (auto s : signal)
+            sum += (double)s * s;
+
+        const double rms = std::sqrt(sum / (double)juce::jmax((size_t)1, signal.size()));
+        return juce::Decibels::gainToDecibels(rms / (amplitude / juce::MathConstants<double>::sqrt2), -200.0);
+    }
+}
+
+namespace Benchmarks
+{
+    juce::String runAll()
+    {
+        return speedModes() + "\n" + resamplers() + "\n" + mappedReads() + "\n" + decodedCache()
+            + "\n" + describeDeckCallbacks(deckCallbacks()) + "\n" + deckScaling() + "\n" + playlistStore()
+            + "\n" + trackSearch() + "\n" + trackAnalysis() + "\n" + spectrumAnalysers() + "\n" + sessionRestore()
+            + "\n" + hotCues();
+    }
+
+    juce::String speedModes()
+    {
+        juce::String report;
+        report << "Speed modes (" << benchSeconds << " s at " << benchSampleRate << " Hz, block " << benchBlockSize << ")\n";
+        report << "  speed    resample xRT    keep-pitch xRT\n";
+
+        for (double speed : { 0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0 })
+        {
+            double factors[2] = {};
+
+            for (int keepPitch = 0; keepPitch < 2; ++keepPitch)
+            {
+                // Same chain as a deck: source -> stretcher -> resampler
+                juce::ToneGeneratorAudioSource tone;
+                tone.setFrequency(440.0);
+                tone.setAmplitude(0.5f);
+
+                TimeStretchAudioSource stretcher(&tone, 2);
+                PolyphaseResamplingAudioSource resampler(&stretcher, false, 2);
+
+                stretcher.setEnabled(keepPitch != 0);
+                stretcher.setSpeed(speed);
+                resampler.setResamplingRatio(keepPitch != 0 ? 1.0 : speed);
+
+                factors[keepPitch] = measureRealtimeFactor(resampler);
+            }
+
+            report << "  " << juce::String(speed, 2).paddedLeft(' ', 5)
+                   << juce::String(factors[0], 1).paddedLeft(' ', 16)
+                   << juce::String(factors[1], 1).paddedLeft(' ', 18) << "\n";
+        }
+
+        return report;
+    }
+
+    juce::String resamplers()
+    {
+        constexpr double fileRatio = 48000.0 / 44100.0;
+        constexpr float amplitude = 0.5f;
+        const char* names[] = { "juce linear", "draft", "standard", "high" };
+
+        juce::String report;
+        report << "Resamplers (THD+N at 48 -> 44.1 kHz, 30 kHz alias rejection at 2x, throughput)\n";
+        report << "  converter      THD+N dB   alias dB   xRT 1.09   xRT 2.0\n";
+
+        for (int tier = 0; tier < 4; ++tier)
+        {
+            // Builds a converter reading a tone at the given ratio: tier 0 is JUCE's, 1-3 ours
+            auto run = [tier](double frequency, double ratio, std::function<void(juce::AudioSource&)> measure)
+                {
+                    juce::ToneGeneratorAudioSource tone;
+                    tone.setFrequency(frequency);
+                    tone.setAmplitude(amplitude);
+
+                    if (tier == 0)
+                    {
+                        juce::ResamplingAudioSource resampler(&tone, false, 2);
+                        resampler.setResamplingRatio(ratio);
+                        measure(resampler);
+                    }
+                    else
+                    {
+                        PolyphaseResamplingAudioSource resampler(&tone, false, 2);
+                        resampler.setQuality((PolyphaseResamplingAudioSource::Quality)(tier - 1));
+                        resampler.setResamplingRatio(ratio);
+                        measure(resampler);
+                    }
+                };
+
+            double thdn = 0.0, alias = 0.0, speedNormal = 0.0, speedDouble = 0.0;
+
+            run(1000.0, fileRatio, [&](juce::AudioSource& s) { thdn = measureThdPlusNoise(renderSteadyState(s, 1 << 16), 1000.0); });
+            // The tone runs at the input rate (88.2 kHz at 2x), so 30 kHz sits above the output's
+            // Nyquist: everything that comes out is what folded back below 22.05 kHz
+            run(30000.0, 2.0, [&](juce::AudioSource& s) { alias = measureLevel(renderSteadyState(s, 1 << 16), amplitude); });
+            run(1000.0, fileRatio, [&](juce::AudioSource& s) { speedNormal = measureRealtimeFactor(s); });
+            run(1000.0, 2.0, [&](juce::AudioSource& s) { speedDouble = measureRealtimeFactor(s); });
+
+            report << "  " << juce::String(names[tier]).paddedRight(' ', 12)
+                   << juce::String(thdn, 1).paddedLeft(' ', 11)
+                   << juce::String(alias, 1).paddedLeft(' ', 11)
+                   << juce::String(speedNormal, 1).paddedLeft(' ', 11)
+                   << juce::String(speedDouble, 1).paddedLeft(' ', 10) << "\n";
+        }
+
+        return report;
+    }
+
+    juce::String mappedReads()
+    {
+        constexpr int numChannels = 2;
+        constexpr int seconds = 120;
+        constexpr int numSeeks = 500;
+
+        juce::String report;
+        report << "Memory-mapped WAV (" << seconds << " s, 16-bit stereo, block " << benchBlockSize << ", mean / p99 us)\n";
+
+        const juce::TemporaryFile temp(".wav");
+        if (!writeTestFile(temp.getFile(), seconds))
+            return report + "  could not write test file\n";
+
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> streaming(formats.createReaderFor(temp.getFile()));
+        std::unique_ptr<juce::AudioFormatReader> mapped(MappedAudioSource::createReaderFor(formats, temp.getFile()).release());
+
+        if (streaming == nullptr || mapped == nullptr)
+            return report + "  could not open test file\n";
+
+        report << "  reader       sequential block       seek + block\n";
+
+        juce::AudioBuffer<float> buffer(numChannels, benchBlockSize);
+        const char* names[] = { "streaming", "mapped" };
+        juce::AudioFormatReader* readers[] = { streaming.get(), mapped.get() };
+
+        for (int r = 0; r < 2; ++r)
+        {
+            auto& reader = *readers[r];
+            std::vector<double> sequential, seeks;
+
+            for (juce::int64 pos = 0; pos + benchBlockSize <= reader.lengthInSamples; pos += benchBlockSize)
+            {
+                const auto start = juce::Time::getHighResolutionTicks();
+                reader.read(&buffer, 0, benchBlockSize, pos, true, true);
+                sequential.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+            }
+
+            // Same positions for both readers
+            juce::Random random(2);
+
+            for (int i = 0; i < numSeeks; ++i)
+            {
+                const auto pos = (juce::int64)(random.nextDouble() * (double)(reader.lengthInSamples - benchBlockSize));
+                const auto start = juce::Time::getHighResolutionTicks();
+                reader.read(&buffer, 0, benchBlockSize, pos, true, true);
+                seeks.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+            }
+
+            report << "  " << juce::String(names[r]).paddedRight(' ', 10)
+                   << describeTimings(sequential).paddedLeft(' ', 19)
+                   << describeTimings(seeks).paddedLeft(' ', 19) << "\n";
+        }
+
+        return report;
+    }
+
+    juce::String decodedCache()
+    {
+        constexpr int seconds = 60;
+
+        juce::String report;
+        report << "Decoded PCM cache (" << seconds << " s WAV read by two decks, block " << benchBlockSize << ", mean / p99 us)\n";
+
+        const juce::TemporaryFile temp(".wav");
+        if (!writeTestFile(temp.getFile(), seconds))
+            return report + "  could not write test file\n";
+
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        for (bool compact : { false, true })
+        {
+            // A private cache, so the figures do not depend on what the decks have loaded
+            DecodedAudioCache cache;
+            cache.setCompactStorage(compact);
+            const auto key = DecodedAudioCache::getKeyFor(temp.getFile());
+
+            juce::AudioBuffer<float> buffer(2, benchBlockSize);
+            juce::String passes;
+
+            for (int deck = 0; deck < 2; ++deck)
+            {
+                CachingAudioFormatReader reader(formats.createReaderFor(temp.getFile()), key, cache);
+                std::vector<double> timings;
+
+                for (juce::int64 pos = 0; pos + benchBlockSize <= reader.lengthInSamples; pos += benchBlockSize)
+                {
+                    const auto start = juce::Time::getHighResolutionTicks();
+                    reader.read(&buffer, 0, benchBlockSize, pos, true, true);
+                    timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+                }
+
+                passes << "  deck " << (deck + 1) << ": " << describeTimings(timings);
+            }
+
+            report << (compact ? "  16-bit" : "  float ") << passes << "\n"
+                   << "          " << cache.getStatistics().toString() << "\n";
+        }
+
+        return report;
+    }
+
+    juce::var deckCallbacks()
+    {
+        constexpr int fixtureSeconds = 30;
+        constexpr double callbackSeconds = 2.0;
+        constexpr int numOperations = 50;
+
+        struct Fixture { const char* name; const char* extension; bool mapped; };
+        const Fixture fixtures[] = { { "wav", ".wav", true }, { "flac", ".flac", false } };
+
+        struct SpeedCase { double speed; bool keepPitch; };
+        const SpeedCase speedCases[] = { { 1.0, false }, { 1.5, false }, { 1.5, true } };
+
+        juce::Array<juce::var> callbackResults, operationResults;
+
+        auto* results = new juce::DynamicObject();
+        juce::var resultsVar(results);
+
+        if (auto* app = juce::JUCEApplication::getInstance())
+            results->setProperty("version", app->getApplicationVersion());
+
+        results->setProperty("date", juce::Time::getCurrentTime().toISO8601(true));
+       #if JUCE_DEBUG
+        results->setProperty("build", "debug");
+       #else
+        results->setProperty("build", "release");
+       #endif
+        results->setProperty("cpu", juce::SystemStats::getCpuModel());
+        results->setProperty("sampleRate", benchSampleRate);
+        results->setProperty("countsAllocations", RealtimeGuard::canCountAllocations());
+
+        for (auto& fixture : fixtures)
+        {
+            const juce::TemporaryFile temp(fixture.extension);
+            if (!writeTestFile(temp.getFile(), fixtureSeconds))
+                continue;
+
+            // ===== Callback cost =====
+            for (int blockSize : { 64, 256, 512, 2048 })
+            {
+                for (auto& speedCase : speedCases)
+                {
+                    for (int numDecks : { 1, 2, 4 })
+                    {
+                        DeckRig rig;
+                        if (!rig.prepare(temp.getFile(), fixture.mapped, numDecks, blockSize, speedCase.speed, speedCase.keepPitch))
+                            continue;
+
+                        for (int i = 0; i < (int)(0.25 * benchSampleRate) / blockSize; ++i)
+                            rig.renderBlock();
+
+                        rig.waitForStreams();
+
+                        const int numCallbacks = juce::jmax(1, (int)(callbackSeconds * benchSampleRate) / blockSize);
+                        std::vector<double> timings;
+                        timings.reserve((size_t)numCallbacks);
+
+                        const auto underrunsBefore = rig.getUnderruns();
+                        const auto allocationsBefore = rig.getAllocationCount();
+
+                        for (int i = 0; i < numCallbacks; ++i)
+                        {
+                            const auto start = juce::Time::getHighResolutionTicks();
+                            rig.renderBlock();
+                            timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+                        }
+
+                        const auto allocations = rig.getAllocationCount() - allocationsBefore;
+                        const auto summary = summarise(timings);
+                        const double deadline = blockSize * 1.0e6 / benchSampleRate;
+
+                        auto result = summaryToVar(summary);
+                        auto* object = result.getDynamicObject();
+                        object->setProperty("fixture", fixture.name);
+                        object->setProperty("blockSize", blockSize);
+                        object->setProperty("speed", speedCase.speed);
+                        object->setProperty("keepPitch", speedCase.keepPitch);
+                        object->setProperty("decks", numDecks);
+                        object->setProperty("callbacks", numCallbacks);
+                        object->setProperty("deadlineUs", deadline);
+                        object->setProperty("cpuShare", summary.mean / deadline);
+                        object->setProperty("p99Share", summary.p99 / deadline);
+                        object->setProperty("allocationsPerCallback", RealtimeGuard::canCountAllocations()
+                            ? juce::var((double)allocations / numCallbacks) : juce::var());
+                        object->setProperty("underruns", rig.getUnderruns() - underrunsBefore);
+                        callbackResults.add(result);
+                    }
+                }
+            }
+
+            // ===== Message-thread operations =====
+            DeckRig rig;
+            if (!rig.prepare(temp.getFile(), fixture.mapped, 1, benchBlockSize, 1.0, false))
+                continue;
+
+            auto& deck = *rig.decks.getFirst();
+            std::vector<double> opens, loads, seeks, seekCallbacks;
+            juce::Random random(3);
+
+            for (int i = 0; i < numOperations; ++i)
+            {
+                // Synchronous open + prime: what the loader thread spends per track
+                auto start = juce::Time::getHighResolutionTicks();
+                deck.loadFileNow(temp.getFile());
+                opens.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+                rig.renderBlock();
+
+                start = juce::Time::getHighResolutionTicks();
+                deck.setPosition(random.nextDouble() * (fixtureSeconds - 2));
+                seeks.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+
+                // The callback that services the seek, including the wait for its first audio
+                start = juce::Time::getHighResolutionTicks();
+                rig.renderBlock();
+                seekCallbacks.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+            }
+
+            // The UI's share of loadFile; the open itself runs on the loader thread, so this
+            // goes last to keep it from overlapping the timings above
+            for (int i = 0; i < numOperations; ++i)
+            {
+                const auto start = juce::Time::getHighResolutionTicks();
+                deck.loadFile(temp.getFile());
+                loads.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+            }
+
+            const std::pair<const char*, std::vector<double>*> operations[] = {
+                { "loadFileNow", &opens }, { "loadFile", &loads }, { "setPosition", &seeks }, { "callbackAfterSeek", &seekCallbacks } };
+
+            for (auto& operation : operations)
+            {
+                auto result = summaryToVar(summarise(*operation.second));
+                result.getDynamicObject()->setProperty("fixture", fixture.name);
+                result.getDynamicObject()->setProperty("operation", operation.first);
+                operationResults.add(result);
+            }
+        }
+
+        results->setProperty("callbacks", callbackResults);
+        results->setProperty("operations", operationResults);
+        return resultsVar;
+    }
+
+    juce::String describeDeckCallbacks(const juce::var& results)
+    {
+        juce::String report;
+        report << "Deck callbacks (" << benchSampleRate << " Hz, decks + mix bus, us; cpu = mean / block deadline)\n"
+               << "  file  block  speed       decks       p50       p99       max     cpu   allocs\n";
+
+        if (auto* callbacks = results["callbacks"].getArray())
+        {
+            for (auto& c : *callbacks)
+            {
+                const auto allocations = c["allocationsPerCallback"];
+
+                report << "  " << c["fixture"].toString().paddedRight(' ', 5)
+                       << c["blockSize"].toString().paddedLeft(' ', 6)
+                       << juce::String((double)c["speed"], 2).paddedLeft(' ', 7) << ((bool)c["keepPitch"] ? " pitch" : "      ")
+                       << c["decks"].toString().paddedLeft(' ', 8)
+                       << juce::String((double)c["p50Us"], 1).paddedLeft(' ', 10)
+                       << juce::String((double)c["p99Us"], 1).paddedLeft(' ', 10)
+                       << juce::String((double)c["maxUs"], 1).paddedLeft(' ', 10)
+                       << (juce::String((double)c["cpuShare"] * 100.0, 1) + "%").paddedLeft(' ', 8)
+                       << (allocations.isVoid() ? juce::String("n/a") : juce::String((double)allocations, 2)).paddedLeft(' ', 9) << "\n";
+            }
+        }
+
+        report << "  operation            file       p50       p99       max (us)\n";
+
+        if (auto* operations = results["operations"].getArray())
+        {
+            for (auto& o : *operations)
+            {
+                report << "  " << o["operation"].toString().paddedRight(' ', 20)
+                       << o["fixture"].toString().paddedRight(' ', 5)
+                       << juce::String((double)o["p50Us"], 1).paddedLeft(' ', 10)
+                       << juce::String((double)o["p99Us"], 1).paddedLeft(' ', 10)
+                       << juce::String((double)o["maxUs"], 1).paddedLeft(' ', 10) << "\n";
+            }
+        }
+
+        return report;
+    }
+
+    juce::String deckScaling()
+    {
+        constexpr int fixtureSeconds = 30;
+        constexpr double callbackSeconds = 2.0;
+        constexpr int blockSize = 512;
+
+        const juce::TemporaryFile temp(".wav");
+        if (!writeTestFile(temp.getFile(), fixtureSeconds))
+            return "Deck scaling: could not write the fixture\n";
+
+        const double deadline = blockSize * 1.0e6 / benchSampleRate;
+
+        juce::String report;
+        report << "Deck scaling (block " << blockSize << ", 1.25x keep-pitch, " << DeckEngine::getDefaultNumWorkers()
+               << " workers; us, cpu = mean / block deadline)\n"
+               << "  decks      serial mean    p99     cpu    parallel mean    p99     cpu   speedup\n";
+
+        for (int numDecks : { 1, 2, 4, 8, 16, 24, 32 })
+        {
+            TimingSummary summaries[2];
+
+            for (int parallel = 0; parallel < 2; ++parallel)
+            {
+                DeckRig rig;
+                if (!rig.prepare(temp.getFile(), true, numDecks, blockSize, 1.25, true, parallel != 0))
+                    return report + "  could not load the fixture\n";
+
+                rig.waitForStreams();
+
+                const int numCallbacks = juce::jmax(1, (int)(callbackSeconds * benchSampleRate) / blockSize);
+                std::vector<double> timings;
+                timings.reserve((size_t)numCallbacks);
+
+                for (int i = 0; i < numCallbacks; ++i)
+                {
+                    const auto start = juce::Time::getHighResolutionTicks();
+                    rig.renderBlock();
+                    timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+                }
+
+                summaries[parallel] = summarise(timings);
+            }
+
+            report << juce::String(numDecks).paddedLeft(' ', 7);
+
+            for (auto& summary : summaries)
+                report << juce::String(summary.mean, 1).paddedLeft(' ', 16)
+                       << juce::String(summary.p99, 1).paddedLeft(' ', 8)
+                       << (juce::String(summary.mean / deadline * 100.0, 1) + "%").paddedLeft(' ', 8);
+
+            report << (juce::String(summaries[0].mean / juce::jmax(1.0e-9, summaries[1].mean), 2) + "x").paddedLeft(' ', 10) << "\n";
+        }
+
+        return report;
+    }
+
+    juce::String mp3Seeks(const juce::File& file)
+    {
+        constexpr int numSeeks = 200;
+        constexpr int chunkSize = 65536;
+
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        auto* mp3 = formats.findFormatForFileExtension("mp3");
+        if (mp3 == nullptr)
+            return "MP3 seeks: this build has no MP3 decoder\n";
+
+        // ===== Open =====
+        auto start = juce::Time::getHighResolutionTicks();
+        std::unique_ptr<juce::AudioFormatReader> plain(formats.createReaderFor(file));
+        const double plainOpenMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (plain == nullptr)
+            return "MP3 seeks: could not open " + file.getFullPathName() + "\n";
+
+        start = juce::Time::getHighResolutionTicks();
+        std::unique_ptr<Mp3SeekIndex::Table> built = Mp3SeekIndex::Table::build(file);
+        const double buildMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (built == nullptr || built->lengthInSamples != plain->lengthInSamples)
+            return "MP3 seeks: " + file.getFileName() + " cannot be indexed (not plain MPEG-1 Layer III, or the scan disagrees with the decoder)\n";
+
+        // What a later open costs: reading the saved table back
+        juce::MemoryOutputStream saved;
+        built->writeTo(saved, "benchmark");
+
+        start = juce::Time::getHighResolutionTicks();
+        juce::MemoryInputStream savedIn(saved.getData(), saved.getDataSize(), false);
+        Mp3SeekIndex::TablePtr table = Mp3SeekIndex::Table::readFrom(savedIn, "benchmark");
+        const double loadMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (table == nullptr)
+            return "MP3 seeks: the saved table did not read back\n";
+
+        SeekIndexedMp3Reader indexed(file, table, *mp3);
+
+        // ===== Seeks =====
+        const int numChannels = (int)plain->numChannels;
+        const auto length = plain->lengthInSamples;
+        juce::Random random(18);
+        std::vector<juce::int64> positions;
+
+        for (int i = 0; i < numSeeks; ++i)
+            positions.push_back((juce::int64)(random.nextDouble() * (double)(length - benchBlockSize)));
+
+        juce::AudioFormatReader* readers[] = { plain.get(), &indexed };
+        std::vector<double> timings[2];
+        std::vector<juce::AudioBuffer<float>> blocks[2];
+
+        for (int r = 0; r < 2; ++r)
+        {
+            for (auto pos : positions)
+            {
+                juce::AudioBuffer<float> block(numChannels, benchBlockSize);
+
+                start = juce::Time::getHighResolutionTicks();
+                readers[r]->read(&block, 0, benchBlockSize, pos, true, true);
+                timings[r].push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+
+                blocks[r].push_back(std::move(block));
+            }
+        }
+
+        // ===== Exactness =====
+        // One pass from the start of the file with a fresh decoder; the buffer keeps a block of
+        // the previous chunk in front so no position straddles two chunks
+        std::unique_ptr<juce::AudioFormatReader> sequential(formats.createReaderFor(file));
+        juce::AudioBuffer<float> window(numChannels, benchBlockSize + chunkSize);
+        window.clear();
+        float maxError[2] = {};
+
+        for (juce::int64 chunkStart = 0; chunkStart < length; chunkStart += chunkSize)
+        {
+            sequential->read(&window, benchBlockSize, chunkSize, chunkStart, true, true);
+            const auto windowStart = chunkStart - benchBlockSize;
+
+            for (size_t i = 0; i < positions.size(); ++i)
+            {
+                const auto pos = positions[i];
+
+                // Blocks ending before this chunk were compared with the previous one
+                if (pos < windowStart || pos + benchBlockSize > chunkStart + chunkSize || pos + benchBlockSize <= chunkStart)
+                    continue;
+
+                for (int r = 0; r < 2; ++r)
+                    for (int ch = 0; ch < numChannels; ++ch)
+                        for (int s = 0; s < benchBlockSize; ++s)
+                            maxError[r] = juce::jmax(maxError[r], std::abs(blocks[r][i].getSample(ch, s)
+                                - window.getSample(ch, (int)(pos - windowStart) + s)));
+            }
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                window.copyFrom(ch, 0, window, ch, chunkSize, benchBlockSize);
+        }
+
+        juce::String report;
+        report << "MP3 seeks (" << file.getFileName() << ", " << juce::String((double)length / plain->sampleRate / 60.0, 1)
+               << " min, " << table->getNumFrames() << " frames, block " << benchBlockSize << ")\n"
+               << "  open: decoder " << juce::String(plainOpenMs, 2) << " ms, index build " << juce::String(buildMs, 2)
+               << " ms (first open, in the background), saved index " << juce::String(loadMs, 2) << " ms ("
+               << (int)saved.getDataSize() / 1024 << " KB)\n"
+               << "  reader      seek + block mean / p99 us    max     error vs sequential decode\n";
+
+        const char* names[] = { "plain  ", "indexed" };
+
+        for (int r = 0; r < 2; ++r)
+        {
+            const auto summary = summarise(timings[r]);
+            report << "  " << names[r] << describeTimings(timings[r]).paddedLeft(' ', 30)
+                   << juce::String(summary.max, 1).paddedLeft(' ', 9)
+                   << juce::String(maxError[r], 6).paddedLeft(' ', 14) << "\n";
+        }
+
+        return report;
+    }
+
+    juce::String playlistStore()
+    {
+        constexpr int numEntries = 1000000;
+        constexpr int filesPerFolder = 12;
+        constexpr int numLookups = 100000;
+
+        juce::String report;
+        report << "Playlist store (" << numEntries << " entries, " << numEntries / filesPerFolder << " folders)\n";
+
+        // Album-sized runs of files, the way a library export lists them
+        const juce::TemporaryFile source(".m3u");
+        {
+            juce::FileOutputStream out(source.getFile(), 1 << 16);
+            if (!out.openedOk())
+                return report + "  could not write test file\n";
+
+            out << "#EXTM3U\n";
+
+            for (int i = 0; i < numEntries; ++i)
+                out << "#EXTINF:215,Artist " << i / filesPerFolder << " - Track " << i % filesPerFolder + 1 << "\n"
+                    << "/music/Artist " << i / (filesPerFolder * 10) << "/Album " << i / filesPerFolder
+                    << "/" << juce::String(i % filesPerFolder + 1).paddedLeft('0', 2) << " Track.mp3\n";
+        }
+
+        PlaylistStore store;
+
+        auto start = juce::Time::getHighResolutionTicks();
+        const int imported = store.importFrom(source.getFile());
+        const double importMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (imported != numEntries)
+            return report + "  import read " + juce::String(imported) + " entries\n";
+
+        // What the row painter asks for: one path per visible row
+        juce::Random random(3);
+        size_t checksum = 0;
+
+        start = juce::Time::getHighResolutionTicks();
+        for (int i = 0; i < numLookups; ++i)
+            checksum += (size_t)store.getPath(random.nextInt(numEntries)).length();
+        const double lookupUs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / numLookups;
+
+        const juce::TemporaryFile exported(".m3u");
+        start = juce::Time::getHighResolutionTicks();
+        const bool wrote = store.exportTo(exported.getFile());
+        const double exportMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        // A juce::File per entry holds its own copy of the full path
+        const double pathBytes = (double)exported.getFile().getSize() / numEntries;
+        const double perFileBytes = (double)sizeof(juce::File) + 16.0 + pathBytes;
+
+        report << "  import " << juce::String(importMs, 1) << " ms (" << source.getFile().getSize() / (1024 * 1024) << " MB file)"
+               << ", export " << (wrote ? juce::String(exportMs, 1) + " ms" : juce::String("failed")) << "\n"
+               << "  memory " << juce::String((double)store.getMemoryUsage() / (1024.0 * 1024.0), 1) << " MB ("
+               << juce::String((double)store.getMemoryUsage() / numEntries, 1) << " bytes/entry; one juce::File per entry ~"
+               << juce::String(perFileBytes, 1) << ")\n"
+               << "  row lookup " << juce::String(lookupUs, 3) << " us (checksum " << (int)(checksum % 1000) << ")\n";
+
+        return report;
+    }
+
+    juce::String trackSearch()
+    {
+        constexpr int vocabularySize = 5000;
+        constexpr int numQueries = 2000;
+
+        // Made-up words of consonant-vowel syllables, picked so a few are far more common than
+        // the rest, the way real tags repeat "the", "love" or "live"
+        juce::Random random(4);
+        const juce::String consonants("bcdfghjklmnprstvwz"), vowels("aeiou");
+        juce::StringArray vocabulary;
+
+        for (int i = 0; i < vocabularySize; ++i)
+        {
+            juce::String word;
+
+            for (int s = 1 + random.nextInt(2); s >= 0; --s)
+            {
+                word += consonants[random.nextInt(consonants.length())];
+                word += vowels[random.nextInt(vowels.length())];
+
+                if (random.nextInt(10) < 3)
+                    word += consonants[random.nextInt(consonants.length())];
+            }
+
+            vocabulary.add(word);
+        }
+
+        auto pickWord = [&random, &vocabulary]
+            {
+                const double r = random.nextDouble();
+                return vocabulary[(int)(r * r * r * vocabularySize)];
+            };
+
+        auto pickWords = [&pickWord, &random](int maxWords)
+            {
+                juce::String words = pickWord();
+                for (int w = random.nextInt(maxWords); w > 0; --w)
+                    words << " " << pickWord();
+                return words;
+            };
+
+        juce::String report;
+        report << "Track search (" << vocabularySize << "-word vocabulary, " << numQueries
+               << " queries per kind, mean / p99 us, max us, mean rows)\n";
+
+        for (int numRows : { 100000, 250000 })
+        {
+            TrackSearchIndex index;
+            std::vector<juce::String> rowTitles;
+            rowTitles.reserve((size_t)numRows);
+
+            juce::int64 buildTicks = 0;
+
+            for (int row = 0; row < numRows; ++row)
+            {
+                const auto title = pickWords(3);
+                const auto text = title + " " + pickWords(2) + " " + pickWords(2) + " "
+                                + juce::String(row % 14 + 1).paddedLeft('0', 2) + " " + title + ".mp3";
+
+                const auto addStart = juce::Time::getHighResolutionTicks();
+                index.add(text);
+                buildTicks += juce::Time::getHighResolutionTicks() - addStart;
+
+                rowTitles.push_back(title);
+            }
+
+            report << "  " << numRows << " rows: indexed in " << juce::String(ticksToMicros(buildTicks) / 1000.0, 1) << " ms, "
+                   << juce::String((double)index.getMemoryUsage() / (1024.0 * 1024.0), 1) << " MB\n";
+
+            // Each kind of query is made from the words of random rows, so most of them match
+            struct Kind
+            {
+                const char* name;
+                std::function<juce::String(const juce::String&)> make;
+            };
+
+            const Kind kinds[] = {
+                { "1 letter       ", [](const juce::String& title) { return title.substring(0, 1); } },
+                { "2 letters      ", [](const juce::String& title) { return title.substring(0, 2); } },
+                { "word           ", [](const juce::String& title) { return title.upToFirstOccurrenceOf(" ", false, false); } },
+                { "word prefix    ", [](const juce::String& title) { auto word = title.upToFirstOccurrenceOf(" ", false, false);
+                                                                     return word.substring(0, juce::jmax(3, word.length() - 2)); } },
+                { "two words      ", [](const juce::String& title) { return title.upToFirstOccurrenceOf(" ", false, false) + " "
+                                                                            + title.fromLastOccurrenceOf(" ", false, false); } },
+                { "typo (fuzzy)   ", [](const juce::String& title) { auto word = title.upToFirstOccurrenceOf(" ", false, false);
+                                                                     return word.substring(0, word.length() / 2) + "q" + word.substring(word.length() / 2 + 1); } },
+                { "every row (mp3)", [](const juce::String&) { return juce::String("mp3"); } },
+            };
+
+            for (const auto& kind : kinds)
+            {
+                std::vector<double> timings;
+                double totalRows = 0.0;
+
+                for (int q = 0; q < numQueries; ++q)
+                {
+                    const auto query = kind.make(rowTitles[(size_t)random.nextInt(numRows)]);
+
+                    const auto start = juce::Time::getHighResolutionTicks();
+                    const auto result = index.search(query);
+                    timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+                    totalRows += (double)result.rows.size();
+                }
+
+                report << "    " << kind.name << describeTimings(timings).paddedLeft(' ', 20)
+                       << juce::String(summarise(timings).max, 1).paddedLeft(' ', 10)
+                       << juce::String(totalRows / numQueries, 0).paddedLeft(' ', 10) << "\n";
+            }
+        }
+
+        return report;
+    }
+
+    // Kick on every beat and a hi-hat on every off-beat over a low drone, as a tempo fixture
+    juce::AudioBuffer<float> makeBeatTrack(double bpm, double firstBeat, int seconds)
+    {
+        const int length = (int)(seconds * benchSampleRate);
+        const double beatLength = 60.0 / bpm;
+        juce::AudioBuffer<float> audio(2, length);
+        juce::Random random(2);
+
+        for (int i = 0; i < length; ++i)
+        {
+            const double t = i / benchSampleRate;
+            const double sinceBeat = std::fmod(t - firstBeat + 100.0 * beatLength, beatLength);
+            const double sinceOffBeat = std::fmod(sinceBeat + 0.5 * beatLength, beatLength);
+
+            const double kick = std::sin(juce::MathConstants<double>::twoPi * 55.0 * sinceBeat) * std::exp(-sinceBeat * 25.0);
+            const double hat = (random.nextFloat() - 0.5f) * std::exp(-sinceOffBeat * 80.0);
+            const double drone = 0.1 * std::sin(juce::MathConstants<double>::twoPi * 110.0 * t);
+            const float sample = (float)(0.6 * kick + 0.3 * hat + drone);
+
+            audio.setSample(0, i, sample);
+            audio.setSample(1, i, sample);
+        }
+
+        return audio;
+    }
+
+    juce::String trackAnalysis()
+    {
+        constexpr int fixtureSeconds = 60;
+        constexpr int numFiles = 8;
+
+        juce::String report;
+        report << "Loudness and tempo analysis (" << numFiles << " x " << fixtureSeconds << " s stereo, realtime multiples)\n";
+
+        // The meter alone, on audio already in memory
+        {
+            const juce::TemporaryFile temp(".wav");
+            if (!writeTestFile(temp.getFile(), fixtureSeconds))
+                return report + "  could not write test file\n";
+
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(temp.getFile()));
+
+            if (reader == nullptr)
+                return report + "  could not open test file\n";
+
+            const int length = (int)reader->lengthInSamples;
+            juce::AudioBuffer<float> audio(2, length);
+            reader->read(&audio, 0, length, 0, true, true);
+
+            constexpr int blockSize = 65536;
+            juce::AudioBuffer<float> block(2, blockSize);
+            LoudnessMeter meter(reader->sampleRate, 2, blockSize);
+
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int pos = 0; pos < length; pos += blockSize)
+            {
+                const int n = juce::jmin(blockSize, length - pos);
+
+                for (int ch = 0; ch < 2; ++ch)
+                    block.copyFrom(ch, 0, audio, ch, pos, n);
+
+                meter.process(block, n);
+            }
+
+            const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            const auto result = meter.getResult();
+
+            report << "  meter only      " << juce::String(fixtureSeconds / elapsed, 0) << "x  ("
+                   << juce::String(result.integratedLufs, 1) << " LUFS, LRA " << juce::String(result.loudnessRange, 1)
+                   << " LU, " << juce::String(result.truePeakDb, 1) << " dBTP)\n";
+        }
+
+        // The tempo analysis alone, on a generated beat of known tempo and phase
+        {
+            constexpr double bpm = 128.0, firstBeat = 0.3;
+            const auto audio = makeBeatTrack(bpm, firstBeat, fixtureSeconds);
+
+            constexpr int blockSize = 65536;
+            juce::AudioBuffer<float> block(2, blockSize);
+            TempoAnalyser tempo(benchSampleRate, 2);
+
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int pos = 0; pos < audio.getNumSamples(); pos += blockSize)
+            {
+                const int n = juce::jmin(blockSize, audio.getNumSamples() - pos);
+
+                for (int ch = 0; ch < 2; ++ch)
+                    block.copyFrom(ch, 0, audio, ch, pos, n);
+
+                tempo.process(block, n);
+            }
+
+            const auto grid = tempo.getResult();
+            const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            // Phase error to the nearest true beat
+            const double beatLength = 60.0 / bpm;
+            double phaseError = std::fmod(grid.firstBeatSeconds - firstBeat, beatLength);
+            phaseError -= beatLength * std::round(phaseError / beatLength);
+
+            report << "  tempo only      " << juce::String(fixtureSeconds / elapsed, 0) << "x  (" << juce::String(bpm, 1)
+                   << " BPM read as " << juce::String(grid.bpm, 3) << ", first beat off by "
+                   << juce::String(phaseError * 1000.0, 1) << " ms, confidence " << juce::String(grid.confidence, 2) << ")\n";
+        }
+
+        // Whole files decoded and analysed, one thread and then one file per core, as AnalysisCache runs them
+        for (const char* extension : { ".wav", ".flac" })
+        {
+            juce::OwnedArray<juce::TemporaryFile> fixtures;
+
+            for (int i = 0; i < numFiles; ++i)
+                if (!writeTestFile(fixtures.add(new juce::TemporaryFile(extension))->getFile(), fixtureSeconds))
+                    return report + "  could not write test file\n";
+
+            auto measureAll = [&fixtures](int numThreads)
+                {
+                    juce::ThreadPool pool(numThreads);
+                    const auto start = juce::Time::getHighResolutionTicks();
+
+                    for (auto* fixture : fixtures)
+                        pool.addJob([file = fixture->getFile()]
+                            {
+                                juce::AudioFormatManager formats;
+                                formats.registerBasicFormats();
+
+                                double seconds = 0.0;
+                                AnalysisCache::measure(file, formats, seconds);
+                            });
+
+                    while (pool.getNumJobs() > 0)
+                        juce::Thread::sleep(1);
+
+                    const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+                    return elapsed > 0.0 ? (double)(fixtures.size() * fixtureSeconds) / elapsed : 0.0;
+                };
+
+            const int numCores = juce::jmax(1, juce::SystemStats::getNumCpus());
+            const double single = measureAll(1);
+            const double parallel = measureAll(numCores);
+
+            report << "  " << juce::String(extension + 1).paddedRight(' ', 14)
+                   << juce::String(single, 0) << "x on one thread, " << juce::String(parallel, 0) << "x on " << numCores
+                   << " (" << juce::String(parallel / juce::jmax(1.0e-9, single), 2) << "x)\n";
+        }
+
+        return report;
+    }
+
+    juce::String spectrumAnalysers()
+    {
+        constexpr int fixtureSeconds = 30;
+        constexpr double callbackSeconds = 2.0;
+        constexpr int blockSize = 512;
+
+        const juce::TemporaryFile temp(".wav");
+        if (!writeTestFile(temp.getFile(), fixtureSeconds))
+            return "Spectrum analysers: could not write the fixture\n";
+
+        juce::String report;
+        report << "Spectrum analysers (block " << blockSize << ", serial; audio thread us per callback)\n"
+               << "  decks     off mean    p99      on mean    p99    cost per deck\n";
+
+        // ===== Audio thread =====
+        // The taps are drained between callbacks (untimed) at about the rate the views read them
+        for (int numDecks : { 1, 8, 32 })
+        {
+            TimingSummary summaries[2];
+
+            for (int enabled = 0; enabled < 2; ++enabled)
+            {
+                DeckRig rig;
+                if (!rig.prepare(temp.getFile(), true, numDecks, blockSize, 1.0, false))
+                    return report + "  could not load the fixture\n";
+
+                for (auto* deck : rig.decks)
+                    deck->getSpectrumTap().setEnabled(enabled != 0);
+
+                rig.waitForStreams();
+
+                const int numCallbacks = juce::jmax(1, (int)(callbackSeconds * benchSampleRate) / blockSize);
+                std::vector<double> timings;
+                timings.reserve((size_t)numCallbacks);
+
+                for (int i = 0; i < numCallbacks; ++i)
+                {
+                    const auto start = juce::Time::getHighResolutionTicks();
+                    rig.renderBlock();
+                    timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+
+                    if (i % 3 == 2)
+                        for (auto* deck : rig.decks)
+                            deck->getSpectrumTap().discard(deck->getSpectrumTap().getNumReady());
+                }
+
+                summaries[enabled] = summarise(timings);
+            }
+
+            report << juce::String(numDecks).paddedLeft(' ', 7);
+
+            for (auto& summary : summaries)
+                report << juce::String(summary.mean, 1).paddedLeft(' ', 13) << juce::String(summary.p99, 1).paddedLeft(' ', 7);
+
+            report << juce::String((summaries[1].mean - summaries[0].mean) / numDecks, 2).paddedLeft(' ', 14) << " us\n";
+        }
+
+        // ===== GUI =====
+        // One view's share of the message thread: analysing a second of audio, and a frame's paint
+        {
+            SpectrumTap tap(1 << 18);
+            tap.setSampleRate(benchSampleRate);
+            tap.setEnabled(true);
+
+            juce::AudioBuffer<float> noise(2, (int)benchSampleRate);
+            juce::Random random(3);
+
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < noise.getNumSamples(); ++i)
+                    noise.setSample(ch, i, random.nextFloat() - 0.5f);
+
+            SpectrumAnalyser analyser(tap);
+            analyser.setNumBands(SpectrumView::maxBands);
+
+            constexpr int numSeconds = 10;
+            int frames = 0;
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int second = 0; second < numSeconds; ++second)
+            {
+                tap.push(noise, 0, noise.getNumSamples());
+                frames += analyser.update(1000);     // all of it: a second is under 400 frames at any rate
+            }
+
+            const double analysisMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1000.0;
+
+            report << "  analysis: " << juce::String(analysisMs / numSeconds, 2) << " ms per second of audio ("
+                   << juce::String(frames / numSeconds) << " FFT frames, " << juce::String(analysisMs * 1000.0 / juce::jmax(1, frames), 1)
+                   << " us each)\n";
+
+            SpectrumView view(tap);
+            view.setSize(400, 54);
+            juce::Image canvas(juce::Image::RGB, view.getWidth(), view.getHeight(), true);
+
+            for (auto mode : { SpectrumView::Mode::spectrum, SpectrumView::Mode::spectrogram })
+            {
+                view.setMode(mode);
+                std::vector<double> timings;
+
+                for (int i = 0; i < 200; ++i)
+                {
+                    juce::Graphics g(canvas);
+                    const auto paintStart = juce::Time::getHighResolutionTicks();
+                    view.paintEntireComponent(g, false);
+                    timings.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - paintStart));
+                }
+
+                report << "  paint " << (mode == SpectrumView::Mode::spectrum ? "spectrum:    " : "spectrogram: ")
+                       << juce::String(summarise(timings).mean, 1) << " us per frame, "
+                       << juce::String(summarise(timings).mean * SpectrumView::refreshHz / 1000.0, 2) << " ms per second\n";
+            }
+        }
+
+        return report;
+    }
+
+    juce::String sessionRestore()
+    {
+        constexpr int numDecks = 4;
+        constexpr int numEntries = 1000000;
+        constexpr int filesPerFolder = 12;
+
+        juce::String report;
+        report << "Session restore (" << numDecks << " decks, " << numEntries << " playlist entries each)\n";
+
+        // Added in batches, the way folder scans add them
+        PlaylistStore playlist;
+        juce::Array<juce::File> batch;
+
+        for (int i = 0; i < numEntries; ++i)
+        {
+            batch.add(juce::File("/music/Artist " + juce::String(i / (filesPerFolder * 10)) + "/Album " + juce::String(i / filesPerFolder)
+                + "/" + juce::String(i % filesPerFolder + 1).paddedLeft('0', 2) + " Track.mp3"));
+
+            if (batch.size() == 65536 || i == numEntries - 1)
+            {
+                playlist.addFiles(batch);
+                batch.clearQuick();
+            }
+        }
+
+        // What PlayerGUI::getSession does on the message thread; the writer serialises it
+        auto start = juce::Time::getHighResolutionTicks();
+        const auto snapshot = playlist.getSnapshot();
+        const double snapshotMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        juce::MemoryOutputStream serialised;
+        snapshot.writeTo(serialised);
+        const auto playlistBytes = (double)serialised.getDataSize();
+
+        Session session;
+
+        for (int d = 0; d < numDecks; ++d)
+        {
+            DeckSession deck;
+            deck.playlist = snapshot;
+            deck.currentTrackIndex = d;
+            deck.filePath = playlist.getPath(d);
+            deck.position = 60.0 * d;
+            deck.looping = true;
+            deck.loopStart = 10.0;
+            deck.loopEnd = 20.0;
+            session.decks.push_back(std::move(deck));
+        }
+
+        const juce::TemporaryFile file(".state");
+        SessionStore store(file.getFile());
+
+        start = juce::Time::getHighResolutionTicks();
+        const bool saved = store.save(session);
+        const double saveMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        start = juce::Time::getHighResolutionTicks();
+        store.save(session);
+        const double unchangedMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (!saved)
+            return report + "  could not write test file\n";
+
+        Session loaded;
+        start = juce::Time::getHighResolutionTicks();
+        const bool read = store.load(loaded);
+        const double loadMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (!read || loaded.decks.size() != (size_t)numDecks || loaded.decks[0].playlist.isEmpty())
+            return report + "  could not read the session back\n";
+
+        PlaylistStore restored;
+        start = juce::Time::getHighResolutionTicks();
+        restored.restore(loaded.decks[0].playlist);
+        const double rebuildMs = ticksToMicros(juce::Time::getHighResolutionTicks() - start) / 1000.0;
+
+        if (restored.size() != numEntries || restored.getPath(numEntries - 1) != playlist.getPath(numEntries - 1))
+            return report + "  restored playlist does not match\n";
+
+        report << "  snapshot " << juce::String(snapshotMs, 3) << " ms on the message thread (" << (int)(playlistBytes / (1024 * 1024))
+               << " MB serialised by the writer, " << juce::String(playlistBytes / numEntries, 1) << " bytes/entry)\n"
+               << "  save " << juce::String(saveMs, 1) << " ms (" << (int)(file.getFile().getSize() / (1024 * 1024)) << " MB file), unchanged save "
+               << juce::String(unchangedMs, 1) << " ms (" << store.getNumUnchangedSaves() << " skipped)\n"
+               << "  load " << juce::String(loadMs, 1) << " ms, playlist rebuild " << juce::String(rebuildMs, 1) << " ms per deck\n";
+
+        return report;
+    }
+
+    juce::String hotCues()
+    {
+        constexpr int fixtureSeconds = 120;
+        constexpr int numJumps = 200;
+
+        juce::String report;
+        report << "Hot cues (" << LoopingAudioSource::maxHotCues << " cues in a " << fixtureSeconds << " s FLAC, block "
+               << benchBlockSize << ", p50 / p99 / max us)\n";
+
+        const juce::TemporaryFile temp(".flac");
+        if (!writeTestFile(temp.getFile(), fixtureSeconds))
+            return report + "  could not write test file\n";
+
+        DeckRig rig;
+        if (!rig.prepare(temp.getFile(), false, 1, benchBlockSize, 1.0, false))
+            return report + "  could not open test file\n";
+
+        auto& deck = *rig.decks.getFirst();
+        juce::Random random(4);
+
+        std::vector<juce::int64> frames;
+        for (int i = 0; i < LoopingAudioSource::maxHotCues; ++i)
+            frames.push_back((juce::int64)(random.nextDouble() * (fixtureSeconds - 2) * benchSampleRate));
+
+        // The cue commands reach the deck with the next block; the disk thread decodes them after it
+        deck.setHotCues(frames);
+        rig.renderBlock();
+        juce::Thread::sleep(1000);
+        rig.waitForStreams();
+
+        std::vector<double> seekCallbacks, cueCallbacks;
+
+        for (int i = 0; i < numJumps; ++i)
+        {
+            // The same work for the UI either way; the difference is in the callback that follows
+            deck.setPosition(random.nextDouble() * (fixtureSeconds - 2));
+            auto start = juce::Time::getHighResolutionTicks();
+            rig.renderBlock();
+            seekCallbacks.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+
+            deck.jumpToHotCue(frames[(size_t)(i % (int)frames.size())]);
+            start = juce::Time::getHighResolutionTicks();
+            rig.renderBlock();
+            cueCallbacks.push_back(ticksToMicros(juce::Time::getHighResolutionTicks() - start));
+        }
+
+        const auto describe = [](std::vector<double> timings)
+            {
+                const auto summary = summarise(std::move(timings));
+                return juce::String(summary.p50, 0) + " / " + juce::String(summary.p99, 0) + " / " + juce::String(summary.max, 0);
+            };
+
+        const double cueMegabytes = LoopingAudioSource::maxHotCues * LoopingAudioSource::headCacheSeconds * benchSampleRate
+            * 2 * sizeof(float) / (1024.0 * 1024.0);
+
+        report << "  callback after setPosition   " << describe(seekCallbacks) << "\n"
+               << "  callback after jumpToHotCue  " << describe(cueCallbacks) << "\n"
+               << "  " << deck.getNumCueHits() << " jumps from memory, " << deck.getNumCueMisses() << " had to seek; "
+               << juce::String(cueMegabytes, 1) << " MB of decoded cues per deck\n";
+
+        return report;
+    }
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Offline throughput measurements, run with --benchmark on the command line.
+// Results are reported as realtime factors (seconds of audio rendered per second of CPU),
+// so 1 / factor is the share of one core a deck needs.
+namespace Benchmarks
+{
+    // Runs every benchmark and returns a printable report
+    juce::String runAll();
+
+    // Resample-only vs pitch-preserving speed change across the speed slider's range
+    juce::String speedModes();
+
+    // Polyphase converter tiers against juce::ResamplingAudioSource: THD+N of a 1 kHz tone
+    // converted 48 -> 44.1 kHz, level of a 15 kHz tone that must be rejected at 2x speed,
+    // and throughput at both ratios
+    juce::String resamplers();
+
+    // Streaming reader against the memory-mapped reader on a generated 16-bit WAV:
+    // per-block read cost for sequential playback and the cost of a block after a random seek.
+    // The file has just been written, so both run from the OS cache (warm); the mapped figures
+    // include faulting pages into the new mapping.
+    juce::String mappedReads();
+
+    // Two decks reading the same file through the shared decoded-PCM cache: read cost of the
+    // first (decoding) pass against the second (cached) one, and the cache statistics
+    juce::String decodedCache();
+
+    // Whole decks and the mix bus driven like MainComponent's callback, against generated
+    // WAV (memory-mapped) and FLAC (decoded) fixtures, across block sizes, speeds and deck
+    // counts: p50/p99/max callback time, mean share of the block deadline and heap
+    // allocations per callback (when the allocation hooks are compiled in), plus the cost of
+    // loadFile, setPosition and the callback that services a seek.
+    // Returns a JSON-ready object so results can be compared between versions.
+    juce::var deckCallbacks();
+    juce::String describeDeckCallbacks(const juce::var& results);
+
+    // Mean and p99 callback time for 1 to 32 pitch-preserving decks at block 512, with every
+    // deck rendered on the audio thread against the DeckEngine's worker threads
+    juce::String deckScaling();
+
+    // Seeking in a real MP3 (JUCE cannot encode one to generate a fixture), run with
+    // --benchmark-seek <file.mp3>: open cost, and the latency of a seek plus its first block
+    // through the plain decoder against the seek-table reader, with each one's largest error
+    // against a sequential decode of the same positions
+    juce::String mp3Seeks(const juce::File& file);
+
+    // A million-entry M3U through PlaylistStore: import and export time, memory per entry
+    // against a juce::File per entry, and the cost of building one row's path
+    juce::String playlistStore();
+
+    // TrackSearchIndex over 100k and 250k generated tracks: indexing time and memory, then
+    // search latency for each kind of search-as-you-type query (first letters, whole and
+    // partial words, two words, a typo that falls back to fuzzy matching, and a query every
+    // row matches)
+    juce::String trackSearch();
+
+    // LoudnessMeter on audio in memory, TempoAnalyser on a generated 128 BPM beat (speed and
+    // accuracy), then whole generated WAV and FLAC files decoded and analysed on one thread and
+    // on every core, as AnalysisCache analyses a playlist
+    juce::String trackAnalysis();
+
+    // Audio thread cost of the decks' spectrum taps, off against on, for 1, 8 and 32 decks;
+    // then one SpectrumView's message thread cost: analysing a second of audio and painting
+    // a frame of the spectrum and of the spectrogram
+    juce::String spectrumAnalysers();
+
+    // Saving and restoring a session of four decks with a million-entry playlist each: the
+    // playlist snapshot an autosave takes on the message thread after an edit, writing the
+    // file, an unchanged save that is skipped, reading it back and rebuilding a playlist
+    juce::String sessionRestore();
+
+    // A deck with every hot cue slot filled in a generated FLAC: the callback after a seek to
+    // a random position against the callback after a jump to a cue (played from memory), and
+    // how many jumps found their cue decoded
+    juce::String hotCues();
+}
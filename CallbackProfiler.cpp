@@ -0,0 +1,208 @@
+﻿#include "CallbackProfiler.h"
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+CallbackProfiler::CallbackProfiler()
+{
+    // Calibrate now, on the message thread, rather than on the first report
+    getCyclesPerSecond();
+    recent.reserve((size_t)recentWindow);
+}
+
+CallbackProfiler::Cycles CallbackProfiler::now() noexcept
+{
+   #if JUCE_INTEL
+    return (Cycles)__rdtsc();
+   #elif JUCE_ARM && JUCE_64BIT && !JUCE_MSVC
+    Cycles value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+   #else
+    return (Cycles)juce::Time::getHighResolutionTicks();
+   #endif
+}
+
+double CallbackProfiler::getCyclesPerSecond()
+{
+    static const double cyclesPerSecond = []
+        {
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            const auto startCycles = now();
+
+            juce::Thread::sleep(20);
+
+            const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+            return juce::jmax(1.0, (double)(now() - startCycles) / seconds);
+        }();
+
+    return cyclesPerSecond;
+}
+
+// ===== Audio thread =====
+void CallbackProfiler::beginBlock(int numSamples, double sampleRate) noexcept
+{
+    current.start = now();
+    current.previousStart = lastStart;
+    current.numSamples = numSamples;
+    current.sampleRate = sampleRate;
+    current.mix = 0;
+    current.numDecks = 0;
+
+    for (auto& deck : current.decks)
+        deck = {};
+
+    lastStart = current.start;
+}
+
+void CallbackProfiler::addDeck(int deck, const DeckStages& stages) noexcept
+{
+    if (!juce::isPositiveAndBelow(deck, maxDecks))
+        return;
+
+    current.decks[deck] += stages;
+    current.numDecks = juce::jmax(current.numDecks, deck + 1);
+}
+
+void CallbackProfiler::addMix(Cycles cycles) noexcept
+{
+    current.mix += (juce::uint32)cycles;
+}
+
+void CallbackProfiler::endBlock() noexcept
+{
+    current.end = now();
+
+    if (!records.push(current))
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ===== Message thread =====
+void CallbackProfiler::collect()
+{
+    Record record;
+
+    while (records.pop(record))
+    {
+        BlockReport report;
+        report.deadlineMs = record.sampleRate > 0.0 ? record.numSamples * 1000.0 / record.sampleRate : 0.0;
+        report.totalMs = cyclesToMilliseconds(record.end - record.start);
+        report.mixMs = cyclesToMilliseconds(record.mix);
+        report.gapMs = record.previousStart != 0 ? cyclesToMilliseconds(record.start - record.previousStart) : 0.0;
+        report.numDecks = record.numDecks;
+
+        for (int d = 0; d < record.numDecks; ++d)
+        {
+            report.streamMs[d] = cyclesToMilliseconds(record.decks[d].stream);
+            report.dspMs[d] = cyclesToMilliseconds(record.decks[d].dsp);
+            report.deckMs[d] = cyclesToMilliseconds(record.decks[d].total);
+        }
+
+        report.overrun = report.totalMs > report.deadlineMs;
+        report.late = record.previousStart != 0 && report.gapMs > report.deadlineMs * 1.5;
+
+        auto binFor = [&](double ms)
+            {
+                const double load = report.deadlineMs > 0.0 ? ms / report.deadlineMs : 0.0;
+                return juce::jlimit(0, numHistogramBins - 1, (int)(load * 20.0));
+            };
+
+        for (int d = 0; d < report.numDecks; ++d)
+            ++histograms[(size_t)d][(size_t)binFor(report.deckMs[d])];
+
+        ++histograms[maxDecks][(size_t)binFor(report.totalMs)];
+
+        ++numBlocks;
+        numOverruns += report.overrun ? 1 : 0;
+        numLate += report.late ? 1 : 0;
+        numDecksSeen = juce::jmax(numDecksSeen, report.numDecks);
+
+        if (recent.size() < (size_t)recentWindow)
+        {
+            recent.push_back(report);
+        }
+        else
+        {
+            recent[nextRecent] = report;
+            nextRecent = (nextRecent + 1) % recent.size();
+        }
+    }
+}
+
+void CallbackProfiler::reset()
+{
+    collect();
+
+    for (auto& histogram : histograms)
+        histogram.fill(0);
+
+    recent.clear();
+    nextRecent = 0;
+    numBlocks = 0;
+    numOverruns = numLate = numDecksSeen = 0;
+    droppedRecords.store(0);
+}
+
+std::vector<CallbackProfiler::BlockReport> CallbackProfiler::getWorstRecentBlocks(int maxNumber) const
+{
+    auto worst = recent;
+    const auto count = (size_t)juce::jlimit(0, (int)worst.size(), maxNumber);
+
+    std::partial_sort(worst.begin(), worst.begin() + (std::ptrdiff_t)count, worst.end(),
+        [](const BlockReport& a, const BlockReport& b) { return a.getLoad() > b.getLoad(); });
+
+    worst.resize(count);
+    return worst;
+}
+
+juce::String CallbackProfiler::BlockReport::toString() const
+{
+    juce::String text;
+    text << juce::String(totalMs, 3) << " of " << juce::String(deadlineMs, 2) << " ms"
+         << (overrun ? " OVERRUN" : "") << (late ? " LATE" : "");
+
+    for (int d = 0; d < numDecks; ++d)
+        text << " | deck " << (d + 1) << ": stream " << juce::String(streamMs[d], 3)
+             << " dsp " << juce::String(dspMs[d], 3) << " total " << juce::String(deckMs[d], 3);
+
+    text << " | mix " << juce::String(mixMs, 3);
+    return text;
+}
+
+juce::String CallbackProfiler::createReport() const
+{
+    juce::String report;
+    report << "Audio callbacks: " << numBlocks << ", overruns: " << numOverruns << ", late callbacks: " << numLate
+           << ", dropped records: " << getNumDroppedRecords() << "\n";
+
+    auto describeHistogram = [](const std::array<int, numHistogramBins>& histogram)
+        {
+            juce::String line;
+            for (int bin = 0; bin < numHistogramBins; ++bin)
+                if (histogram[(size_t)bin] > 0)
+                    line << " " << (bin < numHistogramBins - 1 ? juce::String(bin * 5) + "%" : ">100%") << ":" << histogram[(size_t)bin];
+
+            return line;
+        };
+
+    for (int d = 0; d < numDecksSeen; ++d)
+        report << "Deck " << (d + 1) << " load:" << describeHistogram(histograms[(size_t)d]) << "\n";
+
+    report << "Callback load:" << describeHistogram(histograms[maxDecks]) << "\n";
+    report << "Worst recent blocks:\n";
+
+    for (auto& block : getWorstRecentBlocks(10))
+        report << "  " << block.toString() << "\n";
+
+    return report;
+}
+
+bool CallbackProfiler::writeReport(const juce::File& file) const
+{
+    return file.replaceWithText(createReport());
+}
@@ -0,0 +1,131 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "LockFreeQueue.h"
+
+// Per-block timing of the audio callback, split into stages: for each deck the stream
+// (looper, read-ahead and decoder), the speed DSP (time-stretch and resampler) and the rest
+// of the deck; then the mixer. Stages are timed with the CPU's cycle counter.
+//
+// The audio thread fills one record per callback and pushes it into a lock-free queue; it never
+// allocates or locks, and a full queue just drops the record (and counts it). The message
+// thread drains the queue with collect() into histograms, a window of recent blocks and xrun
+// counts for the overlay or a report file.
+class CallbackProfiler
+{
+public:
+    using Cycles = juce::uint64;
+
+    // One per DeckEngine deck (checked there)
+    static constexpr int maxDecks = 32;
+
+    // Histogram bins are 5% of the block deadline wide; the last one collects everything over 100%
+    static constexpr int numHistogramBins = 21;
+
+    CallbackProfiler();
+    ~CallbackProfiler() = default;
+
+    // Raw cycle counter: TSC on x86, the virtual counter on ARM64, the high-resolution clock elsewhere
+    static Cycles now() noexcept;
+
+    // Measured once, on first use
+    static double getCyclesPerSecond();
+    static double cyclesToMilliseconds(Cycles cycles) { return (double)cycles * 1000.0 / getCyclesPerSecond(); }
+
+    // What one deck spent on one block, in cycles
+    struct DeckStages
+    {
+        juce::uint32 stream = 0;
+        juce::uint32 dsp = 0;
+        juce::uint32 total = 0;
+
+        DeckStages& operator+=(const DeckStages& other) noexcept
+        {
+            stream += other.stream;
+            dsp += other.dsp;
+            total += other.total;
+            return *this;
+        }
+    };
+
+    // ===== Audio thread =====
+    void beginBlock(int numSamples, double sampleRate) noexcept;
+    void addDeck(int deck, const DeckStages& stages) noexcept;
+    void addMix(Cycles cycles) noexcept;
+    void endBlock() noexcept;
+
+    // ===== Message thread =====
+    struct BlockReport
+    {
+        double deadlineMs = 0.0;
+        double totalMs = 0.0;
+        double mixMs = 0.0;
+        double gapMs = 0.0;     // since the previous callback started
+
+        int numDecks = 0;
+        double streamMs[maxDecks] = {};
+        double dspMs[maxDecks] = {};
+        double deckMs[maxDecks] = {};
+
+        // Processing took longer than the block lasts
+        bool overrun = false;
+
+        // The device called us well after the previous block ran out (a dropout upstream of us)
+        bool late = false;
+
+        double getLoad() const { return deadlineMs > 0.0 ? totalMs / deadlineMs : 0.0; }
+        juce::String toString() const;
+    };
+
+    // Moves everything the audio thread has recorded into the statistics below
+    void collect();
+    void reset();
+
+    // Callbacks seen since the last reset, and the xruns among them
+    juce::int64 getNumBlocks() const { return numBlocks; }
+    int getNumOverruns() const { return numOverruns; }
+    int getNumLateCallbacks() const { return numLate; }
+    int getNumDroppedRecords() const { return droppedRecords.load(); }
+
+    // Deck totals (and, at index maxDecks, whole callbacks) as a share of the deadline
+    const std::array<int, numHistogramBins>& getHistogram(int deckOrCallback) const { return histograms[(size_t)deckOrCallback]; }
+    int getNumDecksSeen() const { return numDecksSeen; }
+
+    // The slowest blocks (relative to their deadline) among the most recent ones, slowest first
+    std::vector<BlockReport> getWorstRecentBlocks(int maxNumber) const;
+
+    juce::String createReport() const;
+    bool writeReport(const juce::File& file) const;
+
+private:
+    struct Record
+    {
+        Cycles start = 0;
+        Cycles end = 0;
+        Cycles previousStart = 0;
+        juce::uint32 mix = 0;
+        int numSamples = 0;
+        double sampleRate = 0.0;
+
+        int numDecks = 0;
+        DeckStages decks[maxDecks];
+    };
+
+    static constexpr int recentWindow = 2048;
+
+    // ===== Audio thread =====
+    LockFreeQueue<Record> records{ 512 };
+    Record current;
+    Cycles lastStart = 0;
+    std::atomic<int> droppedRecords{ 0 };
+
+    // ===== Message thread =====
+    std::array<std::array<int, numHistogramBins>, maxDecks + 1> histograms{};
+    std::vector<BlockReport> recent;
+    size_t nextRecent = 0;
+    juce::int64 numBlocks = 0;
+    int numOverruns = 0;
+    int numLate = 0;
+    int numDecksSeen = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CallbackProfiler)
+};
@@ -0,0 +1,341 @@
+﻿#include "DeckEngine.h"
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace
+{
+    // Tells the core we are busy-waiting, so a hyper-threaded sibling gets the pipeline
+    inline void cpuRelax() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #elif JUCE_ARM && !JUCE_MSVC
+        asm volatile("yield");
+       #endif
+    }
+}
+
+// ===== Worker =====
+class DeckEngine::Worker : public juce::Thread
+{
+public:
+    Worker(DeckEngine& ownerEngine, int core)
+        : juce::Thread("Deck Worker " + juce::String(core)),
+        owner(ownerEngine)
+    {
+        setAffinityMask((juce::uint32)1 << (core % 32));
+        // Without permission for real-time scheduling, settle for the highest normal priority
+        if (!startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(9)))
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        wake.signal();
+        stopThread(2000);
+    }
+
+    // Audio thread: wakes the worker if it has parked. Workers spin through whole blocks while
+    // the device runs, so this only signals (a lock) on the first block after a pause.
+    void notifyBlock()
+    {
+        if (parked.exchange(false))
+            wake.signal();
+    }
+
+private:
+    void run() override
+    {
+        const double cyclesPerSecond = CallbackProfiler::getCyclesPerSecond();
+        auto spinCycles = (CallbackProfiler::Cycles)(owner.workerSpinSeconds.load() * cyclesPerSecond);
+        auto seen = owner.blockGeneration.load(std::memory_order_acquire);
+        auto lastWork = CallbackProfiler::now();
+
+        while (!threadShouldExit())
+        {
+            const auto generation = owner.blockGeneration.load(std::memory_order_acquire);
+
+            if (generation != seen)
+            {
+                seen = generation;
+
+                {
+                    // The decks a worker renders are held to the same rules as the audio thread's
+                    const RealtimeGuard::ScopedRealtimeSection realtime;
+                    while (owner.renderNextJob(true)) {}
+                }
+
+                spinCycles = (CallbackProfiler::Cycles)(owner.workerSpinSeconds.load() * cyclesPerSecond);
+                lastWork = CallbackProfiler::now();
+                continue;
+            }
+
+            if (CallbackProfiler::now() - lastWork < spinCycles)
+            {
+                cpuRelax();
+                continue;
+            }
+
+            // Park; the audio thread checks the flag after publishing, so either we see the
+            // new block here or it sees us parked and signals
+            parked.store(true);
+
+            if (owner.blockGeneration.load() == seen)
+                wake.wait(50);
+
+            parked.store(false);
+            lastWork = CallbackProfiler::now();
+        }
+    }
+
+    DeckEngine& owner;
+    juce::WaitableEvent wake;
+    std::atomic<bool> parked{ false };
+};
+
+// ===== Engine =====
+DeckEngine::DeckEngine(int numWorkers)
+{
+    const int numCpus = juce::SystemStats::getNumCpus();
+    if (numWorkers < 0)
+        numWorkers = getDefaultNumWorkers();
+
+    // Core 0 is left to the device's own callback thread
+    for (int i = 0; i < numWorkers; ++i)
+        workers.add(new Worker(*this, 1 + i % juce::jmax(1, numCpus - 1)));
+}
+
+DeckEngine::~DeckEngine()
+{
+    workers.clear();
+}
+
+int DeckEngine::getDefaultNumWorkers()
+{
+    return juce::jlimit(0, maxDecks - 1, juce::SystemStats::getNumCpus() - 1);
+}
+
+// ===== Message thread =====
+int DeckEngine::addDeck(PlayerAudio& deck)
+{
+    RealtimeGuard::assertNotRealtime("DeckEngine::addDeck");
+    const juce::ScopedLock sl(listLock);
+
+    if (decks.contains(&deck) || decks.size() >= maxDecks)
+        return decks.contains(&deck) ? deckInputs[decks.indexOf(&deck)] : -1;
+
+    // The lowest mix bus input nobody is using
+    int input = 0;
+    while (deckInputs.contains(input))
+        ++input;
+
+    mixBus.setInputGain(input, 1.0f);
+    mixBus.setInputPan(input, 0.0f);
+
+    if (preparedBlockSize > 0)
+        deck.prepareToPlay(preparedBlockSize, preparedSampleRate);
+
+    decks.add(&deck);
+    deckInputs.add(input);
+    publish(sl);
+    return input;
+}
+
+void DeckEngine::removeDeck(PlayerAudio& deck)
+{
+    RealtimeGuard::assertNotRealtime("DeckEngine::removeDeck");
+    juce::uint32 generation = 0;
+
+    {
+        const juce::ScopedLock sl(listLock);
+        const int index = decks.indexOf(&deck);
+
+        if (index < 0)
+            return;
+
+        decks.remove(index);
+        deckInputs.remove(index);
+        publish(sl);
+        generation = listGeneration;
+    }
+
+    // Once the audio thread has switched lists (or stopped calling us) it cannot be using the deck
+    const auto deadline = juce::Time::getMillisecondCounter() + 2000;
+
+    while (running.load() && appliedGeneration.load() < generation)
+    {
+        if (juce::Time::getMillisecondCounter() > deadline)
+        {
+            jassertfalse;   // the device has stalled without releasing the engine
+            break;
+        }
+
+        juce::Thread::sleep(1);
+    }
+}
+
+int DeckEngine::getNumDecks() const
+{
+    const juce::ScopedLock sl(listLock);
+    return decks.size();
+}
+
+void DeckEngine::publish(const juce::ScopedLock&)
+{
+    DeckList list;
+    list.generation = ++listGeneration;
+    list.numDecks = decks.size();
+
+    for (int i = 0; i < decks.size(); ++i)
+    {
+        list.decks[i] = decks.getUnchecked(i);
+        list.inputs[i] = deckInputs.getUnchecked(i);
+    }
+
+    // A full queue means the audio thread has not run for a while; give it a moment
+    while (running.load() && !pendingLists.push(list))
+        juce::Thread::sleep(1);
+
+    // Nobody is rendering, so the list can be swapped in directly
+    if (!running.load())
+    {
+        DeckList stale;
+        while (pendingLists.pop(stale)) {}
+
+        active = list;
+        appliedGeneration.store(list.generation);
+    }
+}
+
+// ===== Audio thread =====
+void DeckEngine::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    const juce::ScopedLock sl(listLock);
+
+    preparedBlockSize = samplesPerBlockExpected;
+    preparedSampleRate = sampleRate;
+
+    // Long enough to span the gap between two callbacks, so a running device never has to wake a worker
+    workerSpinSeconds.store(juce::jmax(minWorkerSpinSeconds, 2.0 * samplesPerBlockExpected / juce::jmax(1.0, sampleRate)));
+
+    for (auto* deck : decks)
+        deck->prepareToPlay(samplesPerBlockExpected, sampleRate);
+
+    mixBus.prepare(maxDecks, 2, samplesPerBlockExpected);
+
+    running.store(false);
+    publish(sl);
+    running.store(true);
+}
+
+void DeckEngine::releaseResources()
+{
+    const juce::ScopedLock sl(listLock);
+    running.store(false);
+    workerSpinSeconds.store(minWorkerSpinSeconds);
+
+    for (auto* deck : decks)
+        deck->releaseResources();
+
+    mixBus.release();
+    preparedBlockSize = 0;
+}
+
+void DeckEngine::render(const juce::AudioSourceChannelInfo& bufferToFill, CallbackProfiler* profiler)
+{
+    DeckList list;
+    while (pendingLists.pop(list))
+    {
+        active = list;
+        appliedGeneration.store(list.generation);
+    }
+
+    if (mixBus.getMaxBlockSize() <= 0)
+    {
+        bufferToFill.clearActiveBufferRegion();
+        return;
+    }
+
+    // The device can hand us more than the expected block size, so render in bus-sized chunks
+    for (int offset = 0; offset < bufferToFill.numSamples;)
+    {
+        const int numSamples = juce::jmin(bufferToFill.numSamples - offset, mixBus.getMaxBlockSize());
+
+        renderChunk(numSamples);
+
+        if (profiler != nullptr)
+            for (int i = 0; i < active.numDecks; ++i)
+                profiler->addDeck(active.inputs[i], active.decks[i]->getLastStages());
+
+        const auto mixStart = CallbackProfiler::now();
+        mixBus.mixInto(juce::AudioSourceChannelInfo(bufferToFill.buffer, bufferToFill.startSample + offset, numSamples));
+
+        if (profiler != nullptr)
+            profiler->addMix(CallbackProfiler::now() - mixStart);
+
+        offset += numSamples;
+    }
+}
+
+void DeckEngine::renderChunk(int numSamples)
+{
+    const int numJobs = active.numDecks;
+
+    for (int i = 0; i < numJobs; ++i)
+    {
+        jobDecks[i] = active.decks[i];
+        jobs[i] = mixBus.getInputChannelInfo(active.inputs[i], numSamples);
+    }
+
+    // Synced decks read their leaders while no deck is rendering
+    for (int i = 0; i < numJobs; ++i)
+        jobDecks[i]->followSyncLeader();
+
+    const int numHelpers = parallel.load(std::memory_order_relaxed) ? juce::jmin(workers.size(), numJobs - 1) : 0;
+
+    // ===== Fork =====
+    jobsRemaining.store(numJobs, std::memory_order_relaxed);
+    jobsToClaim.store(numJobs, std::memory_order_release);
+
+    if (numHelpers > 0)
+    {
+        blockGeneration.fetch_add(1);
+
+        for (int i = 0; i < numHelpers; ++i)
+            workers.getUnchecked(i)->notifyBlock();
+    }
+
+    while (renderNextJob()) {}
+
+    // ===== Join =====
+    while (jobsRemaining.load(std::memory_order_acquire) > 0)
+        cpuRelax();
+}
+
+// Claims and renders one deck of the current block; false once every deck has been claimed.
+// The index comes from the counter alone, so a worker still looking at the previous block
+// can never claim a job from a table that is being rewritten.
+bool DeckEngine::renderNextJob(bool onWorker)
+{
+    const int job = jobsToClaim.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (job < 0)
+        return false;
+
+    const auto allocationsBefore = onWorker ? RealtimeGuard::getAllocationCountForThisThread() : 0;
+
+    jobDecks[job]->getNextAudioBlock(jobs[job]);
+
+    // Counted before the job is marked done, so the total is complete once the block has joined
+    if (onWorker)
+        workerAllocations.fetch_add(RealtimeGuard::getAllocationCountForThisThread() - allocationsBefore, std::memory_order_relaxed);
+
+    jobsRemaining.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "PlayerAudio.h"
+#include "MixBus.h"
+#include "LockFreeQueue.h"
+#include "CallbackProfiler.h"
+
+// Renders any number of decks into the master bus, spreading them over worker threads.
+//
+// Decks are added and removed on the message thread; the audio thread picks up a new deck
+// list (a fixed-size snapshot, so nothing is allocated or freed) at the start of its next
+// callback. Each deck keeps a stable mix bus input for its whole life.
+//
+// At each callback the audio thread publishes the block (fork) and then takes decks off a
+// shared atomic counter alongside the workers, so any deck a worker has not claimed yet is
+// simply rendered by the audio thread itself. It then spins until the claimed decks are done
+// (join) and mixes. Workers are real-time threads, one pinned per spare core. Between blocks
+// they spin for two block periods, so while the device runs they keep their cores and are
+// always waiting when the next block is published. They park only once callbacks stop, and
+// waking a parked worker (a WaitableEvent signal, the one step that is not lock-free) happens
+// only on the first block after that; the audio thread never waits for it. Workers render
+// inside a RealtimeGuard section like the audio thread. Synced decks take their tempo and
+// phase from their leaders just before the fork, while every deck is between blocks.
+class DeckEngine
+{
+public:
+    static constexpr int maxDecks = 32;
+    static_assert(maxDecks == CallbackProfiler::maxDecks, "the profiler must have room for every deck");
+
+    // numWorkers < 0 uses one per spare core
+    explicit DeckEngine(int numWorkers = -1);
+    ~DeckEngine();
+
+    static int getDefaultNumWorkers();
+
+    // ===== Message thread =====
+    // Prepares the deck for the current device and hands it to the audio thread.
+    // Returns its mix bus input, or -1 if the engine is full.
+    int addDeck(PlayerAudio& deck);
+
+    // Blocks until the audio thread has let go of the deck, after which it may be deleted
+    void removeDeck(PlayerAudio& deck);
+
+    int getNumDecks() const;
+    int getNumWorkers() const { return workers.size(); }
+
+    // Off renders every deck on the audio thread, one after the other
+    void setParallel(bool shouldRenderInParallel) { parallel.store(shouldRenderInParallel); }
+    bool isParallel() const { return parallel.load(); }
+
+    MixBus& getMixBus() { return mixBus; }
+
+    // Heap allocations made by the worker threads while rendering decks, since construction
+    // (the audio thread's own show up in RealtimeGuard::getAllocationCountForThisThread)
+    juce::int64 getWorkerAllocationCount() const { return workerAllocations.load(); }
+
+    // ===== Audio thread =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
+    void releaseResources();
+
+    // Renders every deck and overwrites the destination with the mix.
+    // The profiler, if given, gets each deck's stage timings by mix bus input.
+    void render(const juce::AudioSourceChannelInfo& bufferToFill, CallbackProfiler* profiler = nullptr);
+
+private:
+    class Worker;
+
+    struct DeckList
+    {
+        juce::uint32 generation = 0;
+        int numDecks = 0;
+        PlayerAudio* decks[maxDecks] = {};
+        int inputs[maxDecks] = {};
+    };
+
+    void publish(const juce::ScopedLock&);
+    void renderChunk(int numSamples);
+    bool renderNextJob(bool onWorker = false);
+
+    // How long an idle worker keeps spinning for the next block before it parks
+    static constexpr double minWorkerSpinSeconds = 0.0005;
+
+    // ===== Message thread =====
+    juce::CriticalSection listLock;
+    juce::Array<PlayerAudio*> decks;
+    juce::Array<int> deckInputs;
+    juce::uint32 listGeneration = 0;
+    int preparedBlockSize = 0;
+    double preparedSampleRate = 0.0;
+
+    // ===== Shared =====
+    LockFreeQueue<DeckList> pendingLists{ 16 };
+    std::atomic<juce::uint32> appliedGeneration{ 0 };
+    std::atomic<bool> running{ false };
+    std::atomic<bool> parallel{ true };
+    std::atomic<double> workerSpinSeconds{ minWorkerSpinSeconds };
+    std::atomic<juce::int64> workerAllocations{ 0 };
+
+    // ===== Audio thread =====
+    DeckList active;
+    MixBus mixBus;
+
+    // ===== Current block (written by the audio thread before each fork) =====
+    juce::AudioSourceChannelInfo jobs[maxDecks];
+    PlayerAudio* jobDecks[maxDecks] = {};
+    std::atomic<int> jobsToClaim{ 0 };
+    std::atomic<int> jobsRemaining{ 0 };
+    std::atomic<juce::uint32> blockGeneration{ 0 };
+
+    juce::OwnedArray<Worker> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DeckEngine)
+};
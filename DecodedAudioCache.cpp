@@ -0,0 +1,247 @@
+﻿#include "DecodedAudioCache.h"
+#include "RealtimeGuard.h"
+
+// ===== Page =====
+DecodedAudioCache::Page::Page(const juce::AudioBuffer<float>& source, int length, bool storeCompact)
+    : numChannels(source.getNumChannels()),
+    numSamples(length),
+    compact(storeCompact)
+{
+    const auto total = (size_t)numChannels * (size_t)numSamples;
+
+    if (compact)
+    {
+        compactData.allocate(total, false);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const auto* src = source.getReadPointer(ch);
+            auto* dest = compactData.get() + (size_t)ch * (size_t)numSamples;
+
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = (juce::int16)juce::jlimit(-32768, 32767, juce::roundToInt(src[i] * 32767.0f));
+        }
+
+        sizeInBytes = total * sizeof(juce::int16);
+    }
+    else
+    {
+        floatData.allocate(total, false);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::copy(floatData.get() + (size_t)ch * (size_t)numSamples, source.getReadPointer(ch), numSamples);
+
+        sizeInBytes = total * sizeof(float);
+    }
+}
+
+void DecodedAudioCache::Page::copyTo(int channel, int offset, float* dest, int numToCopy) const noexcept
+{
+    const auto start = (size_t)channel * (size_t)numSamples + (size_t)offset;
+
+    if (compact)
+    {
+        const auto* src = compactData.get() + start;
+        for (int i = 0; i < numToCopy; ++i)
+            dest[i] = (float)src[i] * (1.0f / 32767.0f);
+    }
+    else
+    {
+        juce::FloatVectorOperations::copy(dest, floatData.get() + start, numToCopy);
+    }
+}
+
+// ===== DecodedAudioCache =====
+juce::String DecodedAudioCache::Statistics::toString() const
+{
+    return juce::String::formatted("%d pages, %.1f / %.1f MB, hits %lld, misses %lld (%.1f%%), evictions %lld",
+        numPages, (double)bytesUsed / (1024.0 * 1024.0), (double)budgetBytes / (1024.0 * 1024.0),
+        (long long)hits, (long long)misses, getHitRate() * 100.0, (long long)evictions);
+}
+
+void DecodedAudioCache::setBudgetBytes(juce::int64 bytes)
+{
+    budgetBytes.store(juce::jmax((juce::int64)0, bytes));
+
+    const juce::ScopedLock sl(lock);
+    evictToBudget();
+}
+
+juce::String DecodedAudioCache::getKeyFor(const juce::File& file)
+{
+    return file.getFullPathName()
+        + "|" + juce::String(file.getSize())
+        + "|" + juce::String(file.getLastModificationTime().toMilliseconds());
+}
+
+juce::String DecodedAudioCache::makePageKey(const juce::String& fileKey, juce::int64 pageIndex)
+{
+    return fileKey + "#" + juce::String(pageIndex);
+}
+
+DecodedAudioCache::Page::Ptr DecodedAudioCache::find(const juce::String& fileKey, juce::int64 pageIndex)
+{
+    const juce::ScopedLock sl(lock);
+    const auto it = pages.find(makePageKey(fileKey, pageIndex));
+
+    if (it == pages.end())
+    {
+        ++misses;
+        return nullptr;
+    }
+
+    ++hits;
+    lru.splice(lru.begin(), lru, it->second.lruPosition);
+    return it->second.page;
+}
+
+DecodedAudioCache::Page::Ptr DecodedAudioCache::insert(const juce::String& fileKey, juce::int64 pageIndex,
+    const juce::AudioBuffer<float>& decoded, int numSamples)
+{
+    RealtimeGuard::assertNotRealtime("DecodedAudioCache::insert");
+
+    // Built outside the lock; converting a page takes a moment
+    Page::Ptr page = new Page(decoded, numSamples, compactStorage.load());
+    const auto key = makePageKey(fileKey, pageIndex);
+
+    const juce::ScopedLock sl(lock);
+
+    if (!isEnabled())
+        return page;
+
+    const auto it = pages.find(key);
+    if (it != pages.end())
+        return it->second.page;
+
+    lru.push_front(key);
+    pages[key] = { page, lru.begin() };
+    bytesUsed += (juce::int64)page->getSizeInBytes();
+
+    evictToBudget();
+    return page;
+}
+
+// Drops least recently used pages; readers still copying from one keep it alive until they finish
+void DecodedAudioCache::evictToBudget()
+{
+    const auto budget = budgetBytes.load();
+
+    while (bytesUsed > budget && !lru.empty())
+    {
+        const auto it = pages.find(lru.back());
+
+        if (it != pages.end())
+        {
+            bytesUsed -= (juce::int64)it->second.page->getSizeInBytes();
+            pages.erase(it);
+            ++evictions;
+        }
+
+        lru.pop_back();
+    }
+}
+
+DecodedAudioCache::Statistics DecodedAudioCache::getStatistics() const
+{
+    const juce::ScopedLock sl(lock);
+
+    Statistics s;
+    s.hits = hits;
+    s.misses = misses;
+    s.evictions = evictions;
+    s.bytesUsed = bytesUsed;
+    s.budgetBytes = budgetBytes.load();
+    s.numPages = (int)pages.size();
+    return s;
+}
+
+void DecodedAudioCache::resetStatistics()
+{
+    const juce::ScopedLock sl(lock);
+    hits = misses = evictions = 0;
+}
+
+void DecodedAudioCache::clear()
+{
+    const juce::ScopedLock sl(lock);
+    pages.clear();
+    lru.clear();
+    bytesUsed = 0;
+}
+
+// ===== CachingAudioFormatReader =====
+CachingAudioFormatReader::CachingAudioFormatReader(juce::AudioFormatReader* sourceReader, const juce::String& key, DecodedAudioCache& c)
+    : juce::AudioFormatReader(nullptr, sourceReader->getFormatName()),
+    source(sourceReader),
+    fileKey(key),
+    cache(c)
+{
+    sampleRate = source->sampleRate;
+    bitsPerSample = 32;
+    lengthInSamples = source->lengthInSamples;
+    numChannels = source->numChannels;
+    usesFloatingPointData = true;
+    metadataValues = source->metadataValues;
+
+    decodeBuffer.setSize((int)numChannels, DecodedAudioCache::pageLength);
+}
+
+DecodedAudioCache::Page::Ptr CachingAudioFormatReader::getPage(juce::int64 pageIndex)
+{
+    if (pageIndex == lastPageIndex)
+        return lastPage;
+
+    auto page = cache.find(fileKey, pageIndex);
+
+    if (page == nullptr)
+    {
+        const auto start = pageIndex * DecodedAudioCache::pageLength;
+        const int num = (int)juce::jmin((juce::int64)DecodedAudioCache::pageLength, lengthInSamples - start);
+
+        decodeBuffer.clear();
+        source->read(&decodeBuffer, 0, num, start, true, true);
+        page = cache.insert(fileKey, pageIndex, decodeBuffer, num);
+    }
+
+    lastPage = page;
+    lastPageIndex = pageIndex;
+    return page;
+}
+
+bool CachingAudioFormatReader::readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+    juce::int64 startSampleInFile, int numSamples)
+{
+    clearSamplesBeyondAvailableLength(destChannels, numDestChannels, startOffsetInDestBuffer,
+        startSampleInFile, numSamples, lengthInSamples);
+
+    while (numSamples > 0)
+    {
+        const auto pageIndex = startSampleInFile / DecodedAudioCache::pageLength;
+        const int offset = (int)(startSampleInFile - pageIndex * DecodedAudioCache::pageLength);
+
+        const auto page = getPage(pageIndex);
+        const int num = juce::jmin(numSamples, page->getNumSamples() - offset);
+
+        if (num <= 0)
+            break;
+
+        for (int ch = 0; ch < numDestChannels; ++ch)
+        {
+            // Float readers hand their samples back through the int pointers
+            auto* dest = reinterpret_cast<float*>(destChannels[ch]);
+            if (dest == nullptr)
+                continue;
+
+            if (ch < page->getNumChannels())
+                page->copyTo(ch, offset, dest + startOffsetInDestBuffer, num);
+            else
+                juce::FloatVectorOperations::clear(dest + startOffsetInDestBuffer, num);
+        }
+
+        startOffsetInDestBuffer += num;
+        startSampleInFile += num;
+        numSamples -= num;
+    }
+
+    return true;
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Process-wide cache of decoded audio, shared by every deck.
+// Files are cut into fixed-size pages of decoded PCM that are immutable once built, so any
+// number of readers can share them. The least recently used pages are dropped when the
+// total goes over the memory budget. Pages can be stored as 16-bit to double what fits.
+// Used from the loader and disk threads only, never from the audio callback.
+class DecodedAudioCache
+{
+public:
+    static constexpr int pageLength = 32768;   // sample frames per page
+
+    class Page : public juce::ReferenceCountedObject
+    {
+    public:
+        using Ptr = juce::ReferenceCountedObjectPtr<Page>;
+
+        Page(const juce::AudioBuffer<float>& source, int numSamples, bool compact);
+
+        int getNumChannels() const noexcept { return numChannels; }
+        int getNumSamples() const noexcept { return numSamples; }
+        size_t getSizeInBytes() const noexcept { return sizeInBytes; }
+
+        // Converts numToCopy samples of one channel starting at offset into dest
+        void copyTo(int channel, int offset, float* dest, int numToCopy) const noexcept;
+
+    private:
+        const int numChannels;
+        const int numSamples;
+        const bool compact;
+        size_t sizeInBytes = 0;
+        juce::HeapBlock<float> floatData;
+        juce::HeapBlock<juce::int16> compactData;
+
+        JUCE_DECLARE_NON_COPYABLE(Page)
+    };
+
+    struct Statistics
+    {
+        juce::int64 hits = 0;
+        juce::int64 misses = 0;
+        juce::int64 evictions = 0;
+        juce::int64 bytesUsed = 0;
+        juce::int64 budgetBytes = 0;
+        int numPages = 0;
+
+        double getHitRate() const { return hits + misses > 0 ? (double)hits / (double)(hits + misses) : 0.0; }
+        juce::String toString() const;
+    };
+
+    DecodedAudioCache() = default;
+
+    // 0 disables caching; shrinking the budget evicts straight away
+    void setBudgetBytes(juce::int64 bytes);
+    juce::int64 getBudgetBytes() const { return budgetBytes.load(); }
+    bool isEnabled() const { return budgetBytes.load() > 0; }
+
+    // Pages decoded from now on are stored as 16-bit integers
+    void setCompactStorage(bool shouldBeCompact) { compactStorage.store(shouldBeCompact); }
+    bool isCompactStorage() const { return compactStorage.load(); }
+
+    // Identifies a file's contents: path, size and modification time
+    static juce::String getKeyFor(const juce::File& file);
+
+    // Returns the page (marking it recently used), or nullptr on a miss
+    Page::Ptr find(const juce::String& fileKey, juce::int64 pageIndex);
+
+    // Stores a freshly decoded page; returns the one to use (an existing copy if another reader won the race)
+    Page::Ptr insert(const juce::String& fileKey, juce::int64 pageIndex, const juce::AudioBuffer<float>& decoded, int numSamples);
+
+    Statistics getStatistics() const;
+    void resetStatistics();
+    void clear();
+
+private:
+    struct Entry
+    {
+        Page::Ptr page;
+        std::list<juce::String>::iterator lruPosition;
+    };
+
+    static juce::String makePageKey(const juce::String& fileKey, juce::int64 pageIndex);
+    void evictToBudget();
+
+    mutable juce::CriticalSection lock;
+    std::unordered_map<juce::String, Entry> pages;
+    std::list<juce::String> lru;   // most recently used at the front
+    juce::int64 bytesUsed = 0;
+
+    std::atomic<juce::int64> budgetBytes{ (juce::int64)512 * 1024 * 1024 };
+    std::atomic<bool> compactStorage{ false };
+    juce::int64 hits = 0, misses = 0, evictions = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DecodedAudioCache)
+};
+
+
+// Reader that serves samples from a DecodedAudioCache, decoding whole pages through the
+// wrapped reader on a miss. Reports float data at the source's rate, length and layout.
+class CachingAudioFormatReader : public juce::AudioFormatReader
+{
+public:
+    CachingAudioFormatReader(juce::AudioFormatReader* sourceReader, const juce::String& fileKey, DecodedAudioCache& cache);
+    ~CachingAudioFormatReader() override = default;
+
+    bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+        juce::int64 startSampleInFile, int numSamples) override;
+
+private:
+    DecodedAudioCache::Page::Ptr getPage(juce::int64 pageIndex);
+
+    std::unique_ptr<juce::AudioFormatReader> source;
+    const juce::String fileKey;
+    DecodedAudioCache& cache;
+    juce::AudioBuffer<float> decodeBuffer;
+
+    // Sequential reads mostly stay within one page, so skip the cache lookup for it
+    DecodedAudioCache::Page::Ptr lastPage;
+    juce::int64 lastPageIndex = -1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CachingAudioFormatReader)
+};
@@ -0,0 +1,126 @@
+﻿#include "HotCueStore.h"
+#include "IndexFile.h"
+
+HotCueStore::HotCueStore()
+    : indexFile(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("HotCues.index"))
+{
+    load();
+}
+
+HotCueStore::~HotCueStore()
+{
+    if (dirty && !save())
+        DBG("HotCueStore: could not save " << indexFile.getFullPathName());
+}
+
+std::vector<HotCue> HotCueStore::getCues(const juce::File& file) const
+{
+    const juce::ScopedLock sl(lock);
+
+    const auto found = cuesByPath.find(file.getFullPathName());
+    return found != cuesByPath.end() ? found->second : std::vector<HotCue>();
+}
+
+void HotCueStore::setCues(const juce::File& file, std::vector<HotCue> cues)
+{
+    std::stable_sort(cues.begin(), cues.end(), [](const HotCue& a, const HotCue& b) { return a.frame < b.frame; });
+    cues.erase(std::unique(cues.begin(), cues.end(), [](const HotCue& a, const HotCue& b) { return a.frame == b.frame; }),
+        cues.end());
+
+    if ((int)cues.size() > maxCuesPerFile)
+        cues.resize((size_t)maxCuesPerFile);
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (cues.empty())
+            cuesByPath.erase(file.getFullPathName());
+        else
+            cuesByPath[file.getFullPathName()] = std::move(cues);
+
+        dirty = true;
+    }
+
+    // A few bytes per cue, and only written when the user edits one
+    if (save())
+    {
+        const juce::ScopedLock sl(lock);
+        dirty = false;
+    }
+    else
+    {
+        DBG("HotCueStore: could not save " << indexFile.getFullPathName());
+    }
+}
+
+int HotCueStore::getNumFiles() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int)cuesByPath.size();
+}
+
+// ===== Persistence =====
+// IndexFile header, file count, then per file: path, cue count and each cue's frame and name
+bool HotCueStore::load()
+{
+    std::unordered_map<juce::String, std::vector<HotCue>> loaded;
+
+    const bool read = IndexFile::read(indexFile, indexMagic, indexVersion, indexVersion, [&](juce::InputStream& in, int)
+        {
+            const int numFiles = in.readCompressedInt();
+            if (numFiles < 0)
+                return false;
+
+            loaded.reserve((size_t)numFiles);
+
+            for (int i = 0; i < numFiles && !in.isExhausted(); ++i)
+            {
+                const auto path = in.readString();
+                const int numCues = in.readCompressedInt();
+
+                if (numCues < 0 || numCues > maxCuesPerFile)
+                    return false;
+
+                std::vector<HotCue> cues((size_t)numCues);
+
+                for (auto& cue : cues)
+                {
+                    cue.frame = in.readInt64();
+                    cue.name = in.readString();
+                }
+
+                loaded[path] = std::move(cues);
+            }
+
+            return (int)loaded.size() == numFiles;
+        });
+
+    if (!read)
+        return false;
+
+    const juce::ScopedLock sl(lock);
+    cuesByPath = std::move(loaded);
+    return true;
+}
+
+bool HotCueStore::save() const
+{
+    return IndexFile::write(indexFile, indexMagic, indexVersion, [this](juce::OutputStream& out)
+        {
+            const juce::ScopedLock sl(lock);
+            out.writeCompressedInt((int)cuesByPath.size());
+
+            for (const auto& entry : cuesByPath)
+            {
+                out.writeString(entry.first);
+                out.writeCompressedInt((int)entry.second.size());
+
+                for (const auto& cue : entry.second)
+                {
+                    out.writeInt64(cue.frame);
+                    out.writeString(cue.name);
+                }
+            }
+        });
+}
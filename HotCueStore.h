@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// A cue point: a sample frame in the track's own sample rate, and an optional name
+struct HotCue
+{
+    juce::int64 frame = 0;
+    juce::String name;
+};
+
+
+// Every file's hot cues, shared by every deck and saved next to the library index as
+// HotCues.index, keyed by the file's path. A file's cues are kept sorted by frame, at most
+// maxCuesPerFile of them. Safe to use from any thread.
+class HotCueStore
+{
+public:
+    HotCueStore();
+    ~HotCueStore();
+
+    // Sorted by frame; empty if the file has none
+    std::vector<HotCue> getCues(const juce::File& file) const;
+
+    // Replaces the file's cues (sorting them and dropping duplicate frames) and saves the store
+    void setCues(const juce::File& file, std::vector<HotCue> cues);
+
+    int getNumFiles() const;
+
+    juce::File getIndexFile() const { return indexFile; }
+
+    static constexpr int maxCuesPerFile = 32;
+
+private:
+    bool load();
+    bool save() const;
+
+    static constexpr int indexMagic = 0x43554553;  // "CUES"
+    static constexpr int indexVersion = 1;
+
+    juce::File indexFile;
+
+    mutable juce::CriticalSection lock;
+    std::unordered_map<juce::String, std::vector<HotCue>> cuesByPath;
+    bool dirty = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HotCueStore)
+};
@@ -0,0 +1,47 @@
+﻿#include "IndexFile.h"
+
+namespace IndexFile
+{
+    bool write(const juce::File& file, int magic, int version, const std::function<void(juce::OutputStream&)>& writeBody)
+    {
+        file.getParentDirectory().createDirectory();
+
+        juce::TemporaryFile temp(file);
+
+        {
+            auto out = temp.getFile().createOutputStream(1 << 16);
+            if (out == nullptr)
+                return false;
+
+            out->writeInt(magic);
+            out->writeInt(version);
+            writeBody(*out);
+
+            out->flush();
+            if (out->getStatus().failed())
+                return false;
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    bool read(const juce::File& file, int magic, int minVersion, int maxVersion,
+        const std::function<bool(juce::InputStream&, int version)>& readBody)
+    {
+        juce::FileInputStream stream(file);
+
+        if (!stream.openedOk())
+            return false;
+
+        juce::BufferedInputStream in(stream, 1 << 16);
+
+        if (in.readInt() != magic)
+            return false;
+
+        const int version = in.readInt();
+        if (version < minVersion || version > maxVersion)
+            return false;
+
+        return readBody(in, version);
+    }
+}
@@ -0,0 +1,18 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// The framing shared by the app's own binary files (library index, analysis cache, hot cues,
+// session): a magic number, a version, then whatever the owner writes after them.
+namespace IndexFile
+{
+    // Creates the folder and writes the header and writeBody's output. The file is written under
+    // a temporary name and only swapped in once complete, so a crash never leaves a truncated
+    // file behind; on failure the old file is left as it was.
+    bool write(const juce::File& file, int magic, int version, const std::function<void(juce::OutputStream&)>& writeBody);
+
+    // Checks the header and hands readBody a buffered stream just past it, with the file's
+    // version. False if the file is missing, is not this kind of file, has a version outside
+    // [minVersion, maxVersion], or readBody returns false.
+    bool read(const juce::File& file, int magic, int minVersion, int maxVersion,
+        const std::function<bool(juce::InputStream&, int version)>& readBody);
+}
@@ -0,0 +1,187 @@
+﻿#include "LibraryIndex.h"
+#include "IndexFile.h"
+
+namespace
+{
+    constexpr int indexMagic = 0x3142494c;   // "LIB1"
+    constexpr int indexVersion = 1;
+}
+
+bool TrackRecord::matches(const juce::File& file) const
+{
+    return fileSize == file.getSize()
+        && modificationTime == file.getLastModificationTime().toMilliseconds();
+}
+
+// ===== Lookup =====
+bool LibraryIndex::find(const juce::File& file, TrackRecord& result) const
+{
+    const juce::ScopedLock sl(lock);
+    const auto it = byPath.find(file.getFullPathName());
+
+    if (it == byPath.end())
+        return false;
+
+    result = records[it->second];
+    return true;
+}
+
+bool LibraryIndex::isUpToDate(const juce::File& file) const
+{
+    const juce::ScopedLock sl(lock);
+    const auto it = byPath.find(file.getFullPathName());
+    return it != byPath.end() && records[it->second].matches(file);
+}
+
+int LibraryIndex::getNumTracks() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int)records.size();
+}
+
+juce::Array<juce::File> LibraryIndex::getTracksUnder(const juce::File& root) const
+{
+    juce::StringArray paths;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        for (const auto& r : records)
+            if (r.valid && juce::File(r.path).isAChildOf(root))
+                paths.add(r.path);
+    }
+
+    paths.sortNatural();
+
+    juce::Array<juce::File> files;
+    for (const auto& p : paths)
+        files.add(juce::File(p));
+
+    return files;
+}
+
+// ===== Updates =====
+void LibraryIndex::update(const std::vector<TrackRecord>& newRecords)
+{
+    const juce::ScopedLock sl(lock);
+
+    for (const auto& r : newRecords)
+    {
+        const auto it = byPath.find(r.path);
+
+        if (it != byPath.end())
+        {
+            records[it->second] = r;
+        }
+        else
+        {
+            byPath[r.path] = records.size();
+            records.push_back(r);
+        }
+    }
+}
+
+int LibraryIndex::removeMissing(const juce::File& root, const std::unordered_set<juce::String>& seenPaths)
+{
+    const juce::ScopedLock sl(lock);
+    int removed = 0;
+
+    for (size_t i = 0; i < records.size();)
+    {
+        if (seenPaths.count(records[i].path) == 0 && juce::File(records[i].path).isAChildOf(root))
+        {
+            removeAt(i);
+            ++removed;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return removed;
+}
+
+// Swaps the last record into the gap so removal stays O(1)
+void LibraryIndex::removeAt(size_t index)
+{
+    byPath.erase(records[index].path);
+
+    if (index != records.size() - 1)
+    {
+        records[index] = std::move(records.back());
+        byPath[records[index].path] = index;
+    }
+
+    records.pop_back();
+}
+
+// ===== Persistence =====
+// IndexFile header, count, then per record: path, size, mtime, title, artist, album,
+// sample rate, length, channels and a valid flag (integers compressed, strings UTF-8)
+bool LibraryIndex::load(const juce::File& indexFile)
+{
+    std::vector<TrackRecord> loaded;
+
+    const bool read = IndexFile::read(indexFile, indexMagic, indexVersion, indexVersion, [&](juce::InputStream& in, int)
+        {
+            const int count = in.readCompressedInt();
+            if (count < 0)
+                return false;
+
+            loaded.reserve((size_t)count);
+
+            for (int i = 0; i < count && !in.isExhausted(); ++i)
+            {
+                TrackRecord r;
+                r.path = in.readString();
+                r.fileSize = in.readInt64();
+                r.modificationTime = in.readInt64();
+                r.title = in.readString();
+                r.artist = in.readString();
+                r.album = in.readString();
+                r.sampleRate = in.readDouble();
+                r.lengthInSamples = in.readInt64();
+                r.numChannels = in.readCompressedInt();
+                r.valid = in.readBool();
+                loaded.push_back(std::move(r));
+            }
+
+            return (int)loaded.size() == count;
+        });
+
+    if (!read)
+        return false;
+
+    const juce::ScopedLock sl(lock);
+    records = std::move(loaded);
+    byPath.clear();
+
+    for (size_t i = 0; i < records.size(); ++i)
+        byPath[records[i].path] = i;
+
+    return true;
+}
+
+bool LibraryIndex::save(const juce::File& indexFile) const
+{
+    return IndexFile::write(indexFile, indexMagic, indexVersion, [this](juce::OutputStream& out)
+        {
+            const juce::ScopedLock sl(lock);
+            out.writeCompressedInt((int)records.size());
+
+            for (const auto& r : records)
+            {
+                out.writeString(r.path);
+                out.writeInt64(r.fileSize);
+                out.writeInt64(r.modificationTime);
+                out.writeString(r.title);
+                out.writeString(r.artist);
+                out.writeString(r.album);
+                out.writeDouble(r.sampleRate);
+                out.writeInt64(r.lengthInSamples);
+                out.writeCompressedInt(r.numChannels);
+                out.writeBool(r.valid);
+            }
+        });
+}
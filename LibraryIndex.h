@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// What the library knows about one audio file, read from its header and tags
+struct TrackRecord
+{
+    juce::String path;
+    juce::int64 fileSize = 0;
+    juce::int64 modificationTime = 0;   // milliseconds since the epoch
+
+    // ===== Metadata =====
+    juce::String title;
+    juce::String artist;
+    juce::String album;
+
+    double sampleRate = 0.0;
+    juce::int64 lengthInSamples = 0;
+    int numChannels = 0;
+
+    // False if no reader could open the file
+    bool valid = false;
+
+    juce::File getFile() const { return juce::File(path); }
+    double getLengthInSeconds() const { return sampleRate > 0.0 ? (double)lengthInSamples / sampleRate : 0.0; }
+
+    // True if the file on disk still has the size and modification time recorded here
+    bool matches(const juce::File& file) const;
+};
+
+
+// Thread-safe table of TrackRecords keyed by full path, saved as a compact binary file
+class LibraryIndex
+{
+public:
+    LibraryIndex() = default;
+
+    bool find(const juce::File& file, TrackRecord& result) const;
+    bool isUpToDate(const juce::File& file) const;
+    int getNumTracks() const;
+
+    // Adds or replaces records (matched by path)
+    void update(const std::vector<TrackRecord>& newRecords);
+
+    // Drops records for files under root that were not in the latest scan; returns how many
+    int removeMissing(const juce::File& root, const std::unordered_set<juce::String>& seenPaths);
+
+    // Readable files under root, sorted by path
+    juce::Array<juce::File> getTracksUnder(const juce::File& root) const;
+
+    bool load(const juce::File& indexFile);
+    bool save(const juce::File& indexFile) const;
+
+private:
+    void removeAt(size_t index);
+
+    juce::CriticalSection lock;
+    std::vector<TrackRecord> records;
+    std::unordered_map<juce::String, size_t> byPath;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LibraryIndex)
+};
@@ -0,0 +1,280 @@
+﻿#include "LibraryScanner.h"
+#include "RealtimeGuard.h"
+
+// ===== Jobs =====
+// Opens a batch of files and records what their readers report
+class LibraryScanner::ReadJob : public juce::ThreadPoolJob
+{
+public:
+    ReadJob(LibraryScanner& o, juce::Array<juce::File> filesToRead, int scanGeneration)
+        : juce::ThreadPoolJob("Library Read"), owner(o), files(std::move(filesToRead)), generation(scanGeneration) {}
+
+    JobStatus runJob() override
+    {
+        // Each job has its own format manager, so pool threads never share reader state
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::vector<TrackRecord> batch;
+        batch.reserve((size_t)files.size());
+
+        for (const auto& file : files)
+        {
+            if (shouldExit())
+                break;
+
+            TrackRecord r;
+            r.path = file.getFullPathName();
+            r.fileSize = file.getSize();
+            r.modificationTime = file.getLastModificationTime().toMilliseconds();
+            r.title = file.getFileNameWithoutExtension();
+
+            if (std::unique_ptr<juce::AudioFormatReader> reader{ formats.createReaderFor(file) })
+            {
+                r.title = reader->metadataValues.getValue("title", r.title);
+                r.artist = reader->metadataValues.getValue("artist", "Unknown");
+                r.album = reader->metadataValues.getValue("album", "Unknown");
+                r.sampleRate = reader->sampleRate;
+                r.lengthInSamples = reader->lengthInSamples;
+                r.numChannels = (int)reader->numChannels;
+                r.valid = true;
+            }
+
+            batch.push_back(std::move(r));
+        }
+
+        owner.index.update(batch);
+        owner.filesRead += (int)batch.size();
+
+        {
+            const juce::ScopedLock sl(owner.callbackLock);
+
+            for (const auto& r : batch)
+                owner.pathsRead.add(r.path);
+        }
+        owner.jobFinished(generation);
+        return jobHasFinished;
+    }
+
+private:
+    LibraryScanner& owner;
+    juce::Array<juce::File> files;
+    const int generation;
+};
+
+// Walks a folder, queueing changed files for reading and dropping deleted ones from the index
+class LibraryScanner::WalkJob : public juce::ThreadPoolJob
+{
+public:
+    WalkJob(LibraryScanner& o, const juce::File& dir, int scanGeneration)
+        : juce::ThreadPoolJob("Library Walk"), owner(o), directory(dir), generation(scanGeneration) {}
+
+    JobStatus runJob() override
+    {
+        std::unordered_set<juce::String> seen;
+        juce::Array<juce::File> pending;
+
+        for (const auto& entry : juce::RangedDirectoryIterator(directory, true, owner.wildcard, juce::File::findFiles))
+        {
+            if (shouldExit())
+            {
+                owner.jobFinished(generation);
+                return jobHasFinished;
+            }
+
+            const auto& file = entry.getFile();
+            seen.insert(file.getFullPathName());
+            ++owner.filesFound;
+
+            if (owner.index.isUpToDate(file))
+            {
+                ++owner.filesUnchanged;
+                continue;
+            }
+
+            pending.add(file);
+
+            if (pending.size() >= filesPerBatch)
+            {
+                owner.addJob(new ReadJob(owner, std::move(pending), generation), generation);
+                pending.clear();
+            }
+        }
+
+        if (!pending.isEmpty())
+            owner.addJob(new ReadJob(owner, std::move(pending), generation), generation);
+
+        owner.index.removeMissing(directory, seen);
+        owner.jobFinished(generation);
+        return jobHasFinished;
+    }
+
+private:
+    LibraryScanner& owner;
+    juce::File directory;
+    const int generation;
+};
+
+// ===== LibraryScanner =====
+LibraryScanner::LibraryScanner()
+    : pool(juce::jmax(2, juce::SystemStats::getNumCpus()))
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    wildcard = formats.getWildcardForAllFormats();
+
+    indexFile = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("Library.index");
+
+    index.load(indexFile);
+}
+
+LibraryScanner::~LibraryScanner()
+{
+    cancelScan();
+}
+
+void LibraryScanner::scanDirectory(const juce::File& directory, FinishedCallback onFinished)
+{
+    RealtimeGuard::assertNotRealtime("LibraryScanner::scanDirectory");
+
+    if (!directory.isDirectory())
+        return;
+
+    if (onFinished)
+    {
+        const juce::ScopedLock sl(callbackLock);
+        finishedCallbacks.push_back(std::move(onFinished));
+    }
+
+    const int generation = scanGeneration.load();
+    addJob(new WalkJob(*this, directory, generation), generation);
+}
+
+void LibraryScanner::scanFiles(const juce::Array<juce::File>& files, FinishedCallback onFinished)
+{
+    if (onFinished)
+    {
+        const juce::ScopedLock sl(callbackLock);
+        finishedCallbacks.push_back(std::move(onFinished));
+    }
+
+    juce::Array<juce::File> pending;
+
+    for (const auto& file : files)
+    {
+        if (!file.existsAsFile())
+            continue;
+
+        ++filesFound;
+
+        if (index.isUpToDate(file))
+            ++filesUnchanged;
+        else
+            pending.add(file);
+    }
+
+    // Keeps the callback firing even when nothing needed reading
+    const int generation = scanGeneration.load();
+
+    if (!beginJob(generation))
+        return;
+
+    queueFiles(pending, generation);
+    jobFinished(generation);
+}
+
+void LibraryScanner::queueFiles(const juce::Array<juce::File>& files, int generation)
+{
+    for (int start = 0; start < files.size(); start += filesPerBatch)
+    {
+        juce::Array<juce::File> batch;
+        batch.addArray(files, start, filesPerBatch);
+        addJob(new ReadJob(*this, std::move(batch), generation), generation);
+    }
+}
+
+// Counts a job against its scan; false if that scan has been cancelled since
+bool LibraryScanner::beginJob(int generation)
+{
+    const juce::ScopedLock sl(scanLock);
+
+    if (generation != scanGeneration.load())
+        return false;
+
+    outstandingJobs += 1;
+    return true;
+}
+
+void LibraryScanner::addJob(juce::ThreadPoolJob* job, int generation)
+{
+    if (beginJob(generation))
+        pool.addJob(job, true);
+    else
+        delete job;
+}
+
+// The last job of a scan saves the index and reports back
+void LibraryScanner::jobFinished(int generation)
+{
+    {
+        const juce::ScopedLock sl(scanLock);
+
+        // Jobs of a cancelled scan were settled by cancelScan
+        if (generation != scanGeneration.load() || --outstandingJobs > 0)
+            return;
+    }
+
+    index.save(indexFile);
+
+    std::vector<FinishedCallback> callbacks;
+    juce::StringArray paths;
+    {
+        const juce::ScopedLock sl(callbackLock);
+        callbacks.swap(finishedCallbacks);
+        paths.swapWith(pathsRead);
+    }
+
+    filesFound = filesRead = filesUnchanged = 0;
+
+    if (!callbacks.empty())
+        juce::MessageManager::callAsync([callbacks, paths = std::move(paths)]
+            {
+                for (const auto& cb : callbacks)
+                    cb(paths);
+            });
+}
+
+void LibraryScanner::cancelScan()
+{
+    {
+        const juce::ScopedLock sl(callbackLock);
+        finishedCallbacks.clear();
+        pathsRead.clear();
+    }
+
+    bool wasScanning = false;
+    {
+        const juce::ScopedLock sl(scanLock);
+        scanGeneration += 1;
+        wasScanning = outstandingJobs.exchange(0) > 0;
+    }
+
+    // Running jobs see shouldExit() and finish themselves; queued ones never start
+    pool.removeAllJobs(true, 5000);
+
+    if (wasScanning)
+        index.save(indexFile);
+
+    filesFound = filesRead = filesUnchanged = 0;
+}
+
+LibraryScanner::Progress LibraryScanner::getProgress() const
+{
+    Progress p;
+    p.filesFound = filesFound.load();
+    p.filesRead = filesRead.load();
+    p.filesUnchanged = filesUnchanged.load();
+    p.scanning = isScanning();
+    return p;
+}
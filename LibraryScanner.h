@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "LibraryIndex.h"
+
+// Shared background scanner that fills the LibraryIndex.
+// A walker job lists the audio files under a folder and hands them out in batches to a
+// thread pool, which opens each file's header and tags in parallel. Files whose size and
+// modification time match the index are skipped, so rescans only read what changed.
+// The index is loaded on construction and saved whenever a scan finishes.
+class LibraryScanner
+{
+public:
+    struct Progress
+    {
+        int filesFound = 0;
+        int filesRead = 0;
+        int filesUnchanged = 0;
+        bool scanning = false;
+    };
+
+    LibraryScanner();
+    ~LibraryScanner();
+
+    LibraryIndex& getIndex() { return index; }
+
+    // Gets the paths of the files that were read (so their records changed) by the scans it waited for
+    using FinishedCallback = std::function<void(const juce::StringArray& pathsRead)>;
+
+    // Scans the folder recursively; onFinished runs on the message thread when every
+    // scan queued so far has completed (not if they are cancelled)
+    void scanDirectory(const juce::File& directory, FinishedCallback onFinished = nullptr);
+
+    // Indexes individual files, e.g. ones added to a playlist by hand
+    void scanFiles(const juce::Array<juce::File>& files, FinishedCallback onFinished = nullptr);
+
+    // Stops all scans; whatever was read so far is kept and saved
+    void cancelScan();
+
+    Progress getProgress() const;
+    bool isScanning() const { return outstandingJobs.load() > 0; }
+
+    juce::File getIndexFile() const { return indexFile; }
+
+private:
+    class WalkJob;
+    class ReadJob;
+
+    bool beginJob(int generation);
+    void addJob(juce::ThreadPoolJob* job, int generation);
+    void queueFiles(const juce::Array<juce::File>& files, int generation);
+    void jobFinished(int generation);
+
+    static constexpr int filesPerBatch = 32;
+
+    LibraryIndex index;
+    juce::File indexFile;
+    juce::String wildcard;
+
+    juce::ThreadPool pool;
+    // Jobs carry the generation they were queued under; cancelScan moves to a new one, so jobs
+    // it could not stop in time neither count against nor finish the next scan
+    juce::CriticalSection scanLock;
+    std::atomic<int> scanGeneration{ 0 };
+    std::atomic<int> outstandingJobs{ 0 };
+    std::atomic<int> filesFound{ 0 }, filesRead{ 0 }, filesUnchanged{ 0 };
+
+    juce::CriticalSection callbackLock;
+    std::vector<FinishedCallback> finishedCallbacks;
+    juce::StringArray pathsRead;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LibraryScanner)
+};
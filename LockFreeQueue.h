@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Wait-free single-producer/single-consumer queue with storage allocated up front.
+// Exactly one thread may push and exactly one (other) thread may pop.
+template <typename ItemType>
+class LockFreeQueue
+{
+public:
+    explicit LockFreeQueue(int capacity)
+        : fifo(capacity + 1), items((size_t)(capacity + 1))
+    {
+    }
+
+    bool push(ItemType item)
+    {
+        const auto scope = fifo.write(1);
+
+        if (scope.blockSize1 > 0)
+        {
+            items[(size_t)scope.startIndex1] = std::move(item);
+            return true;
+        }
+
+        return false;
+    }
+
+    bool pop(ItemType& item)
+    {
+        const auto scope = fifo.read(1);
+
+        if (scope.blockSize1 > 0)
+        {
+            item = std::move(items[(size_t)scope.startIndex1]);
+            return true;
+        }
+
+        return false;
+    }
+
+    int getNumReady() const { return fifo.getNumReady(); }
+    int getFreeSpace() const { return fifo.getFreeSpace(); }
+
+private:
+    juce::AbstractFifo fifo;
+    std::vector<ItemType> items;
+
+    JUCE_DECLARE_NON_COPYABLE(LockFreeQueue)
+};
@@ -0,0 +1,439 @@
+﻿#include "LoopingAudioSource.h"
+
+LoopingAudioSource::LoopingAudioSource(juce::PositionableAudioSource* streamToLoop,
+    juce::AudioFormatReader& sourceReader,
+    juce::TimeSliceThread& backgroundThread,
+    int channels)
+    : input(streamToLoop),
+    reader(sourceReader),
+    thread(backgroundThread),
+    numChannels(juce::jmax(1, channels))
+{
+    jassert(input != nullptr);
+
+    // The stream does not wrap by itself; all looping happens here
+    input->setLooping(false);
+
+    for (auto& request : cueRequests)
+        request.store(-1);
+}
+
+LoopingAudioSource::~LoopingAudioSource()
+{
+    releaseResources();
+}
+
+// ===== Loop settings (audio thread) =====
+void LoopingAudioSource::setLoopRange(juce::int64 start, juce::int64 end, bool enabled)
+{
+    if (start == rangeStart && end == rangeEnd && enabled == rangeEnabled)
+        return;
+
+    rangeStart = start;
+    rangeEnd = end;
+    rangeEnabled = enabled;
+    updateHeadRequest();
+}
+
+void LoopingAudioSource::setLooping(bool shouldLoop)
+{
+    if (shouldLoop == trackLooping)
+        return;
+
+    trackLooping = shouldLoop;
+    updateHeadRequest();
+}
+
+void LoopingAudioSource::setCrossfadeLength(int numSamples)
+{
+    crossfadeLength = juce::jlimit(0, seamTail.getNumSamples(), numSamples);
+}
+
+bool LoopingAudioSource::isLoopActive() const
+{
+    juce::int64 start = 0, end = 0;
+    return getLoopBounds(start, end);
+}
+
+bool LoopingAudioSource::getLoopBounds(juce::int64& start, juce::int64& end) const
+{
+    if (rangeEnabled && rangeEnd - rangeStart >= minimumLoopLength)
+    {
+        start = rangeStart;
+        end = rangeEnd;
+        return true;
+    }
+
+    const auto total = getTotalLength();
+
+    if (trackLooping && total >= minimumLoopLength)
+    {
+        start = 0;
+        end = total;
+        return true;
+    }
+
+    return false;
+}
+
+// Asks the disk thread to keep the start of the active loop decoded
+void LoopingAudioSource::updateHeadRequest()
+{
+    juce::int64 start = 0, end = 0;
+
+    if (getLoopBounds(start, end))
+    {
+        requestedHeadLength.store((int)juce::jmin((juce::int64)maxHeadLength, end - start));
+        requestedHeadStart.store(start);
+    }
+}
+
+// ===== Hot cues =====
+void LoopingAudioSource::setHotCue(int slot, juce::int64 frame)
+{
+    if (juce::isPositiveAndBelow(slot, maxHotCues))
+        cueRequests[slot].store(frame < 0 ? -1 : frame);
+}
+
+juce::int64 LoopingAudioSource::getHotCue(int slot) const
+{
+    return juce::isPositiveAndBelow(slot, maxHotCues) ? cueRequests[slot].load() : -1;
+}
+
+bool LoopingAudioSource::jumpTo(juce::int64 frame, bool crossfade)
+{
+    const int fadeLength = crossfade ? crossfadeLength : 0;
+    if (fadeLength > 0)
+        captureSeamTail(fadeLength);
+
+    releaseHead();
+    seamLength = 0;
+    seamPos = 0;
+
+    head = acquireCue(frame);
+    if (head == nullptr)
+        head = acquireHead(frame);
+
+    playPos = frame;
+
+    if (head == nullptr)
+    {
+        input->setNextReadPosition(frame);
+        return false;
+    }
+
+    // The stream seeks to the end of the decoded cue while we play from RAM
+    const int headLength = head->length.load();
+    seamLength = juce::jmin(fadeLength, headLength);
+    input->setNextReadPosition(frame + headLength);
+    return true;
+}
+
+// The audio that would have played next, to fade out under a jump
+void LoopingAudioSource::captureSeamTail(int length)
+{
+    int done = 0;
+
+    if (head != nullptr)
+    {
+        done = juce::jmin(length, head->length.load() - headPos);
+
+        for (int ch = 0; ch < seamTail.getNumChannels(); ++ch)
+            seamTail.copyFrom(ch, 0, head->data, juce::jmin(ch, numChannels - 1), headPos, done);
+    }
+
+    // The stream is positioned just past the head
+    if (done < length)
+        input->getNextAudioBlock(juce::AudioSourceChannelInfo(&seamTail, done, length - done));
+}
+
+// ===== Head cache =====
+LoopingAudioSource::HeadSlot* LoopingAudioSource::acquireHead(juce::int64 start)
+{
+    const int index = publishedSlot.load();
+    auto& slot = slots[index];
+
+    if (slot.start.load() != start || slot.length.load() <= 0)
+        return nullptr;
+
+    slot.inUse.fetch_add(1);
+
+    // The disk thread may have flipped slots between the check and the claim
+    if (publishedSlot.load() != index)
+    {
+        slot.inUse.fetch_sub(1);
+        return nullptr;
+    }
+
+    return &slot;
+}
+
+// The disk thread clears a cue slot's start before it checks whether the slot is in use, and
+// this claims the slot before checking its start, so one of the two always backs off
+LoopingAudioSource::HeadSlot* LoopingAudioSource::acquireCue(juce::int64 frame)
+{
+    for (auto& slot : cueSlots)
+    {
+        if (slot.start.load() != frame || slot.length.load() <= 0)
+            continue;
+
+        slot.inUse.fetch_add(1);
+
+        if (slot.start.load() == frame)
+            return &slot;
+
+        slot.inUse.fetch_sub(1);
+    }
+
+    return nullptr;
+}
+
+void LoopingAudioSource::releaseHead()
+{
+    if (head != nullptr)
+        head->inUse.fetch_sub(1);
+
+    head = nullptr;
+    headPos = 0;
+}
+
+int LoopingAudioSource::useTimeSlice()
+{
+    if (!isPrepared)
+        return 100;
+
+    const int wait = fillLoopHead();
+    if (wait == 0)
+        return 0;
+
+    // One cue per slice, so a batch of new cues never holds up the loop head for long
+    return decodeNextCue() ? 0 : wait;
+}
+
+// Decodes the first cue whose slot does not hold its requested frame; false if none needed it
+bool LoopingAudioSource::decodeNextCue()
+{
+    const auto total = getTotalLength();
+
+    for (int i = 0; i < maxHotCues; ++i)
+    {
+        auto& slot = cueSlots[i];
+        const auto frame = cueRequests[i].load();
+        const int length = frame >= 0 ? (int)juce::jlimit((juce::int64)0, (juce::int64)maxHeadLength, total - frame) : 0;
+
+        if (slot.start.load() == (length > 0 ? frame : -1) && slot.length.load() == length)
+            continue;
+
+        const auto previous = slot.start.exchange(-1);
+
+        // Still being played from; try again on a later slice
+        if (slot.inUse.load() > 0)
+        {
+            slot.start.store(previous);
+            continue;
+        }
+
+        slot.length.store(0);
+
+        if (length <= 0)
+        {
+            slot.data.setSize(numChannels, 0);
+            return true;
+        }
+
+        if (slot.data.getNumSamples() < maxHeadLength)
+            slot.data.setSize(numChannels, maxHeadLength);
+
+        reader.read(&slot.data, 0, length, frame, true, true);
+        slot.length.store(length);
+        slot.start.store(frame);
+        return true;
+    }
+
+    return false;
+}
+
+// Keeps the published loop head on the requested start; returns the time slice wait
+int LoopingAudioSource::fillLoopHead()
+{
+    const auto start = requestedHeadStart.load();
+    const int length = juce::jmin(requestedHeadLength.load(), maxHeadLength);
+
+    if (start < 0 || length <= 0)
+        return 50;
+
+    const int published = publishedSlot.load();
+    if (slots[published].start.load() == start && slots[published].length.load() == length)
+        return 20;
+
+    // Only ever write the unpublished slot, and only once the audio thread has let go of it
+    auto& slot = slots[1 - published];
+    if (slot.inUse.load() > 0)
+        return 5;
+
+    slot.start.store(-1);
+    reader.read(&slot.data, 0, length, start, true, true);
+    slot.length.store(length);
+    slot.start.store(start);
+
+    publishedSlot.store(1 - published);
+    return 0;
+}
+
+// ===== PositionableAudioSource =====
+void LoopingAudioSource::prepareToPlay(int, double sampleRate)
+{
+    // The wrapped stream is prepared (and primed) by its owner
+    releaseResources();
+
+    const double rate = reader.sampleRate > 0.0 ? reader.sampleRate : sampleRate;
+    maxHeadLength = juce::roundToInt(headCacheSeconds * rate);
+
+    for (auto& slot : slots)
+    {
+        slot.data.setSize(numChannels, maxHeadLength);
+        slot.data.clear();
+        slot.start.store(-1);
+        slot.length.store(0);
+        slot.inUse.store(0);
+    }
+
+    seamTail.setSize(numChannels, juce::roundToInt(maxCrossfadeSeconds * rate));
+    crossfadeLength = juce::jmin(crossfadeLength, seamTail.getNumSamples());
+
+    // Keep the track start decoded so a whole-track loop never waits on the disk
+    requestedHeadStart.store(0);
+    requestedHeadLength.store((int)juce::jmin((juce::int64)maxHeadLength, getTotalLength()));
+    updateHeadRequest();
+
+    isPrepared = true;
+    thread.addTimeSliceClient(this);
+}
+
+void LoopingAudioSource::releaseResources()
+{
+    if (!isPrepared)
+        return;
+
+    thread.removeTimeSliceClient(this);
+    isPrepared = false;
+}
+
+void LoopingAudioSource::setNextReadPosition(juce::int64 newPosition)
+{
+    releaseHead();
+    seamLength = 0;
+
+    playPos = newPosition;
+    input->setNextReadPosition(newPosition);
+}
+
+void LoopingAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    auto& dest = *bufferToFill.buffer;
+    int done = 0;
+
+    while (done < bufferToFill.numSamples)
+    {
+        const int remaining = bufferToFill.numSamples - done;
+        juce::int64 start = 0, end = 0;
+
+        if (head != nullptr)
+        {
+            const int headLength = head->length.load();
+            int num = juce::jmin(remaining, headLength - headPos);
+
+            // A cue's head can run past the loop end
+            if (getLoopBounds(start, end))
+                num = (int)juce::jlimit((juce::int64)0, (juce::int64)num, end - playPos);
+
+            renderFromHead(dest, bufferToFill.startSample + done, num);
+            headPos += num;
+            playPos += num;
+            done += num;
+
+            // The stream was positioned just past the head when we wrapped or jumped
+            if (headPos >= headLength)
+                releaseHead();
+        }
+        else
+        {
+            int num = remaining;
+
+            if (getLoopBounds(start, end))
+                num = (int)juce::jlimit((juce::int64)0, (juce::int64)remaining, end - playPos);
+
+            if (num > 0)
+            {
+                input->getNextAudioBlock(juce::AudioSourceChannelInfo(&dest, bufferToFill.startSample + done, num));
+                playPos += num;
+                done += num;
+            }
+        }
+
+        // Wrap at the exact frame, wherever it falls inside the block
+        if (getLoopBounds(start, end) && playPos >= end)
+            wrap();
+    }
+}
+
+void LoopingAudioSource::wrap()
+{
+    juce::int64 start = 0, end = 0;
+    getLoopBounds(start, end);
+
+    // The audio just past the loop end fades out under the loop start
+    const int fadeLength = (int)juce::jmin((juce::int64)crossfadeLength, end - start);
+    if (fadeLength > 0)
+        captureSeamTail(fadeLength);
+
+    releaseHead();
+    seamLength = 0;
+    seamPos = 0;
+
+    head = acquireHead(start);
+
+    if (head != nullptr)
+    {
+        const int headLength = head->length.load();
+        seamLength = juce::jmin(fadeLength, headLength);
+
+        // The stream refills from the end of the cached head while we play from RAM
+        input->setNextReadPosition(start + headLength);
+    }
+    else
+    {
+        // Cache not ready yet (loop points just moved): fall back to a plain seek
+        input->setNextReadPosition(start);
+    }
+
+    playPos = start;
+    numWraps.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoopingAudioSource::renderFromHead(juce::AudioBuffer<float>& dest, int destStart, int numSamples)
+{
+    const auto& data = head->data;
+
+    for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+        dest.copyFrom(ch, destStart, data, juce::jmin(ch, numChannels - 1), headPos, numSamples);
+
+    const int numToFade = juce::jmin(numSamples, seamLength - seamPos);
+    if (numToFade <= 0)
+        return;
+
+    for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+    {
+        auto* out = dest.getWritePointer(ch, destStart);
+        const auto* tail = seamTail.getReadPointer(juce::jmin(ch, numChannels - 1), seamPos);
+
+        for (int i = 0; i < numToFade; ++i)
+        {
+            const float t = (float)(seamPos + i) / (float)seamLength;
+            const float angle = t * juce::MathConstants<float>::halfPi;
+            out[i] = out[i] * std::sin(angle) + tail[i] * std::cos(angle);
+        }
+    }
+
+    seamPos += numToFade;
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Wraps a track's streaming source and loops it at the exact sample frame, either over
+// the whole track or over an A-B range. The first part of the loop is kept decoded in
+// memory (filled on the disk thread), so a wrap plays from RAM while the stream refills
+// behind it. An optional equal-power crossfade smooths the seam.
+//
+// Hot cues work the same way: the start of each cue is kept decoded in a slot of its own,
+// so a jump to one plays from RAM on the next block while the stream seeks behind it.
+//
+// Everything except prepareToPlay/releaseResources is called from the audio thread.
+// The head cache reads the reader directly, so it must share the disk thread that
+// services the streaming source.
+class LoopingAudioSource : public juce::PositionableAudioSource,
+    private juce::TimeSliceClient
+{
+public:
+    LoopingAudioSource(juce::PositionableAudioSource* streamToLoop,
+        juce::AudioFormatReader& reader,
+        juce::TimeSliceThread& backgroundThread,
+        int numChannels = 2);
+    ~LoopingAudioSource() override;
+
+    // A-B range in source samples; ignored unless enabled and at least a few samples long
+    void setLoopRange(juce::int64 start, juce::int64 end, bool enabled);
+    void setCrossfadeLength(int numSamples);
+
+    // True if playback will wrap rather than run off the end of the track
+    bool isLoopActive() const;
+
+    int getNumWraps() const { return numWraps.load(std::memory_order_relaxed); }
+
+    // ===== Hot cues =====
+    // Any thread: the frame of the cue in a slot, or -1 to free it. The disk thread decodes a
+    // slot's audio (allocating it on first use) whenever its frame changes.
+    void setHotCue(int slot, juce::int64 frame);
+    juce::int64 getHotCue(int slot) const;
+
+    // Audio thread: moves playback to the frame, from a decoded cue there if there is one and
+    // otherwise by seeking the stream; returns false if it had to seek. With crossfade set, the
+    // audio that would have played next fades out under the jump over the loop crossfade length.
+    bool jumpTo(juce::int64 frame, bool crossfade);
+
+    // ===== PositionableAudioSource =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override { return playPos; }
+    juce::int64 getTotalLength() const override { return input->getTotalLength(); }
+    bool isLooping() const override { return trackLooping; }
+    void setLooping(bool shouldLoop) override;
+
+    static constexpr double headCacheSeconds = 0.5;
+    static constexpr double maxCrossfadeSeconds = 0.05;
+    static constexpr int minimumLoopLength = 64;
+    static constexpr int maxHotCues = 32;
+
+private:
+    // Decoded audio starting at a loop point; written only by the disk thread while unpublished
+    struct HeadSlot
+    {
+        juce::AudioBuffer<float> data;
+        std::atomic<juce::int64> start{ -1 };
+        std::atomic<int> length{ 0 };
+        std::atomic<int> inUse{ 0 };
+    };
+
+    int useTimeSlice() override;
+    int fillLoopHead();
+
+    bool getLoopBounds(juce::int64& start, juce::int64& end) const;
+    void updateHeadRequest();
+    HeadSlot* acquireHead(juce::int64 start);
+    HeadSlot* acquireCue(juce::int64 frame);
+    void releaseHead();
+    bool decodeNextCue();
+    void captureSeamTail(int length);
+    void wrap();
+    void renderFromHead(juce::AudioBuffer<float>& dest, int destStart, int numSamples);
+
+    juce::PositionableAudioSource* input;
+    juce::AudioFormatReader& reader;
+    juce::TimeSliceThread& thread;
+    const int numChannels;
+
+    HeadSlot slots[2];
+    std::atomic<int> publishedSlot{ 0 };
+    std::atomic<juce::int64> requestedHeadStart{ 0 };
+    std::atomic<int> requestedHeadLength{ 0 };
+    int maxHeadLength = 0;
+
+    // A cue slot's start is its decoded frame; the request is the frame it should hold
+    HeadSlot cueSlots[maxHotCues];
+    std::atomic<juce::int64> cueRequests[maxHotCues];
+    bool isPrepared = false;
+
+    // ===== Audio thread state =====
+    juce::int64 playPos = 0;
+    bool trackLooping = false;
+    bool rangeEnabled = false;
+    juce::int64 rangeStart = 0, rangeEnd = 0;
+
+    HeadSlot* head = nullptr;      // the loop head or cue being played from
+    int headPos = 0;
+
+    juce::AudioBuffer<float> seamTail;
+    int crossfadeLength = 0;
+    int seamLength = 0;
+    int seamPos = 0;
+
+    std::atomic<int> numWraps{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopingAudioSource)
+};
@@ -0,0 +1,230 @@
+﻿#include "LoudnessMeter.h"
+
+namespace
+{
+    constexpr double absoluteGateLufs = -70.0;
+    constexpr double integratedRelativeGate = -10.0;
+    constexpr double rangeRelativeGate = -20.0;
+
+    double meanAbove(const std::vector<double>& powers, double threshold, int& count)
+    {
+        double sum = 0.0;
+        count = 0;
+
+        for (auto p : powers)
+        {
+            if (p > threshold)
+            {
+                sum += p;
+                ++count;
+            }
+        }
+
+        return count > 0 ? sum / count : 0.0;
+    }
+}
+
+LoudnessMeter::LoudnessMeter(double sampleRate, int channels, int maxBlockSize)
+    : numChannels(juce::jmax(1, channels)),
+    subBlockLength(juce::jmax(1, juce::roundToInt(sampleRate * 0.1)))
+{
+    // K-weighting: the BS.1770 pre-filter (high shelf) and RLB high-pass, re-derived for the
+    // file's sample rate from their analogue prototypes
+    {
+        const double f0 = 1681.974450955533, gainDb = 3.999843853973347, q = 0.7071752369554196;
+        const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+        const double vh = std::pow(10.0, gainDb / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+
+        shelf.b0 = (float)((vh + vb * k / q + k * k) / a0);
+        shelf.b1 = (float)(2.0 * (k * k - vh) / a0);
+        shelf.b2 = (float)((vh - vb * k / q + k * k) / a0);
+        shelf.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+        shelf.a2 = (float)((1.0 - k / q + k * k) / a0);
+    }
+
+    {
+        const double f0 = 38.13547087602444, q = 0.5003270373238773;
+        const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+        const double a0 = 1.0 + k / q + k * k;
+
+        highPass.b0 = 1.0f;
+        highPass.b1 = -2.0f;
+        highPass.b2 = 1.0f;
+        highPass.a1 = (float)(2.0 * (k * k - 1.0) / a0);
+        highPass.a2 = (float)((1.0 - k / q + k * k) / a0);
+    }
+
+    const int numGroups = (numChannels + 3) / 4;
+    filterState.assign((size_t)numGroups * 16, 0.0f);
+    energyScratch.assign((size_t)numGroups * 4, 0.0f);
+    subBlockEnergy.assign((size_t)numChannels, 0.0);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        channelWeights.push_back(ch < 3 ? 1.0f : 1.41f);
+
+    // True peak: a 48-tap Hann-windowed sinc split into four fractional-delay phases, each
+    // normalised to unity gain at DC
+    const int length = truePeakPhases * truePeakTaps;
+    const double centre = (length - 1) / 2.0;
+
+    for (int p = 0; p < truePeakPhases; ++p)
+    {
+        double sum = 0.0, absSum = 0.0;
+
+        for (int j = 0; j < truePeakTaps; ++j)
+        {
+            const double t = (p + j * truePeakPhases - centre) / truePeakPhases;
+            const double sinc = t == 0.0 ? 1.0 : std::sin(juce::MathConstants<double>::pi * t) / (juce::MathConstants<double>::pi * t);
+            const double window = 0.5 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * (p + j * truePeakPhases + 0.5) / length);
+
+            taps[p][truePeakTaps - 1 - j] = (float)(sinc * window);
+            sum += sinc * window;
+        }
+
+        for (int j = 0; j < truePeakTaps; ++j)
+        {
+            taps[p][j] = (float)(taps[p][j] / sum);
+            absSum += std::abs(taps[p][j]);
+        }
+
+        maxPhaseGain = juce::jmax(maxPhaseGain, (float)absSum);
+    }
+
+    history.setSize(numChannels, truePeakTaps - 1 + juce::jmax(1, maxBlockSize));
+    history.clear();
+}
+
+// ===== Loudness =====
+void LoudnessMeter::process(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    jassert(buffer.getNumChannels() >= numChannels);
+
+    const auto* const* channels = buffer.getArrayOfReadPointers();
+    int pos = 0;
+
+    while (pos < numSamples)
+    {
+        const int n = juce::jmin(numSamples - pos, subBlockLength - subBlockFill);
+        std::fill(energyScratch.begin(), energyScratch.end(), 0.0f);
+
+        for (int first = 0; first < numChannels; first += 4)
+            SimdKernels::biquadPairEnergy(channels + first, juce::jmin(4, numChannels - first), pos, n,
+                shelf, highPass, filterState.data() + first * 4, energyScratch.data() + first);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            subBlockEnergy[(size_t)ch] += energyScratch[(size_t)ch];
+
+        subBlockFill += n;
+        pos += n;
+
+        if (subBlockFill == subBlockLength)
+            finishSubBlock();
+    }
+
+    measureTruePeak(buffer, numSamples);
+}
+
+void LoudnessMeter::finishSubBlock()
+{
+    double power = 0.0;
+    for (int ch = 0; ch < numChannels; ++ch)
+        power += channelWeights[(size_t)ch] * subBlockEnergy[(size_t)ch];
+
+    subBlockPowers.push_back(power / subBlockLength);
+    std::fill(subBlockEnergy.begin(), subBlockEnergy.end(), 0.0);
+    subBlockFill = 0;
+
+    // Blocks and windows end on every 100 ms boundary once enough of the track has passed
+    auto meanOfLast = [this](int count)
+        {
+            double sum = 0.0;
+            for (auto i = subBlockPowers.size() - (size_t)count; i < subBlockPowers.size(); ++i)
+                sum += subBlockPowers[i];
+            return sum / count;
+        };
+
+    if (subBlockPowers.size() >= (size_t)subBlocksPerBlock)
+        blockPowers.push_back(meanOfLast(subBlocksPerBlock));
+
+    if (subBlockPowers.size() >= (size_t)subBlocksPerShortTerm)
+        shortTermPowers.push_back(meanOfLast(subBlocksPerShortTerm));
+}
+
+LoudnessMeter::Result LoudnessMeter::getResult() const
+{
+    Result result;
+
+    if (truePeak > 0.0f)
+        result.truePeakDb = juce::Decibels::gainToDecibels((double)truePeak, -200.0);
+
+    // Integrated: blocks above -70 LUFS, then those within 10 LU of their mean
+    int count = 0;
+    const double absoluteMean = meanAbove(blockPowers, toPower(absoluteGateLufs), count);
+
+    if (count > 0)
+    {
+        const double threshold = toPower(toLufs(absoluteMean) + integratedRelativeGate);
+        const double gatedMean = meanAbove(blockPowers, juce::jmax(threshold, toPower(absoluteGateLufs)), count);
+
+        if (count > 0)
+            result.integratedLufs = toLufs(gatedMean);
+    }
+
+    // Range: short-term loudness within 20 LU of the mean, from the 10th to the 95th percentile
+    const double rangeMean = meanAbove(shortTermPowers, toPower(absoluteGateLufs), count);
+
+    if (count > 0)
+    {
+        const double threshold = juce::jmax(toPower(toLufs(rangeMean) + rangeRelativeGate), toPower(absoluteGateLufs));
+        std::vector<double> loudness;
+
+        for (auto p : shortTermPowers)
+            if (p > threshold)
+                loudness.push_back(toLufs(p));
+
+        if (!loudness.empty())
+        {
+            std::sort(loudness.begin(), loudness.end());
+            auto percentile = [&loudness](double fraction) { return loudness[(size_t)juce::roundToInt(fraction * (double)(loudness.size() - 1))]; };
+            result.loudnessRange = percentile(0.95) - percentile(0.10);
+        }
+    }
+
+    return result;
+}
+
+// ===== True peak =====
+// Stretches that are too quiet to beat the peak so far, even at the interpolator's largest
+// overshoot, are skipped, so most of a track costs one min/max scan
+void LoudnessMeter::measureTruePeak(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    const int historyLength = truePeakTaps - 1;
+    jassert(numSamples <= history.getNumSamples() - historyLength);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto* samples = history.getWritePointer(ch);
+        juce::FloatVectorOperations::copy(samples + historyLength, buffer.getReadPointer(ch), numSamples);
+
+        for (int chunk = 0; chunk < numSamples; chunk += truePeakChunk)
+        {
+            const int n = juce::jmin(truePeakChunk, numSamples - chunk);
+            const auto range = juce::FloatVectorOperations::findMinAndMax(samples + chunk, n + historyLength);
+            const float loudest = juce::jmax(-range.getStart(), range.getEnd());
+
+            truePeak = juce::jmax(truePeak, loudest);
+
+            if (loudest * maxPhaseGain <= truePeak)
+                continue;
+
+            for (int i = chunk; i < chunk + n; ++i)
+                for (int p = 0; p < truePeakPhases; ++p)
+                    truePeak = juce::jmax(truePeak, std::abs(SimdKernels::dotProduct(taps[p], samples + i, truePeakTaps)));
+        }
+
+        // Keep the tail for the next block's first outputs
+        std::memmove(samples, samples + numSamples, sizeof(float) * (size_t)historyLength);
+    }
+}
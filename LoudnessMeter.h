@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "SimdKernels.h"
+
+// Loudness of a whole track after ITU-R BS.1770-4 / EBU R128: integrated loudness (gated
+// 400 ms blocks), loudness range (EBU Tech 3342, from 3 s short-term loudness) and true peak
+// (4x oversampled). Feed it the track front to back in blocks of any size; not realtime-safe.
+//
+// K-weighting runs as one SIMD lane per channel (see SimdKernels::biquadPairEnergy). Channels
+// past the third are weighted +1.5 dB as surrounds, which assumes a layout without LFE.
+class LoudnessMeter
+{
+public:
+    struct Result
+    {
+        double integratedLufs = -std::numeric_limits<double>::infinity();
+        double loudnessRange = 0.0;     // LU
+        double truePeakDb = -std::numeric_limits<double>::infinity();     // dBTP
+
+        // False for silence, or anything shorter than one 400 ms block
+        bool hasSignal() const { return std::isfinite(integratedLufs); }
+    };
+
+    LoudnessMeter(double sampleRate, int numChannels, int maxBlockSize);
+
+    void process(const juce::AudioBuffer<float>& buffer, int numSamples);
+    Result getResult() const;
+
+private:
+    static constexpr int subBlocksPerBlock = 4;         // 400 ms momentary blocks, 100 ms apart
+    static constexpr int subBlocksPerShortTerm = 30;    // 3 s short-term windows
+    static constexpr int truePeakPhases = 4;
+    static constexpr int truePeakTaps = 12;             // per phase
+    static constexpr int truePeakChunk = 64;
+
+    void finishSubBlock();
+    void measureTruePeak(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+    static double toLufs(double power) { return -0.691 + 10.0 * std::log10(power); }
+    static double toPower(double lufs) { return std::pow(10.0, (lufs + 0.691) / 10.0); }
+
+    const int numChannels;
+    const int subBlockLength;
+
+    // ===== Loudness =====
+    SimdKernels::Biquad shelf, highPass;
+    std::vector<float> filterState;     // 16 per group of four channels
+    std::vector<float> channelWeights;
+    std::vector<double> subBlockEnergy;
+    std::vector<float> energyScratch;
+    int subBlockFill = 0;
+
+    std::vector<double> subBlockPowers;     // weighted mean square of every finished 100 ms
+    std::vector<double> blockPowers;        // of every 400 ms block
+    std::vector<double> shortTermPowers;    // of every 3 s window
+
+    // ===== True peak =====
+    float taps[truePeakPhases][truePeakTaps];   // each phase reversed, ready for a dot product
+    float maxPhaseGain = 1.0f;
+    juce::AudioBuffer<float> history;           // the last taps - 1 samples, then the block
+    float truePeak = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoudnessMeter)
+};
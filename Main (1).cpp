@@ -1,5 +1,7 @@
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "Benchmarks.h"
+#include "OfflineRenderer.h"
 
 class SimpleAudioPlayer : public juce::JUCEApplication
 {
@@ -7,8 +9,65 @@ public:
     const juce::String getApplicationName() override { return "Simple Audio Player"; }
     const juce::String getApplicationVersion() override { return "1.0"; }
 
-    void initialise(const juce::String&) override
+    void initialise(const juce::String& commandLine) override
     {
+        // Machine-readable deck benchmark: --benchmark-json [file]
+        if (commandLine.contains("--benchmark-json"))
+        {
+            juce::StringArray args;
+            args.addTokens(commandLine, true);
+
+            const auto json = juce::JSON::toString(Benchmarks::deckCallbacks());
+            const auto path = args[args.indexOf("--benchmark-json") + 1].unquoted();
+
+            if (path.isEmpty() || path.startsWith("--"))
+                std::cout << json << std::endl;
+            else
+                juce::File::getCurrentWorkingDirectory().getChildFile(path).replaceWithText(json);
+
+            quit();
+            return;
+        }
+
+        // MP3 seek latency and accuracy: --benchmark-seek <file.mp3>
+        if (commandLine.contains("--benchmark-seek"))
+        {
+            juce::StringArray args;
+            args.addTokens(commandLine, true);
+
+            const auto path = args[args.indexOf("--benchmark-seek") + 1].unquoted();
+            std::cout << Benchmarks::mp3Seeks(juce::File::getCurrentWorkingDirectory().getChildFile(path)) << std::endl;
+            quit();
+            return;
+        }
+
+        // Headless throughput report instead of the UI
+        if (commandLine.contains("--benchmark"))
+        {
+            std::cout << Benchmarks::runAll() << std::endl;
+            quit();
+            return;
+        }
+
+        // Headless mix-down: --render <spec.json>
+        if (commandLine.contains("--render"))
+        {
+            juce::StringArray args;
+            args.addTokens(commandLine, true);
+
+            const auto specPath = args[args.indexOf("--render") + 1].unquoted();
+            OfflineRenderer::Spec spec;
+            OfflineRenderer::Result result;
+
+            if (OfflineRenderer::loadSpec(juce::File::getCurrentWorkingDirectory().getChildFile(specPath), spec, result.error))
+                result = OfflineRenderer().render(spec);
+
+            std::cout << result.toString() << std::endl;
+            setApplicationReturnValue(result.succeeded ? 0 : 1);
+            quit();
+            return;
+        }
+
         mainWindow = std::make_unique<MainWindow>(getApplicationName());
     }
 
@@ -8,98 +8,276 @@ MainComponent::MainComponent()
     options.osxLibrarySubFolder = "Application Support";
     appProperties = std::make_unique<juce::PropertiesFile>(options);
 
-    juce::String lastFilePath1 = appProperties->getValue("lastFilePath1", "");
-    double lastPosition1 = appProperties->getDoubleValue("lastPosition1", 0.0);
+    addAndMakeVisible(addDeckButton);
+    addAndMakeVisible(removeDeckButton);
+    addAndMakeVisible(deckCountLabel);
+    sessionStatusLabel.setColour(juce::Label::textColourId, juce::Colours::grey);
+    addAndMakeVisible(sessionStatusLabel);
+    addAndMakeVisible(masterSpectrum);
+    addAndMakeVisible(deckViewport);
+    deckViewport.setViewedComponent(&deckContainer, false);
+    deckViewport.setScrollBarsShown(true, false);
 
-    if (lastFilePath1.isNotEmpty())
-    {
-        juce::File file(lastFilePath1);
-        if (file.existsAsFile())
-        {
-            player1.getPlayerAudio().loadFile(file);
-            player1.getPlayerAudio().setPosition(lastPosition1);
-        }
-    }
+    addDeckButton.onClick = [this] { addDeck(); };
+    removeDeckButton.onClick = [this] { removeLastDeck(); };
 
-    juce::String lastFilePath2 = appProperties->getValue("lastFilePath2", "");
-    double lastPosition2 = appProperties->getDoubleValue("lastPosition2", 0.0);
+    // Controls, playlists and cached tags go back now; no track is opened until the window is up
+    Session session;
+    if (!sessionStore.load(session) && !loadLegacySession(session))
+        session.decks.resize(defaultNumDecks);
 
-    if (lastFilePath2.isNotEmpty())
-    {
-        juce::File file(lastFilePath2);
-        if (file.existsAsFile())
-        {
-            player2.getPlayerAudio().loadFile(file);
-            player2.getPlayerAudio().setPosition(lastPosition2);
-        }
-    }
+    session.decks.resize((size_t)juce::jlimit(1, DeckEngine::maxDecks, (int)session.decks.size()));
 
-    addAndMakeVisible(player1);
-    addAndMakeVisible(player2);
+    for (const auto& deckSession : session.decks)
+        if (auto* deck = addDeck())
+            deck->restoreSession(deckSession);
+
+    addChildComponent(profilerOverlay);
+    setWantsKeyboardFocus(true);
 
     setSize(800, 600);
-    setAudioChannels(0, 2);
+    setAudioChannels(0, numOutputChannels);
+
+    // Only handled once the message loop runs, i.e. after the window has been shown
+    juce::MessageManager::callAsync([safeThis = juce::Component::SafePointer<MainComponent>(this)]
+        {
+            if (safeThis != nullptr)
+                safeThis->startupFinished();
+        });
+
+    startTimer(autosaveIntervalMs);
 }
 
 MainComponent::~MainComponent()
 {
-    saveLastSession(); 
+    stopTimer();
+    saveLastSession();
     shutdownAudio();
 }
 
 void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
-    player1.prepareToPlay(samplesPerBlockExpected, sampleRate);
-    player2.prepareToPlay(samplesPerBlockExpected, sampleRate);
+    currentSampleRate = sampleRate;
+    masterTap.setSampleRate(sampleRate);
+    engine.prepareToPlay(samplesPerBlockExpected, sampleRate);
 }
 
 void MainComponent::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
 {
-    juce::AudioBuffer<float> tempBuffer;
-    tempBuffer.setSize(bufferToFill.buffer->getNumChannels(), bufferToFill.numSamples);
-    tempBuffer.clear();
+    RealtimeGuard::ScopedRealtimeSection realtimeSection;
+
+    profiler.beginBlock(bufferToFill.numSamples, currentSampleRate);
+    engine.render(bufferToFill, &profiler);
+    masterTap.push(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
+    profiler.endBlock();
+}
+
+void MainComponent::releaseResources()
+{
+    engine.releaseResources();
+}
+
+void MainComponent::resized()
+{
+    auto area = getLocalBounds();
+    auto header = area.removeFromTop(64).reduced(5);
+    masterSpectrum.setBounds(header.removeFromRight(juce::jmin(400, header.getWidth() / 2)));
+
+    auto toolbar = header.removeFromTop(24);
 
-    juce::AudioSourceChannelInfo tempInfo(&tempBuffer, 0, bufferToFill.numSamples);
+    addDeckButton.setBounds(toolbar.removeFromLeft(100));
+    toolbar.removeFromLeft(5);
+    removeDeckButton.setBounds(toolbar.removeFromLeft(100));
+    toolbar.removeFromLeft(10);
+    deckCountLabel.setBounds(toolbar);
+    sessionStatusLabel.setBounds(header.withTrimmedTop(4));
 
-    player1.getNextAudioBlock(bufferToFill);
+    deckViewport.setBounds(area);
 
-    player2.getNextAudioBlock(tempInfo);
+    // Two decks share the window as before; more than that scroll
+    const int visibleDecks = juce::jlimit(1, defaultNumDecks, decks.size());
+    const int deckHeight = juce::jmax(minDeckHeight, area.getHeight() / visibleDecks);
+    const int width = deckViewport.getMaximumVisibleWidth();
 
-    for (int channel = 0; channel < bufferToFill.buffer->getNumChannels(); ++channel)
+    deckContainer.setSize(width, deckHeight * decks.size());
+
+    for (int i = 0; i < decks.size(); ++i)
+        decks[i]->setBounds(0, i * deckHeight, width, deckHeight - 5);
+
+    profilerOverlay.setBounds(getLocalBounds().reduced(20));
+}
+
+// ===== Decks =====
+PlayerGUI* MainComponent::addDeck()
+{
+    if (decks.size() >= DeckEngine::maxDecks)
+        return nullptr;
+
+    auto* deck = decks.add(new PlayerGUI());
+    deck->findSyncLeader = [this, deck] { return findSyncLeaderFor(*deck); };
+    deckContainer.addAndMakeVisible(deck);
+    engine.addDeck(deck->getPlayerAudio());
+
+    updateDeckControls();
+    resized();
+    return deck;
+}
+
+void MainComponent::removeLastDeck()
+{
+    if (decks.size() <= 1)
+        return;
+
+    auto* deck = decks.getLast();
+
+    if (deck->isRestoring())
+        deckRestored();
+
+    // Decks following this one play on at their own speed; the audio thread stops reading
+    // it no later than the block removeDeck waits for
+    for (auto* other : decks)
+        if (other->getPlayerAudio().getSyncLeader() == &deck->getPlayerAudio())
+            other->getPlayerAudio().syncTo(nullptr);
+
+    // The audio thread must have let go of the deck before it is deleted
+    engine.removeDeck(deck->getPlayerAudio());
+    deckContainer.removeChildComponent(deck);
+    decks.removeLast();
+
+    updateDeckControls();
+    resized();
+}
+
+// A playing deck with a beat grid if there is one, otherwise any other deck with a grid
+PlayerAudio* MainComponent::findSyncLeaderFor(PlayerGUI& deck)
+{
+    PlayerAudio* found = nullptr;
+
+    for (auto* other : decks)
     {
-        bufferToFill.buffer->addFrom(channel, bufferToFill.startSample,
-            tempBuffer, channel, 0, bufferToFill.numSamples);
+        auto& audio = other->getPlayerAudio();
+
+        if (other == &deck || !audio.getBeatGrid().isValid() || audio.getSyncLeader() == &deck.getPlayerAudio())
+            continue;
+
+        if (audio.isPlaying())
+            return &audio;
+
+        if (found == nullptr)
+            found = &audio;
     }
+
+    return found;
 }
 
-void MainComponent::releaseResources()
+void MainComponent::updateDeckControls()
 {
-    player1.releaseResources();
-    player2.releaseResources();
+    addDeckButton.setEnabled(decks.size() < DeckEngine::maxDecks);
+    removeDeckButton.setEnabled(decks.size() > 1);
+
+    deckCountLabel.setText(juce::String(decks.size()) + (decks.size() == 1 ? " deck" : " decks")
+        + " on " + juce::String(engine.getNumWorkers() + 1) + " threads", juce::dontSendNotification);
 }
 
-void MainComponent::resized()
+bool MainComponent::keyPressed(const juce::KeyPress& key)
 {
-    auto area = getLocalBounds();
-    auto halfHeight = getHeight() / 2;
+    if (key == juce::KeyPress::F12Key)
+    {
+        profilerOverlay.setVisible(!profilerOverlay.isVisible());
+        if (profilerOverlay.isVisible())
+            profilerOverlay.toFront(false);
+
+        return true;
+    }
 
-    player1.setBounds(0, 0, getWidth(), halfHeight - 5);
-    player2.setBounds(0, halfHeight + 5, getWidth(), halfHeight - 5);
+    return false;
 }
 
+// ===== Session =====
 void MainComponent::saveLastSession()
 {
-    if (player1.getPlayerAudio().isFileLoaded())
-    {
-        appProperties->setValue("lastFilePath1", player1.getPlayerAudio().getCurrentFile().getFullPathName());
-        appProperties->setValue("lastPosition1", player1.getPlayerAudio().getPosition());
-    }
+    if (!sessionStore.save(captureSession()))
+        DBG("Could not save the session to " + sessionStore.getSessionFile().getFullPathName());
+}
+
+// The snapshot is all the message thread does; serialising and writing happen on the store's thread
+void MainComponent::timerCallback()
+{
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+    auto session = captureSession();
+    lastSnapshotMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    sessionStore.saveInBackground(std::move(session));
+    updateSessionStatus();
+}
+
+Session MainComponent::captureSession()
+{
+    Session session;
+
+    for (auto* deck : decks)
+        session.decks.push_back(deck->getSession());
 
-    if (player2.getPlayerAudio().isFileLoaded())
+    return session;
+}
+
+// Sessions saved before SessionStore: a track and position per deck in the settings file
+bool MainComponent::loadLegacySession(Session& result) const
+{
+    // Settings from before the deck count was saved still hold the first two decks' tracks
+    if (!appProperties->containsKey("numDecks") && !appProperties->containsKey("lastFilePath1"))
+        return false;
+
+    const int numDecks = juce::jlimit(1, DeckEngine::maxDecks, appProperties->getIntValue("numDecks", defaultNumDecks));
+    result.decks.assign((size_t)numDecks, DeckSession());
+
+    for (int i = 0; i < numDecks; ++i)
     {
-        appProperties->setValue("lastFilePath2", player2.getPlayerAudio().getCurrentFile().getFullPathName());
-        appProperties->setValue("lastPosition2", player2.getPlayerAudio().getPosition());
+        const juce::String number(i + 1);
+        result.decks[(size_t)i].filePath = appProperties->getValue("lastFilePath" + number);
+        result.decks[(size_t)i].position = appProperties->getDoubleValue("lastPosition" + number);
     }
 
-    appProperties->saveIfNeeded();
+    return true;
+}
+
+// The window is up: the decks open their restored tracks on the loader thread from here on
+void MainComponent::startupFinished()
+{
+    interactiveMs = juce::Time::getMillisecondCounterHiRes() - startupBeganMs;
+    restoresPending = decks.size();
+
+    for (auto* deck : decks)
+        deck->openRestoredTrack([safeThis = juce::Component::SafePointer<MainComponent>(this)]
+            {
+                if (safeThis != nullptr)
+                    safeThis->deckRestored();
+            });
+
+    updateSessionStatus();
+}
+
+void MainComponent::deckRestored()
+{
+    if (restoresPending > 0 && --restoresPending == 0)
+        restoredMs = juce::Time::getMillisecondCounterHiRes() - startupBeganMs;
+
+    updateSessionStatus();
+}
+
+void MainComponent::updateSessionStatus()
+{
+    juce::String status;
+    status << "Interactive in " << juce::roundToInt(interactiveMs) << " ms, ";
+
+    if (restoresPending > 0)
+        status << "opening " << restoresPending << (restoresPending == 1 ? " track" : " tracks");
+    else
+        status << "session restored in " << juce::roundToInt(restoredMs) << " ms";
+
+    if (lastSnapshotMs > 0.0)
+        status << ". Autosave: " << juce::String(lastSnapshotMs, 2) << " ms on this thread, last write "
+               << juce::String(sessionStore.getLastSaveMs(), 1) << " ms on the writer thread";
+
+    sessionStatusLabel.setText(status, juce::dontSendNotification);
 }
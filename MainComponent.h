@@ -1,8 +1,15 @@
 ﻿#pragma once
 #include <JuceHeader.h>
 #include "PlayerGUI.h"
+#include "DeckEngine.h"
+#include "RealtimeGuard.h"
+#include "CallbackProfiler.h"
+#include "ProfilerOverlay.h"
+#include "SpectrumView.h"
+#include "SessionStore.h"
 
-class MainComponent : public juce::AudioAppComponent
+class MainComponent : public juce::AudioAppComponent,
+    private juce::Timer
 {
 public:
     MainComponent();
@@ -13,14 +20,65 @@ public:
     void releaseResources() override;
     void resized() override;
 
+    // F12 shows or hides the callback profile
+    bool keyPressed(const juce::KeyPress& key) override;
+
+    // Writes the session file now, on the calling thread (autosaves run in the background)
     void saveLastSession();
 
+    // Message thread: adds a deck at the bottom, or removes the last one
+    PlayerGUI* addDeck();
+    void removeLastDeck();
+
 private:
+    static constexpr int numOutputChannels = 2;
+    static constexpr int defaultNumDecks = 2;
+    static constexpr int minDeckHeight = 290;
+    static constexpr int autosaveIntervalMs = 30000;
+
+    // ===== Startup timing =====
+    // First data member, so the time taken to construct the rest is counted
+    const double startupBeganMs = juce::Time::getMillisecondCounterHiRes();
+    double interactiveMs = 0.0;     // until the first message after the window was shown
+    double restoredMs = 0.0;        // until every restored deck had its track open
+    int restoresPending = 0;
+    double lastSnapshotMs = 0.0;    // message thread time of the last autosave
+
+    // ===== Session =====
+    void timerCallback() override;
+    Session captureSession();
+    bool loadLegacySession(Session& result) const;
+    void startupFinished();
+    void deckRestored();
+    void updateSessionStatus();
+
+    PlayerAudio* findSyncLeaderFor(PlayerGUI& deck);
+    void updateDeckControls();
+
     juce::AudioSourcePlayer audioSourcePlayer;
+
+    // Only read now, for sessions saved before SessionStore
     std::unique_ptr<juce::PropertiesFile> appProperties;
+    SessionStore sessionStore;
+    juce::Label sessionStatusLabel;
+
+    DeckEngine engine;
+    double currentSampleRate = 0.0;
+
+    // ===== Decks =====
+    juce::TextButton addDeckButton{ "Add Deck" };
+    juce::TextButton removeDeckButton{ "Remove Deck" };
+    juce::Label deckCountLabel;
+    juce::Viewport deckViewport;
+    juce::Component deckContainer;
+    juce::OwnedArray<PlayerGUI> decks;
+
+    CallbackProfiler profiler;
+    ProfilerOverlay profilerOverlay{ profiler };
 
-    PlayerGUI player1;
-    PlayerGUI player2;
+    // ===== Master spectrum =====
+    SpectrumTap masterTap;
+    SpectrumView masterSpectrum{ masterTap };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainComponent)
 };
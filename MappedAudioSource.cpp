@@ -0,0 +1,202 @@
+﻿#include "MappedAudioSource.h"
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+ #include <sys/mman.h>
+#endif
+
+namespace
+{
+    constexpr int pageSize = 4096;
+
+    juce::uint32 readLittleEndian32(const char* p) { return juce::ByteOrder::littleEndianInt(p); }
+    juce::uint32 readBigEndian32(const char* p) { return juce::ByteOrder::bigEndianInt(p); }
+}
+
+// ===== PageAdvisor =====
+MappedAudioSource::PageAdvisor::PageAdvisor(const juce::File& file, const juce::AudioFormatReader& details)
+    : map(file, juce::MemoryMappedFile::readOnly),
+    bytesPerFrame((int)details.numChannels * (int)details.bitsPerSample / 8)
+{
+    if (map.getData() != nullptr)
+        dataStart = findDataStart(map);
+}
+
+// Offset of the first sample frame: the RIFF "data" chunk, or the AIFF "SSND" chunk
+juce::int64 MappedAudioSource::PageAdvisor::findDataStart(const juce::MemoryMappedFile& map)
+{
+    const auto* data = static_cast<const char*>(map.getData());
+    const auto size = (juce::int64)map.getSize();
+
+    if (size < 12)
+        return -1;
+
+    const bool isRiff = std::memcmp(data, "RIFF", 4) == 0 || std::memcmp(data, "RF64", 4) == 0 || std::memcmp(data, "BW64", 4) == 0;
+    const bool isAiff = std::memcmp(data, "FORM", 4) == 0;
+
+    for (juce::int64 pos = 12; pos + 8 <= size;)
+    {
+        const char* chunk = data + pos;
+        const juce::int64 chunkSize = isRiff ? readLittleEndian32(chunk + 4) : readBigEndian32(chunk + 4);
+
+        if (isRiff && std::memcmp(chunk, "data", 4) == 0)
+            return pos + 8;
+
+        if (isAiff && std::memcmp(chunk, "SSND", 4) == 0 && pos + 16 <= size)
+            return pos + 16 + readBigEndian32(chunk + 8);
+
+        if (!isRiff && !isAiff)
+            break;
+
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    return -1;
+}
+
+void MappedAudioSource::PageAdvisor::willNeed(juce::int64 startSample, juce::int64 numSamples) const
+{
+    if (dataStart < 0 || bytesPerFrame <= 0)
+        return;
+
+    const auto size = (juce::int64)map.getSize();
+    const auto first = juce::jlimit((juce::int64)0, size, dataStart + startSample * bytesPerFrame) & ~(juce::int64)(pageSize - 1);
+    const auto last = juce::jlimit((juce::int64)0, size, dataStart + (startSample + numSamples) * bytesPerFrame);
+
+    if (last <= first)
+        return;
+
+   #if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    // Page-aligned: the mapping itself starts on a page boundary
+    madvise(static_cast<char*>(const_cast<void*>(map.getData())) + first, (size_t)(last - first), MADV_WILLNEED);
+   #else
+    juce::ignoreUnused(first, last);
+   #endif
+}
+
+// ===== MappedAudioSource =====
+MappedAudioSource::MappedAudioSource(juce::MemoryMappedAudioFormatReader& mappedReader,
+    juce::TimeSliceThread& backgroundThread,
+    double pageAhead)
+    : reader(mappedReader),
+    thread(backgroundThread),
+    advisor(mappedReader.getFile(), mappedReader),
+    pageAheadSeconds(juce::jmax(0.1, pageAhead))
+{
+}
+
+MappedAudioSource::~MappedAudioSource()
+{
+    releaseResources();
+}
+
+std::unique_ptr<juce::MemoryMappedAudioFormatReader> MappedAudioSource::createReaderFor(juce::AudioFormatManager& formats, const juce::File& file)
+{
+    // Only uncompressed formats implement createMemoryMappedReader(); the rest return nullptr
+    auto* format = formats.findFormatForFileExtension(file.getFileExtension());
+    if (format == nullptr)
+        return {};
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+
+    if (mapped == nullptr || mapped->lengthInSamples <= 0 || !mapped->mapEntireFile())
+        return {};
+
+    return mapped;
+}
+
+// ===== PositionableAudioSource =====
+void MappedAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    releaseResources();
+
+    juce::ignoreUnused(sampleRate);
+    windowLength = juce::jmax((juce::int64)samplesPerBlockExpected * 4, (juce::int64)(pageAheadSeconds * reader.sampleRate));
+
+    // Fault in the opening window on the calling thread so the first blocks never wait
+    prepareWindow(nextPlayPos.load());
+
+    isPrepared.store(true);
+    thread.addTimeSliceClient(this);
+}
+
+void MappedAudioSource::releaseResources()
+{
+    if (!isPrepared.exchange(false))
+        return;
+
+    thread.removeTimeSliceClient(this);
+}
+
+void MappedAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    const auto position = nextPlayPos.load();
+    const auto length = reader.lengthInSamples;
+    const int num = (int)juce::jlimit((juce::int64)0, (juce::int64)bufferToFill.numSamples, length - position);
+
+    if (num > 0)
+    {
+        if (position < residentStart.load(std::memory_order_acquire) || position + num > residentEnd.load(std::memory_order_acquire))
+            underruns.fetch_add(1, std::memory_order_relaxed);
+
+        reader.read(bufferToFill.buffer, bufferToFill.startSample, num, position, true, true);
+    }
+
+    // Past the end of the file
+    if (num < bufferToFill.numSamples)
+        bufferToFill.buffer->clear(bufferToFill.startSample + num, bufferToFill.numSamples - num);
+
+    nextPlayPos.store(position + bufferToFill.numSamples);
+}
+
+float MappedAudioSource::getFillLevel() const
+{
+    if (windowLength <= 0)
+        return 0.0f;
+
+    const auto ahead = residentEnd.load(std::memory_order_relaxed) - nextPlayPos.load(std::memory_order_relaxed);
+    return juce::jlimit(0.0f, 1.0f, (float)ahead / (float)windowLength);
+}
+
+void MappedAudioSource::setNextReadPosition(juce::int64 newPosition)
+{
+    nextPlayPos.store(juce::jmax((juce::int64)0, newPosition));
+
+    // Seeks from the UI get their window prepared first.
+    // (The audio thread must not take the thread's queue lock.)
+    if (isPrepared.load() && juce::MessageManager::existsAndIsCurrentThread())
+        thread.moveToFrontOfQueue(this);
+}
+
+// ===== Background =====
+int MappedAudioSource::useTimeSlice()
+{
+    const auto position = nextPlayPos.load();
+    const auto start = residentStart.load();
+    const auto end = residentEnd.load();
+
+    // Top up once the playhead is halfway through the window, or immediately after a seek
+    if (position < start || position + windowLength / 2 > end)
+    {
+        prepareWindow(position);
+        return 0;
+    }
+
+    return 10;
+}
+
+void MappedAudioSource::prepareWindow(juce::int64 start)
+{
+    const auto end = juce::jmin(reader.lengthInSamples, start + windowLength);
+
+    // Ask the kernel for the whole range in one go, then touch a sample per page to be sure
+    advisor.willNeed(start, end - start);
+
+    const int bytesPerFrame = juce::jmax(1, (int)(reader.numChannels * reader.bitsPerSample / 8));
+    const int samplesPerPage = juce::jmax(1, pageSize / bytesPerFrame);
+
+    for (auto sample = start; sample < end; sample += samplesPerPage)
+        reader.touchSample(sample);
+
+    residentStart.store(start, std::memory_order_release);
+    residentEnd.store(end, std::memory_order_release);
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "TrackStream.h"
+
+// Plays uncompressed PCM straight out of a memory-mapped reader: the audio thread converts
+// samples directly from the mapping, with no ring buffer or copy in between.
+// To keep page faults off the audio thread, a background thread follows the playhead (and
+// seek targets) and makes sure the pages ahead of it are resident, with madvise() read-ahead
+// hints where the platform has them. A block that starts outside the prepared window is
+// still read, but counted as an underrun since it may have had to wait for the disk.
+class MappedAudioSource : public TrackStream,
+    private juce::TimeSliceClient
+{
+public:
+    MappedAudioSource(juce::MemoryMappedAudioFormatReader& mappedReader,
+        juce::TimeSliceThread& backgroundThread,
+        double pageAheadSeconds);
+    ~MappedAudioSource() override;
+
+    // Opens a mapped reader for uncompressed WAV/AIFF files; nullptr for anything else,
+    // or if the file cannot be mapped
+    static std::unique_ptr<juce::MemoryMappedAudioFormatReader> createReaderFor(juce::AudioFormatManager& formats, const juce::File& file);
+
+    int getNumUnderruns() const override { return underruns.load(std::memory_order_relaxed); }
+
+    // Fraction of the page-ahead window already faulted in
+    float getFillLevel() const override;
+
+    // ===== PositionableAudioSource =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override { return nextPlayPos.load(); }
+    juce::int64 getTotalLength() const override { return reader.lengthInSamples; }
+    bool isLooping() const override { return false; }
+
+private:
+    // A second, hint-only mapping of the file: lets us madvise() the byte range holding
+    // upcoming samples (the reader keeps its own mapping private)
+    class PageAdvisor
+    {
+    public:
+        PageAdvisor(const juce::File& file, const juce::AudioFormatReader& details);
+
+        void willNeed(juce::int64 startSample, juce::int64 numSamples) const;
+
+    private:
+        static juce::int64 findDataStart(const juce::MemoryMappedFile& map);
+
+        juce::MemoryMappedFile map;
+        juce::int64 dataStart = -1;
+        int bytesPerFrame = 0;
+    };
+
+    int useTimeSlice() override;
+    void prepareWindow(juce::int64 start);
+
+    juce::MemoryMappedAudioFormatReader& reader;
+    juce::TimeSliceThread& thread;
+    PageAdvisor advisor;
+
+    const double pageAheadSeconds;
+    juce::int64 windowLength = 0;
+    std::atomic<bool> isPrepared{ false };
+
+    std::atomic<juce::int64> nextPlayPos{ 0 };
+
+    // Samples in [residentStart, residentEnd) have been faulted in by the background thread
+    std::atomic<juce::int64> residentStart{ 0 };
+    std::atomic<juce::int64> residentEnd{ 0 };
+
+    std::atomic<int> underruns{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MappedAudioSource)
+};
@@ -0,0 +1,126 @@
+﻿#include "MixBus.h"
+
+void MixBus::prepare(int numInputsToUse, int numChannelsToUse, int maxBlockSizeToUse)
+{
+    numChannels = juce::jmax(1, numChannelsToUse);
+    maxBlockSize = juce::jmax(1, maxBlockSizeToUse);
+
+    while (inputs.size() < numInputsToUse)
+        inputs.add(new Input());
+
+    while (inputs.size() > numInputsToUse)
+        inputs.removeLast();
+
+    for (auto* input : inputs)
+    {
+        input->buffer.setSize(numChannels, maxBlockSize, false, true, false);
+        input->buffer.clear();
+        input->numSamplesRendered = 0;
+
+        input->lastWeights.allocate((size_t)numChannels, true);
+        for (int ch = 0; ch < numChannels; ++ch)
+            input->lastWeights[ch] = getChannelWeight(input->gain.load(), input->pan.load(), ch, numChannels);
+    }
+}
+
+void MixBus::release()
+{
+    for (auto* input : inputs)
+        input->buffer.setSize(0, 0);
+}
+
+void MixBus::setInputGain(int input, float gain)
+{
+    if (auto* in = inputs[input])
+        in->gain.store(juce::jmax(0.0f, gain));
+}
+
+void MixBus::setInputPan(int input, float pan)
+{
+    if (auto* in = inputs[input])
+        in->pan.store(juce::jlimit(-1.0f, 1.0f, pan));
+}
+
+float MixBus::getInputGain(int input) const
+{
+    if (auto* in = inputs[input])
+        return in->gain.load();
+
+    return 0.0f;
+}
+
+float MixBus::getInputPan(int input) const
+{
+    if (auto* in = inputs[input])
+        return in->pan.load();
+
+    return 0.0f;
+}
+
+// Equal-power pan law on the first two channels; any further channels only get the gain
+float MixBus::getChannelWeight(float gain, float pan, int channel, int numChannels)
+{
+    if (numChannels < 2 || channel > 1)
+        return gain;
+
+    const float angle = (pan + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+    const float weight = (channel == 0 ? std::cos(angle) : std::sin(angle)) * juce::MathConstants<float>::sqrt2;
+    return gain * weight;
+}
+
+juce::AudioSourceChannelInfo MixBus::getInputChannelInfo(int input, int numSamples)
+{
+    auto* in = inputs.getUnchecked(input);
+    jassert(numSamples <= maxBlockSize);
+
+    numSamples = juce::jmin(numSamples, maxBlockSize);
+    in->numSamplesRendered = numSamples;
+    in->buffer.clear(0, numSamples);
+
+    return juce::AudioSourceChannelInfo(&in->buffer, 0, numSamples);
+}
+
+void MixBus::mixInto(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    auto& dest = *bufferToFill.buffer;
+    const int destChannels = juce::jmin(dest.getNumChannels(), numChannels);
+
+    dest.clear(bufferToFill.startSample, bufferToFill.numSamples);
+
+    for (auto* in : inputs)
+    {
+        const int numSamples = juce::jmin(in->numSamplesRendered, bufferToFill.numSamples);
+
+        // Inputs with no deck behind them this block (the engine keeps spares for new decks)
+        if (numSamples <= 0)
+            continue;
+
+        const float gain = in->gain.load(std::memory_order_relaxed);
+        const float pan = in->pan.load(std::memory_order_relaxed);
+
+        for (int ch = 0; ch < destChannels; ++ch)
+        {
+            const float target = getChannelWeight(gain, pan, ch, numChannels);
+            const float previous = in->lastWeights[ch];
+            auto* out = dest.getWritePointer(ch, bufferToFill.startSample);
+            const auto* src = in->buffer.getReadPointer(ch);
+
+            if (previous == target)
+            {
+                // Vectorised accumulate for the common steady-state case
+                if (target == 1.0f)
+                    juce::FloatVectorOperations::add(out, src, numSamples);
+                else if (target != 0.0f)
+                    juce::FloatVectorOperations::addWithMultiply(out, src, target, numSamples);
+            }
+            else
+            {
+                dest.addFromWithRamp(ch, bufferToFill.startSample, src, numSamples, previous, target);
+            }
+
+            in->lastWeights[ch] = target;
+        }
+
+        in->numSamplesRendered = 0;
+    }
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Sums N deck inputs into the output buffer.
+// All scratch memory is allocated in prepare(), so render/mix never touch the heap.
+class MixBus
+{
+public:
+    MixBus() = default;
+    ~MixBus() = default;
+
+    void prepare(int numInputs, int numChannels, int maxBlockSize);
+    void release();
+
+    int getNumInputs() const { return inputs.size(); }
+    int getMaxBlockSize() const { return maxBlockSize; }
+
+    // ===== Per-input controls (safe to call from any thread) =====
+    void setInputGain(int input, float gain);
+    void setInputPan(int input, float pan);   // -1 = left, 0 = centre, +1 = right
+    float getInputGain(int input) const;
+    float getInputPan(int input) const;
+
+    // ===== Audio thread =====
+    // Returns a cleared region of the input's scratch buffer for a deck to render into.
+    // numSamples must not exceed getMaxBlockSize().
+    juce::AudioSourceChannelInfo getInputChannelInfo(int input, int numSamples);
+
+    // Overwrites the destination region with the gain/pan-weighted sum of all inputs.
+    void mixInto(const juce::AudioSourceChannelInfo& bufferToFill);
+
+private:
+    struct Input
+    {
+        juce::AudioBuffer<float> buffer;
+        std::atomic<float> gain{ 1.0f };
+        std::atomic<float> pan{ 0.0f };
+        int numSamplesRendered = 0;
+
+        // Per-channel weights applied in the previous block, used to ramp changes
+        juce::HeapBlock<float> lastWeights;
+    };
+
+    static float getChannelWeight(float gain, float pan, int channel, int numChannels);
+
+    juce::OwnedArray<Input> inputs;
+    int numChannels = 0;
+    int maxBlockSize = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MixBus)
+};
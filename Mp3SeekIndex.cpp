@@ -0,0 +1,459 @@
+﻿#include "Mp3SeekIndex.h"
+#include "DecodedAudioCache.h"
+
+namespace
+{
+    constexpr int bitratesKbps[16] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 };
+    constexpr int sampleRates[4] = { 44100, 48000, 32000, 0 };
+
+    // Header, CRC and the longest side info, plus the VBR tag id behind it
+    constexpr int headerBytes = 4 + 2 + 32 + 4;
+
+    constexpr int tableMagic = 0x4b53334d;     // "M3SK"
+    constexpr int tableVersion = 1;
+    constexpr size_t maxTablesInMemory = 32;
+
+    struct FrameHeader
+    {
+        int length = 0;
+        int sampleRate = 0;
+        int numChannels = 0;
+        int mainDataBegin = 0;
+        bool isVbrTag = false;
+
+        // MPEG-1 Layer III only: other layers and versions use other frame sizes
+        bool parse(const juce::uint8* h, int numBytes)
+        {
+            if (numBytes < 4 || h[0] != 0xff || (h[1] & 0xfe) != 0xfa)
+                return false;
+
+            const int bitrate = bitratesKbps[h[2] >> 4];
+            sampleRate = sampleRates[(h[2] >> 2) & 3];
+
+            // Free-format streams have no bitrate to size their frames by
+            if (bitrate == 0 || sampleRate == 0)
+                return false;
+
+            const bool hasCrc = (h[1] & 1) == 0;
+            numChannels = (h[3] >> 6) == 3 ? 1 : 2;
+            length = 144000 * bitrate / sampleRate + ((h[2] >> 1) & 1);
+
+            const int sideInfo = 4 + (hasCrc ? 2 : 0);
+            const int sideInfoLength = numChannels == 1 ? 17 : 32;
+
+            mainDataBegin = numBytes > sideInfo + 1 ? (h[sideInfo] << 1) | (h[sideInfo + 1] >> 7) : 0;
+
+            const int tagPos = sideInfo + sideInfoLength;
+            isVbrTag = (numBytes >= tagPos + 4
+                        && (std::memcmp(h + tagPos, "Xing", 4) == 0 || std::memcmp(h + tagPos, "Info", 4) == 0))
+                    || (numBytes >= 40 && std::memcmp(h + 36, "VBRI", 4) == 0);
+            return true;
+        }
+    };
+
+    bool readHeader(juce::InputStream& in, juce::int64 pos, FrameHeader& header)
+    {
+        juce::uint8 bytes[headerBytes];
+
+        if (!in.setPosition(pos))
+            return false;
+
+        return header.parse(bytes, in.read(bytes, headerBytes));
+    }
+
+    juce::int64 skipId3v2(juce::InputStream& in)
+    {
+        juce::int64 pos = 0;
+        juce::uint8 tag[10];
+
+        while (in.setPosition(pos) && in.read(tag, 10) == 10 && std::memcmp(tag, "ID3", 3) == 0)
+        {
+            const juce::int64 size = ((tag[6] & 0x7f) << 21) | ((tag[7] & 0x7f) << 14) | ((tag[8] & 0x7f) << 7) | (tag[9] & 0x7f);
+            pos += 10 + size + ((tag[5] & 0x10) != 0 ? 10 : 0);
+        }
+
+        return pos;
+    }
+
+    // The next frame at or after pos, confirmed by a matching header straight after it
+    // (so a stray sync pattern in junk or artwork does not count); -1 if there is none
+    juce::int64 findFrame(juce::InputStream& in, juce::int64 pos, juce::int64 fileLength)
+    {
+        for (; pos + 4 <= fileLength; ++pos)
+        {
+            FrameHeader header, next;
+
+            if (readHeader(in, pos, header)
+                && (pos + header.length >= fileLength
+                    || (readHeader(in, pos + header.length, next)
+                        && next.sampleRate == header.sampleRate && next.numChannels == header.numChannels)))
+                return pos;
+        }
+
+        return -1;
+    }
+}
+
+// ===== Table =====
+std::unique_ptr<Mp3SeekIndex::Table> Mp3SeekIndex::Table::build(const juce::File& file, const std::function<bool()>& shouldStop)
+{
+    juce::FileInputStream fileStream(file);
+    if (!fileStream.openedOk())
+        return {};
+
+    juce::BufferedInputStream in(fileStream, 65536);
+    const auto fileLength = in.getTotalLength();
+
+    auto pos = findFrame(in, skipId3v2(in), fileLength);
+    if (pos < 0)
+        return {};
+
+    auto table = std::make_unique<Table>();
+    bool first = true;
+
+    for (int step = 0; pos >= 0 && pos + 4 <= fileLength; ++step)
+    {
+        if (shouldStop && (step & 1023) == 0 && shouldStop())
+            return {};
+
+        FrameHeader header;
+
+        // Junk between frames (or the tags at the end): resync as the decoder does
+        if (!readHeader(in, pos, header))
+        {
+            pos = findFrame(in, pos + 1, fileLength);
+            continue;
+        }
+
+        if (first)
+        {
+            table->sampleRate = header.sampleRate;
+            table->numChannels = header.numChannels;
+        }
+        else if (header.sampleRate != (int)table->sampleRate || header.numChannels != table->numChannels)
+        {
+            return {};
+        }
+
+        // A truncated last frame is not played
+        if (pos + header.length > fileLength)
+            break;
+
+        if (!(first && header.isVbrTag))
+        {
+            table->frameOffsets.push_back(pos);
+            table->selfContained.push_back(header.mainDataBegin == 0);
+        }
+
+        first = false;
+        pos += header.length;
+        table->dataEnd = pos;
+    }
+
+    if (table->frameOffsets.empty())
+        return {};
+
+    table->lengthInSamples = (juce::int64)table->getNumFrames() * samplesPerFrame;
+    return table;
+}
+
+// Offsets are stored as gaps from the previous frame (a frame length, give or take the odd
+// run of junk), packed with the self-contained flag into a compressed int
+bool Mp3SeekIndex::Table::writeTo(juce::OutputStream& out, const juce::String& fileKey) const
+{
+    out.writeInt(tableMagic);
+    out.writeInt(tableVersion);
+    out.writeString(fileKey);
+    out.writeDouble(sampleRate);
+    out.writeInt(numChannels);
+    out.writeInt64(dataEnd);
+    out.writeInt(getNumFrames());
+    out.writeInt64(frameOffsets.front());
+
+    for (int i = 0; i < getNumFrames(); ++i)
+    {
+        const auto gap = i > 0 ? frameOffsets[(size_t)i] - frameOffsets[(size_t)i - 1] : 0;
+        out.writeCompressedInt((int)(gap << 1) | (selfContained[(size_t)i] ? 1 : 0));
+    }
+
+    out.flush();
+    return out.getStatus().wasOk();
+}
+
+std::unique_ptr<Mp3SeekIndex::Table> Mp3SeekIndex::Table::readFrom(juce::InputStream& in, const juce::String& fileKey)
+{
+    if (in.readInt() != tableMagic || in.readInt() != tableVersion || in.readString() != fileKey)
+        return {};
+
+    auto table = std::make_unique<Table>();
+    table->sampleRate = in.readDouble();
+    table->numChannels = in.readInt();
+    table->dataEnd = in.readInt64();
+
+    const int numFrames = in.readInt();
+    auto offset = in.readInt64();
+
+    // A frame is at least 96 bytes, so more frames than that is a damaged file
+    if (numFrames <= 0 || (juce::int64)numFrames > table->dataEnd / 96 + 1 || table->sampleRate <= 0.0)
+        return {};
+
+    table->frameOffsets.reserve((size_t)numFrames);
+    table->selfContained.reserve((size_t)numFrames);
+
+    for (int i = 0; i < numFrames; ++i)
+    {
+        if (in.isExhausted())
+            return {};
+
+        const int packed = in.readCompressedInt();
+        offset += packed >> 1;
+
+        table->frameOffsets.push_back(offset);
+        table->selfContained.push_back((packed & 1) != 0);
+    }
+
+    table->lengthInSamples = (juce::int64)numFrames * samplesPerFrame;
+    return table;
+}
+
+// ===== Index =====
+Mp3SeekIndex::Mp3SeekIndex()
+    : directory(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("SeekIndex"))
+{
+}
+
+Mp3SeekIndex::~Mp3SeekIndex()
+{
+    // Scans check between frames, so this is quick; they must be gone before the index is
+    builder.removeAllJobs(true, -1);
+}
+
+Mp3SeekIndex::TablePtr Mp3SeekIndex::find(const juce::File& file)
+{
+    RealtimeGuard::assertNotRealtime("Mp3SeekIndex::find");
+    const auto key = DecodedAudioCache::getKeyFor(file);
+
+    {
+        const juce::ScopedLock sl(lock);
+        const auto found = tables.find(key);
+
+        if (found != tables.end())
+            return found->second;
+    }
+
+    juce::FileInputStream in(getTableFile(key));
+    if (!in.openedOk())
+        return {};
+
+    TablePtr table = Table::readFrom(in, key);
+
+    if (table != nullptr)
+        store(key, table);
+
+    return table;
+}
+
+void Mp3SeekIndex::buildInBackground(const juce::File& file, juce::int64 expectedLength)
+{
+    const auto key = DecodedAudioCache::getKeyFor(file);
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (tables.count(key) > 0 || building.contains(key) || rejected.contains(key))
+            return;
+
+        building.add(key);
+    }
+
+    builder.addJob([this, file, key, expectedLength]
+        {
+            auto* job = juce::ThreadPoolJob::getCurrentThreadPoolJob();
+            TablePtr table = Table::build(file, [job] { return job != nullptr && job->shouldExit(); });
+
+            // A scan that disagrees with the decoder would put seeks in the wrong place
+            if (table != nullptr && table->lengthInSamples != expectedLength)
+            {
+                DBG("Mp3SeekIndex: " << file.getFileName() << " scans to " << table->lengthInSamples
+                    << " samples but decodes to " << expectedLength << ", not indexed");
+                table = nullptr;
+            }
+
+            if (table != nullptr)
+            {
+                directory.createDirectory();
+
+                juce::TemporaryFile temp(getTableFile(key));
+                bool written = false;
+
+                if (auto out = temp.getFile().createOutputStream())
+                {
+                    written = table->writeTo(*out, key);
+                    out.reset();
+                }
+
+                if (!written || !temp.overwriteTargetFileWithTemporary())
+                    DBG("Mp3SeekIndex: could not save the table for " << file.getFileName());
+
+                store(key, table);
+            }
+
+            const juce::ScopedLock sl(lock);
+            building.removeString(key);
+
+            if (table == nullptr)
+                rejected.add(key);
+        });
+}
+
+juce::File Mp3SeekIndex::getTableFile(const juce::String& fileKey) const
+{
+    return directory.getChildFile(juce::String::toHexString(fileKey.hashCode64()) + ".seek");
+}
+
+void Mp3SeekIndex::store(const juce::String& fileKey, TablePtr table)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (tables.count(fileKey) == 0)
+        loadOrder.add(fileKey);
+
+    tables[fileKey] = std::move(table);
+
+    // Tables are a few hundred KB for an hour of audio; readers hold on to their own
+    while (tables.size() > maxTablesInMemory)
+    {
+        tables.erase(loadOrder[0]);
+        loadOrder.remove(0);
+    }
+}
+
+// ===== Reader =====
+SeekIndexedMp3Reader::SeekIndexedMp3Reader(const juce::File& f, Mp3SeekIndex::TablePtr t, juce::AudioFormat& mp3Format)
+    : juce::AudioFormatReader(nullptr, mp3Format.getFormatName()),
+    file(f),
+    table(std::move(t)),
+    format(mp3Format)
+{
+    sampleRate = table->sampleRate;
+    bitsPerSample = 32;
+    lengthInSamples = table->lengthInSamples;
+    numChannels = (unsigned int)table->numChannels;
+    usesFloatingPointData = true;
+
+    scratch.setSize(table->numChannels, 4096);
+}
+
+bool SeekIndexedMp3Reader::readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+    juce::int64 startSampleInFile, int numSamples)
+{
+    clearSamplesBeyondAvailableLength(destChannels, numDestChannels, startOffsetInDestBuffer,
+        startSampleInFile, numSamples, lengthInSamples);
+
+    while (numSamples > 0)
+    {
+        // Reads that carry on from the last one (or skip less than a frame) keep decoding;
+        // anything else is a seek
+        const bool followsOn = window != nullptr
+            && startSampleInFile >= nextSample
+            && startSampleInFile - nextSample < Mp3SeekIndex::Table::samplesPerFrame
+            && startSampleInFile < windowEndSample;
+
+        if (!followsOn && !openWindow(startSampleInFile))
+            return false;
+
+        if (!skipTo(startSampleInFile))
+            return false;
+
+        const int num = (int)juce::jmin((juce::int64)numSamples, windowEndSample - startSampleInFile);
+
+        if (!window->readSamples(destChannels, numDestChannels, startOffsetInDestBuffer, startSampleInFile - windowStartSample, num))
+            return false;
+
+        nextSample = startSampleInFile + num;
+        startOffsetInDestBuffer += num;
+        startSampleInFile += num;
+        numSamples -= num;
+    }
+
+    return true;
+}
+
+// Opens the decoder on the frames around the target
+bool SeekIndexedMp3Reader::openWindow(juce::int64 targetSample)
+{
+    constexpr int samplesPerFrame = Mp3SeekIndex::Table::samplesPerFrame;
+
+    const int numFrames = table->getNumFrames();
+    const int targetFrame = (int)juce::jlimit((juce::int64)0, (juce::int64)numFrames - 1, targetSample / samplesPerFrame);
+    const int firstFrame = findFirstFrameToDecode(targetFrame);
+    const int endFrame = juce::jmin(numFrames, targetFrame + windowFrames);
+
+    window.reset();
+
+    auto source = std::make_unique<juce::FileInputStream>(file);
+    if (!source->openedOk())
+        return false;
+
+    const auto start = table->frameOffsets[(size_t)firstFrame];
+    auto* region = new juce::SubregionStream(source.release(), start, table->getFrameEnd(endFrame - 1) - start, true);
+
+    // The decoder pulls a few bytes at a time, so give it a buffer; it owns the streams if it opens
+    window.reset(format.createReaderFor(new juce::BufferedInputStream(region, 32768, true), true));
+
+    if (window == nullptr)
+        return false;
+
+    // The decoder drops a first frame whose main data lies in the reservoir it never saw
+    const int firstDecoded = firstFrame + (table->selfContained[(size_t)firstFrame] ? 0 : 1);
+
+    windowStartSample = (juce::int64)firstDecoded * samplesPerFrame;
+    windowEndSample = (juce::int64)endFrame * samplesPerFrame;
+    nextSample = windowStartSample;
+    return true;
+}
+
+// Decodes and drops everything up to the target
+bool SeekIndexedMp3Reader::skipTo(juce::int64 targetSample)
+{
+    while (nextSample < targetSample)
+    {
+        const int num = (int)juce::jmin((juce::int64)scratch.getNumSamples(), targetSample - nextSample);
+        auto* const* channels = reinterpret_cast<int* const*>(scratch.getArrayOfWritePointers());
+
+        if (!window->readSamples(channels, scratch.getNumChannels(), 0, nextSample - windowStartSample, num))
+            return false;
+
+        nextSample += num;
+    }
+
+    return true;
+}
+
+// The target's output overlaps the frame before it, and that frame's main data may start up
+// to 511 bytes back in the frames before that, so decoding starts early enough to cover both.
+// A frame that needs nothing from the reservoir is a clean place to start, if one is close by.
+int SeekIndexedMp3Reader::findFirstFrameToDecode(int targetFrame) const
+{
+    constexpr juce::int64 reservoirMargin = 1024;
+    constexpr int maxPreroll = 12;
+    constexpr int maxCleanSearch = 8;
+
+    if (targetFrame == 0)
+        return 0;
+
+    const auto& offsets = table->frameOffsets;
+    const int overlapFrame = targetFrame - 1;
+    int first = overlapFrame;
+
+    while (first > 0 && targetFrame - first < maxPreroll
+           && offsets[(size_t)overlapFrame] - offsets[(size_t)first] < reservoirMargin)
+        --first;
+
+    for (int f = first; f >= juce::jmax(0, first - maxCleanSearch); --f)
+        if (table->selfContained[(size_t)f])
+            return f;
+
+    return first;
+}
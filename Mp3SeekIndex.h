@@ -0,0 +1,112 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "RealtimeGuard.h"
+
+// Frame-level seek tables for MP3 files, shared by every deck.
+//
+// The first time a file is opened its frame headers are scanned on a background thread
+// (no decoding) and the table is saved next to the library index, keyed by the file's path,
+// size and modification time. Later opens read the table instead of scanning the file, and
+// seeks jump straight to the frame holding the target (see SeekIndexedMp3Reader).
+// Only MPEG-1 Layer III with a fixed frame size is indexed; anything else keeps the plain reader.
+class Mp3SeekIndex
+{
+public:
+    struct Table
+    {
+        static constexpr int samplesPerFrame = 1152;
+
+        double sampleRate = 0.0;
+        int numChannels = 0;
+        juce::int64 lengthInSamples = 0;
+
+        // Byte position of each audio frame (the VBR tag frame is left out, as the decoder
+        // skips it), and one past the end of the last one
+        std::vector<juce::int64> frameOffsets;
+        juce::int64 dataEnd = 0;
+
+        // Frames whose main data starts in the frame itself rather than in the bit reservoir
+        std::vector<bool> selfContained;
+
+        int getNumFrames() const { return (int)frameOffsets.size(); }
+        juce::int64 getFrameEnd(int frame) const { return frame + 1 < getNumFrames() ? frameOffsets[(size_t)frame + 1] : dataEnd; }
+
+        // Scans the frame headers; nullptr if the file is not plain MPEG-1 Layer III, or if
+        // shouldStop (polled as the scan goes) returns true
+        static std::unique_ptr<Table> build(const juce::File& file, const std::function<bool()>& shouldStop = nullptr);
+
+        bool writeTo(juce::OutputStream& out, const juce::String& fileKey) const;
+        static std::unique_ptr<Table> readFrom(juce::InputStream& in, const juce::String& fileKey);
+    };
+
+    using TablePtr = std::shared_ptr<const Table>;
+
+    Mp3SeekIndex();
+    ~Mp3SeekIndex();
+
+    static bool canIndex(const juce::File& file) { return file.hasFileExtension("mp3"); }
+
+    // The table from memory or disk, or nullptr if the file has not been indexed yet
+    TablePtr find(const juce::File& file);
+
+    // Queues a scan of the file unless one is already queued. The table is only kept if its
+    // length matches what the decoder reported when it opened the file (expectedLength),
+    // so indexed reads line up with the samples of a plain decode.
+    void buildInBackground(const juce::File& file, juce::int64 expectedLength);
+
+    juce::File getDirectory() const { return directory; }
+
+private:
+    juce::File getTableFile(const juce::String& fileKey) const;
+    void store(const juce::String& fileKey, TablePtr table);
+
+    juce::File directory;
+    juce::ThreadPool builder{ 1 };
+
+    juce::CriticalSection lock;
+    std::map<juce::String, TablePtr> tables;
+    juce::StringArray loadOrder;
+
+    // Files being scanned, and those whose scan did not match the decoder (this session only)
+    juce::StringArray building, rejected;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Mp3SeekIndex)
+};
+
+
+// Reads an MP3 through its seek table. A seek opens the decoder on a window of frames
+// starting a few frames before the target (enough to refill the bit reservoir and the
+// filterbank overlap), decodes and drops the samples up to the target and carries on from
+// there, so the cost of a seek is a handful of frames however long the file is, and every
+// sample lands where a decode from the start of the file would put it.
+// The decoder format is borrowed and must outlive the reader.
+class SeekIndexedMp3Reader : public juce::AudioFormatReader
+{
+public:
+    SeekIndexedMp3Reader(const juce::File& file, Mp3SeekIndex::TablePtr table, juce::AudioFormat& mp3Format);
+    ~SeekIndexedMp3Reader() override = default;
+
+    bool readSamples(int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+        juce::int64 startSampleInFile, int numSamples) override;
+
+    // Frames one decoder window covers past the target
+    static constexpr int windowFrames = 256;
+
+private:
+    bool openWindow(juce::int64 targetSample);
+    bool skipTo(juce::int64 targetSample);
+    int findFirstFrameToDecode(int targetFrame) const;
+
+    const juce::File file;
+    const Mp3SeekIndex::TablePtr table;
+    juce::AudioFormat& format;
+
+    std::unique_ptr<juce::AudioFormatReader> window;
+    juce::int64 windowStartSample = 0;  // file position of the window's first decoded sample
+    juce::int64 windowEndSample = 0;
+    juce::int64 nextSample = -1;        // file position the window decodes next
+
+    juce::AudioBuffer<float> scratch;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SeekIndexedMp3Reader)
+};
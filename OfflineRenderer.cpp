@@ -0,0 +1,337 @@
+﻿#include "OfflineRenderer.h"
+
+namespace
+{
+    constexpr int numOutputChannels = 2;
+    constexpr int writerFifoSamples = 1 << 18;
+
+    bool parseAction(const juce::String& name, OfflineRenderer::Event::Action& action)
+    {
+        using Action = OfflineRenderer::Event::Action;
+
+        static const std::pair<const char*, Action> actions[] = {
+            { "play", Action::play }, { "stop", Action::stop }, { "gain", Action::gain },
+            { "speed", Action::speed }, { "seek", Action::seek }, { "marker", Action::marker },
+            { "loop", Action::loop }, { "segmentLoop", Action::segmentLoop } };
+
+        for (auto& a : actions)
+        {
+            if (name == a.first)
+            {
+                action = a.second;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    juce::int64 toSamples(double seconds, double sampleRate)
+    {
+        return (juce::int64)std::llround(juce::jmax(0.0, seconds) * sampleRate);
+    }
+}
+
+// ===== Spec =====
+bool OfflineRenderer::loadSpec(const juce::File& specFile, Spec& spec, juce::String& error)
+{
+    const auto json = juce::JSON::parse(specFile);
+    if (!json.isObject())
+    {
+        error = "Could not parse " + specFile.getFullPathName();
+        return false;
+    }
+
+    const auto folder = specFile.getParentDirectory();
+
+    spec = {};
+    spec.output = folder.getChildFile(json.getProperty("output", "mix.wav").toString());
+    spec.sampleRate = json.getProperty("sampleRate", spec.sampleRate);
+    spec.bitDepth = json.getProperty("bitDepth", spec.bitDepth);
+    spec.blockSize = json.getProperty("blockSize", spec.blockSize);
+    spec.lengthSeconds = json.getProperty("length", spec.lengthSeconds);
+    spec.readAheadSeconds = json.getProperty("readAhead", spec.readAheadSeconds);
+    spec.parallel = json.getProperty("parallel", spec.parallel);
+
+    if (spec.sampleRate < 8000.0 || spec.sampleRate > 384000.0)
+    {
+        error = "Unsupported sample rate " + juce::String(spec.sampleRate);
+        return false;
+    }
+
+    spec.blockSize = juce::jlimit(64, 65536, spec.blockSize);
+
+    if (auto* decks = json["decks"].getArray())
+    {
+        for (auto& d : *decks)
+        {
+            DeckSpec deck;
+
+            if (auto* playlist = d["playlist"].getArray())
+                for (auto& path : *playlist)
+                    deck.playlist.add(folder.getChildFile(path.toString()));
+
+            deck.gain = d.getProperty("gain", deck.gain);
+            deck.speed = d.getProperty("speed", deck.speed);
+            deck.keepPitch = d.getProperty("keepPitch", deck.keepPitch);
+            deck.startTime = d.getProperty("start", deck.startTime);
+            deck.startPosition = d.getProperty("position", deck.startPosition);
+            deck.trackCrossfade = d.getProperty("crossfade", deck.trackCrossfade);
+            deck.loopTrack = d.getProperty("loop", deck.loopTrack);
+            deck.segmentLoop = d.getProperty("segmentLoop", deck.segmentLoop);
+            deck.loopStart = d.getProperty("loopStart", deck.loopStart);
+            deck.loopEnd = d.getProperty("loopEnd", deck.loopEnd);
+
+            if (auto* markers = d["markers"].getArray())
+                for (auto& m : *markers)
+                    deck.markers.push_back((double)m);
+
+            if (deck.playlist.isEmpty())
+            {
+                error = "Deck " + juce::String((int)spec.decks.size() + 1) + " has an empty playlist";
+                return false;
+            }
+
+            spec.decks.push_back(std::move(deck));
+        }
+    }
+
+    if (spec.decks.empty())
+    {
+        error = "The spec has no decks";
+        return false;
+    }
+
+    if ((int)spec.decks.size() > DeckEngine::maxDecks)
+    {
+        error = "A render can have at most " + juce::String(DeckEngine::maxDecks) + " decks";
+        return false;
+    }
+
+    if (auto* events = json["events"].getArray())
+    {
+        for (auto& e : *events)
+        {
+            Event event;
+            event.time = e.getProperty("time", 0.0);
+            event.deck = e.getProperty("deck", 0);
+            event.value = e.getProperty("value", 0.0);
+
+            if (!parseAction(e["action"].toString(), event.action) || !juce::isPositiveAndBelow(event.deck, (int)spec.decks.size()))
+            {
+                error = "Bad event: " + juce::JSON::toString(e, true);
+                return false;
+            }
+
+            spec.events.push_back(event);
+        }
+    }
+
+    // A looping deck never runs out, so the render needs an explicit end
+    const bool loopsForever = std::any_of(spec.decks.begin(), spec.decks.end(),
+        [](const DeckSpec& d) { return d.loopTrack || d.segmentLoop; });
+
+    if (loopsForever && spec.lengthSeconds <= 0.0)
+    {
+        error = "A deck loops, so the spec needs a \"length\"";
+        return false;
+    }
+
+    return true;
+}
+
+juce::String OfflineRenderer::Result::toString() const
+{
+    if (!succeeded)
+        return "Render failed: " + error;
+
+    return "Rendered " + juce::String(audioSeconds, 1) + " s in " + juce::String(wallSeconds, 2) + " s ("
+        + juce::String(getRealtimeFactor(), 1) + "x realtime, " + juce::String(underruns) + " underruns)";
+}
+
+// ===== Rendering =====
+OfflineRenderer::Result OfflineRenderer::render(const Spec& spec)
+{
+    RealtimeGuard::assertNotRealtime("OfflineRenderer::render");
+
+    Result result;
+    const int blockSize = spec.blockSize;
+
+    // ===== Output =====
+    const bool flac = spec.output.hasFileExtension("flac");
+    std::unique_ptr<juce::AudioFormat> format(flac ? (juce::AudioFormat*)new juce::FlacAudioFormat()
+                                                   : (juce::AudioFormat*)new juce::WavAudioFormat());
+
+    const int bitDepth = flac ? juce::jmin(24, spec.bitDepth) : spec.bitDepth;
+
+    spec.output.deleteFile();
+    auto* stream = spec.output.createOutputStream().release();
+
+    if (stream == nullptr)
+    {
+        result.error = "Could not create " + spec.output.getFullPathName();
+        return result;
+    }
+
+    // The writer takes ownership of the stream only if it succeeds
+    auto* writer = format->createWriterFor(stream, spec.sampleRate, numOutputChannels, bitDepth, {}, 0);
+    if (writer == nullptr)
+    {
+        delete stream;
+        result.error = "Cannot write " + juce::String(bitDepth) + "-bit " + format->getFormatName();
+        return result;
+    }
+
+    juce::TimeSliceThread writerThread("Render Writer");
+    writerThread.startThread();
+    auto output = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(writer, writerThread, writerFifoSamples);
+
+    // ===== Decks =====
+    // Declared first so it outlives the decks it renders; no more workers than decks to share
+    const int numWorkers = spec.parallel ? juce::jmin((int)spec.decks.size() - 1, juce::SystemStats::getNumCpus() - 1) : 0;
+    DeckEngine engine(juce::jmax(0, numWorkers));
+    engine.setParallel(spec.parallel);
+
+    juce::OwnedArray<PlayerAudio> decks;
+    std::vector<int> nextInPlaylist;
+    std::vector<Event> events(spec.events);
+
+    for (size_t i = 0; i < spec.decks.size(); ++i)
+    {
+        const auto& deckSpec = spec.decks[i];
+        auto* deck = decks.add(new PlayerAudio());
+
+        deck->setBlockingReads(true);
+        deck->setReadAheadSeconds(spec.readAheadSeconds);
+        deck->prepareToPlay(blockSize, spec.sampleRate);
+
+        deck->setGain(deckSpec.gain);
+        deck->setSpeed(deckSpec.speed);
+        deck->setSpeedMode(deckSpec.keepPitch ? PlayerAudio::SpeedMode::preservePitch : PlayerAudio::SpeedMode::resample);
+        deck->setTrackCrossfade(deckSpec.trackCrossfade);
+        deck->setLooping(deckSpec.loopTrack);
+        deck->setLoopPoints(deckSpec.loopStart, deckSpec.loopEnd);
+        deck->enableSegmentLoop(deckSpec.segmentLoop);
+
+        if (!deck->loadFileNow(deckSpec.playlist.getFirst()))
+        {
+            result.error = "Could not open " + deckSpec.playlist.getFirst().getFullPathName();
+            output.reset();
+            spec.output.deleteFile();
+            return result;
+        }
+
+        if (deckSpec.startPosition > 0.0)
+            deck->setPosition(deckSpec.startPosition);
+
+        int next = 1;
+        while (next < deckSpec.playlist.size() && !deck->queueNextFileNow(deckSpec.playlist[next]))
+            ++next;
+
+        nextInPlaylist.push_back(next + 1);
+        engine.addDeck(*deck);
+
+        Event play;
+        play.time = deckSpec.startTime;
+        play.deck = (int)i;
+        events.push_back(play);
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    engine.prepareToPlay(blockSize, spec.sampleRate);
+
+    // ===== Render loop =====
+    juce::AudioBuffer<float> mix(numOutputChannels, blockSize);
+    const auto totalSamples = spec.lengthSeconds > 0.0 ? toSamples(spec.lengthSeconds, spec.sampleRate)
+                                                      : std::numeric_limits<juce::int64>::max();
+    juce::int64 rendered = 0;
+    size_t nextEvent = 0;
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+
+    while (rendered < totalSamples)
+    {
+        // Events land on their exact sample: blocks are cut short in front of the next one
+        while (nextEvent < events.size() && toSamples(events[nextEvent].time, spec.sampleRate) <= rendered)
+        {
+            const auto& event = events[nextEvent++];
+            applyEvent(event, spec, *decks[event.deck]);
+        }
+
+        if (spec.lengthSeconds <= 0.0 && nextEvent >= events.size()
+            && std::none_of(decks.begin(), decks.end(), [](PlayerAudio* d) { return d->isPlaying(); }))
+            break;
+
+        auto numSamples = juce::jmin((juce::int64)blockSize, totalSamples - rendered);
+        if (nextEvent < events.size())
+            numSamples = juce::jmin(numSamples, toSamples(events[nextEvent].time, spec.sampleRate) - rendered);
+
+        {
+            RealtimeGuard::ScopedRealtimeSection realtimeSection;
+            engine.render(juce::AudioSourceChannelInfo(&mix, 0, (int)numSamples));
+        }
+
+        while (!output->write(mix.getArrayOfReadPointers(), (int)numSamples))
+            juce::Thread::sleep(1);
+
+        rendered += numSamples;
+
+        // Keep the next playlist entry queued behind whatever each deck is playing
+        for (int i = 0; i < decks.size(); ++i)
+        {
+            if (!decks[i]->pollTrackAdvance())
+                continue;
+
+            const auto& playlist = spec.decks[(size_t)i].playlist;
+            auto& next = nextInPlaylist[(size_t)i];
+
+            while (next < playlist.size() && !decks[i]->queueNextFileNow(playlist[next]))
+                ++next;
+
+            ++next;
+        }
+    }
+
+    result.wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    result.audioSeconds = (double)rendered / spec.sampleRate;
+
+    for (auto* deck : decks)
+        result.underruns += deck->getUnderrunCount();
+
+    // Flushes the FIFO and closes the file; counted, since a slow encoder is part of the render
+    output.reset();
+    writerThread.stopThread(5000);
+    result.wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+    engine.releaseResources();
+
+    result.succeeded = true;
+    return result;
+}
+
+void OfflineRenderer::applyEvent(const Event& event, const Spec& spec, PlayerAudio& deck)
+{
+    using Action = Event::Action;
+
+    switch (event.action)
+    {
+        case Action::play:        deck.start(); break;
+        case Action::stop:        deck.stop(); break;
+        case Action::gain:        deck.setGain((float)event.value); break;
+        case Action::speed:       deck.setSpeed((float)event.value); break;
+        case Action::seek:        deck.setPosition(event.value); break;
+        case Action::loop:        deck.setLooping(event.value != 0.0); break;
+        case Action::segmentLoop: deck.enableSegmentLoop(event.value != 0.0); break;
+
+        case Action::marker:
+        {
+            const auto& markers = spec.decks[(size_t)event.deck].markers;
+            const int index = (int)event.value;
+
+            if (juce::isPositiveAndBelow(index, (int)markers.size()))
+                deck.setPosition(markers[(size_t)index]);
+            break;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "PlayerAudio.h"
+#include "DeckEngine.h"
+
+// Renders the deck mix to a WAV/FLAC file without an audio device, as fast as the
+// machine allows. The decks are ordinary PlayerAudio instances rendered by a DeckEngine, exactly
+// as MainComponent does it, but their streams wait for the disk instead of underrunning and
+// the output is encoded on a background writer thread.
+//
+// A render is described by a JSON spec (see README):
+//   { "output": "mix.wav", "sampleRate": 44100, "bitDepth": 24, "length": 300,
+//     "decks": [ { "playlist": [ "a.mp3", "b.flac" ], "gain": 0.8, "speed": 1.0,
+//                  "keepPitch": false, "start": 0, "position": 0, "crossfade": 2,
+//                  "loop": false, "loopStart": 0, "loopEnd": 0, "segmentLoop": false,
+//                  "markers": [ 12.5, 40 ] } ],
+//     "events": [ { "time": 30, "deck": 0, "action": "marker", "value": 1 } ] }
+// Relative paths are resolved against the spec's folder. Without a length the render
+// stops once every deck has played out its playlist.
+class OfflineRenderer
+{
+public:
+    struct DeckSpec
+    {
+        juce::Array<juce::File> playlist;
+
+        float gain = 1.0f;
+        float speed = 1.0f;
+        bool keepPitch = false;
+
+        // Mix time at which the deck starts, and where in its first track
+        double startTime = 0.0;
+        double startPosition = 0.0;
+        double trackCrossfade = 0.0;
+
+        bool loopTrack = false;
+        bool segmentLoop = false;
+        double loopStart = 0.0, loopEnd = 0.0;
+
+        std::vector<double> markers;
+    };
+
+    // A change applied to one deck at an exact sample of the mix
+    struct Event
+    {
+        enum class Action { play, stop, gain, speed, seek, marker, loop, segmentLoop };
+
+        double time = 0.0;
+        int deck = 0;
+        Action action = Action::play;
+        double value = 0.0;
+    };
+
+    struct Spec
+    {
+        juce::File output;
+        double sampleRate = 44100.0;
+        int bitDepth = 24;
+        int blockSize = 4096;
+        double lengthSeconds = 0.0;
+        double readAheadSeconds = 4.0;
+        bool parallel = true;
+
+        std::vector<DeckSpec> decks;
+        std::vector<Event> events;
+    };
+
+    struct Result
+    {
+        bool succeeded = false;
+        juce::String error;
+
+        double audioSeconds = 0.0;
+        double wallSeconds = 0.0;
+        int underruns = 0;
+
+        double getRealtimeFactor() const { return wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0; }
+        juce::String toString() const;
+    };
+
+    OfflineRenderer() = default;
+
+    static bool loadSpec(const juce::File& specFile, Spec& spec, juce::String& error);
+
+    // Blocks until the whole mix has been written
+    Result render(const Spec& spec);
+
+private:
+    static void applyEvent(const Event& event, const Spec& spec, PlayerAudio& deck);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineRenderer)
+};
@@ -0,0 +1,432 @@
+﻿#include "PeakCache.h"
+#include "RealtimeGuard.h"
+
+namespace
+{
+    constexpr int peakFileMagic = 0x314b4150;   // "PAK1"
+    constexpr int peakFileVersion = 1;
+    constexpr int maxRecentPeaks = 16;
+
+    // Whole coarsest-level peaks per read, so every level advances in step
+    constexpr int buildChunkSize = 256 << 8;
+
+    juce::int8 toPeakValue(float sample) noexcept
+    {
+        return (juce::int8)juce::jlimit(-127, 127, juce::roundToInt(sample * 127.0f));
+    }
+}
+
+// ===== Peaks =====
+PeakCache::Peaks::Peaks(int channels, double rate, juce::int64 length)
+    : numChannels(juce::jlimit(1, 2, channels)),
+    sampleRate(rate),
+    lengthInSamples(juce::jmax((juce::int64)0, length))
+{
+    for (int level = 0; level < numLevels; ++level)
+    {
+        const auto samplesPerPeak = (juce::int64)getSamplesPerPeak(level);
+        levels[level].numPeaks = (int)((lengthInSamples + samplesPerPeak - 1) / samplesPerPeak);
+        levels[level].data.allocate((size_t)levels[level].numPeaks * (size_t)numChannels * 2, true);
+    }
+}
+
+bool PeakCache::Peaks::getMinMax(int channel, juce::int64 startSample, juce::int64 endSample, float& minValue, float& maxValue) const noexcept
+{
+    channel = juce::jlimit(0, numChannels - 1, channel);
+    const auto span = juce::jmax((juce::int64)1, endSample - startSample);
+
+    // Coarsest level whose peaks are no wider than the span, falling back to finer
+    // levels while the coarse ones have not caught up with the build yet
+    int level = 0;
+    while (level < numLevels - 1 && getSamplesPerPeak(level + 1) <= span)
+        ++level;
+
+    for (; level >= 0; --level)
+    {
+        const auto& l = levels[level];
+        const int samplesPerPeak = getSamplesPerPeak(level);
+        const int ready = l.numReady.load(std::memory_order_acquire);
+        const int first = (int)(startSample / samplesPerPeak);
+
+        if (first >= ready)
+            continue;
+
+        const int last = juce::jlimit(first + 1, ready, (int)((endSample + samplesPerPeak - 1) / samplesPerPeak));
+        int lo = 127, hi = -127;
+
+        for (int i = first; i < last; ++i)
+        {
+            const auto* peak = l.data.get() + ((size_t)i * (size_t)numChannels + (size_t)channel) * 2;
+            lo = juce::jmin(lo, (int)peak[0]);
+            hi = juce::jmax(hi, (int)peak[1]);
+        }
+
+        minValue = (float)lo / 127.0f;
+        maxValue = (float)hi / 127.0f;
+        return true;
+    }
+
+    return false;
+}
+
+void PeakCache::Peaks::drawChannels(juce::Graphics& g, juce::Rectangle<int> area, double startTime, double endTime, float verticalZoom) const
+{
+    if (area.isEmpty() || endTime <= startTime || sampleRate <= 0.0)
+        return;
+
+    const int bandHeight = area.getHeight() / numChannels;
+    const double samplesPerPixel = (endTime - startTime) * sampleRate / area.getWidth();
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float centre = (float)area.getY() + bandHeight * (ch + 0.5f);
+        const float halfHeight = bandHeight * 0.5f * verticalZoom;
+
+        for (int x = 0; x < area.getWidth(); ++x)
+        {
+            const auto start = (juce::int64)(startTime * sampleRate + x * samplesPerPixel);
+            const auto end = (juce::int64)(startTime * sampleRate + (x + 1) * samplesPerPixel);
+            float lo = 0.0f, hi = 0.0f;
+
+            if (!getMinMax(ch, start, end, lo, hi))
+                break;
+
+            const float top = centre - juce::jlimit(-1.0f, 1.0f, hi) * halfHeight;
+            const float bottom = centre - juce::jlimit(-1.0f, 1.0f, lo) * halfHeight;
+            g.fillRect((float)(area.getX() + x), top, 1.0f, juce::jmax(1.0f, bottom - top));
+        }
+    }
+}
+
+void PeakCache::Peaks::addFinestPeaks(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    auto& finest = levels[0];
+    int index = finest.numReady.load();
+
+    for (int offset = 0; offset < numSamples && index < finest.numPeaks; offset += finestSamplesPerPeak, ++index)
+    {
+        const int num = juce::jmin(finestSamplesPerPeak, numSamples - offset);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const auto range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(juce::jmin(ch, buffer.getNumChannels() - 1), offset), num);
+            auto* peak = finest.data.get() + ((size_t)index * (size_t)numChannels + (size_t)ch) * 2;
+            peak[0] = toPeakValue(range.getStart());
+            peak[1] = toPeakValue(range.getEnd());
+        }
+    }
+
+    finest.numReady.store(index, std::memory_order_release);
+}
+
+// Builds each coarser level from the finished peaks of the level below it
+void PeakCache::Peaks::updateCoarseLevels(bool finished)
+{
+    for (int level = 1; level < numLevels; ++level)
+    {
+        const auto& source = levels[level - 1];
+        auto& target = levels[level];
+
+        const int sourceReady = source.numReady.load();
+        const int targetEnd = finished ? target.numPeaks : juce::jmin(target.numPeaks, sourceReady / levelRatio);
+        int index = target.numReady.load();
+
+        for (; index < targetEnd; ++index)
+        {
+            const int first = index * levelRatio;
+            const int last = juce::jmin(first + levelRatio, sourceReady);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                int lo = 127, hi = -127;
+
+                for (int i = first; i < last; ++i)
+                {
+                    const auto* peak = source.data.get() + ((size_t)i * (size_t)numChannels + (size_t)ch) * 2;
+                    lo = juce::jmin(lo, (int)peak[0]);
+                    hi = juce::jmax(hi, (int)peak[1]);
+                }
+
+                auto* peak = target.data.get() + ((size_t)index * (size_t)numChannels + (size_t)ch) * 2;
+                peak[0] = (juce::int8)juce::jmin(lo, hi);
+                peak[1] = (juce::int8)juce::jmax(lo, hi);
+            }
+        }
+
+        target.numReady.store(index, std::memory_order_release);
+    }
+}
+
+void PeakCache::Peaks::markComplete()
+{
+    for (auto& level : levels)
+        level.numReady.store(level.numPeaks, std::memory_order_release);
+
+    complete.store(true);
+}
+
+// ===== Peak file format =====
+// magic, version, channels, sample rate, length, level count, then per level:
+// samples per peak, peak count and the raw [peak][channel][min, max] bytes
+PeakCache::Peaks::Ptr PeakCache::Peaks::readFrom(juce::InputStream& in)
+{
+    if (in.readInt() != peakFileMagic || in.readInt() != peakFileVersion)
+        return nullptr;
+
+    const int channels = in.readInt();
+    const double rate = in.readDouble();
+    const auto length = in.readInt64();
+
+    if (channels < 1 || channels > 2 || rate <= 0.0 || length < 0 || in.readInt() != numLevels)
+        return nullptr;
+
+    Ptr peaks = new Peaks(channels, rate, length);
+
+    for (int level = 0; level < numLevels; ++level)
+    {
+        auto& l = peaks->levels[level];
+        const auto numBytes = (size_t)l.numPeaks * (size_t)channels * 2;
+
+        if (in.readInt() != getSamplesPerPeak(level) || in.readInt() != l.numPeaks
+            || in.read(l.data.get(), (int)numBytes) != (int)numBytes)
+            return nullptr;
+    }
+
+    peaks->markComplete();
+    return peaks;
+}
+
+void PeakCache::Peaks::writeTo(juce::OutputStream& out) const
+{
+    out.writeInt(peakFileMagic);
+    out.writeInt(peakFileVersion);
+    out.writeInt(numChannels);
+    out.writeDouble(sampleRate);
+    out.writeInt64(lengthInSamples);
+    out.writeInt(numLevels);
+
+    for (int level = 0; level < numLevels; ++level)
+    {
+        const auto& l = levels[level];
+        out.writeInt(getSamplesPerPeak(level));
+        out.writeInt(l.numPeaks);
+        out.write(l.data.get(), (size_t)l.numPeaks * (size_t)numChannels * 2);
+    }
+}
+
+// ===== PeakCache =====
+PeakCache::PeakCache() : juce::Thread("Peak Builder")
+{
+    formatManager.registerBasicFormats();
+
+    cacheDirectory = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("PeakCache");
+    cacheDirectory.createDirectory();
+
+    startThread(juce::Thread::Priority::low);
+}
+
+PeakCache::~PeakCache()
+{
+    stopThread(4000);
+}
+
+void PeakCache::requestPeaks(const juce::File& audioFile, PeaksCallback onAvailable)
+{
+    RealtimeGuard::assertNotRealtime("PeakCache::requestPeaks");
+
+    if (!audioFile.existsAsFile())
+    {
+        if (onAvailable) onAvailable(nullptr);
+        return;
+    }
+
+    const auto peakFile = getPeakFileFor(audioFile);
+    const auto key = peakFile.getFileName();
+
+    auto peaks = findRecent(key);
+
+    if (peaks == nullptr)
+    {
+        peaks = loadPeakFile(peakFile);
+
+        if (peaks != nullptr)
+            addRecent(key, peaks);
+    }
+
+    if (peaks != nullptr)
+    {
+        if (onAvailable) onAvailable(peaks);
+        return;
+    }
+
+    {
+        const juce::ScopedLock sl(lock);
+        jobs.push_back({ audioFile, peakFile, std::move(onAvailable) });
+    }
+
+    notify();
+}
+
+void PeakCache::setMaxCacheBytes(juce::int64 bytes)
+{
+    maxCacheBytes.store(juce::jmax((juce::int64)0, bytes));
+}
+
+// The name changes whenever the audio file is replaced, so stale peaks are never used
+juce::File PeakCache::getPeakFileFor(const juce::File& audioFile) const
+{
+    const auto identity = audioFile.getFullPathName()
+        + "|" + juce::String(audioFile.getSize())
+        + "|" + juce::String(audioFile.getLastModificationTime().toMilliseconds());
+
+    return cacheDirectory.getChildFile(juce::MD5(identity.toUTF8()).toHexString() + ".peaks");
+}
+
+PeakCache::Peaks::Ptr PeakCache::loadPeakFile(const juce::File& peakFile)
+{
+    juce::FileInputStream in(peakFile);
+
+    if (!in.openedOk())
+        return nullptr;
+
+    auto peaks = Peaks::readFrom(in);
+
+    if (peaks == nullptr)
+    {
+        peakFile.deleteFile();
+        return nullptr;
+    }
+
+    // Modification time doubles as the last-used stamp for eviction
+    peakFile.setLastModificationTime(juce::Time::getCurrentTime());
+    return peaks;
+}
+
+PeakCache::Peaks::Ptr PeakCache::findRecent(const juce::String& key)
+{
+    const juce::ScopedLock sl(lock);
+    const auto it = recent.find(key);
+    return it != recent.end() ? it->second : nullptr;
+}
+
+void PeakCache::addRecent(const juce::String& key, Peaks::Ptr peaks)
+{
+    const juce::ScopedLock sl(lock);
+
+    // Forget sets nobody else holds any more
+    if ((int)recent.size() >= maxRecentPeaks)
+        for (auto it = recent.begin(); it != recent.end();)
+            it = it->second->getReferenceCount() == 1 ? recent.erase(it) : std::next(it);
+
+    recent[key] = std::move(peaks);
+}
+
+void PeakCache::run()
+{
+    while (!threadShouldExit())
+    {
+        Job job;
+        bool hasJob = false;
+
+        {
+            const juce::ScopedLock sl(lock);
+
+            if (!jobs.empty())
+            {
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                hasJob = true;
+            }
+        }
+
+        if (hasJob)
+            build(job);
+        else
+            wait(-1);
+    }
+}
+
+void PeakCache::build(const Job& job)
+{
+    const auto key = job.peakFile.getFileName();
+    auto deliver = [&job](Peaks::Ptr peaks)
+        {
+            juce::MessageManager::callAsync([onAvailable = job.onAvailable, peaks]
+                {
+                    if (onAvailable) onAvailable(peaks);
+                });
+        };
+
+    // A request queued twice, or one that another deck's build already finished
+    if (auto existing = findRecent(key))
+    {
+        deliver(existing);
+        return;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(job.audioFile));
+
+    if (reader == nullptr)
+    {
+        deliver(nullptr);
+        return;
+    }
+
+    Peaks::Ptr peaks = new Peaks((int)reader->numChannels, reader->sampleRate, reader->lengthInSamples);
+    addRecent(key, peaks);
+    deliver(peaks);
+
+    juce::AudioBuffer<float> buffer(peaks->getNumChannels(), buildChunkSize);
+
+    for (juce::int64 position = 0; position < peaks->getLengthInSamples(); position += buildChunkSize)
+    {
+        if (threadShouldExit())
+            return;
+
+        const int num = (int)juce::jmin((juce::int64)buildChunkSize, peaks->getLengthInSamples() - position);
+        reader->read(&buffer, 0, num, position, true, peaks->getNumChannels() > 1);
+
+        peaks->addFinestPeaks(buffer, num);
+        peaks->updateCoarseLevels(false);
+    }
+
+    peaks->updateCoarseLevels(true);
+    peaks->markComplete();
+
+    // Written under a temporary name so a half-written file is never picked up
+    juce::TemporaryFile temp(job.peakFile);
+
+    if (auto out = temp.getFile().createOutputStream())
+    {
+        peaks->writeTo(*out);
+        out.reset();
+
+        if (temp.overwriteTargetFileWithTemporary())
+            trimCache();
+    }
+}
+
+// Deletes the least recently used peak files until the folder fits its size cap
+void PeakCache::trimCache()
+{
+    auto files = cacheDirectory.findChildFiles(juce::File::findFiles, false, "*.peaks");
+
+    juce::int64 total = 0;
+    for (const auto& f : files)
+        total += f.getSize();
+
+    std::sort(files.begin(), files.end(), [](const juce::File& a, const juce::File& b)
+        {
+            return a.getLastModificationTime() < b.getLastModificationTime();
+        });
+
+    for (const auto& f : files)
+    {
+        if (total <= maxCacheBytes.load())
+            break;
+
+        total -= f.getSize();
+        f.deleteFile();
+    }
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Persistent store of waveform peaks, replacing juce::AudioThumbnail.
+// Each file's peaks are kept at several resolutions in one file under the application data
+// folder, keyed by the audio file's path, size and modification time. Files seen before
+// load straight from disk; new ones are decoded on a low-priority background thread and
+// can be drawn while they fill in. Old entries are evicted least-recently-used first once
+// the folder grows past its size cap.
+class PeakCache : private juce::Thread
+{
+public:
+    // Min/max pairs per channel at each resolution. Peaks fill in front to back while being
+    // built; readers only look at the part published by getNumReady().
+    class Peaks : public juce::ReferenceCountedObject
+    {
+    public:
+        using Ptr = juce::ReferenceCountedObjectPtr<Peaks>;
+
+        static constexpr int numLevels = 5;
+        static constexpr int finestSamplesPerPeak = 256;
+        static constexpr int levelRatio = 4;
+
+        static int getSamplesPerPeak(int level) noexcept { return finestSamplesPerPeak << (2 * level); }
+
+        int getNumChannels() const noexcept { return numChannels; }
+        double getSampleRate() const noexcept { return sampleRate; }
+        juce::int64 getLengthInSamples() const noexcept { return lengthInSamples; }
+        double getLengthInSeconds() const noexcept { return sampleRate > 0.0 ? (double)lengthInSamples / sampleRate : 0.0; }
+
+        bool isComplete() const noexcept { return complete.load(); }
+        int getNumPeaks(int level) const noexcept { return levels[level].numPeaks; }
+        int getNumReady(int level) const noexcept { return levels[level].numReady.load(std::memory_order_acquire); }
+
+        // Min and max (in -1..1) of one channel over [startSample, endSample), using the
+        // coarsest level that still resolves the range. Returns false if nothing is ready there yet.
+        bool getMinMax(int channel, juce::int64 startSample, juce::int64 endSample, float& minValue, float& maxValue) const noexcept;
+
+        // Draws each channel in its own horizontal band, like AudioThumbnail::drawChannels
+        void drawChannels(juce::Graphics& g, juce::Rectangle<int> area, double startTime, double endTime, float verticalZoom) const;
+
+    private:
+        friend class PeakCache;
+
+        struct Level
+        {
+            int numPeaks = 0;
+            juce::HeapBlock<juce::int8> data;  // [peak][channel][min, max]
+            std::atomic<int> numReady{ 0 };
+        };
+
+        Peaks(int channels, double rate, juce::int64 length);
+
+        void addFinestPeaks(const juce::AudioBuffer<float>& buffer, int numSamples);
+        void updateCoarseLevels(bool finished);
+        void markComplete();
+
+        static Ptr readFrom(juce::InputStream& in);
+        void writeTo(juce::OutputStream& out) const;
+
+        const int numChannels;
+        const double sampleRate;
+        const juce::int64 lengthInSamples;
+        Level levels[numLevels];
+        std::atomic<bool> complete{ false };
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Peaks)
+    };
+
+    PeakCache();
+    ~PeakCache() override;
+
+    using PeaksCallback = std::function<void(Peaks::Ptr)>;
+
+    // Calls onAvailable with the file's peaks: straight away if they are cached on disk or
+    // already in use, otherwise on the message thread as soon as the background thread has
+    // opened the file, with a set that keeps filling in. Passes nullptr if the file can't be read.
+    void requestPeaks(const juce::File& audioFile, PeaksCallback onAvailable);
+
+    // Total size of the peak files on disk before least-recently-used ones are deleted
+    void setMaxCacheBytes(juce::int64 bytes);
+    juce::int64 getMaxCacheBytes() const { return maxCacheBytes.load(); }
+
+    juce::File getCacheDirectory() const { return cacheDirectory; }
+
+private:
+    struct Job
+    {
+        juce::File audioFile;
+        juce::File peakFile;
+        PeaksCallback onAvailable;
+    };
+
+    void run() override;
+    void build(const Job& job);
+    void trimCache();
+
+    juce::File getPeakFileFor(const juce::File& audioFile) const;
+    Peaks::Ptr loadPeakFile(const juce::File& peakFile);
+    Peaks::Ptr findRecent(const juce::String& key);
+    void addRecent(const juce::String& key, Peaks::Ptr peaks);
+
+    juce::AudioFormatManager formatManager;
+    juce::File cacheDirectory;
+    std::atomic<juce::int64> maxCacheBytes{ 256 * 1024 * 1024 };
+
+    juce::CriticalSection lock;
+    std::deque<Job> jobs;
+
+    // Peaks handed out recently, so a reloaded file shares its set (and any build in progress)
+    std::map<juce::String, Peaks::Ptr> recent;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PeakCache)
+};
@@ -2,149 +2,930 @@
 
 PlayerAudio::PlayerAudio()
 {
-    formatManager.registerBasicFormats();
-    resampler.reset(new juce::ResamplingAudioSource(&transportSource, false, 2));
+    resampler.reset(new PolyphaseResamplingAudioSource(&timeStretcher, false, 2));
+    loader->addClient(this);
 }
 
 PlayerAudio::~PlayerAudio()
 {
     stop();
-    releaseResources();
+
+    // After this the loader no longer calls us back or touches our queues
+    loader->removeClient(this);
+
+    DeckTrack* track = nullptr;
+    while (incomingTracks.pop(track)) delete track;
+    while (queuedTracks.pop(track)) delete track;
+    while (retiredTracks.pop(track)) delete track;
+
+    delete currentTrack;
+    delete nextTrack;
+    currentTrack = nextTrack = nullptr;
 }
 
 void PlayerAudio::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
-    transportSource.prepareToPlay(samplesPerBlockExpected, sampleRate);
-    if (resampler) resampler->prepareToPlay(samplesPerBlockExpected, sampleRate);
+    deviceBlockSize.store(samplesPerBlockExpected);
+    deviceSampleRate.store(sampleRate);
+    appliedRatio = 0.0;
+    appliedTrackRate = 0.0;
+
+    // Generous headroom: the resampler pulls up to speed x rate-ratio more than the device block
+    handoverBuffer.setSize(2, samplesPerBlockExpected * 8 + 64);
+    spectrumTap.setSampleRate(sampleRate);
+
+    // Control glides are timed in output samples
+    gainRamp.reset(sampleRate, parameterRampSeconds);
+    gainRamp.setCurrentAndTargetValue(gain.load());
+    transportFade.reset(sampleRate, transportFadeSeconds);
+    stretchSpeed.reset(sampleRate, parameterRampSeconds);
+    stretchSpeed.setCurrentAndTargetValue(speed.load());
+
+    if (resampler)
+    {
+        resampler->setRatioRampLength(juce::roundToInt(parameterRampSeconds * sampleRate));
+        resampler->prepareToPlay(samplesPerBlockExpected, sampleRate);
+    }
 }
 
 void PlayerAudio::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
 {
-    if (resampler)
-        resampler->getNextAudioBlock(bufferToFill);
+    const auto blockStart = CallbackProfiler::now();
+    lastStages = {};
+
+    acceptIncomingTracks();
+    applyCommands();
+
+    if (currentTrack == nullptr)
+    {
+        // Nothing to fade, so a stop is immediate
+        transportFade.setCurrentAndTargetValue(transportFade.getTargetValue());
+        controls.running = transportFade.getTargetValue() > 0.0f;
+
+        bufferToFill.clearActiveBufferRegion();
+        spectrumTap.push(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
+        playingBpm.store(0.0);
+        lastStages.total = (juce::uint32)(CallbackProfiler::now() - blockStart);
+        return;
+    }
+
+    auto* track = currentTrack;
+    auto& looper = *track->looper;
+
+    if (pendingSeek >= 0.0)
+    {
+        looper.setNextReadPosition((juce::int64)(pendingSeek * track->sampleRate));
+        timeStretcher.reset();
+        pendingSeek = -1.0;
+    }
+
+    if (pendingCue >= 0)
+    {
+        // A running deck fades out what it was playing under the jump
+        const bool fromMemory = looper.jumpTo(pendingCue, controls.running);
+        (fromMemory ? cueHits : cueMisses).fetch_add(1);
+
+        timeStretcher.reset();
+        pendingCue = -1;
+    }
+
+    // Loop seams are handled sample-accurately inside the looper
+    looper.setLooping(controls.looping);
+    looper.setLoopRange((juce::int64)(controls.loopStart * track->sampleRate),
+        (juce::int64)(controls.loopEnd * track->sampleRate),
+        controls.segmentLooping);
+    looper.setCrossfadeLength(juce::roundToInt(controls.loopCrossfadeSeconds * track->sampleRate));
+
+    // The stretcher absorbs the speed change when pitch is kept; otherwise one
+    // resampler ratio covers both the file's sample rate and the speed control.
+    // The resampler glides to a new ratio per sample; the stretcher works in frames,
+    // so it takes its glide a block at a time.
+    const double targetSpeed = syncedSpeed > 0.0 ? syncedSpeed : speed.load();
+    const bool keepPitch = controls.speedMode == SpeedMode::preservePitch;
+    stretchSpeed.setTargetValue(targetSpeed);
+    timeStretcher.setEnabled(keepPitch);
+    timeStretcher.setSpeed(stretchSpeed.skip(bufferToFill.numSamples));
+
+    const double ratio = (keepPitch ? 1.0 : targetSpeed) * track->sampleRate / deviceSampleRate.load();
+    if (ratio != appliedRatio)
+    {
+        // Only speed changes glide; a new file rate (e.g. after a gapless handover between
+        // 44.1 and 48 kHz files) is taken at once, so the new track never slides in pitch
+        if (track->sampleRate != appliedTrackRate)
+            resampler->jumpToRatio(ratio);
+        else
+            resampler->setResamplingRatio(ratio);
+
+        appliedRatio = ratio;
+    }
+
+    appliedTrackRate = track->sampleRate;
+
+    // The stream is pulled from inside the resampler (via the stretcher); renderTrack times it
+    streamCycles = 0;
+    const auto dspStart = CallbackProfiler::now();
+    resampler->getNextAudioBlock(bufferToFill);
+    const auto dspCycles = CallbackProfiler::now() - dspStart;
+
+    applyGain(bufferToFill);
+    spectrumTap.push(*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
+
+    // A gapless handover inside the resampler's pull may have switched tracks
+    track = currentTrack;
+    const auto readPos = track->looper->getNextReadPosition();
+
+    if (!track->looper->isLoopActive() && readPos >= track->lengthInSamples)
+    {
+        playing.store(false);
+        controls.running = false;
+        transportFade.setCurrentAndTargetValue(0.0f);
+    }
+
+    positionSeconds.store((double)readPos / track->sampleRate);
+    playingBpm.store(track->beatGrid.bpm);
+    playingFirstBeat.store(track->beatGrid.firstBeatSeconds);
+    playbackSpeed.store((float)targetSpeed);
+    underrunCount.store(retiredUnderruns + track->stream->getNumUnderruns());
+    bufferFill.store(track->stream->getFillLevel());
+
+    lastStages.stream = (juce::uint32)streamCycles;
+    lastStages.dsp = (juce::uint32)(dspCycles - juce::jmin(dspCycles, streamCycles));
+    lastStages.total = (juce::uint32)(CallbackProfiler::now() - blockStart);
+}
+
+void PlayerAudio::renderTrack(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    if (currentTrack == nullptr || !controls.running)
+    {
+        bufferToFill.clearActiveBufferRegion();
+        return;
+    }
+
+    const auto start = CallbackProfiler::now();
+    renderTrackAudio(bufferToFill);
+    streamCycles += CallbackProfiler::now() - start;
+}
+
+void PlayerAudio::renderTrackAudio(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    const bool canHandOver = nextTrack != nullptr
+        && !currentTrack->looper->isLoopActive()
+        && retiredTracks.getFreeSpace() > 0;
+
+    if (!canHandOver)
+    {
+        currentTrack->looper->getNextAudioBlock(bufferToFill);
+        return;
+    }
+
+    // Long pulls are split so the incoming track always fits the handover buffer
+    for (int offset = 0; offset < bufferToFill.numSamples;)
+    {
+        const int numSamples = juce::jmin(bufferToFill.numSamples - offset, handoverBuffer.getNumSamples());
+        renderWithHandover(juce::AudioSourceChannelInfo(bufferToFill.buffer, bufferToFill.startSample + offset, numSamples));
+        offset += numSamples;
+    }
+}
+
+// Plays the end of the current track into the start of the queued one, switching at the
+// exact sample (or over an equal-power crossfade ending on the current track's last sample)
+void PlayerAudio::renderWithHandover(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    auto& outgoing = *currentTrack->looper;
+
+    if (nextTrack == nullptr)
+    {
+        outgoing.getNextAudioBlock(bufferToFill);
+        return;
+    }
+
+    // Tracks at different rates switch without a crossfade, as they cannot share a resampler ratio
+    const int fadeLength = nextTrack->sampleRate == currentTrack->sampleRate
+        ? juce::roundToInt(trackCrossfadeSeconds.load() * currentTrack->sampleRate)
+        : 0;
+
+    const auto remaining = currentTrack->lengthInSamples - outgoing.getNextReadPosition();
+    const auto fadeStart = remaining - fadeLength;
+
+    // Renders silence past the end of the track
+    outgoing.getNextAudioBlock(bufferToFill);
+
+    if (fadeStart >= bufferToFill.numSamples)
+        return;
+
+    auto& incoming = *nextTrack->looper;
+    const int offset = (int)juce::jlimit((juce::int64)0, (juce::int64)bufferToFill.numSamples, fadeStart);
+    const int numIncoming = bufferToFill.numSamples - offset;
+    const auto fadePos = incoming.getNextReadPosition();
+
+    incoming.getNextAudioBlock(juce::AudioSourceChannelInfo(&handoverBuffer, 0, numIncoming));
+
+    auto& dest = *bufferToFill.buffer;
+    const int numFading = (int)juce::jlimit((juce::int64)0, (juce::int64)numIncoming, fadeLength - fadePos);
+
+    for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+    {
+        auto* out = dest.getWritePointer(ch, bufferToFill.startSample + offset);
+        const auto* in = handoverBuffer.getReadPointer(juce::jmin(ch, handoverBuffer.getNumChannels() - 1));
+
+        for (int i = 0; i < numFading; ++i)
+        {
+            const float t = (float)(fadePos + i + 1) / (float)(fadeLength + 1);
+            const float angle = t * juce::MathConstants<float>::halfPi;
+            out[i] = out[i] * std::cos(angle) + in[i] * std::sin(angle);
+        }
+
+        juce::FloatVectorOperations::copy(out + numFading, in + numFading, numIncoming - numFading);
+    }
+
+    if (remaining <= bufferToFill.numSamples)
+    {
+        retire(currentTrack);
+        currentTrack = nextTrack;
+        nextTrack = nullptr;
+        trackAdvances.fetch_add(1);
+    }
+}
+
+// Gain and the start/stop fade, per sample while either is gliding
+void PlayerAudio::applyGain(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    // The track's loudness normalisation rides on the user's gain, through the same glide
+    float trackGain = 1.0f;
+    if (autoGain.load() && currentTrack != nullptr && currentTrack->normalisationGain > 0.0f)
+        trackGain = currentTrack->normalisationGain;
+
+    gainRamp.setTargetValue(gain.load() * trackGain);
+
+    auto& buffer = *bufferToFill.buffer;
+
+    if (!gainRamp.isSmoothing() && !transportFade.isSmoothing())
+    {
+        buffer.applyGain(bufferToFill.startSample, bufferToFill.numSamples,
+            gainRamp.getCurrentValue() * transportFade.getCurrentValue());
+    }
     else
-        transportSource.getNextAudioBlock(bufferToFill);
+    {
+        auto* const* channels = buffer.getArrayOfWritePointers();
+        const int numChannels = buffer.getNumChannels();
+
+        for (int i = bufferToFill.startSample; i < bufferToFill.startSample + bufferToFill.numSamples; ++i)
+        {
+            const float g = gainRamp.getNextValue() * transportFade.getNextValue();
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                channels[ch][i] *= g;
+        }
+    }
+
+    // A stop takes effect once its fade has run out
+    if (transportFade.getTargetValue() == 0.0f && !transportFade.isSmoothing())
+        controls.running = false;
+}
+
+// Sends a control change to the audio thread
+void PlayerAudio::send(const Command& command)
+{
+    // Only fills up if the deck has not been rendered for a long while (e.g. no device open)
+    if (!commands.push(command))
+        DBG("PlayerAudio: command queue full, dropped a control change");
+}
 
-    const double length = transportSource.getLengthInSeconds();
-    if (length > 0.0)
+void PlayerAudio::sendTransport(bool shouldRun)
+{
+    transportWanted.store(shouldRun, std::memory_order_relaxed);
+    transportRequests.fetch_add(1, std::memory_order_release);
+}
+
+// Replaces any seek or cue jump the audio thread has not taken yet
+void PlayerAudio::sendPosition(bool isCue, juce::int64 frame)
+{
+    // No track shown yet: nothing to seek in
+    if (currentTrackId <= 0)
+        return;
+
+    const auto packedFrame = juce::jmin((juce::uint64)juce::jmax((juce::int64)0, frame), positionFrameMask);
+    const auto packedTrack = ((juce::uint64)currentTrackId & positionTrackMask) << positionTrackShift;
+
+    positionRequest.store((isCue ? positionCueFlag : 0) | packedTrack | packedFrame, std::memory_order_release);
+}
+
+// Takes the transport state and the latest seek or cue jump sent since the last block
+void PlayerAudio::applyTransportAndPosition()
+{
+    const auto requests = transportRequests.load(std::memory_order_acquire);
+
+    if (requests != transportRequestsSeen)
     {
-        const double pos = transportSource.getCurrentPosition();
-        const double epsilon = 0.02;
+        transportRequestsSeen = requests;
 
-        if (pos + epsilon >= length)
+        if (transportWanted.load(std::memory_order_relaxed))
         {
-            if (transportSource.isLooping() || userLooping)
-            {
-                transportSource.setPosition(0.0);
-                transportSource.start();
-                DBG("PlayerAudio: fallback loop restart executed (userLooping=" << (userLooping ? "YES" : "NO") << ")");
-            }
+            controls.running = true;
+            transportFade.setTargetValue(1.0f);
+        }
+        else
+        {
+            transportFade.setTargetValue(0.0f);
+        }
+    }
+
+    const auto request = positionRequest.exchange(0, std::memory_order_acquire);
+
+    // Meant for the track that was current when it was sent, which a load may have replaced
+    if (request == 0 || currentTrack == nullptr
+        || ((juce::uint64)currentTrack->id & positionTrackMask) != ((request >> positionTrackShift) & positionTrackMask))
+        return;
+
+    const auto frame = (juce::int64)(request & positionFrameMask);
+
+    if ((request & positionCueFlag) != 0)
+    {
+        pendingCue = frame;
+        pendingSeek = -1.0;
+    }
+    else
+    {
+        pendingSeek = (double)frame / currentTrack->sampleRate;
+        pendingCue = -1;
+    }
+
+    alignPending = true;
+}
+
+// Applies the control changes sent since the last block
+void PlayerAudio::applyCommands()
+{
+    using Type = Command::Type;
+    Command command;
+
+    applyTransportAndPosition();
+
+    while (commands.pop(command))
+    {
+        switch (command.type)
+        {
+            case Type::hotCue:
+                for (auto* track : { currentTrack, nextTrack })
+                    if (track != nullptr && track->id == command.trackId)
+                        track->looper->setHotCue((int)command.value, (juce::int64)command.end);
+                break;
+
+            case Type::looping:       controls.looping = command.value != 0.0; break;
+            case Type::segmentLoop:   controls.segmentLooping = command.value != 0.0; break;
+            case Type::loopCrossfade: controls.loopCrossfadeSeconds = command.value; break;
+            case Type::speedMode:     controls.speedMode = (SpeedMode)(int)command.value; break;
+
+            case Type::loopPoints:
+                controls.loopStart = command.value;
+                controls.loopEnd = command.end;
+                break;
+
+            case Type::normalisation:
+                // Only for the track it was measured for, which may have been queued or replaced since
+                for (auto* track : { currentTrack, nextTrack })
+                    if (track != nullptr && track->id == command.trackId && track->normalisationGain < 0.0f)
+                        track->normalisationGain = (float)command.value;
+                break;
+
+            case Type::beatGrid:
+                for (auto* track : { currentTrack, nextTrack })
+                    if (track != nullptr && track->id == command.trackId && !track->beatGrid.isValid())
+                    {
+                        track->beatGrid.bpm = command.value;
+                        track->beatGrid.firstBeatSeconds = command.end;
+                    }
+                break;
         }
     }
+}
+
+// Swaps in tracks published by the loader; replaced ones go back to the loader for deletion
+void PlayerAudio::acceptIncomingTracks()
+{
+    DeckTrack* next = nullptr;
+
+    if (clearQueuedTrack.exchange(false) && nextTrack != nullptr && retiredTracks.getFreeSpace() > 0)
+    {
+        retire(nextTrack);
+        nextTrack = nullptr;
+    }
 
-    if (isSegmentLooping && loopEnd > loopStart)
+    while (retiredTracks.getFreeSpace() > 0 && incomingTracks.pop(next))
     {
-        double pos = transportSource.getCurrentPosition();
-        if (pos >= loopEnd)
+        if (currentTrack != nullptr)
+            retire(currentTrack);
+
+        currentTrack = next;
+        positionSeconds.store(0.0);
+
+        timeStretcher.reset();
+        if (resampler) resampler->flushBuffers();
+
+        // A pre-roll opened before this track followed the old one; ids go up in the order the
+        // loader opens tracks, so one queued for the new track (opened after it) is kept
+        if (nextTrack != nullptr && nextTrack->id < next->id && retiredTracks.getFreeSpace() > 0)
         {
-            transportSource.setPosition(loopStart);
-            transportSource.start();
-            DBG("PlayerAudio: Segment loop restart from " << loopStart << " to " << loopEnd);
+            retire(nextTrack);
+            nextTrack = nullptr;
         }
     }
+
+    while (retiredTracks.getFreeSpace() > 0 && queuedTracks.pop(next))
+    {
+        if (nextTrack != nullptr)
+            retire(nextTrack);
+
+        nextTrack = next;
+    }
+}
+
+void PlayerAudio::retire(DeckTrack* track)
+{
+    retiredUnderruns += track->stream->getNumUnderruns();
+    retiredTracks.push(track);
+}
+
+void PlayerAudio::releaseRetiredTracks()
+{
+    DeckTrack* track = nullptr;
+
+    while (retiredTracks.pop(track))
+        delete track;
 }
 
 void PlayerAudio::setLooping(bool shouldLoop)
 {
-    transportSource.setLooping(shouldLoop);
-    userLooping = shouldLoop;
+    userLooping.store(shouldLoop);
+    send({ Command::Type::looping, shouldLoop ? 1.0 : 0.0 });
     DBG("PlayerAudio::setLooping called -> " << (shouldLoop ? "ON" : "OFF"));
 }
 
+void PlayerAudio::setLoopCrossfade(double seconds)
+{
+    send({ Command::Type::loopCrossfade, juce::jlimit(0.0, LoopingAudioSource::maxCrossfadeSeconds, seconds) });
+}
+
 void PlayerAudio::releaseResources()
 {
-    transportSource.releaseResources();
     if (resampler) resampler->releaseResources();
-    readerSource.reset();
 }
 
-bool PlayerAudio::loadFile(const juce::File& file)
+void PlayerAudio::loadFile(const juce::File& file, LoadCallback onLoaded)
 {
-    if (!file.existsAsFile())
+    RealtimeGuard::assertNotRealtime("PlayerAudio::loadFile");
+
+    // A newer load replaces any that have not started yet
+    pendingLoads -= loader->cancelRequests(this, playRequest);
+    ++pendingLoads;
+
+    requestTrack(file, playRequest, incomingTracks, [this, onLoaded](bool loaded, const TrackInfo& info)
+        {
+            --pendingLoads;
+
+            if (loaded)
+            {
+                applyTrackInfo(info);
+                positionSeconds.store(0.0);
+            }
+
+            if (onLoaded)
+                onLoaded(loaded);
+        });
+}
+
+void PlayerAudio::queueNextFile(const juce::File& file, LoadCallback onQueued)
+{
+    loader->cancelRequests(this, queueRequest);
+
+    requestTrack(file, queueRequest, queuedTracks, [this, onQueued](bool loaded, const TrackInfo& info)
+        {
+            if (loaded)
+            {
+                queuedInfo = info;
+
+                if (info.normalisationGain < 0.0f)
+                    requestAnalysis(info);
+            }
+
+            if (onQueued)
+                onQueued(loaded);
+        });
+}
+
+void PlayerAudio::clearQueuedFile()
+{
+    loader->cancelRequests(this, queueRequest);
+    queuedInfo = {};
+    clearQueuedTrack.store(true);
+}
+
+bool PlayerAudio::loadFileNow(const juce::File& file)
+{
+    TrackInfo info;
+    auto track = openTrackNow(file, info);
+
+    if (track == nullptr || !incomingTracks.push(track.get()))
         return false;
 
-    if (auto* reader = formatManager.createReaderFor(file))
-    {
-        transportSource.stop();
-        transportSource.setSource(nullptr);
-        readerSource.reset();
+    track.release();
+    applyTrackInfo(info);
+    positionSeconds.store(0.0);
+    return true;
+}
+
+bool PlayerAudio::queueNextFileNow(const juce::File& file)
+{
+    TrackInfo info;
+    auto track = openTrackNow(file, info);
 
-        readerSource = std::make_unique<juce::AudioFormatReaderSource>(reader, true);
-        transportSource.setSource(readerSource.get(), 0, nullptr, reader->sampleRate);
+    if (track == nullptr || !queuedTracks.push(track.get()))
+        return false;
 
-        currentFile = file;
+    track.release();
+    queuedInfo = info;
+    return true;
+}
 
-        // ===== Extract metadata =====
-        currentTitle = reader->metadataValues.getValue("title", file.getFileNameWithoutExtension());
-        currentArtist = reader->metadataValues.getValue("artist", "Unknown");
-        currentAlbum = reader->metadataValues.getValue("album", "Unknown");
+std::unique_ptr<DeckTrack> PlayerAudio::openTrackNow(const juce::File& file, TrackInfo& info)
+{
+    auto track = loader->openTrack(file, deviceBlockSize.load(), deviceSampleRate.load(), readAheadSeconds, memoryMapped);
+
+    if (track != nullptr)
+    {
+        track->stream->setBlockingReads(blockingReads);
 
-        return true;
+        // Analysed up front, so the gain and sync of an offline render never change part-way through
+        if (track->normalisationGain < 0.0f)
+        {
+            const auto analysed = loader->getAnalysisCache().analyseNow(file);
+            track->normalisationGain = analysed.getNormalisationGain();
+            track->beatGrid = analysed.beatGrid;
+        }
+
+        info = describeTrack(*track);
     }
 
-    return false;
+    return track;
+}
+
+PlayerAudio::TrackInfo PlayerAudio::describeTrack(const DeckTrack& track)
+{
+    TrackInfo info;
+    info.file = track.file;
+    info.title = track.title;
+    info.artist = track.artist;
+    info.album = track.album;
+    info.lengthSeconds = track.getLengthInSeconds();
+    info.trackId = track.id;
+    info.normalisationGain = track.normalisationGain;
+    info.beatGrid = track.beatGrid;
+    info.sampleRate = track.sampleRate;
+    info.hotCues = track.hotCues;
+    return info;
+}
+
+void PlayerAudio::setTrackCrossfade(double seconds)
+{
+    trackCrossfadeSeconds.store(juce::jlimit(0.0, 30.0, seconds));
+}
+
+bool PlayerAudio::pollTrackAdvance()
+{
+    const int advances = trackAdvances.load();
+
+    // Wait for the queued track's metadata if the deck got there before its callback ran
+    if (advances == trackAdvancesSeen || queuedInfo.file == juce::File())
+        return false;
+
+    trackAdvancesSeen = advances;
+    applyTrackInfo(queuedInfo);
+    queuedInfo = {};
+    return true;
+}
+
+void PlayerAudio::applyTrackInfo(const TrackInfo& info)
+{
+    currentFile = info.file;
+    currentTitle = info.title;
+    currentArtist = info.artist;
+    currentAlbum = info.album;
+    lengthSeconds.store(info.lengthSeconds);
+
+    currentTrackId = info.trackId;
+    currentNormalisation = info.normalisationGain;
+    currentBeatGrid = info.beatGrid;
+    currentSampleRate = info.sampleRate;
+
+    // The loader set the track's stored cues up in these slots
+    std::fill(cueSlots.begin(), cueSlots.end(), (juce::int64)-1);
+    std::copy_n(info.hotCues.begin(), juce::jmin(info.hotCues.size(), cueSlots.size()), cueSlots.begin());
+
+    if (info.normalisationGain < 0.0f && info.file.existsAsFile())
+        requestAnalysis(info);
+}
+
+// Asks for the track's loudness and beat grid ahead of the background queue; the deck applies
+// them whenever they arrive
+void PlayerAudio::requestAnalysis(const TrackInfo& info)
+{
+    loader->getAnalysisCache().analyse(info.file,
+        [weakThis = juce::WeakReference<PlayerAudio>(this), trackId = info.trackId](const AnalysisCache::Measurement& result)
+        {
+            auto* self = weakThis.get();
+            if (self == nullptr)
+                return;
+
+            const float normalisation = result.getNormalisationGain();
+            self->send({ Command::Type::normalisation, normalisation, 0.0, trackId });
+
+            if (result.beatGrid.isValid())
+                self->send({ Command::Type::beatGrid, result.beatGrid.bpm, result.beatGrid.firstBeatSeconds, trackId });
+
+            if (self->currentTrackId == trackId)
+            {
+                self->currentNormalisation = normalisation;
+                self->currentBeatGrid = result.beatGrid;
+            }
+
+            if (self->queuedInfo.trackId == trackId)
+            {
+                self->queuedInfo.normalisationGain = normalisation;
+                self->queuedInfo.beatGrid = result.beatGrid;
+            }
+        });
+}
+
+// Builds a loader request that publishes the primed track into one of our queues
+void PlayerAudio::requestTrack(const juce::File& file, RequestTag tag, LockFreeQueue<DeckTrack*>& destination,
+    std::function<void(bool, const TrackInfo&)> onMessageThread)
+{
+    TrackLoader::Request request;
+    request.owner = this;
+    request.file = file;
+    request.tag = tag;
+    request.blockSize = deviceBlockSize.load();
+    request.sampleRate = deviceSampleRate.load();
+    request.readAheadSeconds = readAheadSeconds;
+    request.memoryMapped = memoryMapped;
+
+    request.onReady = [weakThis = juce::WeakReference<PlayerAudio>(this), &destination, onMessageThread,
+                       blocking = blockingReads](std::unique_ptr<DeckTrack> track)
+        {
+            bool loaded = false;
+            TrackInfo info;
+
+            if (track != nullptr)
+            {
+                track->stream->setBlockingReads(blocking);
+                info = describeTrack(*track);
+
+                auto* raw = track.release();
+                loaded = destination.push(raw);
+
+                if (!loaded)
+                    delete raw;
+            }
+
+            juce::MessageManager::callAsync([weakThis, onMessageThread, loaded, info]
+                {
+                    if (weakThis.get() != nullptr && onMessageThread)
+                        onMessageThread(loaded, info);
+                });
+        };
+
+    loader->load(std::move(request));
 }
 
 void PlayerAudio::start()
 {
-    transportSource.start();
+    playing.store(true);
+    sendTransport(true);
 }
 
 void PlayerAudio::stop()
 {
-    transportSource.stop();
+    playing.store(false);
+    sendTransport(false);
+}
+
+void PlayerAudio::setGain(float newGain)
+{
+    gain.store(newGain);
 }
 
-void PlayerAudio::setGain(float gain)
+void PlayerAudio::setAutoGain(bool shouldNormalise)
 {
-    transportSource.setGain(gain);
+    autoGain.store(shouldNormalise);
 }
 
 void PlayerAudio::setPosition(double pos)
 {
-    transportSource.setPosition(pos);
+    pos = juce::jmax(0.0, pos);
+    positionSeconds.store(pos);
+    sendPosition(false, (juce::int64)std::llround(pos * currentSampleRate));
 }
 
 double PlayerAudio::getPosition() const
 {
-    return transportSource.getCurrentPosition();
+    return positionSeconds.load();
 }
 
 double PlayerAudio::getLength() const
 {
-    return transportSource.getLengthInSeconds();
+    return lengthSeconds.load();
+}
+
+juce::int64 PlayerAudio::getPositionInFrames() const
+{
+    return (juce::int64)std::llround(positionSeconds.load() * currentSampleRate);
 }
 
 bool PlayerAudio::isLooping() const
 {
-    return transportSource.isLooping();
+    return userLooping.load();
 }
 
 void PlayerAudio::setSpeed(float ratio)
 {
-    if (resampler)
-    {
-        resampler->setResamplingRatio(ratio);
-    }
+    speed.store(ratio);
+}
+
+double PlayerAudio::getTempo() const
+{
+    return currentBeatGrid.isValid() ? currentBeatGrid.bpm * playbackSpeed.load() : 0.0;
+}
+
+void PlayerAudio::setSpeedMode(SpeedMode mode)
+{
+    speedMode.store(mode);
+    send({ Command::Type::speedMode, (double)(int)mode });
+}
+
+void PlayerAudio::setResamplerQuality(PolyphaseResamplingAudioSource::Quality quality)
+{
+    resampler->setQuality(quality);
+}
+
+void PlayerAudio::setReadAheadSeconds(double seconds)
+{
+    // Used for every track loaded from now on
+    readAheadSeconds = juce::jlimit(0.1, 60.0, seconds);
 }
 
 void PlayerAudio::setLoopPoints(double start, double end)
 {
-    loopStart = juce::jmax(0.0, start);
-    loopEnd = juce::jmax(loopStart, end);
+    const double newStart = juce::jmax(0.0, start);
+    const double newEnd = juce::jmax(newStart, end);
+
+    loopStart.store(newStart);
+    loopEnd.store(newEnd);
+    send({ Command::Type::loopPoints, newStart, newEnd });
 }
 
 void PlayerAudio::enableSegmentLoop(bool shouldLoop)
 {
-    isSegmentLooping = shouldLoop;
+    send({ Command::Type::segmentLoop, shouldLoop ? 1.0 : 0.0 });
+}
+
+// ===== Hot cues =====
+void PlayerAudio::setHotCues(const std::vector<juce::int64>& frames)
+{
+    auto isWanted = [&frames](juce::int64 frame) { return std::find(frames.begin(), frames.end(), frame) != frames.end(); };
+
+    // Cues that stay keep their slot, so their decoded audio is not thrown away
+    for (size_t slot = 0; slot < cueSlots.size(); ++slot)
+    {
+        if (cueSlots[slot] >= 0 && !isWanted(cueSlots[slot]))
+        {
+            cueSlots[slot] = -1;
+            send({ Command::Type::hotCue, (double)slot, -1.0, currentTrackId });
+        }
+    }
+
+    for (const auto frame : frames)
+    {
+        if (frame < 0 || std::find(cueSlots.begin(), cueSlots.end(), frame) != cueSlots.end())
+            continue;
+
+        const auto freeSlot = std::find(cueSlots.begin(), cueSlots.end(), (juce::int64)-1);
+        if (freeSlot == cueSlots.end())
+            break;
+
+        *freeSlot = frame;
+        send({ Command::Type::hotCue, (double)(freeSlot - cueSlots.begin()), (double)frame, currentTrackId });
+    }
+}
+
+void PlayerAudio::jumpToHotCue(juce::int64 frame)
+{
+    frame = juce::jmax((juce::int64)0, frame);
+
+    if (currentSampleRate > 0.0)
+        positionSeconds.store((double)frame / currentSampleRate);
+
+    sendPosition(true, frame);
+}
+
+// ===== Tempo sync =====
+void PlayerAudio::syncTo(PlayerAudio* leader)
+{
+    // Following anything that leads back here would close a loop. No loop can exist already,
+    // since every link went through this check, so the walk ends
+    for (auto* link = leader; link != nullptr; link = link->getSyncLeader())
+    {
+        if (link == this)
+        {
+            leader = nullptr;
+            break;
+        }
+    }
+
+    syncLeader.store(leader);
+}
+
+void PlayerAudio::followSyncLeader()
+{
+    auto* leader = syncLeader.load();
+    auto* track = currentTrack;
+
+    const double leaderBpm = leader != nullptr ? leader->playingBpm.load() : 0.0;
+
+    if (leaderBpm <= 0.0 || track == nullptr || !track->beatGrid.isValid())
+    {
+        syncedSpeed = 0.0;
+        alignPending = true;
+        return;
+    }
+
+    // ===== Tempo =====
+    // Half or double time when that is nearer the deck's own speed, e.g. 87 BPM against 174;
+    // beatsPerLeaderBeat counts this deck's beats in one of the leader's
+    const auto& grid = track->beatGrid;
+    double ratio = leaderBpm * leader->playbackSpeed.load() / grid.bpm;
+    double beatsPerLeaderBeat = 1.0;
+
+    while (ratio > juce::MathConstants<double>::sqrt2)
+    {
+        ratio *= 0.5;
+        beatsPerLeaderBeat *= 0.5;
+    }
+
+    while (ratio < juce::MathConstants<double>::sqrt2 * 0.5)
+    {
+        ratio *= 2.0;
+        beatsPerLeaderBeat *= 2.0;
+    }
+
+    syncedSpeed = ratio;
+
+    // ===== Phase =====
+    // Both positions are where the next block starts
+    const double leaderBeat = (leader->positionSeconds.load() - leader->playingFirstBeat.load()) * leaderBpm / 60.0;
+    const double position = (double)track->looper->getNextReadPosition() / track->sampleRate;
+
+    // How far this deck's beats are ahead of the leader's, in this deck's beats, from -0.5 to 0.5
+    const double target = leaderBeat * beatsPerLeaderBeat;
+    double error = grid.getBeatPosition(position) - target;
+    error -= std::round(error);
+
+    const bool crossedBeat = std::floor(leaderBeat) != std::floor(lastLeaderBeat);
+    lastLeaderBeat = leaderBeat;
+
+    if (track->id != syncedTrackId)
+    {
+        syncedTrackId = track->id;
+        alignPending = true;
+    }
+
+    // A stopped deck lines up when it starts (its start has not been taken yet, so the jump
+    // falls under the fade in); against a stopped leader only the tempo is followed
+    if (!isPlaying())
+    {
+        alignPending = true;
+        return;
+    }
+
+    if (!leader->isPlaying())
+        return;
+
+    if (alignPending && (crossedBeat || !controls.running))
+    {
+        if (std::abs(error) * grid.getBeatLength() > 0.001 && pendingSeek < 0.0 && pendingCue < 0)
+            pendingSeek = juce::jmax(0.0, position - error * grid.getBeatLength());
+
+        alignPending = false;
+        return;
+    }
+
+    // A seek on the leader shows up as a jump; anything smaller is steered out over about a
+    // second, which is inaudible in the pitch
+    if (std::abs(error) > 0.25)
+    {
+        alignPending = true;
+        return;
+    }
+
+    const double beatsPerSecond = grid.bpm * ratio / 60.0;
+    syncedSpeed = ratio * (1.0 + juce::jlimit(-0.02, 0.02, -error / beatsPerSecond));
 }
@@ -1,28 +1,142 @@
 ﻿#pragma once
 #include <JuceHeader.h>
+#include "RealtimeGuard.h"
+#include "LockFreeQueue.h"
+#include "TrackLoader.h"
+#include "TimeStretchAudioSource.h"
+#include "PolyphaseResamplingAudioSource.h"
+#include "CallbackProfiler.h"
+#include "SpectrumTap.h"
 
-class PlayerAudio
+class PlayerAudio : private TrackLoader::Client
 {
 public:
+    using LoadCallback = std::function<void(bool loaded)>;
+
+    // How the speed control is applied: resampling (cheap, pitch follows speed)
+    // or time-stretching (pitch kept)
+    enum class SpeedMode { resample, preservePitch };
+
     PlayerAudio();
-    ~PlayerAudio();
+    ~PlayerAudio() override;
 
     void prepareToPlay(int samplesPerBlockExpected, double sampleRate);
     void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill);
     void releaseResources();
 
-    bool loadFile(const juce::File& file);
+    // Stage timings of the last getNextAudioBlock (audio thread only)
+    const CallbackProfiler::DeckStages& getLastStages() const { return lastStages; }
+
+    // Opens the file on the loader thread and returns straight away.
+    // onLoaded runs on the message thread once the track has been handed to the deck.
+    void loadFile(const juce::File& file, LoadCallback onLoaded = nullptr);
+    bool isLoading() const { return pendingLoads.load() > 0; }
+
+    // ===== Gapless playback =====
+    // Opens and primes the track that should follow the current one. When the current
+    // track ends (and no loop is active) the deck switches to it at the exact sample,
+    // or crossfades into it if a track crossfade is set.
+    void queueNextFile(const juce::File& file, LoadCallback onQueued = nullptr);
+    void clearQueuedFile();
+    juce::File getQueuedFile() const { return queuedInfo.file; }
+
+    // ===== Offline rendering =====
+    // Open the track on the calling thread and hand it to the deck for its next block,
+    // instead of going through the loader. Return false if the file could not be opened.
+    bool loadFileNow(const juce::File& file);
+    bool queueNextFileNow(const juce::File& file);
+
+    // Tracks loaded from now on wait for the disk instead of playing silence on an underrun
+    void setBlockingReads(bool shouldBlock) { blockingReads = shouldBlock; }
+
+    // Equal-power crossfade between queued tracks (0 = sample-exact gapless switch)
+    void setTrackCrossfade(double seconds);
+
+    // Call from the message thread; returns true (once) after the deck has moved on to
+    // the queued track, and updates the current file and metadata to match
+    bool pollTrackAdvance();
+
+    // ===== Transport and controls =====
+    // Wait-free and safe to call at any rate (e.g. from slider drags) from the one thread
+    // that controls this deck. Gain and speed are published as atomic targets that the audio
+    // thread reads once per block and glides to sample by sample; everything else travels as
+    // a command on a single-producer queue and takes effect at the start of the next block.
     void start();
     void stop();
+
+    // Reflects start/stop straight away, and the end of the track once the deck reaches it
+    bool isPlaying() const { return playing.load(); }
     void setGain(float gain);
+
+    // Seeks the track shown as current; dropped if another track reaches the deck first
     void setPosition(double pos);
     double getPosition() const;
     double getLength() const;
 
+    // The position as a frame of the current track, and the track's own sample rate
+    juce::int64 getPositionInFrames() const;
+    double getTrackSampleRate() const { return currentSampleRate; }
+
     void setLooping(bool shouldLoop);
     bool isLooping() const;
 
+    // Length of the equal-power crossfade at loop seams (0 = hard cut)
+    void setLoopCrossfade(double seconds);
+
+    // With auto gain on, every track is brought to the same loudness (see AnalysisCache) on
+    // top of the gain set here. A track that has not been measured yet plays at unity until
+    // its measurement arrives; loading it moves it to the front of the analysis queue.
+    void setAutoGain(bool shouldNormalise);
+    bool isAutoGain() const { return autoGain.load(); }
+
+    // The current track's normalisation (linear), or negative while it is being measured
+    float getNormalisationGain() const { return currentNormalisation; }
+
     void setSpeed(float ratio);
+    void setSpeedMode(SpeedMode mode);
+    SpeedMode getSpeedMode() const { return speedMode.load(); }
+
+    // The speed the deck is actually playing at as of the last block, sync included
+    float getPlaybackSpeed() const { return playbackSpeed.load(); }
+
+    // ===== Tempo sync =====
+    // The current track's beat grid (see AnalysisCache), invalid until it has been analysed
+    // or if it has no steady beat. The tempo is as played, i.e. scaled by the speed.
+    BeatGrid getBeatGrid() const { return currentBeatGrid; }
+    double getTempo() const;
+
+    // A synced deck plays at the leader's tempo, overriding its speed control (or at half or
+    // twice the speed, whichever is nearest 1). Once the leader crosses its next beat the
+    // deck jumps by less than half a beat to land on it, and from then on rides its speed by
+    // up to 2% to stay there; seeking either deck realigns on the following beat. Until both
+    // tracks have a beat grid the deck plays at its own speed. nullptr stops following; a deck
+    // cannot follow one that follows it, directly or further down the chain (that stops it
+    // following), and the leader must outlive the following.
+    void syncTo(PlayerAudio* leader);
+    bool isSynced() const { return syncLeader.load() != nullptr; }
+    PlayerAudio* getSyncLeader() const { return syncLeader.load(); }
+
+    // Audio thread: matches the leader's tempo and phase. Called by DeckEngine for every deck
+    // before any of them renders the block, so each leader reads as of the end of the last one.
+    void followSyncLeader();
+
+    // Interpolation quality of the combined file-rate x speed converter
+    void setResamplerQuality(PolyphaseResamplingAudioSource::Quality quality);
+
+    // ===== Disk streaming =====
+    void setReadAheadSeconds(double seconds);
+    double getReadAheadSeconds() const { return readAheadSeconds; }
+
+    // Uncompressed WAV/AIFF tracks loaded from now on play from a memory mapping
+    void setMemoryMappedPlayback(bool shouldMap) { memoryMapped = shouldMap; }
+    bool isMemoryMappedPlayback() const { return memoryMapped; }
+    int getUnderrunCount() const { return underrunCount.load(); }
+
+    // Look-ahead of the current track's stream as of the last block, from 0 to 1
+    float getBufferFill() const { return bufferFill.load(); }
+
+    // The deck's output after gain, for a spectrum display (idle until one enables it)
+    SpectrumTap& getSpectrumTap() { return spectrumTap; }
 
     // ===== Metadata =====
     juce::String currentTitle = "Unknown";
@@ -40,24 +154,198 @@ public:
     void setLoopPoints(double start, double end);
     void enableSegmentLoop(bool shouldLoop);
 
-    double getLoopStart() const { return loopStart; }
-    double getLoopEnd() const { return loopEnd; }
+    double getLoopStart() const { return loopStart.load(); }
+    double getLoopEnd() const { return loopEnd.load(); }
+
+    // ===== Hot cues =====
+    // The current track's cues, as frames (see HotCueStore). Each one keeps its first half
+    // second decoded in memory, so a jump to it plays from the exact frame on the next block
+    // without touching the disk. Tracks arrive with their stored cues already decoding; this
+    // only sends the cues that changed, and at most LoopingAudioSource::maxHotCues are kept.
+    void setHotCues(const std::vector<juce::int64>& frames);
+
+    // Moves playback to a frame of the current track, fading out what was playing over the
+    // loop crossfade. Frames without a decoded cue (or one still decoding) are seeked to.
+    void jumpToHotCue(juce::int64 frame);
+
+    // Jumps played from memory, and ones that had to seek
+    int getNumCueHits() const { return cueHits.load(); }
+    int getNumCueMisses() const { return cueMisses.load(); }
 
 private:
-    juce::AudioFormatManager formatManager;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    juce::AudioTransportSource transportSource;
+    struct TrackInfo
+    {
+        juce::File file;
+        juce::String title, artist, album;
+        double lengthSeconds = 0.0;
+        int trackId = 0;
+        float normalisationGain = -1.0f;
+        BeatGrid beatGrid;
+        double sampleRate = 0.0;
+        std::vector<juce::int64> hotCues;
+    };
+
+    enum RequestTag { playRequest = 1, queueRequest = 2 };
+
+    // A control change on its way to the audio thread
+    struct Command
+    {
+        enum class Type { looping, loopPoints, segmentLoop, loopCrossfade, speedMode, normalisation, beatGrid, hotCue };
+
+        Type type = Type::looping;
+        double value = 0.0;     // the grid's tempo for beatGrid; the slot for hotCue
+        double end = 0.0;       // loop points; the grid's first beat; the frame (or -1) for hotCue
+        int trackId = 0;        // the track a cue or analysis result is for
+    };
+
+    // The controls as the audio thread has applied them
+    struct ControlState
+    {
+        bool running = false;
+        bool looping = false;
+        bool segmentLooping = false;
+        double loopStart = 0.0, loopEnd = 0.0;
+        double loopCrossfadeSeconds = 0.005;
+        SpeedMode speedMode = SpeedMode::resample;
+    };
+
+    static constexpr double parameterRampSeconds = 0.02;
+    static constexpr double transportFadeSeconds = 0.005;
+
+    // Feeds the resampler from whichever track the audio thread currently owns
+    class TrackSource : public juce::AudioSource
+    {
+    public:
+        explicit TrackSource(PlayerAudio& o) : owner(o) {}
+
+        void prepareToPlay(int, double) override {}
+        void releaseResources() override {}
+        void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override { owner.renderTrack(bufferToFill); }
+
+    private:
+        PlayerAudio& owner;
+    };
+
+    void renderTrack(const juce::AudioSourceChannelInfo& bufferToFill);
+    void renderTrackAudio(const juce::AudioSourceChannelInfo& bufferToFill);
+    void renderWithHandover(const juce::AudioSourceChannelInfo& bufferToFill);
+    void send(const Command& command);
+    void sendTransport(bool shouldRun);
+    void sendPosition(bool isCue, juce::int64 frame);
+    void applyCommands();
+    void applyTransportAndPosition();
+    void applyGain(const juce::AudioSourceChannelInfo& bufferToFill);
+    void acceptIncomingTracks();
+    void retire(DeckTrack* track);
+    void releaseRetiredTracks() override;
+
+    void requestTrack(const juce::File& file, RequestTag tag, LockFreeQueue<DeckTrack*>& destination,
+        std::function<void(bool, const TrackInfo&)> onMessageThread);
+    void applyTrackInfo(const TrackInfo& info);
+    void requestAnalysis(const TrackInfo& info);
+    std::unique_ptr<DeckTrack> openTrackNow(const juce::File& file, TrackInfo& info);
+    static TrackInfo describeTrack(const DeckTrack& track);
+
+    juce::SharedResourcePointer<TrackLoader> loader;
+    double readAheadSeconds = 2.0;
+    bool memoryMapped = true;
+    bool blockingReads = false;
+
+    // Tracks travel loader -> audio thread -> loader; only the audio thread touches currentTrack
+    LockFreeQueue<DeckTrack*> incomingTracks{ 8 };
+    LockFreeQueue<DeckTrack*> queuedTracks{ 8 };
+    LockFreeQueue<DeckTrack*> retiredTracks{ 16 };
+    DeckTrack* currentTrack = nullptr;
+    DeckTrack* nextTrack = nullptr;
+
+    // Rendering target for the incoming track during a handover
+    juce::AudioBuffer<float> handoverBuffer;
+    TrackInfo queuedInfo;
+
+    // trackSource -> timeStretcher -> resampler
+    TrackSource trackSource{ *this };
+    TimeStretchAudioSource timeStretcher{ &trackSource, 2 };
+    std::unique_ptr<PolyphaseResamplingAudioSource> resampler;
 
     juce::File currentFile;
+    std::atomic<int> pendingLoads{ 0 };
+
+    // ===== State shared with the audio thread =====
+    LockFreeQueue<Command> commands{ 256 };
+    std::atomic<bool> playing{ false };
+
+    // Start/stop never go through the queue: the wanted state plus a count of requests, so the
+    // audio thread sees every one even when a start and a stop land in the same block
+    std::atomic<bool> transportWanted{ false };
+    std::atomic<juce::uint32> transportRequests{ 0 };
+    juce::uint32 transportRequestsSeen = 0;
+
+    // The latest seek or cue jump, packed so the last one wins however many arrive per block:
+    // bit 63 set for a cue, the track id in bits 40-62 and the frame below; 0 for none
+    std::atomic<juce::uint64> positionRequest{ 0 };
+    static constexpr int positionTrackShift = 40;
+    static constexpr juce::uint64 positionFrameMask = (juce::uint64(1) << positionTrackShift) - 1;
+    static constexpr juce::uint64 positionTrackMask = (juce::uint64(1) << 23) - 1;
+    static constexpr juce::uint64 positionCueFlag = juce::uint64(1) << 63;
+    std::atomic<float> gain{ 1.0f };
+    std::atomic<bool> autoGain{ true };
+    std::atomic<float> speed{ 1.0f };
+    std::atomic<PlayerAudio*> syncLeader{ nullptr };
+    std::atomic<double> positionSeconds{ 0.0 };
+    std::atomic<double> lengthSeconds{ 0.0 };
+    std::atomic<double> deviceSampleRate{ 44100.0 };
+    std::atomic<int> deviceBlockSize{ 512 };
+    std::atomic<int> underrunCount{ 0 };
+    std::atomic<float> bufferFill{ 0.0f };
+    std::atomic<int> cueHits{ 0 };
+    std::atomic<int> cueMisses{ 0 };
+
+    // The current track's grid and speed as of the last block, for decks that follow this one
+    std::atomic<double> playingBpm{ 0.0 };
+    std::atomic<double> playingFirstBeat{ 0.0 };
+    std::atomic<float> playbackSpeed{ 1.0f };
+
+    std::atomic<double> trackCrossfadeSeconds{ 0.0 };
+    std::atomic<bool> clearQueuedTrack{ false };
+    std::atomic<int> trackAdvances{ 0 };
+    int trackAdvancesSeen = 0;
+
+    // Controls as last sent, for the getters (controlling thread)
+    std::atomic<bool> userLooping{ false };
+    std::atomic<SpeedMode> speedMode{ SpeedMode::resample };
+    std::atomic<double> loopStart{ 0.0 };
+    std::atomic<double> loopEnd{ 0.0 };
+
+    // The track shown as current (controlling thread)
+    int currentTrackId = 0;
+    float currentNormalisation = -1.0f;
+    BeatGrid currentBeatGrid;
+    double currentSampleRate = 0.0;
+
+    // The frame in each of the current track's cue slots, or -1 for a free one
+    std::vector<juce::int64> cueSlots = std::vector<juce::int64>((size_t)LoopingAudioSource::maxHotCues, -1);
 
-    // A-B segment looping
-    double loopStart = 0.0;
-    double loopEnd = 0.0;
-    bool isSegmentLooping = false;
+    // Audio thread only
+    ControlState controls;
+    double pendingSeek = -1.0;
+    juce::int64 pendingCue = -1;
+    juce::SmoothedValue<float> gainRamp{ 1.0f };
+    juce::SmoothedValue<float> transportFade{ 0.0f };
+    juce::SmoothedValue<double, juce::ValueSmoothingTypes::Linear> stretchSpeed{ 1.0 };
+    double appliedRatio = 0.0;
+    double appliedTrackRate = 0.0;
 
-    std::unique_ptr<juce::ResamplingAudioSource> resampler;
+    // Sync (audio thread only); syncedSpeed is 0 while the deck plays at its own speed
+    double syncedSpeed = 0.0;
+    bool alignPending = true;
+    double lastLeaderBeat = 0.0;
+    int syncedTrackId = 0;
+    int retiredUnderruns = 0;
+    CallbackProfiler::DeckStages lastStages;
+    CallbackProfiler::Cycles streamCycles = 0;
 
-    bool userLooping = false;
+    SpectrumTap spectrumTap;
 
+    JUCE_DECLARE_WEAK_REFERENCEABLE(PlayerAudio)
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PlayerAudio)
 };
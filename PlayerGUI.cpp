@@ -5,42 +5,311 @@
 void PlayerGUI::addTrackToPlaylist(const juce::File& file)
 {
     if (file.existsAsFile())
+        playlist.add(file);
+}
+
+void PlayerGUI::refreshPlaylist()
+{
+    queueAnalysis();
+    updateSearchIndex();
+    playlistListModel->invalidateRows();
+    applySearch();
+}
+
+// ===== Search =====
+juce::String PlayerGUI::getSearchText(int row, bool& hasTags) const
+{
+    TrackRecord record;
+    hasTags = library->getIndex().find(playlist.getFile(row), record) && record.valid;
+
+    if (!hasTags)
+        return playlist.getFileName(row);
+
+    return record.title + " " + record.artist + " " + record.album + " " + playlist.getFileName(row);
+}
+
+// Indexes playlist rows added since the last call. Big imports are indexed a slice at a
+// time from the timer so the message thread stays responsive; searches meanwhile cover the
+// rows indexed so far.
+void PlayerGUI::updateSearchIndex()
+{
+    if (searchIndex.size() > playlist.size())
+    {
+        searchIndex.clear();
+        rowsWithoutTags.clear();
+    }
+
+    const auto deadline = juce::Time::getMillisecondCounterHiRes() + 10.0;
+
+    for (int row = searchIndex.size(); row < playlist.size(); ++row)
     {
-        playlist.push_back(file);
-        playlistList.updateContent();
-        playlistList.repaint();
+        bool hasTags = false;
+        searchIndex.add(getSearchText(row, hasTags));
+
+        if (!hasTags)
+            rowsWithoutTags[playlist.getFile(row).getFullPathName()].push_back(row);
+
+        if ((row & 255) == 255 && juce::Time::getMillisecondCounterHiRes() > deadline)
+            break;
     }
 }
 
-void PlayerGUI::playCurrentTrack()
+// Re-indexes the rows that were only known by file name, for the files a scan has just read
+void PlayerGUI::refreshSearchTags(const juce::StringArray& pathsRead)
 {
-    if (!playlist.empty() && currentTrackIndex >= 0 && currentTrackIndex < (int)playlist.size())
+    for (const auto& path : pathsRead)
     {
-        bool loaded = playerAudio.loadFile(playlist[currentTrackIndex]);
-        if (loaded)
+        const auto found = rowsWithoutTags.find(path);
+        if (found == rowsWithoutTags.end())
+            continue;
+
+        std::vector<int> stillWithoutTags;
+
+        for (auto row : found->second)
         {
-            waveform.clear();
-            hasWaveform = false;
+            if (row >= searchIndex.size())
+                continue;
+
+            bool hasTags = false;
+            const auto text = getSearchText(row, hasTags);
+
+            if (hasTags)
+                searchIndex.update(row, text);
+            else
+                stillWithoutTags.push_back(row);
+        }
+
+        if (stillWithoutTags.empty())
+            rowsWithoutTags.erase(found);
+        else
+            found->second.swap(stillWithoutTags);
+    }
+}
+
+// ===== Analysis =====
+// Hands new playlist rows to the background analysis, a slice per call for big imports
+void PlayerGUI::queueAnalysis()
+{
+    if (rowsQueuedForAnalysis > playlist.size())
+        rowsQueuedForAnalysis = 0;
+
+    const int end = juce::jmin(playlist.size(), rowsQueuedForAnalysis + 4096);
+    if (end == rowsQueuedForAnalysis)
+        return;
+
+    juce::Array<juce::File> files;
+    files.ensureStorageAllocated(end - rowsQueuedForAnalysis);
+
+    for (int row = rowsQueuedForAnalysis; row < end; ++row)
+        files.add(playlist.getFile(row));
+
+    analysis->analyseInBackground(files);
+    rowsQueuedForAnalysis = end;
+}
+
+void PlayerGUI::updateAutoGainText()
+{
+    const float normalisation = playerAudio.getNormalisationGain();
+
+    if (!playerAudio.isFileLoaded())
+        autoGainButton.setButtonText("Auto Gain");
+    else if (normalisation < 0.0f)
+        autoGainButton.setButtonText("Auto (...)");
+    else
+        autoGainButton.setButtonText(juce::String::formatted("Auto %+.1f dB", juce::Decibels::gainToDecibels(normalisation)));
+}
+
+void PlayerGUI::updateTempoDisplay()
+{
+    const double tempo = playerAudio.getTempo();
+    bpmLabel.setText(tempo > 0.0 ? juce::String::formatted("%.1f BPM", tempo) : "-- BPM", juce::dontSendNotification);
+
+    // The leader may have gone away
+    syncButton.setToggleState(playerAudio.isSynced(), juce::dontSendNotification);
+
+    if (playerAudio.isSynced())
+        speedSlider.setValue(playerAudio.getPlaybackSpeed(), juce::dontSendNotification);
+}
+
+void PlayerGUI::applySearch()
+{
+    const auto query = searchBox.getText();
+
+    if (query.trim().isEmpty())
+    {
+        playlistListModel->clearFilter();
+        searchStatusLabel.setText({}, juce::dontSendNotification);
+    }
+    else
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        auto result = searchIndex.search(query);
+        const double ms = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+
+        juce::String status;
+        status << (int)result.rows.size() << (result.fuzzy ? " close matches" : " matches") << " in " << juce::String(ms, 3) << " ms";
+        if (searchIndex.size() < playlist.size())
+            status << " (indexing " << searchIndex.size() << " of " << playlist.size() << ")";
+
+        searchStatusLabel.setText(status, juce::dontSendNotification);
+        playlistListModel->setFilter(std::move(result.rows));
+    }
+
+    playlistList.updateContent();
+    playlistList.repaint();
+}
+
+void PlayerGUI::playCurrentTrack()
+{
+    if (juce::isPositiveAndBelow(currentTrackIndex, playlist.size()))
+    {
+        auto file = playlist.getFile(currentTrackIndex);
 
-            auto file = playlist[currentTrackIndex];
-            if (file.existsAsFile())
+        // Replaces a restored track that is still opening
+        finishRestore();
+
+        // The file is opened on the loader thread; the UI updates once the deck has it
+        playerAudio.loadFile(file, [this, file](bool loaded)
             {
-                waveform.setSource(new juce::FileInputSource(file));
-                hasWaveform = true;
-            }
+                if (!loaded)
+                    return;
+
+                showTrackInfo(file);
+                playerAudio.start();
+                queueNextTrack();
+            });
+    }
+}
 
+void PlayerGUI::showTrackInfo(const juce::File& file)
+{
+    waveformView.setPeaks(nullptr);
 
-            titleLabel.setText("Title: " + playerAudio.getCurrentTitle(), juce::dontSendNotification);
-            artistLabel.setText("Artist: " + playerAudio.getCurrentArtist(), juce::dontSendNotification);
-            albumLabel.setText("Album: " + playerAudio.getCurrentAlbum(), juce::dontSendNotification);
-            playerAudio.start();
-        }
+    // Cached peaks arrive immediately; new files fill in while the peak builder decodes them
+    peakCache->requestPeaks(file, [safeThis = juce::Component::SafePointer<PlayerGUI>(this), file](PeakCache::Peaks::Ptr peaks)
+        {
+            if (safeThis != nullptr && safeThis->playerAudio.getCurrentFile() == file)
+                safeThis->waveformView.setPeaks(peaks);
+        });
+
+    titleLabel.setText("Title: " + playerAudio.getCurrentTitle(), juce::dontSendNotification);
+    artistLabel.setText("Artist: " + playerAudio.getCurrentArtist(), juce::dontSendNotification);
+    albumLabel.setText("Album: " + playerAudio.getCurrentAlbum(), juce::dontSendNotification);
+
+    showHotCues(file, playerAudio.getTrackSampleRate());
+    sendHotCues();
+}
+
+// Tags from the library index only, for a track the deck has not opened yet
+void PlayerGUI::showCachedTrackInfo(const juce::File& file)
+{
+    TrackRecord record;
+
+    if (library->getIndex().find(file, record) && record.valid)
+    {
+        titleLabel.setText("Title: " + record.title, juce::dontSendNotification);
+        artistLabel.setText("Artist: " + record.artist, juce::dontSendNotification);
+        albumLabel.setText("Album: " + record.album, juce::dontSendNotification);
+        showHotCues(file, record.sampleRate);
+    }
+    else
+    {
+        titleLabel.setText("Title: " + file.getFileNameWithoutExtension(), juce::dontSendNotification);
+        showHotCues(file, 0.0);
     }
+
+    waveformView.setPlaceholderText("Opening " + file.getFileName() + "...");
+}
+
+// ===== Hot cues =====
+void PlayerGUI::showHotCues(const juce::File& file, double sampleRate)
+{
+    cueFile = file;
+    cueSampleRate = sampleRate;
+    hotCues = hotCueStore->getCues(file);
+
+    cueList.deselectAllRows();
+    cueList.updateContent();
+    cueList.repaint();
+}
+
+// The deck already has the stored cues decoding; this only sends the ones edited since it loaded
+void PlayerGUI::sendHotCues()
+{
+    std::vector<juce::int64> frames;
+    for (const auto& cue : hotCues)
+        frames.push_back(cue.frame);
+
+    playerAudio.setHotCues(frames);
+}
+
+void PlayerGUI::addHotCue()
+{
+    // Only on the track the deck is playing, once it is open
+    if (isRestoring() || cueFile == juce::File() || playerAudio.getCurrentFile() != cueFile)
+        return;
+
+    if ((int)hotCues.size() >= HotCueStore::maxCuesPerFile)
+        return;
+
+    const auto frame = playerAudio.getPositionInFrames();
+
+    for (const auto& cue : hotCues)
+        if (cue.frame == frame)
+            return;
+
+    hotCues.push_back({ frame, "Cue " + juce::String((int)hotCues.size() + 1) });
+    hotCueStore->setCues(cueFile, hotCues);
+
+    showHotCues(cueFile, cueSampleRate);
+    sendHotCues();
+}
+
+void PlayerGUI::removeHotCue(int index)
+{
+    if (!juce::isPositiveAndBelow(index, (int)hotCues.size()))
+        return;
+
+    hotCues.erase(hotCues.begin() + index);
+    hotCueStore->setCues(cueFile, hotCues);
+    showHotCues(cueFile, cueSampleRate);
+
+    if (!isRestoring() && playerAudio.getCurrentFile() == cueFile)
+        sendHotCues();
+}
+
+void PlayerGUI::triggerHotCue(int index)
+{
+    if (isRestoring() || !juce::isPositiveAndBelow(index, (int)hotCues.size()) || playerAudio.getCurrentFile() != cueFile)
+        return;
+
+    playerAudio.jumpToHotCue(hotCues[(size_t)index].frame);
+    playerAudio.start();
+}
+
+bool PlayerGUI::keyPressed(const juce::KeyPress& key)
+{
+    const auto c = key.getTextCharacter();
+
+    if (c < '0' || c > '9' || key.getModifiers().isAnyModifierKeyDown())
+        return false;
+
+    triggerHotCue(c == '0' ? 9 : c - '1');
+    return true;
+}
+
+// Pre-rolls the following playlist entry so the deck can switch to it without a gap
+void PlayerGUI::queueNextTrack()
+{
+    if (playlist.size() > 1)
+        playerAudio.queueNextFile(playlist.getFile((currentTrackIndex + 1) % playlist.size()));
+    else
+        playerAudio.clearQueuedFile();
 }
 
 void PlayerGUI::nextTrack()
 {
-    if (!playlist.empty())
+    if (!playlist.isEmpty())
     {
         currentTrackIndex = (currentTrackIndex + 1) % playlist.size();
         playCurrentTrack();
@@ -49,13 +318,180 @@ void PlayerGUI::nextTrack()
 
 void PlayerGUI::previousTrack()
 {
-    if (!playlist.empty())
+    if (!playlist.isEmpty())
     {
         currentTrackIndex = (currentTrackIndex - 1 + playlist.size()) % playlist.size();
         playCurrentTrack();
     }
 }
 
+// ===== Session =====
+DeckSession PlayerGUI::getSession()
+{
+    DeckSession session;
+    session.playlist = playlist.getSnapshot();
+    session.currentTrackIndex = currentTrackIndex;
+
+    if (pendingRestore != nullptr)
+    {
+        session.filePath = pendingRestore->filePath;
+        session.position = pendingRestore->position;
+        session.loopStart = pendingRestore->loopStart;
+        session.loopEnd = pendingRestore->loopEnd;
+    }
+    else
+    {
+        // The path only: checking the file is there would touch the disk
+        const auto file = playerAudio.getCurrentFile();
+
+        if (file != juce::File{})
+        {
+            session.filePath = file.getFullPathName();
+            session.position = playerAudio.getPosition();
+        }
+
+        session.loopStart = playerAudio.getLoopStart();
+        session.loopEnd = playerAudio.getLoopEnd();
+    }
+
+    session.looping = loopButton.getToggleState();
+    session.segmentLoop = segmentLoopButton.getToggleState();
+
+    session.gain = isMuted ? savedGain : (float)volumeSlider.getValue();
+    session.muted = isMuted;
+    session.speed = (float)speedSlider.getValue();
+    session.keepPitch = keepPitchButton.getToggleState();
+    session.autoGain = autoGainButton.getToggleState();
+
+    return session;
+}
+
+void PlayerGUI::restoreSession(const DeckSession& session)
+{
+    if (!session.playlist.isEmpty())
+        playlist.restore(session.playlist);
+
+    if (!session.legacyMarkers.empty() && session.filePath.isNotEmpty())
+        migrateLegacyMarkers(juce::File(session.filePath), session.legacyMarkers);
+
+    currentTrackIndex = juce::jlimit(0, juce::jmax(0, playlist.size() - 1), session.currentTrackIndex);
+
+    // The controls are set quietly and their settings sent to the deck directly
+    savedGain = session.gain;
+    isMuted = session.muted;
+    volumeSlider.setValue(session.gain, juce::dontSendNotification);
+    playerAudio.setGain(isMuted ? 0.0f : session.gain);
+    muteButton.setButtonText(isMuted ? "Unmute" : "Mute");
+
+    speedSlider.setValue(session.speed, juce::dontSendNotification);
+    playerAudio.setSpeed((float)speedSlider.getValue());
+    keepPitchButton.setToggleState(session.keepPitch, juce::dontSendNotification);
+    playerAudio.setSpeedMode(session.keepPitch ? PlayerAudio::SpeedMode::preservePitch : PlayerAudio::SpeedMode::resample);
+    autoGainButton.setToggleState(session.autoGain, juce::dontSendNotification);
+    playerAudio.setAutoGain(session.autoGain);
+
+    loopButton.setToggleState(session.looping, juce::dontSendNotification);
+    loopButton.setButtonText(session.looping ? "Loop:On" : "Loop:Off");
+    playerAudio.setLooping(session.looping);
+    segmentLoopButton.setToggleState(session.segmentLoop, juce::dontSendNotification);
+    playerAudio.enableSegmentLoop(session.segmentLoop);
+
+    if (session.filePath.isNotEmpty())
+    {
+        pendingRestore = std::make_unique<DeckSession>(session);
+        showCachedTrackInfo(juce::File(session.filePath));
+    }
+}
+
+void PlayerGUI::openRestoredTrack(std::function<void()> onDone)
+{
+    onRestoreFinished = std::move(onDone);
+
+    if (pendingRestore == nullptr)
+    {
+        finishRestore();
+        return;
+    }
+
+    const juce::File file(pendingRestore->filePath);
+    juce::Component::SafePointer<PlayerGUI> safeThis(this);
+
+    // Peaks cached on disk show before the file is open; the loop points only apply once it is
+    peakCache->requestPeaks(file, [safeThis, file](PeakCache::Peaks::Ptr peaks)
+        {
+            if (safeThis != nullptr && safeThis->pendingRestore != nullptr && juce::File(safeThis->pendingRestore->filePath) == file)
+                safeThis->waveformView.setPeaks(peaks);
+        });
+
+    playerAudio.loadFile(file, [safeThis, file](bool loaded)
+        {
+            if (safeThis == nullptr || safeThis->pendingRestore == nullptr)
+                return;
+
+            const auto restore = *safeThis->pendingRestore;
+            auto& audio = safeThis->playerAudio;
+
+            if (loaded)
+            {
+                audio.setPosition(restore.position);
+                audio.setLoopPoints(restore.loopStart, restore.loopEnd);
+                safeThis->showTrackInfo(file);
+                safeThis->queueNextTrack();
+            }
+            else
+            {
+                DBG("Could not reopen " + file.getFullPathName());
+                safeThis->titleLabel.setText("Title: -", juce::dontSendNotification);
+                safeThis->artistLabel.setText("Artist: -", juce::dontSendNotification);
+                safeThis->albumLabel.setText("Album: -", juce::dontSendNotification);
+                safeThis->waveformView.setPeaks(nullptr);
+            }
+
+            safeThis->finishRestore();
+        });
+}
+
+// Ends a restore in progress, if any, and tells whoever was waiting for it
+void PlayerGUI::finishRestore()
+{
+    pendingRestore.reset();
+    waveformView.setPlaceholderText("No Track Loaded");
+
+    auto done = std::move(onRestoreFinished);
+    onRestoreFinished = nullptr;
+
+    if (done)
+        done();
+}
+
+// Turns a version 1 session's markers into the file's hot cues, at the sample rate the
+// library index has for it; cues set since then are left alone
+void PlayerGUI::migrateLegacyMarkers(const juce::File& file, const std::vector<DeckSession::LegacyMarker>& markers)
+{
+    TrackRecord record;
+
+    if (!library->getIndex().find(file, record) || !record.valid || record.sampleRate <= 0.0)
+    {
+        DBG("Could not migrate the markers of " << file.getFileName() << ": not in the library index");
+        return;
+    }
+
+    if (!hotCueStore->getCues(file).empty())
+        return;
+
+    std::vector<HotCue> cues;
+
+    for (const auto& marker : markers)
+    {
+        HotCue cue;
+        cue.frame = (juce::int64)std::llround(juce::jmax(0.0, marker.seconds) * record.sampleRate);
+        cue.name = marker.name;
+        cues.push_back(std::move(cue));
+    }
+
+    hotCueStore->setCues(file, std::move(cues));
+}
+
 // ===== Audio callbacks =====
 void PlayerGUI::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
@@ -76,45 +512,32 @@ void PlayerGUI::releaseResources()
 
 void PlayerGUI::paint(juce::Graphics& g)
 {
+    // The waveform draws itself; this only runs on resize or when a child uncovers it
     g.fillAll(juce::Colours::black);
+}
 
-    auto box = juce::Rectangle<int>(20, 300, 600, 100);
-
-    g.setColour(juce::Colours::black.withAlpha(0.3f));
-    g.fillRect(box);
-
-    g.setColour(juce::Colours::white);
-    g.drawRect(box, 2);
 
-    if (hasWaveform)
+// ===== Timer Callback =====
+void PlayerGUI::timerCallback()
+{
+    // Carries on indexing a big batch of new playlist rows
+    if (searchIndex.size() < playlist.size())
     {
-        auto waveformArea = box.reduced(5);
-        g.setColour(juce::Colours::blueviolet);
-
-        waveform.drawChannels(g, waveformArea, 0.0, playerAudio.getLength(), 1.0f);
+        updateSearchIndex();
+        applySearch();
+    }
 
-        // ====== Playhead ======
-        double length = playerAudio.getLength();
-        double pos = playerAudio.getPosition();
+    if (rowsQueuedForAnalysis < playlist.size())
+        queueAnalysis();
 
-        if (length > 0.0)
-        {
-            float x = waveformArea.getX() + (float)(pos / length) * waveformArea.getWidth();
-            g.setColour(juce::Colours::red);
-            g.drawLine(x, waveformArea.getY(), x, waveformArea.getBottom(), 2.0f);
-        }
-    }
-    else
+    // The deck moved on to the pre-rolled track by itself
+    if (playerAudio.pollTrackAdvance() && !playlist.isEmpty())
     {
-        g.setColour(juce::Colours::white);
-        g.drawText("No Track Loaded", box, juce::Justification::centred);
+        currentTrackIndex = (currentTrackIndex + 1) % playlist.size();
+        showTrackInfo(playerAudio.getCurrentFile());
+        queueNextTrack();
     }
-}
 
-
-// ===== Timer Callback =====
-void PlayerGUI::timerCallback()
-{
     double pos = playerAudio.getPosition();
     double length = playerAudio.getLength();
     int minutes = static_cast<int>(pos) / 60;
@@ -124,7 +547,29 @@ void PlayerGUI::timerCallback()
     if (length > 0.0)
         positionSlider.setValue(pos / length, juce::dontSendNotification);
 
-    repaint();
+    const auto scan = library->getProgress();
+    addFolderButton.setButtonText(scan.scanning ? "Cancel Scan" : "Add Folder");
+    const auto analysed = analysis->getProgress();
+
+    if (scan.scanning)
+        libraryStatusLabel.setText(juce::String::formatted("Scanning: %d found, %d read, %d unchanged",
+            scan.filesFound, scan.filesRead, scan.filesUnchanged), juce::dontSendNotification);
+    else if (analysed.analysing)
+        libraryStatusLabel.setText(juce::String::formatted("Analysing: %d to go, %.0fx realtime",
+            analysed.filesQueued, analysed.getRealtimeMultiple()), juce::dontSendNotification);
+    else
+        libraryStatusLabel.setText("Library: " + juce::String(library->getIndex().getNumTracks()) + " tracks",
+            juce::dontSendNotification);
+
+    updateAutoGainText();
+    updateTempoDisplay();
+
+    // Each of these repaints only its own area, and only when it changed
+    waveformView.setPlayPosition(pos);
+
+    const auto stats = waveformView.getFrameStats();
+    frameTimeLabel.setText(juce::String::formatted("Waveform: %d paints/s, avg %.2f ms, worst %.2f ms",
+        stats.paintsPerSecond, stats.averageMs, stats.worstMs), juce::dontSendNotification);
 
 }
 
@@ -139,7 +584,12 @@ void PlayerGUI::sliderValueChanged(juce::Slider* slider)
     else if (slider == &volumeSlider)
         playerAudio.setGain((float)slider->getValue());
     else if (slider == &speedSlider)
+    {
+        // Taking hold of the speed ends the sync
+        playerAudio.syncTo(nullptr);
+        syncButton.setToggleState(false, juce::dontSendNotification);
         playerAudio.setSpeed((float)slider->getValue());
+    }
 }
 
 // ===== Constructor =====
@@ -147,24 +597,23 @@ void PlayerGUI::sliderValueChanged(juce::Slider* slider)
 
 PlayerGUI::PlayerGUI()
 {
-    formatManagerForMeta.registerBasicFormats();
-
     // ===== TextButtons =====
-    for (auto* btn : { &loadButton, &restartButton, &stopButton, &playButton, &muteButton,
+    for (auto* btn : { &loadButton, &addFolderButton, &saveListButton, &restartButton, &stopButton, &playButton, &muteButton,
                        &forwardButton, &rewindButton, &nextButton, &prevButton,
-                       &setAButton, &setBButton, &addMarkerButton })
+                       &setAButton, &setBButton, &addCueButton })
     {
         btn->addListener(this);
         addAndMakeVisible(btn);
     }
 
     // ===== ToggleButtons =====
-    for (auto* tbtn : { &loopButton, &segmentLoopButton })
+    for (auto* tbtn : { &loopButton, &segmentLoopButton, &keepPitchButton, &autoGainButton, &syncButton })
     {
         tbtn->addListener(this);
         addAndMakeVisible(tbtn);
     }
     loopButton.setClickingTogglesState(true);
+    autoGainButton.setToggleState(playerAudio.isAutoGain(), juce::dontSendNotification);
 
     // ===== Sliders =====
     volumeSlider.setRange(0.0, 1.0, 0.01);
@@ -174,7 +623,7 @@ PlayerGUI::PlayerGUI()
     volumeSlider.setSliderStyle(juce::Slider::LinearVertical);
     addAndMakeVisible(volumeSlider);
 
-    speedSlider.setRange(0.25, 2.0, 0.25);
+    speedSlider.setRange(0.25, 2.0, 0.01);
     speedSlider.setValue(1.0);
     speedSlider.addListener(this);
     speedSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 40, 20);
@@ -199,25 +648,48 @@ PlayerGUI::PlayerGUI()
     addAndMakeVisible(artistLabel);
     addAndMakeVisible(albumLabel);
 
+    bpmLabel.setText("-- BPM", juce::dontSendNotification);
+    addAndMakeVisible(bpmLabel);
+
+    frameTimeLabel.setColour(juce::Label::textColourId, juce::Colours::grey);
+    addAndMakeVisible(frameTimeLabel);
+
+    addAndMakeVisible(waveformView);
+    addAndMakeVisible(spectrumView);
+
     isMuted = false;
     savedGain = (float)volumeSlider.getValue();
 
     startTimer(500);
 
-    // ===== Marker List =====
-    markerList.setModel(this);
-    addAndMakeVisible(markerList);
+    // ===== Hot Cue List =====
+    cueList.setModel(this);
+    addAndMakeVisible(cueList);
+
+    // Clicking the deck gives it the cue keys
+    setWantsKeyboardFocus(true);
 
     // ===== Playlist List =====
-    playlistListModel = std::make_unique<PlaylistListModel>(playlist);
+    playlistListModel = std::make_unique<PlaylistListModel>(playlist, library->getIndex());
     playlistListModel->onItemClicked = [this](int index)
         {
             currentTrackIndex = index;
             playCurrentTrack();
         };
     playlistList.setModel(playlistListModel.get());
+    playlist.onChanged = [this] { refreshPlaylist(); };
     addAndMakeVisible(playlistList);
 
+    // ===== Search =====
+    searchBox.setTextToShowWhenEmpty("Search title, artist, album or file name", juce::Colours::grey);
+    searchBox.onTextChange = [this] { applySearch(); };
+    searchBox.onEscapeKey = [this] { searchBox.clear(); applySearch(); };
+    addAndMakeVisible(searchBox);
+
+    searchStatusLabel.setColour(juce::Label::textColourId, juce::Colours::grey);
+    addAndMakeVisible(searchStatusLabel);
+    addAndMakeVisible(libraryStatusLabel);
+
     startTimerHz(30);  
 
 }
@@ -233,9 +705,16 @@ void PlayerGUI::resized()
 
     volumeSlider.setBounds(640, 100, 40, 150);
     speedSlider.setBounds(690, 100, 40, 150);
+    keepPitchButton.setBounds(650, 255, 100, 25);
+    autoGainButton.setBounds(640, 280, 110, 25);
+    bpmLabel.setBounds(640, 20, 100, 20);
+    syncButton.setBounds(640, 40, 100, 20);
 
     int yButtons = 200;
     loadButton.setBounds(1000, 20, 80, 30);
+    addFolderButton.setBounds(1090, 20, 100, 30);
+    saveListButton.setBounds(1200, 20, 90, 30);
+    libraryStatusLabel.setBounds(1300, 20, 200, 30);
     restartButton.setBounds(380, 250, 80, 30);
     stopButton.setBounds(200, yButtons, 80, 30);
     playButton.setBounds(290, yButtons, 80, 30);
@@ -258,14 +737,20 @@ void PlayerGUI::resized()
     artistLabel.setBounds(20, 80 + 25, getWidth() - 40, 20);
     albumLabel.setBounds(20, 80 + 50, getWidth() - 40, 20);
 
-    // Marker Button + List
+    // Hot Cue Button + List
 
     int yLine = 380;
     int spacing = 40;
 
-    addMarkerButton.setBounds(750, 20, 100, 30);
-    markerList.setBounds(750, 50, 240, 300);
-    playlistList.setBounds(1000, 50, 500, 300);
+    waveformView.setBounds(20, 300, 600, 100);
+    spectrumView.setBounds(630, 310, 110, 90);
+    frameTimeLabel.setBounds(20, 402, 600, 16);
+
+    addCueButton.setBounds(750, 20, 100, 30);
+    cueList.setBounds(750, 50, 240, 300);
+    searchBox.setBounds(1000, 50, 500, 24);
+    playlistList.setBounds(1000, 76, 500, 274);
+    searchStatusLabel.setBounds(1000, 352, 500, 16);
 
 }
 
@@ -276,15 +761,15 @@ PlayerGUI::~PlayerGUI()
     stopTimer();
 
     // ===== TextButtons =====
-    for (auto* btn : { &loadButton, &restartButton, &stopButton, &playButton, &muteButton,
+    for (auto* btn : { &loadButton, &addFolderButton, &saveListButton, &restartButton, &stopButton, &playButton, &muteButton,
                        &forwardButton, &rewindButton, &nextButton, &prevButton,
-                       &setAButton, &setBButton, &addMarkerButton })
+                       &setAButton, &setBButton, &addCueButton })
     {
         btn->removeListener(this);
     }
 
     // ===== ToggleButtons =====
-    for (auto* tbtn : { &loopButton, &segmentLoopButton })
+    for (auto* tbtn : { &loopButton, &segmentLoopButton, &keepPitchButton, &autoGainButton, &syncButton })
     {
         tbtn->removeListener(this);
     }
@@ -299,20 +784,46 @@ void PlayerGUI::buttonClicked(juce::Button* button)
 
     if (button == &loadButton)
     {
-        fileChooser = std::make_unique<juce::FileChooser>("Select Audio Files", juce::File{}, "*.wav;*.mp3");
+        fileChooser = std::make_unique<juce::FileChooser>("Select Audio Files or a Playlist", juce::File{}, "*.wav;*.mp3;*.m3u;*.m3u8;*.pls");
         fileChooser->launchAsync(
             juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectMultipleItems,
             [this](const juce::FileChooser& fc)
             {
-                auto files = fc.getResults();
-                for (auto& file : files)
+                const int firstNew = playlist.size();
+                juce::Array<juce::File> files;
+
+                for (auto& file : fc.getResults())
                 {
-                    if (file.existsAsFile())
-                        addTrackToPlaylist(file);
+                    if (!file.existsAsFile())
+                        continue;
+
+                    if (PlaylistStore::isPlaylistFile(file))
+                    {
+                        if (playlist.importFrom(file) < 0)
+                            DBG("Could not read playlist " + file.getFullPathName());
+                    }
+                    else
+                    {
+                        files.add(file);
+                    }
                 }
-                if (!playlist.empty())
+
+                playlist.addFiles(files);
+
+                // Fills in the playlist rows once the headers have been read. Imported
+                // playlists are left to the folder scans: a huge list would flood the scanner.
+                library->scanFiles(files,
+                    [safeThis = juce::Component::SafePointer<PlayerGUI>(this)](const juce::StringArray& pathsRead)
+                    {
+                        if (safeThis == nullptr)
+                            return;
+
+                        safeThis->refreshSearchTags(pathsRead);
+                        safeThis->refreshPlaylist();
+                    });
+                if (playlist.size() > firstNew)
                 {
-                    currentTrackIndex = playlist.size() - files.size();
+                    currentTrackIndex = firstNew;
                     playCurrentTrack();
                 }
             });
@@ -361,35 +872,113 @@ void PlayerGUI::buttonClicked(juce::Button* button)
     else if (button == &setAButton) playerAudio.setLoopPoints(playerAudio.getPosition(), playerAudio.getLoopEnd());
     else if (button == &setBButton) playerAudio.setLoopPoints(playerAudio.getLoopStart(), playerAudio.getPosition());
     else if (button == &segmentLoopButton) playerAudio.enableSegmentLoop(segmentLoopButton.getToggleState());
-    else if (button == &addMarkerButton)
+    else if (button == &addFolderButton)
     {
-        double currentPos = playerAudio.getPosition();
-        markers.push_back(currentPos);
-        juce::String markerLabel = "Marker " + juce::String(markers.size()) +
-            " (" + juce::String(int(currentPos / 60)) + ":" +
-            juce::String(int(currentPos) % 60).paddedLeft('0', 2) + ")";
-        markerNames.push_back(markerLabel);
-        markerList.updateContent();
-        markerList.repaint();
+        if (library->isScanning())
+        {
+            library->cancelScan();
+            return;
+        }
+
+        fileChooser = std::make_unique<juce::FileChooser>("Select a Music Folder");
+        fileChooser->launchAsync(
+            juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+            [this](const juce::FileChooser& fc)
+            {
+                const auto folder = fc.getResult();
+                if (!folder.isDirectory())
+                    return;
+
+                // Rescans only read files that changed since the last time
+                library->scanDirectory(folder,
+                    [safeThis = juce::Component::SafePointer<PlayerGUI>(this), folder](const juce::StringArray& pathsRead)
+                    {
+                        if (safeThis == nullptr)
+                            return;
+
+                        safeThis->refreshSearchTags(pathsRead);
+                        safeThis->playlist.addFiles(safeThis->library->getIndex().getTracksUnder(folder));
+                    });
+            });
     }
+    else if (button == &saveListButton)
+    {
+        fileChooser = std::make_unique<juce::FileChooser>("Save Playlist", juce::File{}, "*.m3u;*.m3u8;*.pls");
+        fileChooser->launchAsync(
+            juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::warnAboutOverwriting,
+            [this](const juce::FileChooser& fc)
+            {
+                auto target = fc.getResult();
+                if (target == juce::File{})
+                    return;
+
+                if (!PlaylistStore::isPlaylistFile(target))
+                    target = target.withFileExtension("m3u");
+
+                if (!playlist.exportTo(target))
+                    DBG("Could not write playlist " + target.getFullPathName());
+            });
+    }
+    else if (button == &keepPitchButton)
+        playerAudio.setSpeedMode(keepPitchButton.getToggleState() ? PlayerAudio::SpeedMode::preservePitch
+                                                                  : PlayerAudio::SpeedMode::resample);
+    else if (button == &autoGainButton)
+        playerAudio.setAutoGain(autoGainButton.getToggleState());
+    else if (button == &syncButton)
+    {
+        if (syncButton.getToggleState())
+        {
+            playerAudio.syncTo(findSyncLeader ? findSyncLeader() : nullptr);
+            syncButton.setToggleState(playerAudio.isSynced(), juce::dontSendNotification);
+        }
+        else
+        {
+            // Carries on at the tempo it was synced to
+            playerAudio.syncTo(nullptr);
+            playerAudio.setSpeed((float)speedSlider.getValue());
+        }
+    }
+    else if (button == &addCueButton)
+        addHotCue();
 }
 
-// ===== ListBoxModel (Markers) =====
-int PlayerGUI::getNumRows() { return (int)markerNames.size(); }
+// ===== ListBoxModel (Hot cues) =====
+int PlayerGUI::getNumRows() { return (int)hotCues.size(); }
 
+// The key that triggers the cue (1-9, 0), its name and its time
 void PlayerGUI::paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
 {
-    if (rowNumber < markerNames.size())
+    if (!juce::isPositiveAndBelow(rowNumber, (int)hotCues.size()))
+        return;
+
+    const auto& cue = hotCues[(size_t)rowNumber];
+
+    if (rowIsSelected) g.fillAll(juce::Colours::lightyellow);
+    g.setColour(juce::Colours::black);
+
+    const auto keyText = rowNumber < 10 ? juce::String((rowNumber + 1) % 10) : juce::String();
+    g.drawText(keyText, 2, 0, 16, height, juce::Justification::centredLeft);
+    g.drawText(cue.name, 20, 0, width - 90, height, juce::Justification::centredLeft);
+
+    if (cueSampleRate > 0.0)
     {
-        if (rowIsSelected) g.fillAll(juce::Colours::lightyellow);
-        g.setColour(juce::Colours::black);
-        g.drawText(markerNames[rowNumber], 2, 0, width - 4, height, juce::Justification::centredLeft);
+        const double seconds = (double)cue.frame / cueSampleRate;
+        g.drawText(juce::String::formatted("%d:%06.3f", (int)seconds / 60, std::fmod(seconds, 60.0)),
+            width - 70, 0, 68, height, juce::Justification::centredRight);
     }
 }
 
-void PlayerGUI::listBoxItemClicked(int row, const juce::MouseEvent&)
+// Click to jump, right-click to remove
+void PlayerGUI::listBoxItemClicked(int row, const juce::MouseEvent& e)
+{
+    if (e.mods.isPopupMenu())
+        removeHotCue(row);
+    else
+        triggerHotCue(row);
+}
+
+void PlayerGUI::deleteKeyPressed(int lastRowSelected)
 {
-    if (row < markers.size())
-        playerAudio.setPosition(markers[row]);
+    removeHotCue(lastRowSelected);
 }
 
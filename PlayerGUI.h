@@ -1,39 +1,132 @@
 ﻿#pragma once
 #include <JuceHeader.h>
 #include "PlayerAudio.h"
-
+#include "PeakCache.h"
+#include "WaveformView.h"
+#include "SpectrumView.h"
+#include "LibraryScanner.h"
+#include "PlaylistStore.h"
+#include "TrackSearchIndex.h"
+#include "AnalysisCache.h"
+#include "SessionStore.h"
+#include "HotCueStore.h"
+
+// Draws the rows of a PlaylistStore. Only visible rows are ever asked for; their text is
+// looked up once and kept in a small cache, so scrolling a long list does not go back to the
+// library index for every repaint. A search can narrow the list to some of the playlist's rows.
 class PlaylistListModel : public juce::ListBoxModel
 {
 public:
-    PlaylistListModel(std::vector<juce::File>& playlistRef) : playlist(playlistRef) {}
+    PlaylistListModel(const PlaylistStore& playlistRef, const LibraryIndex& libraryIndex)
+        : playlist(playlistRef), index(libraryIndex) {}
+
+    int getNumRows() override { return filtered ? (int)filter.size() : playlist.size(); }
+
+    // The playlist row shown at a list row, or -1
+    int getPlaylistRow(int listRow) const
+    {
+        if (!filtered)
+            return listRow < playlist.size() ? listRow : -1;
+
+        return juce::isPositiveAndBelow(listRow, (int)filter.size()) ? filter[(size_t)listRow] : -1;
+    }
+
+    // Shows only the given playlist rows, in that order
+    void setFilter(std::vector<int> playlistRows)
+    {
+        filter = std::move(playlistRows);
+        filtered = true;
+    }
+
+    void clearFilter()
+    {
+        filter.clear();
+        filtered = false;
+    }
 
-    int getNumRows() override { return static_cast<int>(playlist.size()); }
+    bool isFiltered() const { return filtered; }
 
-    void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override
+    void paintListBoxItem(int listRow, juce::Graphics& g, int width, int height, bool rowIsSelected) override
     {
-        if (rowNumber < playlist.size())
+        const int rowNumber = getPlaylistRow(listRow);
+
+        if (rowNumber >= 0)
         {
             if (rowIsSelected)
                 g.fillAll(juce::Colours::darkorange);
 
             g.setColour(juce::Colours::white);
-            g.drawText(playlist[rowNumber].getFileName(), 2, 0, width - 4, height, juce::Justification::centredLeft);
+
+            const auto& row = getRow(rowNumber);
+            if (row.duration.isNotEmpty())
+            {
+                g.drawText(row.text, 2, 0, width - 54, height, juce::Justification::centredLeft);
+                g.drawText(row.duration, width - 50, 0, 48, height, juce::Justification::centredRight);
+            }
+            else
+            {
+                g.drawText(row.text, 2, 0, width - 4, height, juce::Justification::centredLeft);
+            }
         }
     }
 
-    void listBoxItemClicked(int row, const juce::MouseEvent&) override
+    void listBoxItemClicked(int listRow, const juce::MouseEvent&) override
     {
-        if (row < playlist.size())
+        const int row = getPlaylistRow(listRow);
+
+        if (row >= 0)
         {
             if (onItemClicked)
                 onItemClicked(row);
         }
     }
 
+    // Call when the playlist or the library index changed
+    void invalidateRows() { rows.clear(); }
+
     std::function<void(int)> onItemClicked;
 
 private:
-    std::vector<juce::File>& playlist;
+    struct Row
+    {
+        juce::String text;
+        juce::String duration;      // empty until the library index has read the file
+    };
+
+    static constexpr size_t maxCachedRows = 1024;
+
+    const Row& getRow(int rowNumber)
+    {
+        const auto cached = rows.find(rowNumber);
+        if (cached != rows.end())
+            return cached->second;
+
+        if (rows.size() >= maxCachedRows)
+            rows.clear();
+
+        // Straight from the library index; files it has not read yet show their name
+        Row row;
+        TrackRecord record;
+        if (index.find(playlist.getFile(rowNumber), record) && record.valid)
+        {
+            const int seconds = juce::roundToInt(record.getLengthInSeconds());
+            row.text = record.title + "  -  " + record.artist + "  -  " + record.album;
+            row.duration = juce::String::formatted("%d:%02d", seconds / 60, seconds % 60);
+        }
+        else
+        {
+            row.text = playlist.getFileName(rowNumber);
+        }
+
+        return rows.emplace(rowNumber, std::move(row)).first->second;
+    }
+
+    const PlaylistStore& playlist;
+    const LibraryIndex& index;
+    std::unordered_map<int, Row> rows;
+
+    std::vector<int> filter;
+    bool filtered = false;
 };
 
 
@@ -56,6 +149,9 @@ public:
     void paint(juce::Graphics& g) override;
     void resized() override;
 
+    // 1-9 and 0 trigger the first ten hot cues
+    bool keyPressed(const juce::KeyPress& key) override;
+
     // Callbacks
     void buttonClicked(juce::Button* button) override;
     void sliderValueChanged(juce::Slider* slider) override;
@@ -64,24 +160,73 @@ public:
     // ===== ListBoxModel overrides =====
     int getNumRows() override;
     void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
-    void listBoxItemClicked(int row, const juce::MouseEvent&) override;
+    void listBoxItemClicked(int row, const juce::MouseEvent& e) override;
+    void deleteKeyPressed(int lastRowSelected) override;
 
     PlayerAudio& getPlayerAudio() { return playerAudio; }
 
     // ===== Playlist functions =====
     void addTrackToPlaylist(const juce::File& file);
+    void refreshPlaylist();
+
+    // ===== Search =====
+    juce::String getSearchText(int row, bool& hasTags) const;
+    void updateSearchIndex();
+    void refreshSearchTags(const juce::StringArray& pathsRead);
+    void applySearch();
+
+    // ===== Analysis =====
+    void queueAnalysis();
+    void updateAutoGainText();
+
+    // ===== Tempo sync =====
+    void updateTempoDisplay();
+
+    // ===== Hot cues =====
+    // Cues are kept per file in the HotCueStore, sorted by position. Adding one puts it at the
+    // current frame; triggering one starts the deck from it (see PlayerAudio::jumpToHotCue).
+    void addHotCue();
+    void removeHotCue(int index);
+    void triggerHotCue(int index);
+
+    // Set by the owner: the deck the Sync button should follow, or nullptr if there is none
+    std::function<PlayerAudio*()> findSyncLeader;
+
+    // ===== Session =====
+    // The deck's state for the session file; the playlist is a snapshot the session writer serialises
+    DeckSession getSession();
+
+    // Puts the playlist and controls back and shows the restored track's tags from the
+    // library index. Nothing is read from disk for the track until openRestoredTrack.
+    void restoreSession(const DeckSession& session);
+
+    // Shows the restored track's cached peaks and opens it on the loader thread, at its old
+    // position and loop. onDone runs once it is open, has failed or was replaced by another load.
+    void openRestoredTrack(std::function<void()> onDone);
+    bool isRestoring() const { return pendingRestore != nullptr; }
+
     void playCurrentTrack();
     void nextTrack();
     void previousTrack();
+    void queueNextTrack();
 
 
 
 
 private:
+    void showTrackInfo(const juce::File& file);
+    void showCachedTrackInfo(const juce::File& file);
+    void showHotCues(const juce::File& file, double sampleRate);
+    void sendHotCues();
+    void finishRestore();
+    void migrateLegacyMarkers(const juce::File& file, const std::vector<DeckSession::LegacyMarker>& markers);
+
     PlayerAudio playerAudio;
 
     // Buttons
     juce::TextButton loadButton{ "Load" };
+    juce::TextButton addFolderButton{ "Add Folder" };
+    juce::TextButton saveListButton{ "Save List" };
     juce::TextButton restartButton{ "Restart" };
     juce::TextButton stopButton{ "Stop" };
     juce::TextButton playButton{ "Play" };
@@ -97,6 +242,9 @@ private:
     // Sliders
     juce::Slider volumeSlider;
     juce::Slider speedSlider;
+    juce::ToggleButton keepPitchButton{ "Keep Pitch" };
+    juce::ToggleButton autoGainButton{ "Auto Gain" };
+    juce::ToggleButton syncButton{ "Sync" };
     juce::Slider positionSlider;
 
     // Labels
@@ -104,36 +252,57 @@ private:
     juce::Label titleLabel;
     juce::Label artistLabel;
     juce::Label albumLabel;
+    juce::Label bpmLabel;
 
     // Segment loop buttons
     juce::TextButton setAButton{ "Set A" };
     juce::TextButton setBButton{ "Set B" };
     juce::ToggleButton segmentLoopButton{ "Segment Loop" };
 
-    // Track Markers
-    std::vector<double> markers;
-    std::vector<juce::String> markerNames;
-    juce::TextButton addMarkerButton{ "Add Marker" };
-    juce::ListBox markerList;
+    // Hot cues of the file shown, and its sample rate for showing them as times
+    juce::SharedResourcePointer<HotCueStore> hotCueStore;
+    juce::File cueFile;
+    double cueSampleRate = 0.0;
+    std::vector<HotCue> hotCues;
+    juce::TextButton addCueButton{ "Add Cue" };
+    juce::ListBox cueList;
 
     // Playlist data
-    std::vector<juce::File> playlist;
+    PlaylistStore playlist;
     int currentTrackIndex = 0;
 
     bool isMuted = false;
     float savedGain = 0.5f;
 
     juce::ListBox playlistList;
+    juce::SharedResourcePointer<LibraryScanner> library;
+    juce::Label libraryStatusLabel;
     std::unique_ptr<PlaylistListModel> playlistListModel;
 
-    juce::AudioFormatManager formatManagerForMeta;
+    // Search over the playlist, one index row per playlist row
+    TrackSearchIndex searchIndex;
+    // Rows indexed by file name only, by path, until the library reads them
+    std::unordered_map<juce::String, std::vector<int>> rowsWithoutTags;
+    juce::TextEditor searchBox;
+    juce::Label searchStatusLabel;
+
+    // Playlist rows handed to the loudness and tempo analysis so far
+    juce::SharedResourcePointer<AnalysisCache> analysis;
+    int rowsQueuedForAnalysis = 0;
+
     std::unique_ptr<juce::FileChooser> fileChooser;
 
 
     // ===== Waveform =====
-    juce::AudioThumbnailCache waveformCache{ 5 };
-    juce::AudioThumbnail waveform{ 512, formatManagerForMeta, waveformCache };
-    bool hasWaveform = false;
+    juce::SharedResourcePointer<PeakCache> peakCache;
+    WaveformView waveformView;
+    SpectrumView spectrumView{ playerAudio.getSpectrumTap() };
+    juce::Label frameTimeLabel;
+
+    // ===== Session =====
+    // The restored track, position and loop until the track is open; saved as they are meanwhile
+    std::unique_ptr<DeckSession> pendingRestore;
+    std::function<void()> onRestoreFinished;
 
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PlayerGUI)
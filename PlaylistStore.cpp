@@ -0,0 +1,409 @@
+﻿#include "PlaylistStore.h"
+
+namespace
+{
+    constexpr int importBlockSize = 65536;
+
+    bool isSeparator(char c) { return c == '/' || c == '\\'; }
+    bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    // "File<N>=" at the start of a PLS line, in any case; returns the length of the prefix or 0
+    size_t getPlsEntryPrefix(const char* line, size_t length)
+    {
+        if (length < 6 || juce::String(line, 4).compareIgnoreCase("file") != 0)
+            return 0;
+
+        size_t i = 4;
+        while (i < length && juce::CharacterFunctions::isDigit(line[i]))
+            ++i;
+
+        return i > 4 && i < length && line[i] == '=' ? i + 1 : 0;
+    }
+}
+
+// ===== Entries =====
+juce::String PlaylistStore::getPath(int row) const
+{
+    if (!juce::isPositiveAndBelow(row, size()))
+        return {};
+
+    const auto& entry = contents->entries[(size_t)row];
+    return contents->folders[(int)entry.folder] + juce::String(juce::CharPointer_UTF8(contents->names.data() + entry.name));
+}
+
+juce::String PlaylistStore::getFileName(int row) const
+{
+    if (!juce::isPositiveAndBelow(row, size()))
+        return {};
+
+    return juce::String(juce::CharPointer_UTF8(contents->names.data() + contents->entries[(size_t)row].name));
+}
+
+// ===== Edits =====
+void PlaylistStore::add(const juce::File& file)
+{
+    appendPath(file.getFullPathName());
+    notify();
+}
+
+void PlaylistStore::addFiles(const juce::Array<juce::File>& files)
+{
+    auto& entries = edit().entries;
+    entries.reserve(entries.size() + (size_t)files.size());
+
+    for (const auto& file : files)
+        appendPath(file.getFullPathName());
+
+    notify();
+}
+
+void PlaylistStore::clear()
+{
+    contents = std::make_shared<Contents>();
+    folderIds.clear();
+    notify();
+}
+
+// Snapshots are only taken on this thread, so once the count reads zero no other thread can
+// take one; the acquire pairs with the release of the last one dropped, wherever that was
+PlaylistStore::Contents& PlaylistStore::edit()
+{
+    if (contents->snapshots.load(std::memory_order_acquire) > 0)
+        contents = std::make_shared<Contents>(*contents);
+
+    return *contents;
+}
+
+PlaylistStore::EntryId PlaylistStore::internFolder(const juce::String& folder)
+{
+    const auto found = folderIds.find(folder);
+    if (found != folderIds.end())
+        return found->second;
+
+    auto& folders = edit().folders;
+    const auto id = (EntryId)folders.size();
+    folders.add(folder);
+    folderIds.emplace(folder, id);
+    return id;
+}
+
+void PlaylistStore::append(EntryId folder, const char* name, size_t length)
+{
+    auto& c = edit();
+
+    // Offsets are 32-bit: 4 GB of file names is far past any real playlist
+    jassert(c.names.size() + length + 1 < std::numeric_limits<EntryId>::max());
+
+    Entry entry;
+    entry.folder = folder;
+    entry.name = (EntryId)c.names.size();
+
+    c.names.insert(c.names.end(), name, name + length);
+    c.names.push_back(0);
+    c.entries.push_back(entry);
+}
+
+void PlaylistStore::appendPath(const juce::String& path)
+{
+    const int split = juce::jmax(path.lastIndexOfChar('/'), path.lastIndexOfChar('\\')) + 1;
+    const auto name = path.substring(split);
+
+    append(internFolder(path.substring(0, split)), name.toRawUTF8(), name.getNumBytesAsUTF8());
+}
+
+void PlaylistStore::notify()
+{
+    ++revision;
+
+    if (onChanged)
+        onChanged();
+}
+
+// ===== Playlist files =====
+int PlaylistStore::importFrom(const juce::File& playlistFile)
+{
+    juce::FileInputStream in(playlistFile);
+    if (!in.openedOk())
+        return -1;
+
+    ImportState state;
+    state.base = playlistFile.getParentDirectory();
+    state.isPls = playlistFile.hasFileExtension("pls");
+
+    const int numBefore = size();
+    juce::HeapBlock<char> block(importBlockSize);
+    std::string carry;
+
+    // Lines are cut straight out of the read buffer; only one split across two blocks is copied
+    for (;;)
+    {
+        const int numRead = in.read(block.get(), importBlockSize);
+        if (numRead <= 0)
+            break;
+
+        const char* pos = block.get();
+        const char* const end = pos + numRead;
+
+        while (pos < end)
+        {
+            const auto* newline = static_cast<const char*>(std::memchr(pos, '\n', (size_t)(end - pos)));
+
+            if (newline == nullptr)
+            {
+                carry.append(pos, end);
+                break;
+            }
+
+            if (carry.empty())
+            {
+                appendLine(pos, (size_t)(newline - pos), state);
+            }
+            else
+            {
+                carry.append(pos, newline);
+                appendLine(carry.data(), carry.size(), state);
+                carry.clear();
+            }
+
+            pos = newline + 1;
+        }
+    }
+
+    if (!carry.empty())
+        appendLine(carry.data(), carry.size(), state);
+
+    notify();
+    return size() - numBefore;
+}
+
+void PlaylistStore::appendLine(const char* line, size_t length, ImportState& state)
+{
+    if (state.firstLine)
+    {
+        state.firstLine = false;
+
+        if (length >= 3 && std::memcmp(line, "\xef\xbb\xbf", 3) == 0)
+        {
+            line += 3;
+            length -= 3;
+        }
+    }
+
+    while (length > 0 && isSpace(line[length - 1]))
+        --length;
+
+    while (length > 0 && isSpace(*line))
+    {
+        ++line;
+        --length;
+    }
+
+    if (length == 0)
+        return;
+
+    if (state.isPls)
+    {
+        // Only the File<N>= lines are entries; titles, lengths and the header are skipped
+        const auto prefix = getPlsEntryPrefix(line, length);
+        if (prefix == 0)
+            return;
+
+        line += prefix;
+        length -= prefix;
+    }
+    else if (line[0] == '#')
+    {
+        return;     // #EXTM3U, #EXTINF and comments
+    }
+
+    const juce::String text(juce::CharPointer_UTF8(line), length);
+
+    // Local file URLs are rare enough to take the slow road; streams cannot be played from a deck
+    if (text.startsWithIgnoreCase("file:"))
+    {
+        appendPath(juce::URL(text).getLocalFile().getFullPathName());
+        return;
+    }
+
+    if (text.contains("://"))
+        return;
+
+    size_t split = length;
+    while (split > 0 && !isSeparator(line[split - 1]))
+        --split;
+
+    if (split == length)
+        return;
+
+    if (!state.haveFolder || state.rawFolder.size() != split || std::memcmp(state.rawFolder.data(), line, split) != 0)
+    {
+        const auto raw = juce::String(juce::CharPointer_UTF8(line), split);
+        juce::String folder;
+
+        if (juce::File::isAbsolutePath(raw))
+            folder = raw;
+        else
+            folder = (split == 0 ? state.base : state.base.getChildFile(raw)).getFullPathName()
+                     + juce::File::getSeparatorString();
+
+        state.rawFolder.assign(line, split);
+        state.folder = internFolder(folder);
+        state.haveFolder = true;
+    }
+
+    append(state.folder, line + split, length - split);
+}
+
+bool PlaylistStore::exportTo(const juce::File& playlistFile) const
+{
+    const bool pls = playlistFile.hasFileExtension("pls");
+    juce::TemporaryFile temp(playlistFile);
+
+    {
+        juce::FileOutputStream out(temp.getFile(), importBlockSize);
+        if (!out.openedOk())
+            return false;
+
+        out << (pls ? "[playlist]\n" : "#EXTM3U\n");
+
+        const auto& c = *contents;
+
+        for (size_t i = 0; i < c.entries.size(); ++i)
+        {
+            const auto& folder = c.folders.getReference((int)c.entries[i].folder);
+            const char* name = c.names.data() + c.entries[i].name;
+
+            if (pls)
+                out << "File" << (int)i + 1 << "=";
+
+            out.write(folder.toRawUTF8(), folder.getNumBytesAsUTF8());
+            out.write(name, std::strlen(name));
+            out.writeByte('\n');
+        }
+
+        if (pls)
+            out << "NumberOfEntries=" << size() << "\nVersion=2\n";
+
+        out.flush();
+        if (!out.getStatus().wasOk())
+            return false;
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+// ===== Session state =====
+void PlaylistStore::restore(const Snapshot& snapshot)
+{
+    contents = snapshot.contents != nullptr ? std::make_shared<Contents>(*snapshot.contents) : std::make_shared<Contents>();
+    folderIds.clear();
+
+    for (int i = 0; i < contents->folders.size(); ++i)
+        folderIds.emplace(contents->folders[i], (EntryId)i);
+
+    notify();
+}
+
+PlaylistStore::Snapshot::Snapshot(std::shared_ptr<const Contents> shared)
+    : contents(std::move(shared))
+{
+    if (contents != nullptr)
+        contents->snapshots.fetch_add(1, std::memory_order_relaxed);
+}
+
+PlaylistStore::Snapshot::Snapshot(const Snapshot& other)
+    : Snapshot(other.contents)
+{
+}
+
+PlaylistStore::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : contents(std::move(other.contents))
+{
+}
+
+PlaylistStore::Snapshot& PlaylistStore::Snapshot::operator=(Snapshot other) noexcept
+{
+    std::swap(contents, other.contents);
+    return *this;
+}
+
+// After this snapshot's last read of the tables, so the store may then change them
+PlaylistStore::Snapshot::~Snapshot()
+{
+    if (contents != nullptr)
+        contents->snapshots.fetch_sub(1, std::memory_order_release);
+}
+
+bool PlaylistStore::Snapshot::isEmpty() const
+{
+    return contents == nullptr || contents->entries.empty();
+}
+
+// Folder count and folders, arena size and arena, entry count and entries. The arena and the
+// entry table are written as they sit in memory: the session file never leaves this machine.
+void PlaylistStore::Snapshot::writeTo(juce::OutputStream& out) const
+{
+    const Contents none;
+    const auto& c = contents != nullptr ? *contents : none;
+
+    out.writeCompressedInt(c.folders.size());
+
+    for (const auto& folder : c.folders)
+        out.writeString(folder);
+
+    out.writeInt64((juce::int64)c.names.size());
+    if (!c.names.empty())
+        out.write(c.names.data(), c.names.size());
+
+    out.writeInt64((juce::int64)c.entries.size());
+    if (!c.entries.empty())
+        out.write(c.entries.data(), c.entries.size() * sizeof(Entry));
+}
+
+bool PlaylistStore::Snapshot::readFrom(juce::InputStream& in)
+{
+    *this = Snapshot();
+    auto c = std::make_shared<Contents>();
+
+    const int numFolders = in.readCompressedInt();
+    if (numFolders < 0)
+        return false;
+
+    for (int i = 0; i < numFolders && !in.isExhausted(); ++i)
+        c->folders.add(in.readString());
+
+    // Sizes are checked against what is left before anything is allocated for them
+    const auto numNameBytes = in.readInt64();
+    if (c->folders.size() != numFolders || numNameBytes < 0 || numNameBytes > in.getNumBytesRemaining())
+        return false;
+
+    c->names.resize((size_t)numNameBytes);
+    if (!c->names.empty() && ((juce::int64)in.read(c->names.data(), c->names.size()) != numNameBytes || c->names.back() != 0))
+        return false;
+
+    const auto numEntries = in.readInt64();
+    if (numEntries < 0 || numEntries > in.getNumBytesRemaining() / (juce::int64)sizeof(Entry))
+        return false;
+
+    c->entries.resize((size_t)numEntries);
+    const auto entryBytes = c->entries.size() * sizeof(Entry);
+    if (!c->entries.empty() && (size_t)in.read(c->entries.data(), entryBytes) != entryBytes)
+        return false;
+
+    for (const auto& entry : c->entries)
+        if (entry.folder >= (EntryId)c->folders.size() || entry.name >= (EntryId)c->names.size())
+            return false;
+
+    *this = Snapshot(std::move(c));
+    return true;
+}
+
+size_t PlaylistStore::getMemoryUsage() const
+{
+    size_t total = contents->entries.capacity() * sizeof(Entry) + contents->names.capacity();
+
+    for (const auto& folder : contents->folders)
+        total += folder.getNumBytesAsUTF8() + sizeof(juce::String) * 3;
+
+    return total;
+}
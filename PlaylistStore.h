@@ -0,0 +1,139 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Compact playlist for very long lists (a million entries in a few tens of MB).
+//
+// An entry is two 32-bit ids: its folder, interned once however many entries share it, and
+// its file name, stored NUL-terminated in one growing character arena. Nothing per entry is
+// a juce::String or juce::File; those are only built for the rows being looked at.
+//
+// Edits come in batches and listeners hear about each batch once. Playlists are imported
+// and exported as M3U/M3U8/PLS by streaming over the file in blocks.
+// Message thread only, apart from snapshots.
+class PlaylistStore
+{
+    struct Contents;
+
+public:
+    using EntryId = juce::uint32;
+
+    PlaylistStore() = default;
+
+    int size() const { return (int)contents->entries.size(); }
+    bool isEmpty() const { return contents->entries.empty(); }
+
+    // ===== Entries =====
+    juce::File getFile(int row) const { return juce::File(getPath(row)); }
+    juce::String getPath(int row) const;
+    juce::String getFileName(int row) const;
+
+    // ===== Edits =====
+    // Each call is one batch: onChanged runs once after it
+    void add(const juce::File& file);
+    void addFiles(const juce::Array<juce::File>& files);
+    void clear();
+
+    std::function<void()> onChanged;
+
+    // ===== Playlist files =====
+    static bool isPlaylistFile(const juce::File& file) { return file.hasFileExtension("m3u;m3u8;pls"); }
+
+    // Appends the entries of an M3U/M3U8 or PLS file (relative paths are resolved against its
+    // folder; text is read as UTF-8). Returns the number of entries added, or -1 on failure.
+    int importFrom(const juce::File& playlistFile);
+
+    // Writes every entry with its full path: PLS if the extension says so, otherwise extended M3U
+    bool exportTo(const juce::File& playlistFile) const;
+
+    // ===== Session state =====
+    // The entries as they were at one revision, for writing out on another thread. A snapshot
+    // shares the store's tables instead of copying them; while any snapshot of them is alive,
+    // the store's next edit copies the tables first. Each snapshot counts itself on the tables
+    // and drops its count (release) after its last read, and an edit reads the count (acquire)
+    // before changing them in place, so a snapshot dropped on another thread is safe.
+    class Snapshot
+    {
+    public:
+        Snapshot() = default;
+        Snapshot(const Snapshot& other);
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot other) noexcept;
+        ~Snapshot();
+
+        bool isEmpty() const;
+
+        // The store in its own compact form (folders, the name arena and the entry table), for
+        // the session file: far quicker to write and read back than a playlist file. readFrom
+        // returns false, leaving the snapshot empty, if the data is damaged.
+        void writeTo(juce::OutputStream& out) const;
+        bool readFrom(juce::InputStream& in);
+
+    private:
+        friend class PlaylistStore;
+        explicit Snapshot(std::shared_ptr<const Contents> shared);
+
+        std::shared_ptr<const Contents> contents;
+    };
+
+    Snapshot getSnapshot() const { return Snapshot(contents); }
+
+    // Replaces the contents with a copy of the snapshot's
+    void restore(const Snapshot& snapshot);
+
+    // Goes up with every batch of edits, so a saved copy can tell whether it is stale
+    juce::uint32 getRevision() const { return revision; }
+
+    // Bytes held by the arena and the tables
+    size_t getMemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        EntryId folder = 0;
+        EntryId name = 0;     // offset into names
+    };
+
+    // Where an import is up to. Imports mostly list a folder's files together, so the last
+    // folder's raw text is kept to skip resolving and interning it again.
+    struct ImportState
+    {
+        juce::File base;
+        bool isPls = false;
+        bool firstLine = true;
+
+        std::string rawFolder;
+        EntryId folder = 0;
+        bool haveFolder = false;
+    };
+
+    // Everything a snapshot shares; only ever changed through edit()
+    struct Contents
+    {
+        Contents() = default;
+        Contents(const Contents& other) : entries(other.entries), names(other.names), folders(other.folders) {}
+
+        std::vector<Entry> entries;
+        std::vector<char> names;
+        juce::StringArray folders;
+
+        // Live snapshots of these tables (a copy starts with none)
+        mutable std::atomic<int> snapshots{ 0 };
+    };
+
+    // The contents for an edit, copied first if a snapshot still shares them
+    Contents& edit();
+
+    // Folders keep their trailing separator, so a path is folder + name
+    EntryId internFolder(const juce::String& folder);
+    void append(EntryId folder, const char* name, size_t length);
+    void appendPath(const juce::String& path);
+    void appendLine(const char* line, size_t length, ImportState& state);
+    void notify();
+
+    std::shared_ptr<Contents> contents = std::make_shared<Contents>();
+    std::unordered_map<juce::String, EntryId> folderIds;
+
+    juce::uint32 revision = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PlaylistStore)
+};
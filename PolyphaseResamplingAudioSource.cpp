@@ -0,0 +1,252 @@
+﻿#include "PolyphaseResamplingAudioSource.h"
+#include "SimdKernels.h"
+
+// ===== Shared coefficient tables =====
+class PolyphaseResamplingAudioSource::FilterBank
+{
+public:
+    static constexpr int numPhases = 128;
+    static constexpr int numQualities = 3;
+    // Fine steps just above 1:1, where file-rate conversion (e.g. 48 -> 44.1 kHz) and small
+    // speed changes sit, so the cutoff never drops more than ~6% below the output Nyquist there
+    static constexpr float factors[] = { 1.0f, 1.0625f, 1.125f, 1.1875f, 1.25f, 1.375f, 1.5f, 1.75f,
+                                         2.0f, 2.5f, 3.0f, 4.0f, 6.0f, 8.0f };
+    static constexpr int numFactors = (int)(sizeof(factors) / sizeof(factors[0]));
+
+    // Taps per side at 1:1, kaiser beta and passband edge (fraction of Nyquist) per quality
+    static constexpr int baseHalfTaps[] = { 4, 12, 32 };
+    static constexpr double betas[] = { 5.0, 8.0, 10.0 };
+    static constexpr double cutoffs[] = { 0.85, 0.91, 0.95 };
+
+    struct Table
+    {
+        int numTaps = 0;
+        juce::HeapBlock<float> rows;   // (numPhases + 1) rows of numTaps, phase 0 -> 1
+
+        const float* getRow(int phase) const noexcept { return rows.get() + (size_t)phase * (size_t)numTaps; }
+    };
+
+    FilterBank()
+    {
+        for (int q = 0; q < numQualities; ++q)
+            for (int f = 0; f < numFactors; ++f)
+                build(tables[q][f], (int)std::ceil(baseHalfTaps[q] * factors[f]), betas[q], cutoffs[q] / factors[f]);
+    }
+
+    // Narrowest table whose cutoff is at or below the output Nyquist for this ratio
+    const Table& getTable(Quality quality, double ratio) const noexcept
+    {
+        int f = 0;
+        while (f < numFactors - 1 && factors[f] < ratio)
+            ++f;
+
+        return tables[(int)quality][f];
+    }
+
+    static int getMaxHalfTaps() noexcept { return (int)std::ceil(baseHalfTaps[numQualities - 1] * factors[numFactors - 1]); }
+
+private:
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 50 && term > sum * 1.0e-12; ++k)
+        {
+            const double h = x / (2.0 * k);
+            term *= h * h;
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    static void build(Table& table, int halfTaps, double beta, double cutoff)
+    {
+        table.numTaps = halfTaps * 2;
+        table.rows.allocate((size_t)((numPhases + 1) * table.numTaps), true);
+
+        const double norm = besselI0(beta);
+
+        for (int phase = 0; phase <= numPhases; ++phase)
+        {
+            auto* row = table.rows.get() + (size_t)phase * (size_t)table.numTaps;
+            const double frac = (double)phase / numPhases;
+            double sum = 0.0;
+
+            for (int j = 0; j < table.numTaps; ++j)
+            {
+                // Distance from the output instant to input sample (readIndex - halfTaps + 1 + j)
+                const double t = (double)(j - (halfTaps - 1)) - frac;
+                const double x = juce::MathConstants<double>::pi * cutoff * t;
+                const double sinc = x == 0.0 ? 1.0 : std::sin(x) / x;
+                const double edge = t / halfTaps;
+                const double window = std::abs(edge) < 1.0 ? besselI0(beta * std::sqrt(1.0 - edge * edge)) / norm : 0.0;
+
+                row[j] = (float)(sinc * window);
+                sum += row[j];
+            }
+
+            // Unity gain at DC for every phase
+            for (int j = 0; j < table.numTaps; ++j)
+                row[j] = (float)(row[j] / sum);
+        }
+    }
+
+    Table tables[numQualities][numFactors];
+
+    JUCE_DECLARE_NON_COPYABLE(FilterBank)
+};
+
+// ===== PolyphaseResamplingAudioSource =====
+PolyphaseResamplingAudioSource::PolyphaseResamplingAudioSource(juce::AudioSource* inputSource, bool deleteInputWhenDeleted, int channels)
+    : input(inputSource, deleteInputWhenDeleted),
+    numChannels(juce::jmax(1, channels))
+{
+    jassert(input != nullptr);
+}
+
+PolyphaseResamplingAudioSource::~PolyphaseResamplingAudioSource() = default;
+
+void PolyphaseResamplingAudioSource::setResamplingRatio(double samplesInPerOutputSample)
+{
+    jassert(samplesInPerOutputSample > 0.0);
+    ratio.store(juce::jlimit(1.0e-3, maxRatio, samplesInPerOutputSample));
+}
+
+void PolyphaseResamplingAudioSource::jumpToRatio(double samplesInPerOutputSample)
+{
+    setResamplingRatio(samplesInPerOutputSample);
+    snapToRatio = true;
+}
+
+void PolyphaseResamplingAudioSource::flushBuffers()
+{
+    // Start on a run of silence long enough for the widest filter's left half
+    const int maxHalf = FilterBank::getMaxHalfTaps();
+
+    history.clear();
+    readIndex = maxHalf - 1;
+    numBuffered = readIndex;
+    fraction = 0.0;
+    snapToRatio = true;
+}
+
+void PolyphaseResamplingAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    const double currentRatio = ratio.load();
+
+    // Output is rendered in chunks of at most one expected block, so the history never
+    // needs more than the filter span plus one block at the maximum ratio
+    maxChunk = juce::jmax(64, samplesPerBlockExpected);
+    history.setSize(numChannels, FilterBank::getMaxHalfTaps() * 2 + (int)std::ceil(maxChunk * maxRatio) + 4);
+    flushBuffers();
+
+    input->prepareToPlay(juce::roundToInt(samplesPerBlockExpected * currentRatio), sampleRate * currentRatio);
+}
+
+void PolyphaseResamplingAudioSource::releaseResources()
+{
+    input->releaseResources();
+    history.setSize(numChannels, 0);
+}
+
+void PolyphaseResamplingAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    for (int offset = 0; offset < bufferToFill.numSamples;)
+    {
+        const int num = juce::jmin(maxChunk, bufferToFill.numSamples - offset);
+        render(juce::AudioSourceChannelInfo(bufferToFill.buffer, bufferToFill.startSample + offset, num));
+        offset += num;
+    }
+}
+
+void PolyphaseResamplingAudioSource::render(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    const double target = ratio.load();
+
+    if (snapToRatio || rampLength.load() == 0)
+    {
+        currentRatio = rampTarget = target;
+        rampRemaining = 0;
+        snapToRatio = false;
+    }
+    else if (target != rampTarget)
+    {
+        rampTarget = target;
+        rampRemaining = rampLength.load();
+        rampIncrement = (target - currentRatio) / rampRemaining;
+    }
+
+    // Over a glide the filter is chosen for the faster end, so neither end aliases
+    const double fastest = juce::jmax(currentRatio, rampTarget);
+    const auto& table = filterBank->getTable(quality.load(), fastest);
+    const int halfTaps = table.numTaps / 2;
+
+    // Pull enough input for the right half of the filter at the last output sample
+    const int needed = readIndex + (int)(fraction + bufferToFill.numSamples * fastest) + halfTaps + 1;
+    jassert(needed <= history.getNumSamples());
+
+    if (needed > numBuffered)
+    {
+        input->getNextAudioBlock(juce::AudioSourceChannelInfo(&history, numBuffered, needed - numBuffered));
+        numBuffered = needed;
+    }
+
+    auto& dest = *bufferToFill.buffer;
+    const int numOutChannels = dest.getNumChannels();
+    const int activeChannels = juce::jmin(numChannels, numOutChannels);
+
+    for (int i = 0; i < bufferToFill.numSamples; ++i)
+    {
+        const double phasePos = fraction * FilterBank::numPhases;
+        const int phase = (int)phasePos;
+        const float blend = (float)(phasePos - phase);
+
+        const float* lower = table.getRow(phase);
+        const float* upper = table.getRow(phase + 1);
+        const int first = readIndex - halfTaps + 1;
+
+        for (int ch = 0; ch < activeChannels; ++ch)
+        {
+            const float* in = history.getReadPointer(ch, first);
+            const float a = SimdKernels::dotProduct(in, lower, table.numTaps);
+            const float b = SimdKernels::dotProduct(in, upper, table.numTaps);
+
+            dest.getWritePointer(ch, bufferToFill.startSample)[i] = a + (b - a) * blend;
+        }
+
+        fraction += currentRatio;
+
+        if (rampRemaining > 0)
+            currentRatio = --rampRemaining > 0 ? currentRatio + rampIncrement : rampTarget;
+
+        const int advance = (int)fraction;
+        readIndex += advance;
+        fraction -= advance;
+    }
+
+    // A mono source feeds every output channel
+    for (int ch = activeChannels; ch < numOutChannels; ++ch)
+        dest.copyFrom(ch, bufferToFill.startSample, dest, 0, bufferToFill.startSample, bufferToFill.numSamples);
+
+    compact();
+}
+
+// Moves the live part of the history back to the front, keeping the widest filter's left half
+void PolyphaseResamplingAudioSource::compact()
+{
+    const int keepFrom = readIndex - (FilterBank::getMaxHalfTaps() - 1);
+    if (keepFrom <= 0)
+        return;
+
+    const int remaining = numBuffered - keepFrom;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto* data = history.getWritePointer(ch);
+        std::memmove(data, data + keepFrom, (size_t)remaining * sizeof(float));
+    }
+
+    readIndex -= keepFrom;
+    numBuffered = remaining;
+}
@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Windowed-sinc sample-rate converter, a drop-in for juce::ResamplingAudioSource.
+// Each output sample is a dot product of the surrounding input with one row of a
+// precomputed polyphase table (interpolated between neighbouring phases), so file-rate
+// conversion and the speed ratio are handled in a single pass.
+//
+// When reading faster than 1:1 the cutoff is lowered to the output Nyquist by switching to
+// a wider table from a set of decimation factors, closely spaced just above 1:1. Tables are
+// shared by every instance and built once; nothing is allocated after prepareToPlay().
+class PolyphaseResamplingAudioSource : public juce::AudioSource
+{
+public:
+    enum class Quality
+    {
+        draft,      // 8 taps, cheapest
+        standard,   // 24 taps
+        high        // 64 taps, ~0.95 x Nyquist passband
+    };
+
+    PolyphaseResamplingAudioSource(juce::AudioSource* inputSource, bool deleteInputWhenDeleted, int numChannels = 2);
+    ~PolyphaseResamplingAudioSource() override;
+
+    // Input samples consumed per output sample, clamped to (0, maxRatio]
+    void setResamplingRatio(double samplesInPerOutputSample);
+
+    // Audio thread, between blocks: sets the ratio without a glide, e.g. when the source
+    // switches to a file at another sample rate
+    void jumpToRatio(double samplesInPerOutputSample);
+    double getResamplingRatio() const noexcept { return ratio.load(); }
+
+    // With a ramp length, a new ratio is reached by a linear glide of that many output
+    // samples (restarted from wherever the last one got to) instead of a step.
+    // After flushBuffers() the next ratio is taken straight away.
+    void setRatioRampLength(int numOutputSamples) { rampLength.store(juce::jmax(0, numOutputSamples)); }
+
+    void setQuality(Quality newQuality) { quality.store(newQuality); }
+    Quality getQuality() const noexcept { return quality.load(); }
+
+    // Drops buffered input, e.g. after a seek
+    void flushBuffers();
+
+    // ===== AudioSource =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    static constexpr double maxRatio = 8.0;
+
+private:
+    class FilterBank;
+
+    void render(const juce::AudioSourceChannelInfo& bufferToFill);
+    void compact();
+
+    juce::OptionalScopedPointer<juce::AudioSource> input;
+    const int numChannels;
+    juce::SharedResourcePointer<FilterBank> filterBank;
+
+    std::atomic<double> ratio{ 1.0 };
+    std::atomic<int> rampLength{ 0 };
+    std::atomic<Quality> quality{ Quality::standard };
+
+    // Ratio glide (audio thread)
+    double currentRatio = 1.0;
+    double rampTarget = 1.0;
+    double rampIncrement = 0.0;
+    int rampRemaining = 0;
+    bool snapToRatio = true;
+
+    // Input history: samples before readIndex are kept for the filter's left half
+    juce::AudioBuffer<float> history;
+    int maxChunk = 0;
+    int numBuffered = 0;
+    int readIndex = 0;
+    double fraction = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PolyphaseResamplingAudioSource)
+};
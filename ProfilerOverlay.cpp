@@ -0,0 +1,123 @@
+﻿#include "ProfilerOverlay.h"
+
+ProfilerOverlay::ProfilerOverlay(CallbackProfiler& profilerToShow)
+    : profiler(profilerToShow)
+{
+    addAndMakeVisible(saveButton);
+    addAndMakeVisible(resetButton);
+
+    saveButton.onClick = [this]
+        {
+            const auto file = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                .getChildFile("MyAudioPlayer")
+                .getChildFile("CallbackReport " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".txt");
+
+            file.getParentDirectory().createDirectory();
+            status = profiler.writeReport(file) ? "Saved " + file.getFullPathName() : "Could not write " + file.getFullPathName();
+            repaint();
+        };
+
+    resetButton.onClick = [this]
+        {
+            profiler.reset();
+            status = {};
+            repaint();
+        };
+
+    startTimerHz(4);
+}
+
+ProfilerOverlay::~ProfilerOverlay()
+{
+    stopTimer();
+}
+
+void ProfilerOverlay::timerCallback()
+{
+    profiler.collect();
+
+    if (isShowing())
+        repaint();
+}
+
+void ProfilerOverlay::resized()
+{
+    saveButton.setBounds(getWidth() - 220, 10, 100, 24);
+    resetButton.setBounds(getWidth() - 110, 10, 100, 24);
+}
+
+void ProfilerOverlay::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colours::black.withAlpha(0.85f));
+    g.setColour(juce::Colours::white);
+
+    auto area = getLocalBounds().reduced(10);
+    auto header = area.removeFromTop(24);
+
+    g.drawText("Callbacks " + juce::String(profiler.getNumBlocks())
+        + "   overruns " + juce::String(profiler.getNumOverruns())
+        + "   late " + juce::String(profiler.getNumLateCallbacks())
+        + "   dropped records " + juce::String(profiler.getNumDroppedRecords()),
+        header, juce::Justification::centredLeft);
+
+    area.removeFromTop(6);
+
+    // ===== Histograms =====
+    auto histograms = area.removeFromTop(110);
+    const int numCharts = profiler.getNumDecksSeen() + 1;
+    const int chartWidth = histograms.getWidth() / juce::jmax(1, numCharts);
+
+    for (int d = 0; d < profiler.getNumDecksSeen(); ++d)
+        drawHistogram(g, histograms.removeFromLeft(chartWidth).reduced(4, 0), "Deck " + juce::String(d + 1),
+            profiler.getHistogram(d));
+
+    drawHistogram(g, histograms.removeFromLeft(chartWidth).reduced(4, 0), "Callback",
+        profiler.getHistogram(CallbackProfiler::maxDecks));
+
+    // ===== Worst blocks =====
+    area.removeFromTop(10);
+    g.setColour(juce::Colours::white);
+    g.drawText("Worst recent blocks (ms)", area.removeFromTop(20), juce::Justification::centredLeft);
+
+    for (auto& block : profiler.getWorstRecentBlocks(6))
+    {
+        g.setColour(block.overrun ? juce::Colours::orangered : juce::Colours::lightgrey);
+        g.drawText(block.toString(), area.removeFromTop(18), juce::Justification::centredLeft);
+    }
+
+    if (status.isNotEmpty())
+    {
+        g.setColour(juce::Colours::lightgrey);
+        g.drawText(status, getLocalBounds().reduced(10).removeFromBottom(20), juce::Justification::centredLeft);
+    }
+}
+
+// Bars are 5% of the deadline wide (the last one is everything over 100%), with log-scaled heights
+void ProfilerOverlay::drawHistogram(juce::Graphics& g, juce::Rectangle<int> area, const juce::String& title,
+    const std::array<int, CallbackProfiler::numHistogramBins>& histogram) const
+{
+    g.setColour(juce::Colours::white);
+    g.drawText(title, area.removeFromTop(16), juce::Justification::centredLeft);
+
+    g.setColour(juce::Colours::darkgrey);
+    g.drawRect(area);
+
+    const int peak = *std::max_element(histogram.begin(), histogram.end());
+    if (peak <= 0)
+        return;
+
+    const float barWidth = (float)area.getWidth() / (float)histogram.size();
+    const float scale = (float)area.getHeight() / std::log1p((float)peak);
+
+    for (size_t bin = 0; bin < histogram.size(); ++bin)
+    {
+        if (histogram[bin] == 0)
+            continue;
+
+        const float height = std::log1p((float)histogram[bin]) * scale;
+        const bool overDeadline = bin == histogram.size() - 1;
+
+        g.setColour(overDeadline ? juce::Colours::orangered : juce::Colours::limegreen);
+        g.fillRect((float)area.getX() + barWidth * (float)bin, (float)area.getBottom() - height, juce::jmax(1.0f, barWidth - 1.0f), height);
+    }
+}
@@ -0,0 +1,30 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "CallbackProfiler.h"
+
+// Translucent panel over the decks showing the audio callback profile: xrun counts, a load
+// histogram per deck and for the whole callback, and the worst recent blocks by stage.
+// It drains the profiler even while hidden, so the counts always cover the whole session.
+class ProfilerOverlay : public juce::Component,
+    private juce::Timer
+{
+public:
+    explicit ProfilerOverlay(CallbackProfiler& profilerToShow);
+    ~ProfilerOverlay() override;
+
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+
+private:
+    void timerCallback() override;
+    void drawHistogram(juce::Graphics& g, juce::Rectangle<int> area, const juce::String& title,
+        const std::array<int, CallbackProfiler::numHistogramBins>& histogram) const;
+
+    CallbackProfiler& profiler;
+
+    juce::TextButton saveButton{ "Save Report" };
+    juce::TextButton resetButton{ "Reset" };
+    juce::String status;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProfilerOverlay)
+};
@@ -0,0 +1,248 @@
+﻿#include "ReadAheadAudioSource.h"
+
+ReadAheadAudioSource::ReadAheadAudioSource(juce::PositionableAudioSource* sourceToRead,
+    juce::TimeSliceThread& backgroundThread,
+    double bufferLength,
+    int channels)
+    : source(sourceToRead),
+    thread(backgroundThread),
+    bufferLengthSeconds(bufferLength),
+    numChannels(juce::jmax(1, channels))
+{
+    jassert(source != nullptr);
+}
+
+ReadAheadAudioSource::~ReadAheadAudioSource()
+{
+    releaseResources();
+}
+
+void ReadAheadAudioSource::setBufferLength(double seconds)
+{
+    bufferLengthSeconds = juce::jlimit(0.1, 60.0, seconds);
+}
+
+float ReadAheadAudioSource::getFillLevel() const
+{
+    if (ringSize <= 0)
+        return 0.0f;
+
+    const auto ahead = validEnd.load(std::memory_order_relaxed) - nextPlayPos.load(std::memory_order_relaxed);
+    return juce::jlimit(0.0f, 1.0f, (float)ahead / (float)ringSize);
+}
+
+// ===== PositionableAudioSource =====
+void ReadAheadAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    releaseResources();
+
+    source->prepareToPlay(samplesPerBlockExpected, sampleRate);
+
+    blockSize = juce::jmax(1, samplesPerBlockExpected);
+    ringSize = juce::jmax(blockSize * 4, juce::roundToInt(bufferLengthSeconds * sampleRate));
+    ring.setSize(numChannels, ringSize);
+    ring.clear();
+
+    // Force the background thread to restart filling from the current play position
+    seekGeneration.fetch_add(1, std::memory_order_release);
+    isPrepared.store(true);
+
+    // Decode the first few blocks on the calling thread so playback can start without waiting
+    while (fillPos - nextPlayPos.load() < (juce::int64)blockSize * 4 && useTimeSlice() == 0)
+    {
+    }
+
+    thread.addTimeSliceClient(this);
+}
+
+void ReadAheadAudioSource::releaseResources()
+{
+    if (!isPrepared.exchange(false))
+        return;
+
+    // Blocks until any read in progress on the background thread has finished
+    thread.removeTimeSliceClient(this);
+
+    source->releaseResources();
+    ring.setSize(numChannels, 0);
+    ringSize = 0;
+}
+
+void ReadAheadAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    if (blockingReads.load(std::memory_order_relaxed))
+        waitForData(nextPlayPos.load(std::memory_order_acquire), bufferToFill.numSamples);
+
+    const auto generation = seekGeneration.load(std::memory_order_acquire);
+
+    // A seek is still being serviced: hold position and output silence until data arrives
+    if (!isPrepared.load(std::memory_order_relaxed)
+        || publishedGeneration.load(std::memory_order_acquire) != generation)
+    {
+        bufferToFill.clearActiveBufferRegion();
+        return;
+    }
+
+    auto pos = nextPlayPos.load(std::memory_order_acquire);
+    const auto start = validStart.load(std::memory_order_acquire);
+    const auto end = validEnd.load(std::memory_order_acquire);
+
+    int numReady = 0;
+    if (pos >= start && pos < end)
+        numReady = (int)juce::jmin((juce::int64)bufferToFill.numSamples, end - pos);
+
+    auto& dest = *bufferToFill.buffer;
+    const int destChannels = dest.getNumChannels();
+
+    if (numReady > 0)
+    {
+        const int index = (int)(pos % ringSize);
+        const int first = juce::jmin(numReady, ringSize - index);
+
+        for (int ch = 0; ch < destChannels; ++ch)
+        {
+            const int srcCh = juce::jmin(ch, numChannels - 1);
+            dest.copyFrom(ch, bufferToFill.startSample, ring, srcCh, index, first);
+
+            if (first < numReady)
+                dest.copyFrom(ch, bufferToFill.startSample + first, ring, srcCh, 0, numReady - first);
+        }
+    }
+
+    if (numReady < bufferToFill.numSamples)
+        dest.clear(bufferToFill.startSample + numReady, bufferToFill.numSamples - numReady);
+
+    // The ring may have been refilled for a seek while we were copying
+    if (seekGeneration.load(std::memory_order_acquire) != generation)
+    {
+        bufferToFill.clearActiveBufferRegion();
+        return;
+    }
+
+    if (numReady < bufferToFill.numSamples && (isLooping() || pos + numReady < getTotalLength()))
+        underruns.fetch_add(1, std::memory_order_relaxed);
+
+    // Fails harmlessly if a seek replaced the position in the meantime
+    nextPlayPos.compare_exchange_strong(pos, pos + bufferToFill.numSamples);
+}
+
+void ReadAheadAudioSource::setNextReadPosition(juce::int64 newPosition)
+{
+    nextPlayPos.store(newPosition, std::memory_order_release);
+    seekGeneration.fetch_add(1, std::memory_order_release);
+
+    // Seeks from the UI jump the queue so the refill starts straight away.
+    // (The audio thread must not take the thread's queue lock.)
+    if (isPrepared.load() && juce::MessageManager::existsAndIsCurrentThread())
+        thread.moveToFrontOfQueue(this);
+}
+
+juce::int64 ReadAheadAudioSource::getNextReadPosition() const
+{
+    const auto pos = nextPlayPos.load(std::memory_order_relaxed);
+    const auto length = getTotalLength();
+
+    return (isLooping() && length > 0) ? pos % length : pos;
+}
+
+juce::int64 ReadAheadAudioSource::getTotalLength() const
+{
+    return source->getTotalLength();
+}
+
+bool ReadAheadAudioSource::isLooping() const
+{
+    return source->isLooping();
+}
+
+void ReadAheadAudioSource::setLooping(bool shouldLoop)
+{
+    source->setLooping(shouldLoop);
+}
+
+// Offline rendering only: sleeps until the ring covers the block (or the end of the track).
+// Gives up after a couple of seconds so a stalled disk cannot hang the render.
+bool ReadAheadAudioSource::waitForData(juce::int64 position, int numSamples)
+{
+    const auto wanted = isLooping() ? position + numSamples : juce::jmin(position + numSamples, getTotalLength());
+    const auto deadline = juce::Time::getMillisecondCounter() + 2000;
+
+    for (;;)
+    {
+        const bool ready = publishedGeneration.load(std::memory_order_acquire) == seekGeneration.load(std::memory_order_acquire)
+            && validStart.load(std::memory_order_acquire) <= position
+            && validEnd.load(std::memory_order_acquire) >= wanted;
+
+        if (ready || !isPrepared.load())
+            return ready;
+
+        if (juce::Time::getMillisecondCounter() > deadline)
+            return false;
+
+        // The disk thread may be idling between slices
+        thread.notify();
+        dataReady.wait(5);
+    }
+}
+
+// ===== Background thread =====
+void ReadAheadAudioSource::readIntoRing(juce::int64 position, int numSamples)
+{
+    const int index = (int)(position % ringSize);
+    const int first = juce::jmin(numSamples, ringSize - index);
+
+    source->setNextReadPosition(position);
+    source->getNextAudioBlock(juce::AudioSourceChannelInfo(&ring, index, first));
+
+    if (first < numSamples)
+        source->getNextAudioBlock(juce::AudioSourceChannelInfo(&ring, 0, numSamples - first));
+}
+
+int ReadAheadAudioSource::useTimeSlice()
+{
+    if (!isPrepared.load() || ringSize <= 0)
+        return 100;
+
+    const auto generation = seekGeneration.load(std::memory_order_acquire);
+    auto playPos = nextPlayPos.load(std::memory_order_acquire);
+
+    // After a seek, or if playback has overtaken us, restart the ring at the playhead
+    if (generation != filledGeneration || playPos > fillPos)
+    {
+        fillPos = playPos;
+        validEnd.store(fillPos, std::memory_order_release);
+        validStart.store(fillPos, std::memory_order_release);
+        filledGeneration = generation;
+        publishedGeneration.store(generation, std::memory_order_release);
+    }
+
+    const auto limit = isLooping() ? std::numeric_limits<juce::int64>::max() : getTotalLength();
+    const auto ahead = fillPos - playPos;
+
+    // Small first reads after a seek keep the restart latency low
+    const int chunk = ahead < blockSize * 4 ? blockSize * 2 : blockSize * 16;
+    const auto freeSpace = (juce::int64)ringSize - ahead;
+    const int numToRead = (int)juce::jmin((juce::int64)chunk, freeSpace, limit - fillPos);
+
+    if (numToRead <= 0)
+        return 20;
+
+    // Slots about to be overwritten leave the valid window before the write starts
+    validStart.store(juce::jmax(validStart.load(), fillPos + numToRead - ringSize), std::memory_order_release);
+
+    readIntoRing(fillPos, numToRead);
+
+    fillPos += numToRead;
+
+    // Only publish if no seek arrived while we were reading
+    if (seekGeneration.load(std::memory_order_acquire) == filledGeneration)
+        validEnd.store(fillPos, std::memory_order_release);
+
+    dataReady.signal();
+
+    // A blocked offline render wants the ring topped up as fast as possible
+    if (blockingReads.load(std::memory_order_relaxed))
+        return 0;
+
+    return ahead + numToRead < ringSize / 2 ? 0 : 5;
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "TrackStream.h"
+
+// One background thread shared by every deck for disk reads and decoding
+class DiskStreamThread : public juce::TimeSliceThread
+{
+public:
+    DiskStreamThread() : juce::TimeSliceThread("Disk Stream")
+    {
+        startThread(juce::Thread::Priority::high);
+    }
+
+    ~DiskStreamThread() override
+    {
+        stopThread(2000);
+    }
+};
+
+
+// Keeps a ring of decoded audio ahead of the playhead, filled on a DiskStreamThread,
+// so getNextAudioBlock only ever copies from memory. If the disk falls behind, the
+// missing samples are played as silence and counted as an underrun.
+// prepareToPlay() decodes the first few blocks synchronously, so it should be called
+// off the audio thread (the track loader does this before publishing a track).
+class ReadAheadAudioSource : public TrackStream,
+    private juce::TimeSliceClient
+{
+public:
+    ReadAheadAudioSource(juce::PositionableAudioSource* sourceToRead,
+        juce::TimeSliceThread& backgroundThread,
+        double bufferLengthSeconds,
+        int numChannels = 2);
+    ~ReadAheadAudioSource() override;
+
+    // Takes effect at the next prepareToPlay()
+    void setBufferLength(double seconds);
+    double getBufferLength() const { return bufferLengthSeconds; }
+
+    int getNumUnderruns() const override { return underruns.load(std::memory_order_relaxed); }
+    void resetUnderruns() { underruns.store(0, std::memory_order_relaxed); }
+
+    // Fraction of the ring currently holding audio ahead of the playhead
+    float getFillLevel() const override;
+
+    // ===== PositionableAudioSource =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    void setNextReadPosition(juce::int64 newPosition) override;
+    juce::int64 getNextReadPosition() const override;
+    juce::int64 getTotalLength() const override;
+    bool isLooping() const override;
+    void setLooping(bool shouldLoop) override;
+
+private:
+    int useTimeSlice() override;
+    bool waitForData(juce::int64 position, int numSamples);
+    void readIntoRing(juce::int64 position, int numSamples);
+
+    juce::PositionableAudioSource* source;
+    juce::TimeSliceThread& thread;
+
+    double bufferLengthSeconds;
+    const int numChannels;
+
+    juce::AudioBuffer<float> ring;
+    int ringSize = 0;
+    int blockSize = 512;
+    std::atomic<bool> isPrepared{ false };
+
+    // Written by the audio thread (playback) and by seeks
+    std::atomic<juce::int64> nextPlayPos{ 0 };
+    std::atomic<juce::uint32> seekGeneration{ 0 };
+
+    // Written by the background thread only
+    std::atomic<juce::int64> validStart{ 0 };
+    std::atomic<juce::int64> validEnd{ 0 };
+    std::atomic<juce::uint32> publishedGeneration{ 0 };
+    juce::uint32 filledGeneration = 0;
+    juce::int64 fillPos = 0;
+
+    std::atomic<int> underruns{ 0 };
+
+    // Signalled by the background thread whenever it publishes new audio
+    juce::WaitableEvent dataReady;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReadAheadAudioSource)
+};
@@ -0,0 +1,106 @@
+﻿#include "RealFft.h"
+
+RealFft::RealFft(int order)
+    : size(1 << juce::jmax(2, order)),
+    half(size / 2),
+    bitReversed((size_t)half),
+    twiddleRe((size_t)half), twiddleIm((size_t)half),
+    unpackRe((size_t)half), unpackIm((size_t)half),
+    workRe((size_t)half), workIm((size_t)half)
+{
+    int bits = 0;
+    while ((1 << bits) < half)
+        ++bits;
+
+    for (int i = 0; i < half; ++i)
+    {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b)
+            if ((i >> b) & 1)
+                reversed |= 1 << (bits - 1 - b);
+
+        bitReversed[(size_t)i] = reversed;
+    }
+
+    for (int span = 1; span < half; span <<= 1)
+    {
+        for (int j = 0; j < span; ++j)
+        {
+            const double angle = -juce::MathConstants<double>::pi * j / span;
+            twiddleRe[(size_t)(span - 1 + j)] = (float)std::cos(angle);
+            twiddleIm[(size_t)(span - 1 + j)] = (float)std::sin(angle);
+        }
+    }
+
+    for (int k = 0; k < half; ++k)
+    {
+        const double angle = -juce::MathConstants<double>::twoPi * k / size;
+        unpackRe[(size_t)k] = (float)std::cos(angle);
+        unpackIm[(size_t)k] = (float)std::sin(angle);
+    }
+}
+
+// In-place radix-2 decimation in time over the work arrays
+void RealFft::transformPacked() noexcept
+{
+    float* const re = workRe.data();
+    float* const im = workIm.data();
+
+    for (int span = 1; span < half; span <<= 1)
+    {
+        const float* const wRe = twiddleRe.data() + span - 1;
+        const float* const wIm = twiddleIm.data() + span - 1;
+
+        for (int start = 0; start < half; start += 2 * span)
+        {
+            float* const aRe = re + start;
+            float* const aIm = im + start;
+            float* const bRe = aRe + span;
+            float* const bIm = aIm + span;
+
+            for (int j = 0; j < span; ++j)
+            {
+                const float tRe = wRe[j] * bRe[j] - wIm[j] * bIm[j];
+                const float tIm = wRe[j] * bIm[j] + wIm[j] * bRe[j];
+
+                bRe[j] = aRe[j] - tRe;
+                bIm[j] = aIm[j] - tIm;
+                aRe[j] += tRe;
+                aIm[j] += tIm;
+            }
+        }
+    }
+}
+
+void RealFft::performMagnitudes(const float* input, float* magnitudes) noexcept
+{
+    // Even samples in the real part, odd ones in the imaginary part
+    for (int i = 0; i < half; ++i)
+    {
+        const auto target = (size_t)bitReversed[(size_t)i];
+        workRe[target] = input[2 * i];
+        workIm[target] = input[2 * i + 1];
+    }
+
+    transformPacked();
+
+    // Split the packed spectrum into the even and odd samples' spectra and recombine them:
+    // X[k] = E[k] + exp(-2 pi i k / size) O[k]
+    magnitudes[0] = std::abs(workRe[0] + workIm[0]);
+    magnitudes[half] = std::abs(workRe[0] - workIm[0]);
+
+    for (int k = 1; k < half; ++k)
+    {
+        const auto a = (size_t)k, b = (size_t)(half - k);
+
+        const float evenRe = 0.5f * (workRe[a] + workRe[b]);
+        const float evenIm = 0.5f * (workIm[a] - workIm[b]);
+        const float oddRe = 0.5f * (workIm[a] + workIm[b]);
+        const float oddIm = -0.5f * (workRe[a] - workRe[b]);
+
+        const float re = evenRe + unpackRe[a] * oddRe - unpackIm[a] * oddIm;
+        const float im = evenIm + unpackRe[a] * oddIm + unpackIm[a] * oddRe;
+
+        magnitudes[k] = std::sqrt(re * re + im * im);
+    }
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Forward FFT of real input, for the analysis code (the project does not use juce_dsp).
+// The input is packed into a complex FFT of half the size and unpacked with one extra pass,
+// so a transform costs about half a complex one. Real and imaginary parts are kept in separate
+// arrays and every stage reads its twiddles contiguously, so the butterfly loops vectorise
+// (SSE/NEON) in optimised builds. Construction allocates; perform does not.
+class RealFft
+{
+public:
+    // size = 2^order, at least 4
+    explicit RealFft(int order);
+
+    int getSize() const noexcept { return size; }
+    int getNumBins() const noexcept { return size / 2 + 1; }
+
+    // Magnitudes of bins 0 (DC) to size / 2 (Nyquist) of size real samples
+    void performMagnitudes(const float* input, float* magnitudes) noexcept;
+
+private:
+    void transformPacked() noexcept;
+
+    const int size;
+    const int half;
+    std::vector<int> bitReversed;               // half entries
+
+    // exp(-2 pi i j / length) for j < length / 2, one run per stage starting at length / 2 - 1
+    std::vector<float> twiddleRe, twiddleIm;
+
+    // exp(-2 pi i k / size), half entries
+    std::vector<float> unpackRe, unpackIm;
+
+    std::vector<float> workRe, workIm;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RealFft)
+};
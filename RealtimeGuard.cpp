@@ -0,0 +1,133 @@
+﻿#include "RealtimeGuard.h"
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local int realtimeDepth = 0;
+    thread_local bool isReporting = false;
+    thread_local juce::int64 threadAllocations = 0;
+    std::atomic<juce::int64> violationCount{ 0 };
+}
+
+void RealtimeGuard::enterRealtimeSection() noexcept
+{
+   #if AUDIOPLAYER_REALTIME_CHECKS
+    ++realtimeDepth;
+   #endif
+}
+
+void RealtimeGuard::exitRealtimeSection() noexcept
+{
+   #if AUDIOPLAYER_REALTIME_CHECKS
+    --realtimeDepth;
+   #endif
+}
+
+RealtimeGuard::ScopedSuspend::ScopedSuspend() noexcept
+    : savedDepth(realtimeDepth)
+{
+    realtimeDepth = 0;
+}
+
+RealtimeGuard::ScopedSuspend::~ScopedSuspend() noexcept
+{
+    realtimeDepth = savedDepth;
+}
+
+bool RealtimeGuard::isInRealtimeSection() noexcept
+{
+    return realtimeDepth > 0;
+}
+
+void RealtimeGuard::assertNotRealtime(const char* operation) noexcept
+{
+    if (isInRealtimeSection())
+        reportViolation(operation);
+}
+
+juce::int64 RealtimeGuard::getViolationCount() noexcept
+{
+    return violationCount.load(std::memory_order_relaxed);
+}
+
+juce::int64 RealtimeGuard::getAllocationCountForThisThread() noexcept
+{
+    return threadAllocations;
+}
+
+void RealtimeGuard::noteAllocation() noexcept
+{
+    ++threadAllocations;
+
+    if (isInRealtimeSection())
+        reportViolation("heap allocation");
+}
+
+void RealtimeGuard::noteDeallocation() noexcept
+{
+    if (isInRealtimeSection())
+        reportViolation("heap deallocation");
+}
+
+void RealtimeGuard::reportViolation(const char* what) noexcept
+{
+    // Reporting itself allocates (DBG builds a String), so guard against re-entry
+    if (isReporting)
+        return;
+
+    isReporting = true;
+    violationCount.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        ScopedSuspend suspend;
+        DBG("RealtimeGuard: " << what << " on the audio thread");
+        jassertfalse;
+    }
+
+    isReporting = false;
+}
+
+// ===== Global allocation hooks =====
+#if AUDIOPLAYER_ALLOCATION_HOOKS
+void* operator new(std::size_t size)
+{
+    RealtimeGuard::noteAllocation();
+
+    if (auto* p = std::malloc(size > 0 ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    RealtimeGuard::noteAllocation();
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+static void releaseAllocation(void* p) noexcept
+{
+    if (p != nullptr)
+        RealtimeGuard::noteDeallocation();
+
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept                          { releaseAllocation(p); }
+void operator delete[](void* p) noexcept                        { releaseAllocation(p); }
+void operator delete(void* p, std::size_t) noexcept             { releaseAllocation(p); }
+void operator delete[](void* p, std::size_t) noexcept           { releaseAllocation(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept   { releaseAllocation(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { releaseAllocation(p); }
+#endif
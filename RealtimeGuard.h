@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Debug-only detector for real-time violations on the audio thread.
+// Wrap the body of an audio callback in a ScopedRealtimeSection: any heap
+// allocation or free (or a call to assertNotRealtime() from a locking code path)
+// made on that thread while the section is active triggers an assertion.
+#ifndef AUDIOPLAYER_REALTIME_CHECKS
+ #define AUDIOPLAYER_REALTIME_CHECKS JUCE_DEBUG
+#endif
+
+// The global new/delete hooks; also wanted in release builds that count allocations (benchmarks)
+#ifndef AUDIOPLAYER_ALLOCATION_HOOKS
+ #define AUDIOPLAYER_ALLOCATION_HOOKS AUDIOPLAYER_REALTIME_CHECKS
+#endif
+
+class RealtimeGuard
+{
+public:
+    class ScopedRealtimeSection
+    {
+    public:
+        ScopedRealtimeSection() noexcept { RealtimeGuard::enterRealtimeSection(); }
+        ~ScopedRealtimeSection() noexcept { RealtimeGuard::exitRealtimeSection(); }
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+    };
+
+    // Lets a known non-real-time operation (e.g. a debug dump) run inside a section
+    class ScopedSuspend
+    {
+    public:
+        ScopedSuspend() noexcept;
+        ~ScopedSuspend() noexcept;
+
+    private:
+        int savedDepth = 0;
+        JUCE_DECLARE_NON_COPYABLE(ScopedSuspend)
+    };
+
+    static bool isInRealtimeSection() noexcept;
+
+    // Call from any code path that locks or blocks, so it fails loudly when reached from the audio thread
+    static void assertNotRealtime(const char* operation) noexcept;
+
+    // Number of violations seen inside real-time sections since start-up
+    static juce::int64 getViolationCount() noexcept;
+
+    // Heap allocations made by the calling thread since it started (always 0 without the hooks)
+    static juce::int64 getAllocationCountForThisThread() noexcept;
+    static constexpr bool canCountAllocations() noexcept
+    {
+       #if AUDIOPLAYER_ALLOCATION_HOOKS
+        return true;
+       #else
+        return false;
+       #endif
+    }
+
+    // Called by the global allocation hooks in RealtimeGuard.cpp
+    static void noteAllocation() noexcept;
+    static void noteDeallocation() noexcept;
+
+private:
+    static void enterRealtimeSection() noexcept;
+    static void exitRealtimeSection() noexcept;
+    static void reportViolation(const char* what) noexcept;
+
+    RealtimeGuard() = delete;
+};
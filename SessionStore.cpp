@@ -0,0 +1,221 @@
+﻿#include "SessionStore.h"
+#include "IndexFile.h"
+
+namespace
+{
+    // FNV-1a: enough to tell an unchanged session from a changed one
+    juce::uint64 hashBytes(const void* data, size_t numBytes)
+    {
+        auto* bytes = static_cast<const juce::uint8*>(data);
+        juce::uint64 hash = 14695981039346656037ull;
+
+        for (size_t i = 0; i < numBytes; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+        return hash;
+    }
+}
+
+SessionStore::SessionStore()
+    : SessionStore(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("MyAudioPlayer").getChildFile("Session.state"))
+{
+}
+
+SessionStore::SessionStore(const juce::File& file)
+    : juce::Thread("Session Writer"),
+    sessionFile(file)
+{
+    startThread(juce::Thread::Priority::low);
+}
+
+SessionStore::~SessionStore()
+{
+    stopThread(4000);
+}
+
+// ===== Saving =====
+void SessionStore::saveInBackground(Session session)
+{
+    {
+        const juce::ScopedLock sl(pendingLock);
+        pending = std::make_unique<Session>(std::move(session));
+    }
+
+    notify();
+}
+
+bool SessionStore::save(const Session& session)
+{
+    {
+        // Older than this one, so never worth writing
+        const juce::ScopedLock sl(pendingLock);
+        pending.reset();
+    }
+
+    return write(session);
+}
+
+void SessionStore::run()
+{
+    while (!threadShouldExit())
+    {
+        std::unique_ptr<Session> session;
+
+        {
+            const juce::ScopedLock sl(pendingLock);
+            session = std::move(pending);
+        }
+
+        if (session == nullptr)
+            wait(-1);
+        else if (!write(*session))
+            DBG("SessionStore: could not save " << sessionFile.getFullPathName());
+    }
+}
+
+// IndexFile header, deck count, then each deck (see writeDeck)
+bool SessionStore::write(const Session& session)
+{
+    const juce::ScopedLock sl(writeLock);
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+    juce::MemoryOutputStream data;
+    data.writeCompressedInt((int)session.decks.size());
+
+    for (const auto& deck : session.decks)
+        writeDeck(data, deck);
+
+    const auto hash = hashBytes(data.getData(), data.getDataSize());
+
+    if (hash == lastWrittenHash && sessionFile.existsAsFile())
+    {
+        unchangedSaves.fetch_add(1);
+        return true;
+    }
+
+    if (!IndexFile::write(sessionFile, sessionMagic, sessionVersion,
+            [&data](juce::OutputStream& out) { out.write(data.getData(), data.getDataSize()); }))
+        return false;
+
+    lastWrittenHash = hash;
+    lastSaveMs.store(juce::Time::getMillisecondCounterHiRes() - startMs);
+    return true;
+}
+
+// Playlist (byte count, then PlaylistStore::Snapshot::writeTo), current row, file, position,
+// loop, A-B points, segment loop, gain, mute, speed, keep pitch, auto gain (integers
+// compressed, strings UTF-8)
+void SessionStore::writeDeck(juce::MemoryOutputStream& out, const DeckSession& deck)
+{
+    if (deck.playlist.isEmpty())
+    {
+        out.writeInt64(0);
+    }
+    else
+    {
+        // The byte count goes in once the playlist is written
+        const auto sizePosition = out.getPosition();
+        out.writeInt64(0);
+        deck.playlist.writeTo(out);
+
+        const auto end = out.getPosition();
+        out.setPosition(sizePosition);
+        out.writeInt64(end - sizePosition - (juce::int64)sizeof(juce::int64));
+        out.setPosition(end);
+    }
+
+    out.writeCompressedInt(deck.currentTrackIndex);
+    out.writeString(deck.filePath);
+    out.writeDouble(deck.position);
+    out.writeBool(deck.looping);
+    out.writeDouble(deck.loopStart);
+    out.writeDouble(deck.loopEnd);
+    out.writeBool(deck.segmentLoop);
+    out.writeFloat(deck.gain);
+    out.writeBool(deck.muted);
+    out.writeFloat(deck.speed);
+    out.writeBool(deck.keepPitch);
+    out.writeBool(deck.autoGain);
+}
+
+// ===== Loading =====
+bool SessionStore::load(Session& result) const
+{
+    Session loaded;
+
+    const bool read = IndexFile::read(sessionFile, sessionMagic, 1, sessionVersion, [&loaded](juce::InputStream& in, int version)
+        {
+            const int numDecks = in.readCompressedInt();
+            if (numDecks < 0)
+                return false;
+
+            for (int i = 0; i < numDecks; ++i)
+            {
+                DeckSession deck;
+                if (!readDeck(in, deck, version))
+                    return false;
+
+                loaded.decks.push_back(std::move(deck));
+            }
+
+            return true;
+        });
+
+    if (!read)
+        return false;
+
+    result = std::move(loaded);
+    return true;
+}
+
+bool SessionStore::readDeck(juce::InputStream& in, DeckSession& deck, int version)
+{
+    const auto playlistBytes = in.readInt64();
+    if (playlistBytes < 0 || playlistBytes > in.getNumBytesRemaining())
+        return false;
+
+    if (playlistBytes > 0)
+    {
+        juce::MemoryBlock playlist((size_t)playlistBytes);
+        if ((juce::int64)in.read(playlist.getData(), playlist.getSize()) != playlistBytes)
+            return false;
+
+        // A damaged playlist costs the deck its list, not the rest of the session
+        juce::MemoryInputStream playlistIn(playlist, false);
+        if (!deck.playlist.readFrom(playlistIn))
+            DBG("SessionStore: could not read a deck's playlist");
+    }
+
+    deck.currentTrackIndex = in.readCompressedInt();
+    deck.filePath = in.readString();
+    deck.position = in.readDouble();
+    deck.looping = in.readBool();
+    deck.loopStart = in.readDouble();
+    deck.loopEnd = in.readDouble();
+    deck.segmentLoop = in.readBool();
+
+    // Version 1 kept the loaded track's markers with the deck, in seconds
+    if (version == 1)
+    {
+        const int numMarkers = in.readCompressedInt();
+        if (numMarkers < 0)
+            return false;
+
+        for (int i = 0; i < numMarkers && !in.isExhausted(); ++i)
+        {
+            DeckSession::LegacyMarker marker;
+            marker.seconds = in.readDouble();
+            marker.name = in.readString();
+            deck.legacyMarkers.push_back(std::move(marker));
+        }
+    }
+
+    deck.gain = in.readFloat();
+    deck.muted = in.readBool();
+    deck.speed = in.readFloat();
+    deck.keepPitch = in.readBool();
+    deck.autoGain = in.readBool();
+
+    return true;
+}
@@ -0,0 +1,98 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "PlaylistStore.h"
+
+// One deck as it was left, enough to put it back the way it was
+struct DeckSession
+{
+    // Shares the playlist's tables, so a long playlist costs nothing to save until it is written
+    PlaylistStore::Snapshot playlist;
+    int currentTrackIndex = 0;
+
+    // The loaded track (empty if none) and where it was
+    juce::String filePath;
+    double position = 0.0;
+
+    bool looping = false;
+    double loopStart = 0.0;
+    double loopEnd = 0.0;
+    bool segmentLoop = false;
+
+    // The volume slider's value, kept while muted
+    float gain = 0.5f;
+    bool muted = false;
+    float speed = 1.0f;
+    bool keepPitch = false;
+    bool autoGain = true;
+
+    // Markers from a version 1 session, in seconds: moved to the HotCueStore when restored
+    struct LegacyMarker
+    {
+        double seconds = 0.0;
+        juce::String name;
+    };
+
+    std::vector<LegacyMarker> legacyMarkers;
+};
+
+struct Session
+{
+    std::vector<DeckSession> decks;
+};
+
+
+// Keeps the session in Session.state next to the library index: a versioned binary file
+// holding every deck's playlist, track, position, loops and controls. Hot cues belong to the
+// file rather than the deck, so they live in the HotCueStore.
+//
+// Autosaves take a snapshot on the message thread (playlists included, which costs no copy)
+// and hand it to a background writer, which serialises it and writes it only if it differs
+// from the last one written. A newer snapshot replaces one the writer has not got to yet.
+class SessionStore : private juce::Thread
+{
+public:
+    // Session.state in the app's data folder, or another file (e.g. for the benchmarks)
+    SessionStore();
+    explicit SessionStore(const juce::File& file);
+    ~SessionStore() override;
+
+    // False if there is no session file or it can't be read
+    bool load(Session& result) const;
+
+    // Writes on the calling thread, after any background write in progress (for shutdown)
+    bool save(const Session& session);
+
+    // Returns at once; the background writer saves the snapshot
+    void saveInBackground(Session session);
+
+    // Time the last write took, serialising included, and how many autosaves were skipped
+    // because nothing had changed
+    double getLastSaveMs() const { return lastSaveMs.load(); }
+    int getNumUnchangedSaves() const { return unchangedSaves.load(); }
+
+    juce::File getSessionFile() const { return sessionFile; }
+
+private:
+    void run() override;
+    bool write(const Session& session);
+
+    static void writeDeck(juce::MemoryOutputStream& out, const DeckSession& deck);
+    static bool readDeck(juce::InputStream& in, DeckSession& deck, int version);
+
+    static constexpr int sessionMagic = 0x5345534e;   // "SESN"
+    static constexpr int sessionVersion = 2;     // 1 also stored each deck's markers
+
+    juce::File sessionFile;
+
+    juce::CriticalSection pendingLock;
+    std::unique_ptr<Session> pending;
+
+    // Held for a whole write, so a shutdown save never races an autosave
+    juce::CriticalSection writeLock;
+    juce::uint64 lastWrittenHash = 0;
+
+    std::atomic<double> lastSaveMs{ 0.0 };
+    std::atomic<int> unchangedSaves{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionStore)
+};
@@ -0,0 +1,178 @@
+﻿#include "SimdKernels.h"
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+namespace SimdKernels
+{
+    float dotProduct(const float* a, const float* b, int numSamples) noexcept
+    {
+        int i = 0;
+        float sum = 0.0f;
+
+       #if JUCE_USE_SSE_INTRINSICS && defined(__AVX__)
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+
+        for (; i + 16 <= numSamples; i += 16)
+        {
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+        }
+
+        const __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+        for (; i + 4 <= numSamples; i += 4)
+            acc4 = _mm_add_ps(acc4, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, acc4);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+       #elif JUCE_USE_SSE_INTRINSICS
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, _mm_add_ps(acc0, acc1));
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+       #elif JUCE_USE_ARM_NEON
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+            acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+
+        const float32x4_t acc = vaddq_f32(acc0, acc1);
+        sum = (vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)) + (vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3));
+       #endif
+
+        for (; i < numSamples; ++i)
+            sum += a[i] * b[i];
+
+        return sum;
+    }
+
+    void biquadPairEnergy(const float* const* channels, int numChannels, int startSample, int numSamples,
+        const Biquad& first, const Biquad& second, float* state, float* sumsOfSquares) noexcept
+    {
+        jassert(numChannels > 0 && numChannels <= 4);
+
+        // Missing lanes read a silent channel, so every lane can be loaded the same way
+        static const float silence[1] = { 0.0f };
+        const float* in[4];
+        int stride[4];
+
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            in[ch] = ch < numChannels ? channels[ch] + startSample : silence;
+            stride[ch] = ch < numChannels ? 1 : 0;
+        }
+
+       #if JUCE_USE_SSE_INTRINSICS
+        const __m128 b0a = _mm_set1_ps(first.b0), b1a = _mm_set1_ps(first.b1), b2a = _mm_set1_ps(first.b2);
+        const __m128 a1a = _mm_set1_ps(first.a1), a2a = _mm_set1_ps(first.a2);
+        const __m128 b0b = _mm_set1_ps(second.b0), b1b = _mm_set1_ps(second.b1), b2b = _mm_set1_ps(second.b2);
+        const __m128 a1b = _mm_set1_ps(second.a1), a2b = _mm_set1_ps(second.a2);
+
+        __m128 s1a = _mm_loadu_ps(state), s2a = _mm_loadu_ps(state + 4);
+        __m128 s1b = _mm_loadu_ps(state + 8), s2b = _mm_loadu_ps(state + 12);
+        __m128 energy = _mm_setzero_ps();
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const __m128 x = _mm_set_ps(in[3][i * stride[3]], in[2][i * stride[2]], in[1][i * stride[1]], in[0][i * stride[0]]);
+
+            const __m128 y = _mm_add_ps(_mm_mul_ps(b0a, x), s1a);
+            s1a = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1a, x), _mm_mul_ps(a1a, y)), s2a);
+            s2a = _mm_sub_ps(_mm_mul_ps(b2a, x), _mm_mul_ps(a2a, y));
+
+            const __m128 z = _mm_add_ps(_mm_mul_ps(b0b, y), s1b);
+            s1b = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1b, y), _mm_mul_ps(a1b, z)), s2b);
+            s2b = _mm_sub_ps(_mm_mul_ps(b2b, y), _mm_mul_ps(a2b, z));
+
+            energy = _mm_add_ps(energy, _mm_mul_ps(z, z));
+        }
+
+        _mm_storeu_ps(state, s1a);
+        _mm_storeu_ps(state + 4, s2a);
+        _mm_storeu_ps(state + 8, s1b);
+        _mm_storeu_ps(state + 12, s2b);
+
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, energy);
+       #elif JUCE_USE_ARM_NEON
+        const float32x4_t b0a = vdupq_n_f32(first.b0), b1a = vdupq_n_f32(first.b1), b2a = vdupq_n_f32(first.b2);
+        const float32x4_t a1a = vdupq_n_f32(first.a1), a2a = vdupq_n_f32(first.a2);
+        const float32x4_t b0b = vdupq_n_f32(second.b0), b1b = vdupq_n_f32(second.b1), b2b = vdupq_n_f32(second.b2);
+        const float32x4_t a1b = vdupq_n_f32(second.a1), a2b = vdupq_n_f32(second.a2);
+
+        float32x4_t s1a = vld1q_f32(state), s2a = vld1q_f32(state + 4);
+        float32x4_t s1b = vld1q_f32(state + 8), s2b = vld1q_f32(state + 12);
+        float32x4_t energy = vdupq_n_f32(0.0f);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float gathered[4] = { in[0][i * stride[0]], in[1][i * stride[1]], in[2][i * stride[2]], in[3][i * stride[3]] };
+            const float32x4_t x = vld1q_f32(gathered);
+
+            const float32x4_t y = vmlaq_f32(s1a, b0a, x);
+            s1a = vaddq_f32(vmlsq_f32(vmulq_f32(b1a, x), a1a, y), s2a);
+            s2a = vmlsq_f32(vmulq_f32(b2a, x), a2a, y);
+
+            const float32x4_t z = vmlaq_f32(s1b, b0b, y);
+            s1b = vaddq_f32(vmlsq_f32(vmulq_f32(b1b, y), a1b, z), s2b);
+            s2b = vmlsq_f32(vmulq_f32(b2b, y), a2b, z);
+
+            energy = vmlaq_f32(energy, z, z);
+        }
+
+        vst1q_f32(state, s1a);
+        vst1q_f32(state + 4, s2a);
+        vst1q_f32(state + 8, s1b);
+        vst1q_f32(state + 12, s2b);
+
+        float lanes[4];
+        vst1q_f32(lanes, energy);
+       #else
+        float lanes[4] = {};
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            float s1a = state[ch], s2a = state[4 + ch], s1b = state[8 + ch], s2b = state[12 + ch];
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float x = in[ch][i];
+
+                const float y = first.b0 * x + s1a;
+                s1a = first.b1 * x - first.a1 * y + s2a;
+                s2a = first.b2 * x - first.a2 * y;
+
+                const float z = second.b0 * y + s1b;
+                s1b = second.b1 * y - second.a1 * z + s2b;
+                s2b = second.b2 * y - second.a2 * z;
+
+                lanes[ch] += z * z;
+            }
+
+            state[ch] = s1a; state[4 + ch] = s2a; state[8 + ch] = s1b; state[12 + ch] = s2b;
+        }
+       #endif
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            sumsOfSquares[ch] += lanes[ch];
+    }
+}
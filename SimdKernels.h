@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Hand-vectorised inner loops that juce::FloatVectorOperations does not provide.
+// Each kernel has SSE (AVX when the compiler targets it) and NEON paths with a scalar fallback.
+namespace SimdKernels
+{
+    // Sum of a[i] * b[i] for i in [0, numSamples)
+    float dotProduct(const float* a, const float* b, int numSamples) noexcept;
+
+    // Coefficients of one biquad section, normalised so a0 == 1
+    struct Biquad
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+    };
+
+    // Runs two biquads in series (transposed direct form II) over up to four channels at once,
+    // one channel per SIMD lane, and adds the sum of each channel's squared output to
+    // sumsOfSquares. state holds 16 floats: first s1, first s2, second s1, second s2, four
+    // lanes each; zero it to start from silence.
+    void biquadPairEnergy(const float* const* channels, int numChannels, int startSample, int numSamples,
+        const Biquad& first, const Biquad& second, float* state, float* sumsOfSquares) noexcept;
+}
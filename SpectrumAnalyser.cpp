@@ -0,0 +1,130 @@
+﻿#include "SpectrumAnalyser.h"
+
+SpectrumAnalyser::SpectrumAnalyser(SpectrumTap& tapToRead)
+    : tap(tapToRead),
+    fft(fftOrder),
+    hopSize(fft.getSize() / 4)
+{
+    const int n = fft.getSize();
+
+    for (int i = 0; i < n; ++i)
+        window.push_back((float)(0.5 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * i / n)));
+
+    history.assign((size_t)n, 0.0f);
+    frame.resize((size_t)n);
+    magnitudes.resize((size_t)fft.getNumBins());
+
+    setNumBands(64);
+}
+
+void SpectrumAnalyser::setNumBands(int numBands)
+{
+    numBands = juce::jmax(1, numBands);
+
+    if (numBands == getNumBands())
+        return;
+
+    bandFirstBin.assign((size_t)numBands, 0);
+    bandLastBin.assign((size_t)numBands, 0);
+    frameLevels.assign((size_t)numBands, minDb);
+    levels.assign((size_t)numBands, minDb);
+    bandsSampleRate = 0.0;
+
+    updateBands();
+}
+
+// Bands narrower than a bin (at the bottom end) take the bin nearest their centre
+void SpectrumAnalyser::updateBands()
+{
+    const double sampleRate = tap.getSampleRate();
+    const int numBands = getNumBands();
+    const int lastBin = fft.getNumBins() - 1;
+    const double binHz = sampleRate / fft.getSize();
+    const double nyquist = sampleRate * 0.5;
+
+    auto edge = [numBands, nyquist](int band) { return minFrequency * std::pow(nyquist / minFrequency, (double)band / numBands); };
+
+    for (int band = 0; band < numBands; ++band)
+    {
+        const double low = edge(band), high = edge(band + 1);
+        int first = (int)std::ceil(low / binHz);
+        int last = (int)std::ceil(high / binHz) - 1;
+
+        if (last < first)
+            first = last = juce::roundToInt(std::sqrt(low * high) / binHz);
+
+        bandFirstBin[(size_t)band] = juce::jlimit(1, lastBin, first);
+        bandLastBin[(size_t)band] = juce::jlimit(1, lastBin, last);
+    }
+
+    bandsSampleRate = sampleRate;
+}
+
+int SpectrumAnalyser::update(int maxFrames)
+{
+    if (tap.getSampleRate() != bandsSampleRate)
+        updateBands();
+
+    // Far behind (the display was hidden or stalled): only the newest audio is worth showing
+    const int backlog = tap.getNumReady() + filled;
+    const int wanted = maxFrames * hopSize;
+
+    if (backlog > wanted)
+    {
+        tap.discard(backlog - wanted);
+        filled = 0;
+    }
+
+    const int n = fft.getSize();
+    int frames = 0;
+
+    while (frames < maxFrames)
+    {
+        filled += tap.pull(history.data() + n - hopSize + filled, hopSize - filled);
+
+        if (filled < hopSize)
+            break;
+
+        analyseFrame();
+        ++frames;
+
+        std::memmove(history.data(), history.data() + hopSize, (size_t)(n - hopSize) * sizeof(float));
+        filled = 0;
+    }
+
+    return frames;
+}
+
+void SpectrumAnalyser::analyseFrame()
+{
+    const int n = fft.getSize();
+
+    juce::FloatVectorOperations::multiply(frame.data(), history.data(), window.data(), n);
+    fft.performMagnitudes(frame.data(), magnitudes.data());
+
+    // A full-scale sine peaks at n / 4 through the Hann window
+    const float toFullScale = 4.0f / (float)n;
+    const float fall = decayDbPerSecond * (float)(hopSize / juce::jmax(1.0, bandsSampleRate));
+
+    for (size_t band = 0; band < levels.size(); ++band)
+    {
+        float peak = 0.0f;
+
+        for (int bin = bandFirstBin[band]; bin <= bandLastBin[band]; ++bin)
+            peak = juce::jmax(peak, magnitudes[(size_t)bin]);
+
+        frameLevels[band] = juce::jmax(minDb, juce::Decibels::gainToDecibels(peak * toFullScale, minDb));
+        levels[band] = juce::jmax(frameLevels[band], levels[band] - fall);
+    }
+
+    if (onFrame)
+        onFrame(frameLevels);
+}
+
+void SpectrumAnalyser::decay(double seconds)
+{
+    const float fall = decayDbPerSecond * (float)seconds;
+
+    for (auto& level : levels)
+        level = juce::jmax(minDb, level - fall);
+}
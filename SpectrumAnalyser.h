@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "SpectrumTap.h"
+#include "RealFft.h"
+
+// Turns what a SpectrumTap has collected into levels for a display, on the reading thread.
+//
+// Hann-windowed 2048-point frames overlap by three quarters (about 86 frames a second at
+// 44.1 kHz). Each frame is reduced to a fixed number of log-spaced bands, the loudest bin in
+// each, in dB relative to a full-scale sine. The levels fall back slowly from their peaks so
+// the display does not flicker. Each update analyses a bounded number of frames and skips
+// older audio beyond that, so a stalled display catches up instead of falling further behind.
+class SpectrumAnalyser
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr float minDb = -90.0f;
+    static constexpr double minFrequency = 20.0;
+
+    explicit SpectrumAnalyser(SpectrumTap& tapToRead);
+
+    // Log-spaced from minFrequency to Nyquist
+    void setNumBands(int numBands);
+    int getNumBands() const { return (int)levels.size(); }
+
+    // Analyses the audio collected since the last call, at most maxFrames frames of it.
+    // onFrame, if set, gets each frame's band levels. Returns the number of frames analysed.
+    int update(int maxFrames);
+
+    // Band levels in dB, held at their peaks and falling back at decayDbPerSecond
+    const std::vector<float>& getLevels() const { return levels; }
+
+    // Lets the levels fall while no audio arrives (e.g. the deck is stopped)
+    void decay(double seconds);
+
+    std::function<void(const std::vector<float>& frameLevels)> onFrame;
+
+    static constexpr float decayDbPerSecond = 40.0f;
+
+private:
+    void analyseFrame();
+    void updateBands();
+
+    SpectrumTap& tap;
+    RealFft fft;
+    const int hopSize;
+
+    std::vector<float> window;
+    std::vector<float> history;         // the last fft-size samples, oldest first
+    std::vector<float> frame, magnitudes;
+    int filled = 0;                     // new samples at the end of history since the last frame
+
+    // Bins [bandFirstBin, bandLastBin] make up each band
+    std::vector<int> bandFirstBin, bandLastBin;
+    std::vector<float> frameLevels, levels;
+    double bandsSampleRate = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumAnalyser)
+};
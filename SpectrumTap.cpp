@@ -0,0 +1,57 @@
+﻿#include "SpectrumTap.h"
+
+SpectrumTap::SpectrumTap(int capacity)
+    : fifo(capacity), samples((size_t)capacity, 0.0f)
+{
+}
+
+void SpectrumTap::push(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept
+{
+    if (!enabled.load(std::memory_order_relaxed) || buffer.getNumChannels() == 0)
+        return;
+
+    // Never waits: a display that has fallen behind simply misses this block
+    if (fifo.getFreeSpace() < numSamples)
+    {
+        dropped.fetch_add(numSamples, std::memory_order_relaxed);
+        return;
+    }
+
+    const auto scope = fifo.write(numSamples);
+
+    if (scope.blockSize1 > 0)
+        mixInto(samples.data() + scope.startIndex1, buffer, startSample, scope.blockSize1);
+
+    if (scope.blockSize2 > 0)
+        mixInto(samples.data() + scope.startIndex2, buffer, startSample + scope.blockSize1, scope.blockSize2);
+}
+
+// Average of the channels, so a mono signal shows at the same level as on one channel
+void SpectrumTap::mixInto(float* dest, const juce::AudioBuffer<float>& buffer, int startSample, int numSamples) const noexcept
+{
+    const int numChannels = buffer.getNumChannels();
+    const float scale = 1.0f / (float)numChannels;
+
+    juce::FloatVectorOperations::copyWithMultiply(dest, buffer.getReadPointer(0, startSample), scale, numSamples);
+
+    for (int ch = 1; ch < numChannels; ++ch)
+        juce::FloatVectorOperations::addWithMultiply(dest, buffer.getReadPointer(ch, startSample), scale, numSamples);
+}
+
+int SpectrumTap::pull(float* dest, int maxSamples) noexcept
+{
+    const auto scope = fifo.read(juce::jmin(maxSamples, fifo.getNumReady()));
+
+    if (scope.blockSize1 > 0)
+        juce::FloatVectorOperations::copy(dest, samples.data() + scope.startIndex1, scope.blockSize1);
+
+    if (scope.blockSize2 > 0)
+        juce::FloatVectorOperations::copy(dest + scope.blockSize1, samples.data() + scope.startIndex2, scope.blockSize2);
+
+    return scope.blockSize1 + scope.blockSize2;
+}
+
+void SpectrumTap::discard(int numSamples) noexcept
+{
+    fifo.finishedRead(juce::jmin(numSamples, fifo.getNumReady()));
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Hands a signal from the audio thread to a spectrum display without either side waiting.
+//
+// The audio thread mixes each block to mono straight into a ring managed by an AbstractFifo;
+// whatever does not fit is dropped rather than waited for. Nothing is allocated after
+// construction. While disabled (no display is showing it) a push is a single atomic load.
+// Exactly one thread may push and one other thread may read.
+class SpectrumTap
+{
+public:
+    explicit SpectrumTap(int capacity = 16384);
+
+    // ===== Audio thread =====
+    void push(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept;
+
+    // ===== Reader =====
+    // Copies up to maxSamples of the oldest samples into dest; returns how many
+    int pull(float* dest, int maxSamples) noexcept;
+
+    // Throws away the oldest samples, e.g. to catch up after the reader fell behind
+    void discard(int numSamples) noexcept;
+    int getNumReady() const noexcept { return fifo.getNumReady(); }
+
+    // ===== Any thread =====
+    void setEnabled(bool shouldCapture) noexcept { enabled.store(shouldCapture); }
+    bool isEnabled() const noexcept { return enabled.load(); }
+
+    // Rate of the pushed signal, set by whoever prepares the audio side
+    void setSampleRate(double newRate) noexcept { sampleRate.store(newRate); }
+    double getSampleRate() const noexcept { return sampleRate.load(); }
+
+    // Samples dropped because the reader was not keeping up
+    int getNumDropped() const noexcept { return dropped.load(); }
+
+private:
+    void mixInto(float* dest, const juce::AudioBuffer<float>& buffer, int startSample, int numSamples) const noexcept;
+
+    juce::AbstractFifo fifo;
+    std::vector<float> samples;
+
+    std::atomic<bool> enabled{ false };
+    std::atomic<double> sampleRate{ 44100.0 };
+    std::atomic<int> dropped{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumTap)
+};
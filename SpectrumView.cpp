@@ -0,0 +1,162 @@
+﻿#include "SpectrumView.h"
+
+SpectrumView::SpectrumView(SpectrumTap& tapToShow)
+    : tap(tapToShow), analyser(tapToShow)
+{
+    // Dark blue through red to yellow as the level rises
+    for (size_t i = 0; i < palette.size(); ++i)
+    {
+        const float t = (float)i / (float)(palette.size() - 1);
+        palette[i] = juce::Colour::fromHSV(0.7f * (1.0f - t), 0.9f, juce::jmin(1.0f, 0.15f + t), 1.0f);
+    }
+
+    analyser.onFrame = [this](const std::vector<float>& frameLevels)
+        {
+            if (mode == Mode::spectrogram)
+                addSpectrogramColumn(frameLevels);
+        };
+
+    startTimerHz(refreshHz);
+}
+
+SpectrumView::~SpectrumView()
+{
+    stopTimer();
+    tap.setEnabled(false);
+}
+
+void SpectrumView::setMode(Mode newMode)
+{
+    if (newMode == mode)
+        return;
+
+    mode = newMode;
+    repaint();
+}
+
+void SpectrumView::timerCallback()
+{
+    refresh();
+}
+
+void SpectrumView::refresh()
+{
+    const bool onScreen = isOnScreen();
+    tap.setEnabled(onScreen);
+
+    const double now = juce::Time::getMillisecondCounterHiRes();
+    const double elapsedSeconds = lastRefreshMs > 0.0 ? (now - lastRefreshMs) / 1000.0 : 0.0;
+    lastRefreshMs = now;
+
+    if (!onScreen)
+    {
+        tap.discard(tap.getNumReady());
+        return;
+    }
+
+    if (analyser.update(maxFramesPerRefresh) > 0)
+    {
+        repaint();
+        return;
+    }
+
+    // Nothing arrived (the deck is stopped or empty): let the spectrum fall away
+    const auto& levels = analyser.getLevels();
+    if (mode == Mode::spectrum && std::any_of(levels.begin(), levels.end(), [](float l) { return l > SpectrumAnalyser::minDb; }))
+    {
+        analyser.decay(elapsedSeconds);
+        repaint();
+    }
+}
+
+// Decks scrolled out of the viewport are showing as far as JUCE is concerned, but not on screen
+bool SpectrumView::isOnScreen() const
+{
+    if (!isShowing())
+        return false;
+
+    if (auto* viewport = findParentComponentOfClass<juce::Viewport>())
+        if (auto* viewed = viewport->getViewedComponent())
+            return viewport->getViewArea().intersects(viewed->getLocalArea(this, getLocalBounds()));
+
+    return true;
+}
+
+void SpectrumView::resized()
+{
+    const int numBands = juce::jlimit(8, maxBands, getWidth() / pixelsPerBand);
+
+    if (numBands != analyser.getNumBands() || !spectrogram.isValid())
+    {
+        analyser.setNumBands(numBands);
+        spectrogram = juce::Image(juce::Image::RGB, spectrogramColumns, numBands, true);
+        nextColumn = 0;
+    }
+}
+
+void SpectrumView::addSpectrogramColumn(const std::vector<float>& frameLevels)
+{
+    if (!spectrogram.isValid())
+        return;
+
+    const int numBands = spectrogram.getHeight();
+    const int topIndex = (int)palette.size() - 1;
+
+    {
+        juce::Image::BitmapData column(spectrogram, nextColumn, 0, 1, numBands, juce::Image::BitmapData::writeOnly);
+
+        for (int band = 0; band < juce::jmin(numBands, (int)frameLevels.size()); ++band)
+        {
+            const float t = 1.0f - frameLevels[(size_t)band] / SpectrumAnalyser::minDb;
+            column.setPixelColour(0, numBands - 1 - band, palette[(size_t)juce::jlimit(0, topIndex, juce::roundToInt(t * topIndex))]);
+        }
+    }
+
+    nextColumn = (nextColumn + 1) % spectrogramColumns;
+}
+
+void SpectrumView::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colours::black);
+
+    const auto area = getLocalBounds();
+    const int width = area.getWidth(), height = area.getHeight();
+
+    if (mode == Mode::spectrogram)
+    {
+        // Oldest frames on the left: the ring from nextColumn to the end, then from the start
+        const int olderColumns = spectrogramColumns - nextColumn;
+        const int split = width * olderColumns / spectrogramColumns;
+
+        g.setImageResamplingQuality(juce::Graphics::lowResamplingQuality);
+        g.drawImage(spectrogram, 0, 0, split, height, nextColumn, 0, olderColumns, spectrogram.getHeight());
+
+        if (nextColumn > 0)
+            g.drawImage(spectrogram, split, 0, width - split, height, 0, 0, nextColumn, spectrogram.getHeight());
+    }
+    else
+    {
+        const auto& levels = analyser.getLevels();
+        const float bandWidth = (float)width / (float)levels.size();
+
+        juce::Path outline;
+        outline.startNewSubPath(0.0f, (float)height);
+
+        for (size_t band = 0; band < levels.size(); ++band)
+            outline.lineTo(((float)band + 0.5f) * bandWidth, (float)height * levels[band] / SpectrumAnalyser::minDb);
+
+        outline.lineTo((float)width, (float)height);
+        outline.closeSubPath();
+
+        g.setColour(juce::Colours::darkorange.withAlpha(0.7f));
+        g.fillPath(outline);
+    }
+
+    g.setColour(juce::Colours::grey);
+    g.drawRect(area);
+}
+
+void SpectrumView::mouseDown(const juce::MouseEvent&)
+{
+    setMode(mode == Mode::spectrum ? Mode::spectrogram : Mode::spectrum);
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "SpectrumAnalyser.h"
+
+// Spectrum or scrolling spectrogram of a SpectrumTap; a click switches between them.
+//
+// Everything happens on the message thread at 30 frames a second: the view analyses what the
+// tap collected since the last frame (at most a few FFT frames, see SpectrumAnalyser) and
+// repaints if anything arrived. The spectrum is one point per band, a band being a few pixels
+// wide; the spectrogram writes one column per FFT frame into an image used as a ring, and is
+// drawn as two blits. The tap is only enabled while the view is on screen, so decks scrolled
+// out of sight cost neither the audio thread nor the GUI anything.
+class SpectrumView : public juce::Component,
+    private juce::Timer
+{
+public:
+    enum class Mode { spectrum, spectrogram };
+
+    explicit SpectrumView(SpectrumTap& tapToShow);
+    ~SpectrumView() override;
+
+    void setMode(Mode newMode);
+    Mode getMode() const { return mode; }
+
+    // Analyses what has arrived and repaints if it changed; the timer calls this
+    void refresh();
+
+    // ===== Component =====
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    void mouseDown(const juce::MouseEvent& e) override;
+
+    static constexpr int refreshHz = 30;
+    static constexpr int maxFramesPerRefresh = 8;
+    static constexpr int pixelsPerBand = 3;
+    static constexpr int maxBands = 128;
+    static constexpr int spectrogramColumns = 256;
+
+private:
+    void timerCallback() override;
+    bool isOnScreen() const;
+    void addSpectrogramColumn(const std::vector<float>& frameLevels);
+
+    SpectrumTap& tap;
+    SpectrumAnalyser analyser;
+    Mode mode = Mode::spectrum;
+
+    // One column per FFT frame, one row per band (lowest at the bottom); the next column to
+    // write is the oldest one on screen
+    juce::Image spectrogram;
+    int nextColumn = 0;
+    std::array<juce::Colour, 256> palette;
+
+    double lastRefreshMs = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumView)
+};
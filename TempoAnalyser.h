@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "RealFft.h"
+
+// Constant-tempo beat grid of a track: beats fall every 60 / bpm seconds from firstBeatSeconds
+struct BeatGrid
+{
+    double bpm = 0.0;
+    double firstBeatSeconds = 0.0;  // the first beat at or after the start of the track
+    float confidence = 0.0f;        // 0 to 1: how strongly the onsets agree with the grid
+
+    bool isValid() const { return bpm > 0.0; }
+    double getBeatLength() const { return 60.0 / bpm; }
+
+    // Beats since the grid's origin at a track position; the fraction is the phase
+    double getBeatPosition(double seconds) const { return (seconds - firstBeatSeconds) / getBeatLength(); }
+    double getBeatTime(double beatPosition) const { return firstBeatSeconds + beatPosition * getBeatLength(); }
+};
+
+
+// Finds the tempo and beat grid of a whole track, fed front to back in blocks of any size.
+//
+// The track is mixed to mono and decimated to about 11 kHz. Short FFT frames give a spectral
+// flux onset envelope (the summed rise in log magnitude per bin, 86 frames a second), whose
+// autocorrelation picks the beat period in 60-200 BPM, weighted towards 120 BPM so the
+// half- and double-time readings lose. The period is then refined by folding the envelope over
+// candidate beat lengths: the right one stacks every onset in the same place. The grid is
+// placed where the low band's onsets stack up, so it lands on the kick rather than the
+// off-beat hi-hats. Not realtime-safe.
+class TempoAnalyser
+{
+public:
+    TempoAnalyser(double sampleRate, int numChannels);
+
+    void process(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // An invalid grid if the track is too short or has no steady beat
+    BeatGrid getResult() const;
+
+    static constexpr double minBpm = 60.0, maxBpm = 200.0;
+
+private:
+    static constexpr int fftOrder = 9;      // 46 ms frames at ~11 kHz
+    static constexpr int hopSize = 128;
+    static constexpr double targetRate = 11025.0;
+    static constexpr int lowBandBins = 7;   // up to ~150 Hz, where the kick drum is
+
+    void analyseFrame();
+    static std::vector<float> removeLocalMean(const std::vector<float>& flux, int radius);
+    double foldedScore(const std::vector<float>& envelope, double period, int numBins, double& phase) const;
+
+    const int numChannels;
+    const int decimation;
+    const double analysisRate;
+
+    RealFft fft;
+    std::vector<float> window;
+    std::vector<float> frame, magnitudes, previous;
+
+    std::vector<float> ring;            // the last fft-size decimated samples
+    int ringPos = 0, sinceLastFrame = 0, samplesSeen = 0;
+    float decimationSum = 0.0f;
+    int decimationCount = 0;
+
+    std::vector<float> onsets;          // spectral flux per hop
+    std::vector<float> lowOnsets;       // the same, over the low band only
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TempoAnalyser)
+};
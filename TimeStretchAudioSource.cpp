@@ -0,0 +1,213 @@
+﻿#include "TimeStretchAudioSource.h"
+#include "SimdKernels.h"
+
+TimeStretchAudioSource::TimeStretchAudioSource(juce::AudioSource* inputSource, int channels)
+    : input(inputSource),
+    numChannels(juce::jmax(1, channels))
+{
+    jassert(input != nullptr);
+}
+
+void TimeStretchAudioSource::setEnabled(bool shouldBeEnabled)
+{
+    if (enabled != shouldBeEnabled)
+    {
+        enabled = shouldBeEnabled;
+        reset();
+    }
+}
+
+void TimeStretchAudioSource::setSpeed(double newSpeed)
+{
+    speed = juce::jlimit(minSpeed, maxSpeed, newSpeed);
+}
+
+void TimeStretchAudioSource::reset()
+{
+    inputStart = 0;
+    inputCount = 0;
+    outputReady = 0;
+    outputRead = 0;
+    analysisPos = 0.0;
+    previousFrameStart = -1;
+    overlapBuffer.clear();
+}
+
+// ===== AudioSource =====
+void TimeStretchAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    // ~40 ms frames with 50% overlap, searching up to a quarter frame either side
+    frameSize = juce::nextPowerOfTwo(juce::roundToInt(juce::jmax(8000.0, sampleRate) * 0.04));
+    hopSize = frameSize / 2;
+    searchRadius = frameSize / 4;
+
+    // Periodic Hann: two copies offset by half a frame sum to exactly one
+    window.allocate((size_t)frameSize, false);
+    for (int i = 0; i < frameSize; ++i)
+        window[i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float)i / (float)frameSize);
+
+    inputCapacity = frameSize * 4 + searchRadius * 4;
+    inputBuffer.setSize(numChannels, inputCapacity);
+    monoBuffer.allocate((size_t)inputCapacity, true);
+
+    overlapBuffer.setSize(numChannels, frameSize);
+    frameScratch.setSize(1, frameSize);
+
+    reset();
+    input->prepareToPlay(samplesPerBlockExpected, sampleRate);
+}
+
+void TimeStretchAudioSource::releaseResources()
+{
+    input->releaseResources();
+}
+
+void TimeStretchAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
+{
+    if (!enabled || frameSize == 0)
+    {
+        input->getNextAudioBlock(bufferToFill);
+        return;
+    }
+
+    auto& dest = *bufferToFill.buffer;
+    int done = 0;
+
+    while (done < bufferToFill.numSamples)
+    {
+        if (outputRead >= outputReady)
+            processFrame();
+
+        const int num = juce::jmin(bufferToFill.numSamples - done, outputReady - outputRead);
+
+        for (int ch = 0; ch < dest.getNumChannels(); ++ch)
+            dest.copyFrom(ch, bufferToFill.startSample + done, overlapBuffer, juce::jmin(ch, numChannels - 1), outputRead, num);
+
+        outputRead += num;
+        done += num;
+    }
+}
+
+// ===== WSOLA =====
+void TimeStretchAudioSource::processFrame()
+{
+    const auto nominal = (juce::int64)analysisPos;
+    const auto continuation = previousFrameStart < 0 ? nominal : previousFrameStart + hopSize;
+
+    ensureInputUpTo(juce::jmax(nominal + searchRadius, continuation) + frameSize);
+
+    juce::int64 frameStart = nominal;
+
+    if (previousFrameStart >= 0)
+    {
+        // At unity speed the natural continuation reconstructs the input exactly
+        frameStart = speed == 1.0 ? continuation : findBestFrameStart(continuation, nominal);
+    }
+
+    // Retire the half that has already been played and overlap-add the new frame
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto* overlap = overlapBuffer.getWritePointer(ch);
+
+        if (outputReady > 0)
+        {
+            juce::FloatVectorOperations::copy(overlap, overlap + hopSize, frameSize - hopSize);
+            juce::FloatVectorOperations::clear(overlap + frameSize - hopSize, hopSize);
+        }
+
+        auto* scratch = frameScratch.getWritePointer(0);
+        const auto* src = inputBuffer.getReadPointer(ch, (int)(frameStart - inputStart));
+
+        juce::FloatVectorOperations::multiply(scratch, src, window.get(), frameSize);
+        juce::FloatVectorOperations::add(overlap, scratch, frameSize);
+    }
+
+    outputReady = hopSize;
+    outputRead = 0;
+
+    previousFrameStart = frameStart;
+    analysisPos = (speed == 1.0 ? (double)frameStart : analysisPos) + hopSize * speed;
+
+    discardInputBefore(juce::jmin((juce::int64)analysisPos - searchRadius, frameStart + hopSize));
+}
+
+// Picks the frame start near `nominal` whose opening best matches the audio that would
+// naturally have followed the previous frame (coarse pass, then a fine pass around the peak)
+juce::int64 TimeStretchAudioSource::findBestFrameStart(juce::int64 target, juce::int64 nominal) const
+{
+    const int overlapLength = frameSize - hopSize;
+    const float* reference = monoBuffer.get() + (target - inputStart);
+
+    const auto lowest = juce::jmax(inputStart, nominal - searchRadius);
+    const auto highest = nominal + searchRadius;
+
+    auto best = juce::jlimit(lowest, highest, nominal);
+    float bestScore = std::numeric_limits<float>::lowest();
+
+    auto score = [&](juce::int64 candidate)
+        {
+            return SimdKernels::dotProduct(reference, monoBuffer.get() + (candidate - inputStart), overlapLength);
+        };
+
+    for (auto candidate = lowest; candidate <= highest; candidate += 4)
+    {
+        const float s = score(candidate);
+        if (s > bestScore) { bestScore = s; best = candidate; }
+    }
+
+    const auto coarseBest = best;
+    for (auto candidate = juce::jmax(lowest, coarseBest - 3); candidate <= juce::jmin(highest, coarseBest + 3); ++candidate)
+    {
+        const float s = score(candidate);
+        if (s > bestScore) { bestScore = s; best = candidate; }
+    }
+
+    return best;
+}
+
+void TimeStretchAudioSource::ensureInputUpTo(juce::int64 endPosition)
+{
+    const auto available = inputStart + inputCount;
+    if (endPosition <= available)
+        return;
+
+    const int needed = (int)(endPosition - available);
+    jassert(inputCount + needed <= inputCapacity);
+
+    const int num = juce::jmin(needed, inputCapacity - inputCount);
+    input->getNextAudioBlock(juce::AudioSourceChannelInfo(&inputBuffer, inputCount, num));
+
+    // Similarity search runs on a mono mix
+    auto* mono = monoBuffer.get() + inputCount;
+    if (numChannels > 1)
+    {
+        juce::FloatVectorOperations::copyWithMultiply(mono, inputBuffer.getReadPointer(0, inputCount), 0.5f, num);
+        juce::FloatVectorOperations::addWithMultiply(mono, inputBuffer.getReadPointer(1, inputCount), 0.5f, num);
+    }
+    else
+    {
+        juce::FloatVectorOperations::copy(mono, inputBuffer.getReadPointer(0, inputCount), num);
+    }
+
+    inputCount += num;
+}
+
+void TimeStretchAudioSource::discardInputBefore(juce::int64 position)
+{
+    const int shift = (int)juce::jlimit((juce::int64)0, (juce::int64)inputCount, position - inputStart);
+    if (shift <= 0)
+        return;
+
+    const int remaining = inputCount - shift;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto* data = inputBuffer.getWritePointer(ch);
+        std::memmove(data, data + shift, (size_t)remaining * sizeof(float));
+    }
+
+    std::memmove(monoBuffer.get(), monoBuffer.get() + shift, (size_t)remaining * sizeof(float));
+
+    inputStart += shift;
+    inputCount = remaining;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Pitch-preserving speed change using WSOLA (waveform-similarity overlap-add).
+// Frames of the input are taken every speed x hop samples, nudged within a small search
+// window to the offset that best continues the previous frame, windowed and overlap-added
+// at a fixed output hop. When disabled it passes audio straight through.
+//
+// All buffers are allocated in prepareToPlay(); everything else runs on the audio thread.
+class TimeStretchAudioSource : public juce::AudioSource
+{
+public:
+    TimeStretchAudioSource(juce::AudioSource* inputSource, int numChannels = 2);
+    ~TimeStretchAudioSource() override = default;
+
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const { return enabled; }
+
+    // Playback speed (input samples consumed per output sample)
+    void setSpeed(double newSpeed);
+    double getSpeed() const { return speed; }
+
+    // Drops buffered audio, e.g. after a seek
+    void reset();
+
+    // ===== AudioSource =====
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
+
+    static constexpr double minSpeed = 0.25;
+    static constexpr double maxSpeed = 2.0;
+
+private:
+    void processFrame();
+    juce::int64 findBestFrameStart(juce::int64 target, juce::int64 nominal) const;
+    void ensureInputUpTo(juce::int64 endPosition);
+    void discardInputBefore(juce::int64 position);
+
+    juce::AudioSource* input;
+    const int numChannels;
+
+    bool enabled = false;
+    double speed = 1.0;
+
+    // ===== Frame geometry (set in prepareToPlay) =====
+    int frameSize = 0;
+    int hopSize = 0;
+    int searchRadius = 0;
+    juce::HeapBlock<float> window;
+
+    // ===== Input history (absolute positions count from the last reset) =====
+    juce::AudioBuffer<float> inputBuffer;
+    juce::HeapBlock<float> monoBuffer;
+    int inputCapacity = 0;
+    juce::int64 inputStart = 0;
+    int inputCount = 0;
+
+    // ===== Synthesis =====
+    juce::AudioBuffer<float> overlapBuffer;
+    juce::AudioBuffer<float> frameScratch;
+    int outputReady = 0;
+    int outputRead = 0;
+
+    double analysisPos = 0.0;
+    juce::int64 previousFrameStart = -1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TimeStretchAudioSource)
+};
@@ -0,0 +1,185 @@
+﻿#include "TrackLoader.h"
+#include "RealtimeGuard.h"
+
+TrackLoader::TrackLoader() : juce::Thread("Track Loader")
+{
+    formatManager.registerBasicFormats();
+    startThread();
+}
+
+TrackLoader::~TrackLoader()
+{
+    stopThread(4000);
+}
+
+void TrackLoader::addClient(Client* client)
+{
+    const juce::ScopedLock sl(requestLock);
+    clients.addIfNotAlreadyThere(client);
+}
+
+void TrackLoader::removeClient(Client* client)
+{
+    {
+        const juce::ScopedLock sl(requestLock);
+        clients.removeFirstMatchingValue(client);
+    }
+
+    cancelRequests(client);
+
+    // Wait for any request or clean-up that was already running for this client
+    const juce::ScopedLock sl(processLock);
+}
+
+void TrackLoader::load(Request request)
+{
+    {
+        const juce::ScopedLock sl(requestLock);
+        requests.push_back(std::move(request));
+    }
+
+    notify();
+}
+
+int TrackLoader::cancelRequests(Client* client, int tag)
+{
+    const juce::ScopedLock sl(requestLock);
+
+    const auto numBefore = requests.size();
+    requests.erase(std::remove_if(requests.begin(), requests.end(),
+        [client, tag](const Request& r) { return r.owner == client && (tag < 0 || r.tag == tag); }),
+        requests.end());
+
+    return (int)(numBefore - requests.size());
+}
+
+std::unique_ptr<DeckTrack> TrackLoader::openTrack(const juce::File& file, int blockSize, double sampleRate, double readAheadSeconds,
+    bool memoryMapped)
+{
+    RealtimeGuard::assertNotRealtime("TrackLoader::openTrack");
+
+    if (!file.existsAsFile())
+        return {};
+
+    // Compressed formats (and files that cannot be mapped) fall back to the streaming reader
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader;
+    if (memoryMapped)
+        mappedReader = MappedAudioSource::createReaderFor(formatManager, file);
+
+    const bool isMapped = mappedReader != nullptr;
+
+    // MP3s seek through their frame table once they have one; the first open builds it
+    auto* mp3Format = Mp3SeekIndex::canIndex(file) ? formatManager.findFormatForFileExtension("mp3") : nullptr;
+    Mp3SeekIndex::TablePtr seekTable;
+
+    if (!isMapped && mp3Format != nullptr)
+        seekTable = seekIndex->find(file);
+
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    if (isMapped)
+        reader.reset(mappedReader.release());
+    else if (seekTable != nullptr)
+        reader = std::make_unique<SeekIndexedMp3Reader>(file, seekTable, *mp3Format);
+    else
+        reader.reset(formatManager.createReaderFor(file));
+
+    if (reader == nullptr)
+        return {};
+
+    if (mp3Format != nullptr && seekTable == nullptr)
+        seekIndex->buildInBackground(file, reader->lengthInSamples);
+
+    // Decoded formats go through the shared PCM cache, so a track that is replayed or
+    // loaded on both decks is only decoded once (mapped files already share the OS cache)
+    if (!isMapped && decodedCache->isEnabled())
+        reader.reset(new CachingAudioFormatReader(reader.release(), DecodedAudioCache::getKeyFor(file), *decodedCache));
+
+    auto track = std::make_unique<DeckTrack>();
+    track->file = file;
+    track->id = ++nextTrackId;
+
+    AnalysisCache::Measurement analysed;
+    if (analysis->find(file, analysed))
+    {
+        track->normalisationGain = analysed.getNormalisationGain();
+        track->beatGrid = analysed.beatGrid;
+    }
+
+    // ===== Extract metadata =====
+    track->title = reader->metadataValues.getValue("title", file.getFileNameWithoutExtension());
+    track->artist = reader->metadataValues.getValue("artist", "Unknown");
+    track->album = reader->metadataValues.getValue("album", "Unknown");
+
+    track->sampleRate = reader->sampleRate;
+    track->lengthInSamples = reader->lengthInSamples;
+
+    track->readerSource = std::make_unique<juce::AudioFormatReaderSource>(reader.release(), true);
+    if (auto* mapped = dynamic_cast<juce::MemoryMappedAudioFormatReader*>(track->readerSource->getAudioFormatReader()))
+        track->stream = std::make_unique<MappedAudioSource>(*mapped, *diskThread, readAheadSeconds);
+    else
+        track->stream = std::make_unique<ReadAheadAudioSource>(track->readerSource.get(), *diskThread, readAheadSeconds);
+
+    // Allocates the ring and decodes the first blocks (or faults in the first mapped pages)
+    track->stream->prepareToPlay(blockSize, sampleRate);
+
+    track->looper = std::make_unique<LoopingAudioSource>(track->stream.get(),
+        *track->readerSource->getAudioFormatReader(), *diskThread);
+    track->looper->prepareToPlay(blockSize, sampleRate);
+
+    // The disk thread decodes the start of each cue once the stream is primed
+    for (const auto& cue : hotCueStore->getCues(file))
+    {
+        if (cue.frame >= track->lengthInSamples || (int)track->hotCues.size() >= LoopingAudioSource::maxHotCues)
+            continue;
+
+        track->looper->setHotCue((int)track->hotCues.size(), cue.frame);
+        track->hotCues.push_back(cue.frame);
+    }
+
+    return track;
+}
+
+void TrackLoader::run()
+{
+    while (!threadShouldExit())
+    {
+        Request request;
+        bool hasRequest = false;
+
+        {
+            const juce::ScopedLock sl(requestLock);
+
+            if (!requests.empty())
+            {
+                request = std::move(requests.front());
+                requests.pop_front();
+                hasRequest = true;
+            }
+        }
+
+        {
+            const juce::ScopedLock sl(processLock);
+
+            juce::Array<Client*> activeClients;
+            {
+                const juce::ScopedLock sl2(requestLock);
+                activeClients = clients;
+            }
+
+            if (hasRequest && activeClients.contains(request.owner))
+            {
+                auto track = openTrack(request.file, request.blockSize, request.sampleRate, request.readAheadSeconds,
+                    request.memoryMapped);
+
+                if (request.onReady)
+                    request.onReady(std::move(track));
+            }
+
+            for (auto* client : activeClients)
+                client->releaseRetiredTracks();
+        }
+
+        if (!hasRequest)
+            wait(20);
+    }
+}
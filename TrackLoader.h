@@ -0,0 +1,122 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "ReadAheadAudioSource.h"
+#include "MappedAudioSource.h"
+#include "LoopingAudioSource.h"
+#include "DecodedAudioCache.h"
+#include "Mp3SeekIndex.h"
+#include "AnalysisCache.h"
+#include "HotCueStore.h"
+
+// A fully opened and primed track, ready to be handed to the audio thread
+struct DeckTrack
+{
+    juce::File file;
+
+    // ===== Metadata =====
+    juce::String title;
+    juce::String artist;
+    juce::String album;
+
+    double sampleRate = 0.0;
+    juce::int64 lengthInSamples = 0;
+
+    double getLengthInSeconds() const { return sampleRate > 0.0 ? (double)lengthInSamples / sampleRate : 0.0; }
+
+    // Unique per opened track, so a late update can tell which track it was meant for
+    int id = 0;
+
+    // Linear loudness normalisation, or negative until the track has been analysed
+    float normalisationGain = -1.0f;
+
+    // Tempo and beats, once analysed; invalid for tracks without a steady beat
+    BeatGrid beatGrid;
+
+    // The frame of the hot cue in each of the looper's cue slots, in slot order
+    std::vector<juce::int64> hotCues;
+
+    // Each stage reads from the one above it, so they are destroyed bottom-up.
+    // The stream is a ReadAheadAudioSource, or a MappedAudioSource for uncompressed PCM.
+    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+    std::unique_ptr<TrackStream> stream;
+    std::unique_ptr<LoopingAudioSource> looper;
+
+    JUCE_LEAK_DETECTOR(DeckTrack)
+};
+
+
+// Shared background thread that opens, decodes and primes tracks for the decks,
+// and destroys the tracks they retire, so the audio thread never blocks or frees memory.
+class TrackLoader : private juce::Thread
+{
+public:
+    class Client
+    {
+    public:
+        virtual ~Client() = default;
+
+        // Called on the loader thread: delete whatever the audio thread has handed back
+        virtual void releaseRetiredTracks() = 0;
+    };
+
+    struct Request
+    {
+        Client* owner = nullptr;
+        juce::File file;
+
+        // Lets a client replace one kind of request without cancelling its others
+        int tag = 0;
+
+        // Device settings the track is prepared for
+        int blockSize = 512;
+        double sampleRate = 44100.0;
+        double readAheadSeconds = 2.0;
+
+        // Play uncompressed WAV/AIFF straight from a memory mapping when possible
+        bool memoryMapped = true;
+
+        // Called on the loader thread with the primed track, or nullptr if the file could not be opened
+        std::function<void(std::unique_ptr<DeckTrack>)> onReady;
+    };
+
+    TrackLoader();
+    ~TrackLoader() override;
+
+    void addClient(Client* client);
+
+    // Cancels the client's pending requests and waits for one in progress to finish
+    void removeClient(Client* client);
+
+    void load(Request request);
+
+    // Drops the client's pending requests (all of them, or only those with the given tag)
+    // and returns how many were dropped
+    int cancelRequests(Client* client, int tag = -1);
+
+    juce::AudioFormatManager& getFormatManager() { return formatManager; }
+    DecodedAudioCache& getDecodedCache() { return *decodedCache; }
+    Mp3SeekIndex& getSeekIndex() { return *seekIndex; }
+    AnalysisCache& getAnalysisCache() { return *analysis; }
+    HotCueStore& getHotCueStore() { return *hotCueStore; }
+
+    // Opens and primes a track on the calling thread
+    std::unique_ptr<DeckTrack> openTrack(const juce::File& file, int blockSize, double sampleRate, double readAheadSeconds,
+        bool memoryMapped = true);
+
+private:
+    void run() override;
+
+    juce::AudioFormatManager formatManager;
+    juce::SharedResourcePointer<DiskStreamThread> diskThread;
+    juce::SharedResourcePointer<DecodedAudioCache> decodedCache;
+    juce::SharedResourcePointer<Mp3SeekIndex> seekIndex;
+    juce::SharedResourcePointer<AnalysisCache> analysis;
+    juce::SharedResourcePointer<HotCueStore> hotCueStore;
+    std::atomic<int> nextTrackId{ 0 };
+
+    juce::CriticalSection requestLock, processLock;
+    std::deque<Request> requests;
+    juce::Array<Client*> clients;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TrackLoader)
+};
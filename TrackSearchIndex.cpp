@@ -0,0 +1,463 @@
+﻿#include "TrackSearchIndex.h"
+
+namespace
+{
+    std::vector<std::string> splitWords(const std::string& normalised)
+    {
+        std::vector<std::string> words;
+        size_t start = 0;
+
+        while (start < normalised.size())
+        {
+            const auto end = normalised.find(' ', start);
+            const auto length = (end == std::string::npos ? normalised.size() : end) - start;
+
+            if (length > 0)
+                words.push_back(normalised.substr(start, length));
+
+            start += length + 1;
+        }
+
+        return words;
+    }
+
+    // Drops the candidates whose row is not in list (both ascending), or that keep() turns
+    // down given the row's index in list. Each step gallops forward from the last match, so
+    // lists of similar length cost a merge rather than a binary search per candidate.
+    template <typename CandidateType, typename KeepFn>
+    void intersect(std::vector<CandidateType>& candidates, const std::vector<juce::uint32>& list, KeepFn&& keep)
+    {
+        auto pos = list.begin();
+        const auto end = list.end();
+        size_t kept = 0;
+
+        for (auto& candidate : candidates)
+        {
+            std::ptrdiff_t step = 1;
+            while (step < end - pos && pos[step] < candidate.row)
+                step *= 2;
+
+            pos = std::lower_bound(pos + step / 2, pos + juce::jmin(step + 1, (std::ptrdiff_t)(end - pos)), candidate.row);
+            if (pos == end)
+                break;
+
+            if (*pos == candidate.row && keep(candidate, (size_t)(pos - list.begin())))
+                candidates[kept++] = candidate;
+        }
+
+        candidates.resize(kept);
+    }
+}
+
+// ===== Rows =====
+void TrackSearchIndex::add(const juce::String& rowText)
+{
+    const auto normalised = normalise(rowText);
+
+    rows.push_back((juce::uint32)text.size());
+    rewritten.push_back(false);
+    text.insert(text.end(), normalised.begin(), normalised.end());
+    text.push_back(0);
+
+    index(size() - 1, normalised);
+}
+
+void TrackSearchIndex::update(int row, const juce::String& rowText)
+{
+    if (!juce::isPositiveAndBelow(row, size()))
+        return;
+
+    const auto normalised = normalise(rowText);
+    if (normalised == getText(row))
+        return;
+
+    // The old keys stay in the postings; rewritten rows are always checked against their text
+    rows[(size_t)row] = (juce::uint32)text.size();
+    if (!rewritten[(size_t)row])
+    {
+        rewritten[(size_t)row] = true;
+        ++numRewritten;
+    }
+
+    text.insert(text.end(), normalised.begin(), normalised.end());
+    text.push_back(0);
+
+    index(row, normalised);
+}
+
+void TrackSearchIndex::clear()
+{
+    rows.clear();
+    rows.shrink_to_fit();
+    rewritten.clear();
+    rewritten.shrink_to_fit();
+    numRewritten = 0;
+    text.clear();
+    text.shrink_to_fit();
+    postings.clear();
+}
+
+void TrackSearchIndex::index(int row, const std::string& normalised)
+{
+    keyScratch.clear();
+    collectKeys(normalised, keyScratch);
+
+    for (const auto& keyAt : keyScratch)
+    {
+        auto& list = postings[keyAt.key];
+
+        // Appended rows land at the end; only updates need the search
+        if (list.rows.empty() || list.rows.back() < (juce::uint32)row)
+        {
+            list.rows.push_back((juce::uint32)row);
+            list.starts.push_back(keyAt.start);
+        }
+        else
+        {
+            const auto pos = std::lower_bound(list.rows.begin(), list.rows.end(), (juce::uint32)row);
+            const auto i = pos - list.rows.begin();
+
+            if (*pos == (juce::uint32)row)
+            {
+                list.starts[(size_t)i] = keyAt.start;
+            }
+            else
+            {
+                list.rows.insert(pos, (juce::uint32)row);
+                list.starts.insert(list.starts.begin() + i, keyAt.start);
+            }
+        }
+    }
+}
+
+// ===== Keys =====
+// Lower case, letters and digits only, words separated by single spaces and the whole text
+// wrapped in spaces, so " ab" marks a word starting with "ab". Bytes of multi-byte UTF-8
+// characters are kept as they are.
+std::string TrackSearchIndex::normalise(const juce::String& rowText)
+{
+    const auto lower = rowText.toLowerCase();
+    const char* utf8 = lower.toRawUTF8();
+
+    std::string result(" ");
+    result.reserve(lower.getNumBytesAsUTF8() + 2);
+
+    for (; *utf8 != 0; ++utf8)
+    {
+        const auto c = (unsigned char)*utf8;
+
+        if (c >= 0x80 || juce::CharacterFunctions::isLetterOrDigit((char)c))
+            result.push_back((char)c);
+        else if (result.back() != ' ')
+            result.push_back(' ');
+    }
+
+    if (result.back() != ' ')
+        result.push_back(' ');
+
+    return result;
+}
+
+TrackSearchIndex::Key TrackSearchIndex::makeKey(const char* chars, int length)
+{
+    // One- and two-character word starts are padded with spaces in front; normalised text
+    // never has two spaces in a row, so the padded keys cannot clash with real trigrams
+    Key key = 0;
+    for (int i = 0; i < 3 - length; ++i)
+        key = (key << 8) | (Key)' ';
+
+    for (int i = 0; i < length; ++i)
+        key = (key << 8) | (Key)(unsigned char)chars[i];
+
+    return key;
+}
+
+void TrackSearchIndex::collectKeys(const std::string& normalised, std::vector<KeyAt>& keys)
+{
+    const char* s = normalised.data();
+    const int length = (int)normalised.size();
+
+    for (int i = 0; i + 1 < length; ++i)
+    {
+        if (s[i + 1] == ' ')
+            continue;
+
+        const auto start = (Start)juce::jmin(i, (int)unknownStart);
+
+        // The first character of each word, and every trigram that ends inside a word
+        // (" ab" is the two-character start of a word)
+        if (s[i] == ' ')
+            keys.push_back({ makeKey(s + i + 1, 1), start });
+
+        if (i + 2 < length && s[i + 2] != ' ')
+            keys.push_back({ makeKey(s + i, 3), start });
+    }
+
+    std::stable_sort(keys.begin(), keys.end(), [](const KeyAt& a, const KeyAt& b) { return a.key < b.key; });
+
+    // One entry per key, holding its first start
+    size_t kept = 0;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (kept > 0 && keys[kept - 1].key == keys[i].key)
+            keys[kept - 1].start |= repeatedFlag;
+        else
+            keys[kept++] = keys[i];
+    }
+
+    keys.resize(kept);
+}
+
+void TrackSearchIndex::collectQueryKeys(const std::string& word, std::vector<Key>& keys)
+{
+    const int length = (int)word.size();
+
+    if (length == 1)
+        keys.push_back(makeKey(word.data(), 1));
+    else if (length == 2)
+        keys.push_back(makeKey((" " + word).data(), 3));
+    else
+        for (int i = 0; i + 3 <= length; ++i)
+            keys.push_back(makeKey(word.data() + i, 3));
+}
+
+// ===== Search =====
+bool TrackSearchIndex::rowContains(int row, const std::vector<std::string>& patterns) const
+{
+    const char* rowText = getText(row);
+
+    for (const auto& pattern : patterns)
+        if (std::strstr(rowText, pattern.c_str()) == nullptr)
+            return false;
+
+    return true;
+}
+
+// The posting lists of a query word's keys, in the order the keys appear in the word, or
+// nothing if one of them is not in the index
+std::vector<const TrackSearchIndex::Postings*> TrackSearchIndex::findLists(const std::string& word) const
+{
+    std::vector<Key> keys;
+    collectQueryKeys(word, keys);
+
+    std::vector<const Postings*> lists;
+
+    for (auto key : keys)
+    {
+        const auto found = postings.find(key);
+        if (found == postings.end())
+            return {};
+
+        lists.push_back(&found->second);
+    }
+
+    return lists;
+}
+
+// Narrows candidates to the rows that may hold the word whose key lists are given (or, for
+// the first word, fills it). A word of three characters or fewer is one key and needs no
+// check; a longer one is confirmed by its trigrams first starting one after another, and left
+// to check against the text where a repeated trigram leaves that open.
+void TrackSearchIndex::matchWord(const std::vector<const Postings*>& lists, std::vector<Candidate>& candidates, bool first) const
+{
+    // Rarest trigram first; order holds each key's offset in the word
+    std::vector<int> order((size_t)lists.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+        [&lists](int a, int b) { return lists[(size_t)a]->rows.size() < lists[(size_t)b]->rows.size(); });
+
+    const bool positional = lists.size() > 1;
+    const int anchor = order.front();
+    const auto& anchorList = *lists[(size_t)anchor];
+
+    // Where the word starts in the row, going by the anchor trigram's first start
+    auto placeWord = [positional, anchor](Candidate& candidate, Start start)
+        {
+            const int position = start & unknownStart;
+            candidate.start = -1;
+            candidate.repeats = (start & repeatedFlag) != 0;
+
+            if (!positional)
+                return true;
+
+            if (position == unknownStart || position < anchor)
+            {
+                // The word could still be at a later repeat of the anchor
+                if (position != unknownStart && !candidate.repeats)
+                    return false;
+
+                candidate.check = true;
+                return true;
+            }
+
+            candidate.start = position - anchor;
+            return true;
+        };
+
+    if (first)
+    {
+        candidates.reserve(anchorList.rows.size());
+
+        for (size_t i = 0; i < anchorList.rows.size(); ++i)
+        {
+            const auto row = anchorList.rows[i];
+            Candidate candidate{ row, -1, numRewritten > 0 && rewritten[row], false };
+
+            if (placeWord(candidate, anchorList.starts[i]))
+                candidates.push_back(candidate);
+        }
+    }
+    else
+    {
+        intersect(candidates, anchorList.rows, [&anchorList, &placeWord](Candidate& candidate, size_t i)
+            {
+                return placeWord(candidate, anchorList.starts[i]);
+            });
+    }
+
+    for (size_t k = 1; k < order.size() && !candidates.empty(); ++k)
+    {
+        const int offset = order[k];
+        const auto& list = *lists[(size_t)offset];
+
+        intersect(candidates, list.rows, [&list, offset](Candidate& candidate, size_t i)
+            {
+                if (candidate.check)
+                    return true;
+
+                const auto start = list.starts[i];
+                const bool repeats = (start & repeatedFlag) != 0;
+
+                if ((start & unknownStart) == candidate.start + offset)
+                {
+                    candidate.repeats = candidate.repeats || repeats;
+                    return true;
+                }
+
+                // Out of line at their first starts: only a later repeat could still hold the word
+                if (!(candidate.repeats || repeats || (start & unknownStart) == unknownStart))
+                    return false;
+
+                candidate.check = true;
+                return true;
+            });
+    }
+}
+
+TrackSearchIndex::Result TrackSearchIndex::search(const juce::String& query) const
+{
+    Result result;
+    const auto words = splitWords(normalise(query));
+
+    if (words.empty() || rows.empty())
+        return result;
+
+    // Rarest word first, so the candidates start as small as they can be
+    std::vector<std::vector<const Postings*>> wordLists;
+
+    for (const auto& word : words)
+    {
+        wordLists.push_back(findLists(word));
+
+        if (wordLists.back().empty())
+            return findSimilar(words);
+    }
+
+    auto rarest = [](const std::vector<const Postings*>& lists)
+        {
+            size_t size = std::numeric_limits<size_t>::max();
+            for (auto* list : lists)
+                size = juce::jmin(size, list->rows.size());
+            return size;
+        };
+
+    // The first keystrokes of a search: one key, and its posting list is the answer
+    if (wordLists.size() == 1 && wordLists.front().size() == 1 && numRewritten == 0)
+    {
+        const auto& list = wordLists.front().front()->rows;
+        result.rows.assign(list.begin(), list.end());
+        return result;
+    }
+
+    std::sort(wordLists.begin(), wordLists.end(),
+        [&rarest](const auto& a, const auto& b) { return rarest(a) < rarest(b); });
+
+    std::vector<Candidate> candidates;
+
+    for (size_t w = 0; w < wordLists.size() && (w == 0 || !candidates.empty()); ++w)
+        matchWord(wordLists[w], candidates, w == 0);
+
+    if (!candidates.empty())
+    {
+        // What each word must appear as in the row text: anywhere, or at a word start if short
+        std::vector<std::string> patterns;
+        for (const auto& word : words)
+            patterns.push_back(word.size() < 3 ? " " + word : word);
+
+        result.rows.reserve(candidates.size());
+
+        for (const auto& candidate : candidates)
+            if (!candidate.check || rowContains((int)candidate.row, patterns))
+                result.rows.push_back((int)candidate.row);
+
+        if (!result.rows.empty())
+            return result;
+    }
+
+    return findSimilar(words);
+}
+
+// Rows holding at least half of the query's trigrams, most shared first. Short words have no
+// trigrams to share and take no part.
+TrackSearchIndex::Result TrackSearchIndex::findSimilar(const std::vector<std::string>& words) const
+{
+    Result result;
+    std::vector<Key> keys;
+
+    for (const auto& word : words)
+        if (word.size() >= 3)
+            collectQueryKeys(word, keys);
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    if (keys.size() < 2)
+        return result;
+
+    std::vector<juce::uint16> hits(rows.size(), 0);
+
+    for (auto key : keys)
+    {
+        const auto found = postings.find(key);
+        if (found != postings.end())
+            for (auto row : found->second.rows)
+                ++hits[row];
+    }
+
+    const auto threshold = (juce::uint16)((keys.size() + 1) / 2);
+
+    for (size_t row = 0; row < hits.size(); ++row)
+        if (hits[row] >= threshold)
+            result.rows.push_back((int)row);
+
+    std::stable_sort(result.rows.begin(), result.rows.end(),
+        [&hits](int a, int b) { return hits[(size_t)a] > hits[(size_t)b]; });
+
+    if (result.rows.size() > (size_t)maxFuzzyResults)
+        result.rows.resize((size_t)maxFuzzyResults);
+
+    result.fuzzy = true;
+    return result;
+}
+
+size_t TrackSearchIndex::getMemoryUsage() const
+{
+    size_t total = rows.capacity() * sizeof(juce::uint32) + rewritten.capacity() / 8 + text.capacity();
+
+    for (const auto& entry : postings)
+        total += entry.second.rows.capacity() * sizeof(juce::uint32) + entry.second.starts.capacity()
+                 + sizeof(entry) + sizeof(void*) * 2;
+
+    return total;
+}
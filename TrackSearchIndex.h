@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// Search-as-you-type over a list of tracks (title, artist, album and file name per row).
+//
+// Each row's text is folded to lower case with punctuation turned into spaces, and every
+// three-character window of it is a key in an inverted index of sorted row numbers. A query
+// word of three or more characters matches anywhere in a row; shorter words match the start
+// of a word ("be" finds "Beatles" but not "Abbey"), through keys for the first one or two
+// characters of every word. A row matches when it contains every word of the query.
+//
+// Every posting also records where in the row its trigram first starts, so the trigrams of a
+// longer word confirm the word itself when they sit next to each other; the row text is only
+// read when they do not and one of them appears again later in the row. A query costs in proportion to its rarest word rather
+// than to the size of the list. When nothing matches exactly, rows sharing most of the
+// query's trigrams are returned instead, best first, which catches most typos.
+//
+// Rows are appended as tracks are added and can be re-indexed when their metadata arrives.
+// Message thread only.
+class TrackSearchIndex
+{
+public:
+    struct Result
+    {
+        std::vector<int> rows;      // ascending for exact matches, best first for fuzzy ones
+        bool fuzzy = false;
+    };
+
+    TrackSearchIndex() = default;
+
+    int size() const { return (int)rows.size(); }
+
+    // Indexes the next row (rows are numbered in the order they are added)
+    void add(const juce::String& text);
+
+    // Replaces the text of an existing row
+    void update(int row, const juce::String& text);
+
+    void clear();
+
+    // Rows containing every word of query; an empty query returns no rows
+    Result search(const juce::String& query) const;
+
+    // Fuzzy results are cut off at this many rows
+    static constexpr int maxFuzzyResults = 500;
+
+    size_t getMemoryUsage() const;
+
+private:
+    using Key = juce::uint32;
+
+    // First start of a key in its row, with a flag for keys that appear again later
+    using Start = juce::uint16;
+    static constexpr Start repeatedFlag = 0x8000;
+    static constexpr Start unknownStart = 0x7fff;   // too far into the row to record
+
+    struct KeyAt
+    {
+        Key key;
+        Start start;
+    };
+
+    struct Postings
+    {
+        std::vector<juce::uint32> rows;     // ascending
+        std::vector<Start> starts;
+    };
+
+    // A row that may contain a query word, and whether that still has to be checked
+    struct Candidate
+    {
+        juce::uint32 row;
+        int start;          // where the current word would start, or -1
+        bool check;
+        bool repeats;       // a trigram of the current word appears more than once
+    };
+
+    static std::string normalise(const juce::String& text);
+    static Key makeKey(const char* chars, int length);
+    static void collectKeys(const std::string& text, std::vector<KeyAt>& keys);
+    static void collectQueryKeys(const std::string& word, std::vector<Key>& keys);
+
+    void index(int row, const std::string& text);
+    std::vector<const Postings*> findLists(const std::string& word) const;
+    void matchWord(const std::vector<const Postings*>& lists, std::vector<Candidate>& candidates, bool first) const;
+    Result findSimilar(const std::vector<std::string>& words) const;
+    bool rowContains(int row, const std::vector<std::string>& patterns) const;
+    const char* getText(int row) const { return text.data() + rows[(size_t)row]; }
+
+    // Offsets into text, which holds each row's normalised text NUL-terminated. Updated rows
+    // get new text at the end; the old copy stays until clear().
+    std::vector<juce::uint32> rows;
+    std::vector<char> text;
+
+    // Rows whose text changed after they were indexed: their old keys are still posted
+    std::vector<bool> rewritten;
+    int numRewritten = 0;
+
+    std::unordered_map<Key, Postings> postings;
+
+    // Reused by index() so adding a row does not allocate for its keys
+    std::vector<KeyAt> keyScratch;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TrackSearchIndex)
+};
@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <JuceHeader.h>
+
+// The source a deck's looper reads from: a read-ahead ring for decoded formats,
+// or a memory-mapped file for uncompressed PCM
+class TrackStream : public juce::PositionableAudioSource
+{
+public:
+    // Blocks the audio thread asked for before the background thread had them ready
+    virtual int getNumUnderruns() const = 0;
+
+    // How much of the stream's look-ahead is ready, from 0 to 1
+    virtual float getFillLevel() const = 0;
+
+    // Offline rendering: wait for the background thread instead of playing silence
+    void setBlockingReads(bool shouldBlock) { blockingReads.store(shouldBlock); }
+    bool isBlockingReads() const { return blockingReads.load(); }
+
+protected:
+    std::atomic<bool> blockingReads{ false };
+};
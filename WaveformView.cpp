@@ -0,0 +1,302 @@
+﻿#include "WaveformView.h"
+
+namespace
+{
+    constexpr double maxPixelsPerSecond = 2000.0;
+    constexpr int maxCachedTiles = 48;
+}
+
+WaveformView::WaveformView()
+{
+    // Fully painted here, so playhead repaints never reach the parent
+    setOpaque(true);
+}
+
+WaveformView::~WaveformView()
+{
+    stopTimer();
+}
+
+void WaveformView::setPeaks(PeakCache::Peaks::Ptr newPeaks)
+{
+    if (peaks == newPeaks)
+        return;
+
+    peaks = newPeaks;
+    playPosition = 0.0;
+    pixelsPerSecond = 0.0;
+    scrollPixels = 0.0;
+    setVisibleSeconds(0.0);
+
+    // Watch for more peaks while the builder is still working on this file
+    if (peaks != nullptr && !peaks->isComplete())
+        startTimerHz(10);
+    else
+        stopTimer();
+
+    repaint();
+}
+
+void WaveformView::setPlaceholderText(const juce::String& text)
+{
+    if (placeholderText == text)
+        return;
+
+    placeholderText = text;
+
+    if (peaks == nullptr)
+        repaint();
+}
+
+void WaveformView::setPlayPosition(double seconds)
+{
+    if (seconds == playPosition)
+        return;
+
+    const auto oldArea = getPlayheadArea(playPosition);
+    playPosition = seconds;
+
+    // Page along when zoomed in and the playhead runs off either edge
+    const auto wave = getWaveArea();
+    const double playPixels = playPosition * pixelsPerSecond;
+
+    if (wave.getWidth() > 0 && (playPixels < scrollPixels || playPixels >= scrollPixels + wave.getWidth()))
+    {
+        const double fullWidth = getTrackLength() * pixelsPerSecond;
+
+        if (fullWidth > wave.getWidth())
+        {
+            scrollPixels = juce::jlimit(0.0, fullWidth - wave.getWidth(), playPixels - wave.getWidth() * 0.1);
+            repaint();
+            return;
+        }
+    }
+
+    repaint(oldArea);
+    repaint(getPlayheadArea(playPosition));
+}
+
+void WaveformView::setVisibleSeconds(double seconds)
+{
+    const auto width = getWaveArea().getWidth();
+    const double length = getTrackLength();
+
+    if (width <= 0 || length <= 0.0)
+        return;
+
+    const double fitWhole = width / length;
+    const double newPixelsPerSecond = seconds <= 0.0 ? fitWhole
+        : juce::jlimit(fitWhole, juce::jmax(fitWhole, maxPixelsPerSecond), width / seconds);
+
+    if (newPixelsPerSecond != pixelsPerSecond)
+    {
+        pixelsPerSecond = newPixelsPerSecond;
+        invalidateTiles();
+    }
+
+    setViewStart(scrollPixels / pixelsPerSecond);
+}
+
+void WaveformView::setViewStart(double seconds)
+{
+    const auto width = getWaveArea().getWidth();
+    const double maxScroll = juce::jmax(0.0, getTrackLength() * pixelsPerSecond - width);
+    const double newScroll = std::floor(juce::jlimit(0.0, maxScroll, seconds * pixelsPerSecond));
+
+    if (newScroll != scrollPixels)
+    {
+        scrollPixels = newScroll;
+        repaint();
+    }
+}
+
+// ===== Painting =====
+void WaveformView::paint(juce::Graphics& g)
+{
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+    g.fillAll(juce::Colours::black);
+
+    const auto box = getLocalBounds();
+    g.setColour(juce::Colours::white);
+    g.drawRect(box, 2);
+
+    const auto wave = getWaveArea();
+
+    if (peaks == nullptr || pixelsPerSecond <= 0.0)
+    {
+        g.drawText(placeholderText, box, juce::Justification::centred);
+        return;
+    }
+
+    // Only tiles under the dirty region are drawn (and rendered, if not cached yet)
+    const auto clip = g.getClipBounds().getIntersection(wave);
+
+    if (!clip.isEmpty())
+    {
+        const int offset = (int)scrollPixels;
+        const int firstTile = (clip.getX() - wave.getX() + offset) / tileWidth;
+        const int lastTile = (clip.getRight() - 1 - wave.getX() + offset) / tileWidth;
+
+        juce::Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(wave);
+
+        for (int index = firstTile; index <= lastTile; ++index)
+            g.drawImageAt(getTile(index).image, wave.getX() + index * tileWidth - offset, wave.getY());
+
+        evictDistantTiles(firstTile, lastTile);
+    }
+
+    // ====== Playhead ======
+    const int x = timeToX(playPosition);
+    if (x >= wave.getX() && x < wave.getRight())
+    {
+        g.setColour(juce::Colours::red);
+        g.fillRect(x - 1, wave.getY(), 2, wave.getHeight());
+    }
+
+    // ===== Frame timing =====
+    const auto endMs = juce::Time::getMillisecondCounterHiRes();
+    const double paintMs = endMs - startMs;
+
+    windowTotalMs += paintMs;
+    windowWorstMs = juce::jmax(windowWorstMs, paintMs);
+    ++windowPaints;
+
+    if (endMs - windowStartMs >= 1000.0)
+    {
+        frameStats.paintsPerSecond = windowPaints;
+        frameStats.averageMs = windowTotalMs / windowPaints;
+        frameStats.worstMs = windowWorstMs;
+
+        windowStartMs = endMs;
+        windowTotalMs = windowWorstMs = 0.0;
+        windowPaints = 0;
+    }
+}
+
+void WaveformView::resized()
+{
+    // Tiles are as tall as the view and the fit-to-width zoom depends on its width
+    const double visible = pixelsPerSecond > 0.0 ? getWaveArea().getWidth() / pixelsPerSecond : 0.0;
+    invalidateTiles();
+    pixelsPerSecond = 0.0;
+    setVisibleSeconds(visible >= getTrackLength() ? 0.0 : visible);
+}
+
+int WaveformView::timeToX(double seconds) const
+{
+    return getWaveArea().getX() + juce::roundToInt(seconds * pixelsPerSecond - scrollPixels);
+}
+
+juce::Rectangle<int> WaveformView::getPlayheadArea(double seconds) const
+{
+    const auto wave = getWaveArea();
+    return { timeToX(seconds) - 2, wave.getY(), 4, wave.getHeight() };
+}
+
+// ===== Tiles =====
+const WaveformView::Tile& WaveformView::getTile(int index)
+{
+    auto& tile = tiles[index];
+
+    if (tile.image.isValid())
+        return tile;
+
+    const auto wave = getWaveArea();
+    tile.image = juce::Image(juce::Image::ARGB, tileWidth, juce::jmax(1, wave.getHeight()), true);
+
+    const double startTime = index * tileWidth / pixelsPerSecond;
+    const double endTime = (index + 1) * tileWidth / pixelsPerSecond;
+
+    juce::Graphics tg(tile.image);
+    tg.setColour(juce::Colours::blueviolet);
+    peaks->drawChannels(tg, { 0, 0, tileWidth, wave.getHeight() }, startTime, endTime, 1.0f);
+
+    // A tile drawn before the builder got past its end is redrawn once more peaks arrive
+    const auto ready = peaks->getNumReady(0);
+    tile.final = peaks->isComplete()
+        || (juce::int64)ready * PeakCache::Peaks::finestSamplesPerPeak >= (juce::int64)(endTime * peaks->getSampleRate());
+    peaksReadyAtRender = juce::jmax(peaksReadyAtRender, ready);
+
+    return tile;
+}
+
+void WaveformView::invalidateTiles()
+{
+    tiles.clear();
+    peaksReadyAtRender = 0;
+    repaint();
+}
+
+void WaveformView::evictDistantTiles(int firstVisible, int lastVisible)
+{
+    for (auto it = tiles.begin(); (int)tiles.size() > maxCachedTiles && it != tiles.end();)
+    {
+        if (it->first < firstVisible - 2 || it->first > lastVisible + 2)
+            it = tiles.erase(it);
+        else
+            ++it;
+    }
+}
+
+void WaveformView::timerCallback()
+{
+    if (peaks == nullptr)
+    {
+        stopTimer();
+        return;
+    }
+
+    if (peaks->getNumReady(0) == peaksReadyAtRender && !peaks->isComplete())
+        return;
+
+    // Redraw only the tiles that were rendered from a partial set
+    const auto wave = getWaveArea();
+    const int offset = (int)scrollPixels;
+
+    for (auto it = tiles.begin(); it != tiles.end();)
+    {
+        if (it->second.final)
+        {
+            ++it;
+            continue;
+        }
+
+        repaint(wave.getX() + it->first * tileWidth - offset, wave.getY(), tileWidth, wave.getHeight());
+        it = tiles.erase(it);
+    }
+
+    if (peaks->isComplete())
+        stopTimer();
+}
+
+// ===== Mouse =====
+void WaveformView::mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel)
+{
+    if (peaks == nullptr || pixelsPerSecond <= 0.0)
+        return;
+
+    const auto wave = getWaveArea();
+
+    if (e.mods.isShiftDown() || std::abs(wheel.deltaX) > std::abs(wheel.deltaY))
+    {
+        const float delta = e.mods.isShiftDown() ? wheel.deltaY : wheel.deltaX;
+        setViewStart((scrollPixels - delta * wave.getWidth() * 0.5) / pixelsPerSecond);
+        return;
+    }
+
+    // Keep the time under the pointer where it is while zooming
+    const double anchorX = juce::jlimit(0, wave.getWidth(), e.x - wave.getX());
+    const double anchorTime = (scrollPixels + anchorX) / pixelsPerSecond;
+    const double visible = wave.getWidth() / pixelsPerSecond;
+
+    setVisibleSeconds(visible * std::pow(0.5, wheel.deltaY * 2.0));
+    setViewStart(anchorTime - anchorX / pixelsPerSecond);
+}
+
+void WaveformView::mouseDoubleClick(const juce::MouseEvent&)
+{
+    setVisibleSeconds(0.0);
+    setViewStart(0.0);
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+#include <JuceHeader.h>
+#include "PeakCache.h"
+
+// Waveform display that renders peaks into cached image tiles once per zoom level and size.
+// Playhead moves only repaint the strips it left and entered; scrolling just re-blits tiles.
+// Mouse wheel zooms around the pointer, horizontal wheel (or shift + wheel) scrolls, and a
+// double-click zooms back out to the whole track.
+class WaveformView : public juce::Component,
+    private juce::Timer
+{
+public:
+    WaveformView();
+    ~WaveformView() override;
+
+    void setPeaks(PeakCache::Peaks::Ptr newPeaks);
+    bool hasPeaks() const { return peaks != nullptr; }
+
+    // Shown in place of the waveform while there are no peaks
+    void setPlaceholderText(const juce::String& text);
+
+    // Moves the playhead, repainting only around its old and new positions
+    void setPlayPosition(double seconds);
+
+    // Seconds visible across the view (0 or the track length = whole track)
+    void setVisibleSeconds(double seconds);
+    void setViewStart(double seconds);
+
+    // Paint cost of this view over the last completed second
+    struct FrameStats
+    {
+        int paintsPerSecond = 0;
+        double averageMs = 0.0;
+        double worstMs = 0.0;
+    };
+
+    FrameStats getFrameStats() const { return frameStats; }
+
+    // ===== Component =====
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    void mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override;
+    void mouseDoubleClick(const juce::MouseEvent& e) override;
+
+    static constexpr int tileWidth = 256;
+
+private:
+    struct Tile
+    {
+        juce::Image image;
+        bool final = false;     // false while the peaks under it were still being built
+    };
+
+    void timerCallback() override;
+
+    juce::Rectangle<int> getWaveArea() const { return getLocalBounds().reduced(5); }
+    double getTrackLength() const { return peaks != nullptr ? peaks->getLengthInSeconds() : 0.0; }
+    int timeToX(double seconds) const;
+    juce::Rectangle<int> getPlayheadArea(double seconds) const;
+
+    const Tile& getTile(int index);
+    void invalidateTiles();
+    void evictDistantTiles(int firstVisible, int lastVisible);
+
+    PeakCache::Peaks::Ptr peaks;
+    juce::String placeholderText{ "No Track Loaded" };
+
+    // Zoom is pixels per second; the scroll offset is in the same pixel space as the tiles
+    double pixelsPerSecond = 0.0;
+    double scrollPixels = 0.0;
+    double playPosition = 0.0;
+
+    std::map<int, Tile> tiles;
+    int peaksReadyAtRender = 0;
+
+    // ===== Frame timing =====
+    FrameStats frameStats;
+    double windowStartMs = 0.0;
+    double windowTotalMs = 0.0;
+    double windowWorstMs = 0.0;
+    int windowPaints = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformView)
+};